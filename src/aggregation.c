@@ -29,13 +29,20 @@
 #include "common.h"
 #include "meta_data.h"
 #include "plugin.h"
-#include "utils_cache.h" /* for uc_get_rate() */
+#include "utils_cache.h" /* for uc_get_rates() */
+#include "utils_sketch.h"
 #include "utils_subst.h"
 #include "utils_vl_lookup.h"
 
 #define AGG_MATCHES_ALL(str) (strcmp("/.*/", str) == 0)
 #define AGG_FUNC_PLACEHOLDER "%{aggregation}"
 
+/* Number of partial aggregates per instance. Each thread updates the partial
+ * returned by agg_partial_index(), so write threads rarely wait for each
+ * other. agg_instance_read() merges the partials. */
+#define AGG_PARTIALS_NUM 8
+#define AGG_CACHE_LINE_SIZE 64
+
 struct aggregation_s /* {{{ */
 {
   lookup_identifier_t ident;
@@ -54,17 +61,16 @@ struct aggregation_s /* {{{ */
   _Bool calc_min;
   _Bool calc_max;
   _Bool calc_stddev;
+  _Bool calc_distinct;
+
+  double *percentiles;
+  size_t percentiles_num;
 }; /* }}} */
 typedef struct aggregation_s aggregation_t;
 
-struct agg_instance_s;
-typedef struct agg_instance_s agg_instance_t;
-struct agg_instance_s /* {{{ */
+struct agg_partial_s /* {{{ */
 {
   pthread_mutex_t lock;
-  lookup_identifier_t ident;
-
-  int ds_type;
 
   derive_t num;
   gauge_t sum;
@@ -73,12 +79,38 @@ struct agg_instance_s /* {{{ */
   gauge_t min;
   gauge_t max;
 
+  /* Only allocated if percentiles or distinct counts are calculated. */
+  quantile_sketch_t *sketch;
+  distinct_counter_t *distinct;
+
+  /* Keep the partials of different threads on separate cache lines. */
+  char pad[AGG_CACHE_LINE_SIZE];
+}; /* }}} */
+typedef struct agg_partial_s agg_partial_t;
+
+struct agg_instance_s;
+typedef struct agg_instance_s agg_instance_t;
+struct agg_instance_s /* {{{ */
+{
+  lookup_identifier_t ident;
+  aggregation_t const *agg;
+
+  int ds_type;
+
+  agg_partial_t partials[AGG_PARTIALS_NUM];
+
+  /* The partials' sketches are merged into these by agg_instance_read(). */
+  quantile_sketch_t *sketch;
+  distinct_counter_t *distinct;
+
   rate_to_value_state_t *state_num;
   rate_to_value_state_t *state_sum;
   rate_to_value_state_t *state_average;
   rate_to_value_state_t *state_min;
   rate_to_value_state_t *state_max;
   rate_to_value_state_t *state_stddev;
+  rate_to_value_state_t *state_distinct;
+  rate_to_value_state_t *state_percentiles; /* one per percentile */
 
   agg_instance_t *next;
 }; /* }}} */
@@ -88,6 +120,10 @@ static lookup_t *lookup = NULL;
 static pthread_mutex_t agg_instance_list_lock = PTHREAD_MUTEX_INITIALIZER;
 static agg_instance_t *agg_instance_list_head = NULL;
 
+/* Holds the index of the calling thread's partial, plus one. */
+static pthread_key_t agg_partial_key;
+static unsigned int agg_partial_next = 0;
+
 static _Bool agg_is_regex(char const *str) /* {{{ */
 {
   size_t len;
@@ -107,9 +143,40 @@ static _Bool agg_is_regex(char const *str) /* {{{ */
 
 static void agg_destroy(aggregation_t *agg) /* {{{ */
 {
+  if (agg == NULL)
+    return;
+
+  sfree(agg->percentiles);
   sfree(agg);
 } /* }}} void agg_destroy */
 
+/* Returns the index of the partial updated by the calling thread. Threads are
+ * assigned to the partials round-robin when they first update an instance. */
+static size_t agg_partial_index(void) /* {{{ */
+{
+  uintptr_t index = (uintptr_t)pthread_getspecific(agg_partial_key);
+
+  if (index == 0) {
+    index = (__atomic_fetch_add(&agg_partial_next, 1, __ATOMIC_RELAXED) %
+             AGG_PARTIALS_NUM) +
+            1;
+    pthread_setspecific(agg_partial_key, (void *)index);
+  }
+
+  return (size_t)(index - 1);
+} /* }}} size_t agg_partial_index */
+
+static void agg_partial_reset(agg_partial_t *p) /* {{{ */
+{
+  p->num = 0;
+  p->sum = 0.0;
+  p->squares_sum = 0.0;
+  p->min = NAN;
+  p->max = NAN;
+  quantile_sketch_reset(p->sketch);
+  distinct_counter_reset(p->distinct);
+} /* }}} void agg_partial_reset */
+
 /* Frees all dynamically allocated memory within the instance. */
 static void agg_instance_destroy(agg_instance_t *inst) /* {{{ */
 {
@@ -129,17 +196,25 @@ static void agg_instance_destroy(agg_instance_t *inst) /* {{{ */
   }
   pthread_mutex_unlock(&agg_instance_list_lock);
 
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++) {
+    pthread_mutex_destroy(&inst->partials[i].lock);
+    quantile_sketch_destroy(inst->partials[i].sketch);
+    distinct_counter_destroy(inst->partials[i].distinct);
+  }
+  quantile_sketch_destroy(inst->sketch);
+  distinct_counter_destroy(inst->distinct);
+
   sfree(inst->state_num);
   sfree(inst->state_sum);
   sfree(inst->state_average);
   sfree(inst->state_min);
   sfree(inst->state_max);
   sfree(inst->state_stddev);
+  sfree(inst->state_distinct);
+  sfree(inst->state_percentiles);
 
   memset(inst, 0, sizeof(*inst));
   inst->ds_type = -1;
-  inst->min = NAN;
-  inst->max = NAN;
 } /* }}} void agg_instance_destroy */
 
 static int agg_instance_create_name(agg_instance_t *inst, /* {{{ */
@@ -238,14 +313,43 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
     ERROR("aggregation plugin: calloc() failed.");
     return NULL;
   }
-  pthread_mutex_init(&inst->lock, /* attr = */ NULL);
+  inst->agg = agg;
 
   inst->ds_type = ds->ds[0].type;
 
   agg_instance_create_name(inst, vl, agg);
 
-  inst->min = NAN;
-  inst->max = NAN;
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++) {
+    agg_partial_t *p = inst->partials + i;
+
+    pthread_mutex_init(&p->lock, /* attr = */ NULL);
+    p->min = NAN;
+    p->max = NAN;
+  }
+
+#define INIT_SKETCH(ptr, create)                                               \
+  do {                                                                         \
+    (ptr) = create();                                                          \
+    if ((ptr) == NULL) {                                                       \
+      agg_instance_destroy(inst);                                              \
+      free(inst);                                                              \
+      ERROR("aggregation plugin: " #create "() failed.");                      \
+      return NULL;                                                             \
+    }                                                                          \
+  } while (0)
+
+  if (agg->percentiles_num > 0) {
+    INIT_SKETCH(inst->sketch, quantile_sketch_create);
+    for (size_t i = 0; i < AGG_PARTIALS_NUM; i++)
+      INIT_SKETCH(inst->partials[i].sketch, quantile_sketch_create);
+  }
+  if (agg->calc_distinct) {
+    INIT_SKETCH(inst->distinct, distinct_counter_create);
+    for (size_t i = 0; i < AGG_PARTIALS_NUM; i++)
+      INIT_SKETCH(inst->partials[i].distinct, distinct_counter_create);
+  }
+
+#undef INIT_SKETCH
 
 #define INIT_STATE(field)                                                      \
   do {                                                                         \
@@ -267,9 +371,21 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
   INIT_STATE(min);
   INIT_STATE(max);
   INIT_STATE(stddev);
+  INIT_STATE(distinct);
 
 #undef INIT_STATE
 
+  if (agg->percentiles_num > 0) {
+    inst->state_percentiles =
+        calloc(agg->percentiles_num, sizeof(*inst->state_percentiles));
+    if (inst->state_percentiles == NULL) {
+      agg_instance_destroy(inst);
+      free(inst);
+      ERROR("aggregation plugin: calloc() failed.");
+      return NULL;
+    }
+  }
+
   pthread_mutex_lock(&agg_instance_list_lock);
   inst->next = agg_instance_list_head;
   agg_instance_list_head = inst;
@@ -278,13 +394,15 @@ static agg_instance_t *agg_instance_create(data_set_t const *ds, /* {{{ */
   return inst;
 } /* }}} agg_instance_t *agg_instance_create */
 
-/* Update the num, sum, min, max, ... fields of the aggregation instance, if
- * the rate of the value list is available. Value lists with more than one data
- * source are not supported and will return an error. Returns zero on success
- * and non-zero otherwise. */
+/* Update the num, sum, min, max, ... fields of the calling thread's partial of
+ * the aggregation instance, if the rate of the value list is available. Value
+ * lists with more than one data source are not supported and will return an
+ * error. Returns zero on success and non-zero otherwise. */
 static int agg_instance_update(agg_instance_t *inst, /* {{{ */
                                data_set_t const *ds, value_list_t const *vl) {
-  gauge_t *rate;
+  vl_ident_t const *ident;
+  gauge_t rate;
+  int status = 0;
 
   if (ds->ds_num != 1) {
     ERROR("aggregation plugin: The \"%s\" type (data set) has more than one "
@@ -294,35 +412,54 @@ static int agg_instance_update(agg_instance_t *inst, /* {{{ */
     return EINVAL;
   }
 
-  rate = uc_get_rate(ds, vl);
-  if (rate == NULL) {
-    char ident[6 * DATA_MAX_NAME_LEN];
-    FORMAT_VL(ident, sizeof(ident), vl);
+  /* Use the rate computed by the value cache while dispatching the value
+   * list, if available. Otherwise look it up. */
+  ident = plugin_get_vl_ident(vl);
+  if ((ident != NULL) && (ident->rates != NULL))
+    rate = ident->rates[0];
+  else if (uc_get_rates(ds, vl, &rate) != 0) {
+    char name[6 * DATA_MAX_NAME_LEN];
+    FORMAT_VL(name, sizeof(name), vl);
     ERROR("aggregation plugin: Unable to read the current rate of \"%s\".",
-          ident);
+          name);
     return ENOENT;
   }
 
-  if (isnan(rate[0])) {
-    sfree(rate);
+  if (isnan(rate))
     return 0;
+
+  uint64_t hash = 0;
+  if (inst->distinct != NULL) {
+    if (ident != NULL)
+      hash = ident->hash;
+    else {
+      char name[6 * DATA_MAX_NAME_LEN];
+      FORMAT_VL(name, sizeof(name), vl);
+      hash = strhash(name);
+    }
   }
 
-  pthread_mutex_lock(&inst->lock);
+  agg_partial_t *p = inst->partials + agg_partial_index();
+  pthread_mutex_lock(&p->lock);
 
-  inst->num++;
-  inst->sum += rate[0];
-  inst->squares_sum += (rate[0] * rate[0]);
+  p->num++;
+  p->sum += rate;
+  p->squares_sum += (rate * rate);
 
-  if (isnan(inst->min) || (inst->min > rate[0]))
-    inst->min = rate[0];
-  if (isnan(inst->max) || (inst->max < rate[0]))
-    inst->max = rate[0];
+  if (isnan(p->min) || (p->min > rate))
+    p->min = rate;
+  if (isnan(p->max) || (p->max < rate))
+    p->max = rate;
 
-  pthread_mutex_unlock(&inst->lock);
+  /* Infinite rates can't be sorted into the sketch and are skipped. */
+  if ((p->sketch != NULL) && isfinite(rate))
+    status = quantile_sketch_add(p->sketch, rate);
+  if (p->distinct != NULL)
+    distinct_counter_add(p->distinct, hash);
 
-  sfree(rate);
-  return 0;
+  pthread_mutex_unlock(&p->lock);
+
+  return status;
 } /* }}} int agg_instance_update */
 
 static int agg_instance_read_func(agg_instance_t *inst, /* {{{ */
@@ -365,6 +502,41 @@ static int agg_instance_read_func(agg_instance_t *inst, /* {{{ */
 static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
 {
   value_list_t vl = VALUE_LIST_INIT;
+  aggregation_t const *agg = inst->agg;
+
+  derive_t num = 0;
+  gauge_t sum = 0.0;
+  gauge_t squares_sum = 0.0;
+  gauge_t min = NAN;
+  gauge_t max = NAN;
+
+  /* Merge and reset the partials. Each partial is locked on its own, so
+   * threads updating other partials are not blocked. */
+  quantile_sketch_reset(inst->sketch);
+  distinct_counter_reset(inst->distinct);
+
+  for (size_t i = 0; i < AGG_PARTIALS_NUM; i++) {
+    agg_partial_t *p = inst->partials + i;
+
+    pthread_mutex_lock(&p->lock);
+
+    num += p->num;
+    sum += p->sum;
+    squares_sum += p->squares_sum;
+    if (!isnan(p->min) && (isnan(min) || (min > p->min)))
+      min = p->min;
+    if (!isnan(p->max) && (isnan(max) || (max < p->max)))
+      max = p->max;
+
+    if ((inst->sketch != NULL) &&
+        (quantile_sketch_merge(inst->sketch, p->sketch) != 0))
+      WARNING("aggregation plugin: quantile_sketch_merge failed.");
+    distinct_counter_merge(inst->distinct, p->distinct);
+
+    agg_partial_reset(p);
+
+    pthread_mutex_unlock(&p->lock);
+  }
 
   /* Pre-set all the fields in the value list that will not change per
    * aggregation type (sum, average, ...). The struct will be re-used and must
@@ -394,30 +566,33 @@ static int agg_instance_read(agg_instance_t *inst, cdtime_t t) /* {{{ */
     }                                                                          \
   } while (0)
 
-  pthread_mutex_lock(&inst->lock);
-
-  READ_FUNC(num, (gauge_t)inst->num);
+  READ_FUNC(num, (gauge_t)num);
+  READ_FUNC(distinct, distinct_counter_get(inst->distinct));
 
   /* All other aggregations are only defined when there have been any values
    * at all. */
-  if (inst->num > 0) {
-    READ_FUNC(sum, inst->sum);
-    READ_FUNC(average, (inst->sum / ((gauge_t)inst->num)));
-    READ_FUNC(min, inst->min);
-    READ_FUNC(max, inst->max);
-    READ_FUNC(stddev, sqrt((((gauge_t)inst->num) * inst->squares_sum) -
-                           (inst->sum * inst->sum)) /
-                          ((gauge_t)inst->num));
+  if (num > 0) {
+    READ_FUNC(sum, sum);
+    READ_FUNC(average, (sum / ((gauge_t)num)));
+    READ_FUNC(min, min);
+    READ_FUNC(max, max);
+    READ_FUNC(stddev, sqrt((((gauge_t)num) * squares_sum) - (sum * sum)) /
+                          ((gauge_t)num));
   }
 
-  /* Reset internal state. */
-  inst->num = 0;
-  inst->sum = 0.0;
-  inst->squares_sum = 0.0;
-  inst->min = NAN;
-  inst->max = NAN;
+  if ((num > 0) && (quantile_sketch_get_num(inst->sketch) > 0)) {
+    for (size_t i = 0; i < agg->percentiles_num; i++) {
+      char func[DATA_MAX_NAME_LEN];
+
+      ssnprintf(func, sizeof(func), "percentile-%g", agg->percentiles[i]);
+      agg_instance_read_func(
+          inst, func,
+          quantile_sketch_get_percentile(inst->sketch, agg->percentiles[i]),
+          inst->state_percentiles + i, &vl, inst->ident.plugin_instance, t);
+    }
+  }
 
-  pthread_mutex_unlock(&inst->lock);
+#undef READ_FUNC
 
   meta_data_destroy(vl.meta);
   vl.meta = NULL;
@@ -468,6 +643,8 @@ static void agg_lookup_free_obj_callback(void *user_obj) /* {{{ */
  *     CalculateMinimum true
  *     CalculateMaximum true
  *     CalculateStddev true
+ *     CalculatePercentile 95
+ *     CalculateCountDistinct true
  *   </Aggregation>
  * </Plugin>
  */
@@ -504,6 +681,36 @@ static int agg_config_handle_group_by(oconfig_item_t const *ci, /* {{{ */
   return 0;
 } /* }}} int agg_config_handle_group_by */
 
+static int agg_config_handle_percentile(oconfig_item_t const *ci, /* {{{ */
+                                        aggregation_t *agg) {
+  double percent = NAN;
+  double *tmp;
+  int status;
+
+  status = cf_util_get_double(ci, &percent);
+  if (status != 0)
+    return status;
+
+  if ((percent <= 0.0) || (percent >= 100)) {
+    ERROR("aggregation plugin: The value for \"%s\" must be between 0 and "
+          "100, exclusively.",
+          ci->key);
+    return ERANGE;
+  }
+
+  tmp = realloc(agg->percentiles,
+                sizeof(*agg->percentiles) * (agg->percentiles_num + 1));
+  if (tmp == NULL) {
+    ERROR("aggregation plugin: realloc failed.");
+    return ENOMEM;
+  }
+  agg->percentiles = tmp;
+  agg->percentiles[agg->percentiles_num] = percent;
+  agg->percentiles_num++;
+
+  return 0;
+} /* }}} int agg_config_handle_percentile */
+
 static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
 {
   aggregation_t *agg;
@@ -563,6 +770,10 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &agg->calc_max);
     else if (strcasecmp("CalculateStddev", child->key) == 0)
       cf_util_get_boolean(child, &agg->calc_stddev);
+    else if (strcasecmp("CalculatePercentile", child->key) == 0)
+      agg_config_handle_percentile(child, agg);
+    else if (strcasecmp("CalculateCountDistinct", child->key) == 0)
+      cf_util_get_boolean(child, &agg->calc_distinct);
     else
       WARNING("aggregation plugin: The \"%s\" key is not allowed inside "
               "<Aggregation /> blocks and will be ignored.",
@@ -623,7 +834,8 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
   } /* }}} */
 
   if (!agg->calc_num && !agg->calc_sum && !agg->calc_average /* {{{ */
-      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev) {
+      && !agg->calc_min && !agg->calc_max && !agg->calc_stddev &&
+      !agg->calc_distinct && (agg->percentiles_num == 0)) {
     ERROR("aggregation plugin: No aggregation function has been specified. "
           "Without this, I don't know what I should be calculating. "
           "(Host \"%s\", Plugin \"%s\", PluginInstance \"%s\", "
@@ -635,14 +847,14 @@ static int agg_config_aggregation(oconfig_item_t *ci) /* {{{ */
 
   if (!is_valid) /* {{{ */
   {
-    sfree(agg);
+    agg_destroy(agg);
     return -1;
   } /* }}} */
 
   status = lookup_add(lookup, &agg->ident, agg->group_by, agg);
   if (status != 0) {
     ERROR("aggregation plugin: lookup_add failed with status %i.", status);
-    sfree(agg);
+    agg_destroy(agg);
     return -1;
   }
 
@@ -667,6 +879,7 @@ static int agg_config(oconfig_item_t *ci) /* {{{ */
       ERROR("aggregation plugin: lookup_create failed.");
       return -1;
     }
+    pthread_key_create(&agg_partial_key, /* destructor = */ NULL);
   }
 
   for (int i = 0; i < ci->children_num; i++) {
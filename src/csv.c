@@ -25,86 +25,98 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_avltree.h"
 #include "utils_cache.h"
 
+/*
+ * Private types
+ */
+/* An open CSV file. Files are cached by their name without the date, so a new
+ * file is opened transparently when the date changes. */
+struct csv_file_s {
+  char *name;
+  char *filename;
+  char date[16];
+  int fd;
+
+  char *buffer;
+  size_t buffer_fill;
+  cdtime_t first_buffered;
+  cdtime_t last_write;
+
+  struct csv_file_s *lru_prev;
+  struct csv_file_s *lru_next;
+};
+typedef struct csv_file_s csv_file_t;
+
 /*
  * Private variables
  */
-static const char *config_keys[] = {"DataDir", "StoreRates"};
+static const char *config_keys[] = {"DataDir", "StoreRates", "MaxOpenFiles",
+                                    "BufferSize", "FlushInterval"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static char *datadir = NULL;
 static int store_rates = 0;
 static int use_stdio = 0;
+static size_t max_open_files = 128;
+static size_t buffer_size = 0;
+static cdtime_t flush_interval = 0;
+
+/* Open files, most recently used first. */
+static c_avl_tree_t *files = NULL;
+static csv_file_t *lru_head = NULL;
+static csv_file_t *lru_tail = NULL;
+static pthread_mutex_t files_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static int value_list_to_string(char *buffer, int buffer_len,
                                 const data_set_t *ds, const value_list_t *vl) {
-  int offset;
+  strbuf_t buf;
+  gauge_t rates[ds->ds_num];
+  _Bool have_rates = 0;
   int status;
-  gauge_t *rates = NULL;
 
   assert(0 == strcmp(ds->type, vl->type));
 
-  memset(buffer, '\0', buffer_len);
-
-  status = ssnprintf(buffer, buffer_len, "%.3f", CDTIME_T_TO_DOUBLE(vl->time));
-  if ((status < 1) || (status >= buffer_len))
+  strbuf_init_fixed(&buf, buffer, (size_t)buffer_len);
+  if (strbuf_print_time(&buf, vl->time) != 0)
     return -1;
-  offset = status;
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     if ((ds->ds[i].type != DS_TYPE_COUNTER) &&
         (ds->ds[i].type != DS_TYPE_GAUGE) &&
         (ds->ds[i].type != DS_TYPE_DERIVE) &&
-        (ds->ds[i].type != DS_TYPE_ABSOLUTE)) {
-      sfree(rates);
+        (ds->ds[i].type != DS_TYPE_ABSOLUTE))
       return -1;
-    }
 
+    /* Gauges and rates keep the fixed six decimals of the file format. */
     if (ds->ds[i].type == DS_TYPE_GAUGE) {
-      status = ssnprintf(buffer + offset, buffer_len - offset, ",%lf",
-                         vl->values[i].gauge);
+      status = strbuf_printf(&buf, ",%lf", vl->values[i].gauge);
     } else if (store_rates != 0) {
-      if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
-      if (rates == NULL) {
+      if (!have_rates && (uc_get_rates(ds, vl, rates) != 0)) {
         WARNING("csv plugin: "
-                "uc_get_rate failed.");
+                "uc_get_rates failed.");
         return -1;
       }
-      status =
-          ssnprintf(buffer + offset, buffer_len - offset, ",%lf", rates[i]);
-    } else if (ds->ds[i].type == DS_TYPE_COUNTER) {
-      status = ssnprintf(buffer + offset, buffer_len - offset, ",%llu",
-                         vl->values[i].counter);
-    } else if (ds->ds[i].type == DS_TYPE_DERIVE) {
-      status = ssnprintf(buffer + offset, buffer_len - offset, ",%" PRIi64,
-                         vl->values[i].derive);
-    } else if (ds->ds[i].type == DS_TYPE_ABSOLUTE) {
-      status = ssnprintf(buffer + offset, buffer_len - offset, ",%" PRIu64,
-                         vl->values[i].absolute);
+      have_rates = 1;
+      status = strbuf_printf(&buf, ",%lf", rates[i]);
+    } else {
+      status = strbuf_print(&buf, ",");
+      if (status == 0)
+        status = format_value(&buf, ds->ds[i].type, vl->values[i]);
     }
 
-    if ((status < 1) || (status >= (buffer_len - offset))) {
-      sfree(rates);
+    if (status != 0)
       return -1;
-    }
-
-    offset += status;
   } /* for ds->ds_num */
 
-  sfree(rates);
   return 0;
 } /* int value_list_to_string */
 
 static int value_list_to_filename(char *buffer, size_t buffer_size,
                                   value_list_t const *vl) {
-  int status;
-
   char *ptr = buffer;
   size_t ptr_size = buffer_size;
-  time_t now;
-  struct tm struct_tm;
 
   if (datadir != NULL) {
     size_t len = strlen(datadir) + 1;
@@ -118,65 +130,255 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
     ptr += len;
   }
 
-  status = FORMAT_VL(ptr, ptr_size, vl);
-  if (status != 0)
-    return status;
-
-  /* Skip all the time formatting stuff when printing to STDOUT or
-   * STDERR. */
-  if (use_stdio)
-    return 0;
+  /* The date is appended by the file cache. */
+  return FORMAT_VL(ptr, ptr_size, vl);
+} /* int value_list_to_filename */
 
-  ptr_size -= strlen(ptr);
-  ptr += strlen(ptr);
+/* Returns the date appended to file names, e.g. "-2013-07-12". localtime_r is
+ * expensive, so it's only called again after midnight. You must hold
+ * "files_lock". */
+static int csv_date_suffix(char const **ret_date) {
+  static char date[16];
+  static time_t date_valid_until = 0;
+  time_t now = time(NULL);
+  struct tm struct_tm;
 
-  /* "-2013-07-12" => 11 bytes */
-  if (ptr_size < 12) {
-    ERROR("csv plugin: Buffer too small.");
-    return ENOMEM;
+  if (now < date_valid_until) {
+    *ret_date = date;
+    return 0;
   }
 
-  /* TODO: Find a way to minimize the calls to `localtime_r',
-   * since they are pretty expensive.. */
-  now = time(NULL);
   if (localtime_r(&now, &struct_tm) == NULL) {
     ERROR("csv plugin: localtime_r failed");
     return -1;
   }
 
-  status = strftime(ptr, ptr_size, "-%Y-%m-%d", &struct_tm);
-  if (status == 0) /* yep, it returns zero on error. */
-  {
+  if (strftime(date, sizeof(date), "-%Y-%m-%d", &struct_tm) == 0) {
+    /* yep, it returns zero on error. */
     ERROR("csv plugin: strftime failed");
     return -1;
   }
 
+  /* Next midnight; mktime normalizes the day of month and takes care of
+   * daylight saving time. */
+  struct_tm.tm_sec = 0;
+  struct_tm.tm_min = 0;
+  struct_tm.tm_hour = 0;
+  struct_tm.tm_mday++;
+  struct_tm.tm_isdst = -1;
+  date_valid_until = mktime(&struct_tm);
+  if (date_valid_until == (time_t)-1)
+    date_valid_until = now + 1;
+
+  *ret_date = date;
   return 0;
-} /* int value_list_to_filename */
+} /* int csv_date_suffix */
 
-static int csv_create_file(const char *filename, const data_set_t *ds) {
-  FILE *csv;
+/* Writes the buffered lines in one go. If that fails, the lines are dropped
+ * and the file is reopened with the next value. You must hold "files_lock". */
+static int csv_file_flush(csv_file_t *f) {
+  if ((f->buffer_fill == 0) || (f->fd < 0))
+    return 0;
 
-  if (check_create_dir(filename))
+  if (swrite(f->fd, f->buffer, f->buffer_fill) != 0) {
+    char errbuf[1024];
+    ERROR("csv plugin: write (%s) failed: %s", f->filename,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    f->buffer_fill = 0;
+    close(f->fd);
+    f->fd = -1;
     return -1;
+  }
+
+  f->buffer_fill = 0;
+  return 0;
+} /* int csv_file_flush */
+
+/* You must hold "files_lock". */
+static void csv_file_close(csv_file_t *f) {
+  csv_file_flush(f);
+  if (f->fd >= 0) {
+    close(f->fd);
+    f->fd = -1;
+  }
+  sfree(f->filename);
+} /* void csv_file_close */
+
+/* Opens "filename" for appending, creating it and writing the header line if
+ * it doesn't exist yet. You must hold "files_lock". */
+static int csv_file_open(csv_file_t *f, char const *filename,
+                         data_set_t const *ds) {
+  struct stat statbuf;
+  int fd;
+
+  fd = open(filename, O_WRONLY | O_APPEND);
+  if ((fd < 0) && (errno == ENOENT)) {
+    if (check_create_dir(filename))
+      return -1;
 
-  csv = fopen(filename, "w");
-  if (csv == NULL) {
+    fd = open(filename, O_WRONLY | O_APPEND | O_CREAT | O_EXCL, 0666);
+    if (fd >= 0) {
+      char header[4096] = "epoch";
+      size_t len = strlen(header);
+
+      for (size_t i = 0; i < ds->ds_num; i++) {
+        int status = ssnprintf(header + len, sizeof(header) - len, ",%s",
+                               ds->ds[i].name);
+        if ((status < 0) || ((size_t)status >= (sizeof(header) - len)))
+          break;
+        len += (size_t)status;
+      }
+      if (len < (sizeof(header) - 1))
+        header[len++] = '\n';
+
+      if (swrite(fd, header, len) != 0) {
+        char errbuf[1024];
+        ERROR("csv plugin: write (%s) failed: %s", filename,
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+        close(fd);
+        return -1;
+      }
+    } else if (errno == EEXIST) {
+      /* Somebody else created the file in the meantime. */
+      fd = open(filename, O_WRONLY | O_APPEND);
+    }
+  }
+
+  if (fd < 0) {
     char errbuf[1024];
-    ERROR("csv plugin: fopen (%s) failed: %s", filename,
+    ERROR("csv plugin: open (%s) failed: %s", filename,
           sstrerror(errno, errbuf, sizeof(errbuf)));
     return -1;
   }
 
-  fprintf(csv, "epoch");
-  for (size_t i = 0; i < ds->ds_num; i++)
-    fprintf(csv, ",%s", ds->ds[i].name);
+  if ((fstat(fd, &statbuf) != 0) || !S_ISREG(statbuf.st_mode)) {
+    ERROR("csv plugin: %s: Not a regular file!", filename);
+    close(fd);
+    return -1;
+  }
+
+  f->filename = strdup(filename);
+  if (f->filename == NULL) {
+    ERROR("csv plugin: strdup failed.");
+    close(fd);
+    return -1;
+  }
+  f->fd = fd;
+
+  return 0;
+} /* int csv_file_open */
+
+static void csv_lru_unlink(csv_file_t *f) {
+  if (f->lru_prev != NULL)
+    f->lru_prev->lru_next = f->lru_next;
+  else
+    lru_head = f->lru_next;
+  if (f->lru_next != NULL)
+    f->lru_next->lru_prev = f->lru_prev;
+  else
+    lru_tail = f->lru_prev;
+  f->lru_prev = NULL;
+  f->lru_next = NULL;
+} /* void csv_lru_unlink */
+
+static void csv_lru_push(csv_file_t *f) {
+  f->lru_prev = NULL;
+  f->lru_next = lru_head;
+  if (lru_head != NULL)
+    lru_head->lru_prev = f;
+  else
+    lru_tail = f;
+  lru_head = f;
+} /* void csv_lru_push */
+
+/* Closes a file and removes it from the cache. You must hold "files_lock". */
+static void csv_file_remove(csv_file_t *f) {
+  csv_file_close(f);
+  csv_lru_unlink(f);
+  c_avl_remove(files, f->name, NULL, NULL);
+
+  sfree(f->name);
+  sfree(f->buffer);
+  sfree(f);
+} /* void csv_file_remove */
+
+/* Returns the cache entry for "name", i.e. the file name without the date,
+ * and marks it as the most recently used one. You must hold "files_lock". */
+static csv_file_t *csv_file_get(char const *name) {
+  csv_file_t *f = NULL;
+
+  if (c_avl_get(files, name, (void *)&f) == 0) {
+    if (f != lru_head) {
+      csv_lru_unlink(f);
+      csv_lru_push(f);
+    }
+    return f;
+  }
+
+  f = calloc(1, sizeof(*f));
+  if (f == NULL) {
+    ERROR("csv plugin: calloc failed.");
+    return NULL;
+  }
+  f->fd = -1;
+
+  f->name = strdup(name);
+  if (f->name == NULL) {
+    ERROR("csv plugin: strdup failed.");
+    sfree(f);
+    return NULL;
+  }
+
+  if (c_avl_insert(files, f->name, f) != 0) {
+    ERROR("csv plugin: c_avl_insert failed.");
+    sfree(f->name);
+    sfree(f);
+    return NULL;
+  }
+  csv_lru_push(f);
+
+  /* Make room by closing the least recently used file. */
+  while ((size_t)c_avl_size(files) > max_open_files)
+    csv_file_remove(lru_tail);
+
+  return f;
+} /* csv_file_t *csv_file_get */
+
+/* You must hold "files_lock". */
+static int csv_file_append(csv_file_t *f, char const *line, size_t line_len) {
+  if ((f->buffer == NULL) && (buffer_size > 0)) {
+    f->buffer = malloc(buffer_size);
+    if (f->buffer == NULL) {
+      ERROR("csv plugin: malloc failed.");
+      return -1;
+    }
+  }
+
+  if ((f->buffer_fill + line_len) > buffer_size) {
+    if (csv_file_flush(f) != 0)
+      return -1;
+  }
+
+  /* Unbuffered, or the line doesn't fit into the buffer anyway */
+  if (line_len > buffer_size) {
+    if (swrite(f->fd, line, line_len) != 0) {
+      char errbuf[1024];
+      ERROR("csv plugin: write (%s) failed: %s", f->filename,
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      close(f->fd);
+      f->fd = -1;
+      return -1;
+    }
+    return 0;
+  }
 
-  fprintf(csv, "\n");
-  fclose(csv);
+  if (f->buffer_fill == 0)
+    f->first_buffered = cdtime();
+  memcpy(f->buffer + f->buffer_fill, line, line_len);
+  f->buffer_fill += line_len;
 
   return 0;
-} /* int csv_create_file */
+} /* int csv_file_append */
 
 static int csv_config(const char *key, const char *value) {
   if (strcasecmp("DataDir", key) == 0) {
@@ -208,6 +410,27 @@ static int csv_config(const char *key, const char *value) {
       store_rates = 1;
     else
       store_rates = 0;
+  } else if (strcasecmp("MaxOpenFiles", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      ERROR("csv plugin: `MaxOpenFiles' must be greater than 0.");
+      return 1;
+    }
+    max_open_files = (size_t)tmp;
+  } else if (strcasecmp("BufferSize", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 0) {
+      ERROR("csv plugin: `BufferSize' must not be negative.");
+      return 1;
+    }
+    buffer_size = (size_t)tmp;
+  } else if (strcasecmp("FlushInterval", key) == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      ERROR("csv plugin: `FlushInterval' must not be negative.");
+      return 1;
+    }
+    flush_interval = DOUBLE_TO_CDTIME_T(tmp);
   } else {
     return -1;
   }
@@ -216,12 +439,12 @@ static int csv_config(const char *key, const char *value) {
 
 static int csv_write(const data_set_t *ds, const value_list_t *vl,
                      user_data_t __attribute__((unused)) * user_data) {
-  struct stat statbuf;
+  char name[512];
   char filename[512];
   char values[4096];
-  FILE *csv;
-  int csv_fd;
-  struct flock fl = {0};
+  char const *date;
+  csv_file_t *f;
+  size_t values_len;
   int status;
 
   if (0 != strcmp(ds->type, vl->type)) {
@@ -229,17 +452,17 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
-  status = value_list_to_filename(filename, sizeof(filename), vl);
+  status = value_list_to_filename(name, sizeof(name), vl);
   if (status != 0)
     return -1;
 
-  DEBUG("csv plugin: csv_write: filename = %s;", filename);
+  DEBUG("csv plugin: csv_write: name = %s;", name);
 
   if (value_list_to_string(values, sizeof(values), ds, vl) != 0)
     return -1;
 
   if (use_stdio) {
-    escape_string(filename, sizeof(filename));
+    escape_string(name, sizeof(name));
 
     /* Replace commas by colons for PUTVAL compatible output. */
     for (size_t i = 0; i < sizeof(values); i++) {
@@ -250,57 +473,149 @@ static int csv_write(const data_set_t *ds, const value_list_t *vl,
     }
 
     fprintf(use_stdio == 1 ? stdout : stderr, "PUTVAL %s interval=%.3f %s\n",
-            filename, CDTIME_T_TO_DOUBLE(vl->interval), values);
+            name, CDTIME_T_TO_DOUBLE(vl->interval), values);
     return 0;
   }
 
-  if (stat(filename, &statbuf) == -1) {
-    if (errno == ENOENT) {
-      if (csv_create_file(filename, ds))
-        return -1;
-    } else {
-      char errbuf[1024];
-      ERROR("stat(%s) failed: %s", filename,
-            sstrerror(errno, errbuf, sizeof(errbuf)));
-      return -1;
-    }
-  } else if (!S_ISREG(statbuf.st_mode)) {
-    ERROR("stat(%s): Not a regular file!", filename);
+  values_len = strlen(values);
+  if (values_len >= (sizeof(values) - 1)) {
+    ERROR("csv plugin: Buffer too small.");
     return -1;
   }
+  values[values_len++] = '\n';
 
-  csv = fopen(filename, "a");
-  if (csv == NULL) {
-    char errbuf[1024];
-    ERROR("csv plugin: fopen (%s) failed: %s", filename,
-          sstrerror(errno, errbuf, sizeof(errbuf)));
+  pthread_mutex_lock(&files_lock);
+
+  if ((files == NULL) || (csv_date_suffix(&date) != 0)) {
+    pthread_mutex_unlock(&files_lock);
     return -1;
   }
-  csv_fd = fileno(csv);
 
-  fl.l_pid = getpid();
-  fl.l_type = F_WRLCK;
-  fl.l_whence = SEEK_SET;
+  f = csv_file_get(name);
+  if (f == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    return -1;
+  }
 
-  status = fcntl(csv_fd, F_SETLK, &fl);
-  if (status != 0) {
-    char errbuf[1024];
-    ERROR("csv plugin: flock (%s) failed: %s", filename,
-          sstrerror(errno, errbuf, sizeof(errbuf)));
-    fclose(csv);
+  /* The date changed: start a new file. */
+  if ((f->filename != NULL) && (strcmp(f->date, date) != 0))
+    csv_file_close(f);
+
+  if (f->fd < 0) {
+    sfree(f->filename);
+    status = ssnprintf(filename, sizeof(filename), "%s%s", name, date);
+    if ((status < 0) || ((size_t)status >= sizeof(filename))) {
+      pthread_mutex_unlock(&files_lock);
+      ERROR("csv plugin: Buffer too small.");
+      return -1;
+    }
+
+    if (csv_file_open(f, filename, ds) != 0) {
+      pthread_mutex_unlock(&files_lock);
+      return -1;
+    }
+    sstrncpy(f->date, date, sizeof(f->date));
+  }
+
+  status = csv_file_append(f, values, values_len);
+  f->last_write = cdtime();
+
+  pthread_mutex_unlock(&files_lock);
+
+  return status;
+} /* int csv_write */
+
+static int csv_flush(cdtime_t timeout, const char *identifier,
+                     user_data_t __attribute__((unused)) * user_data) {
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&files_lock);
+
+  for (csv_file_t *f = lru_head; f != NULL; f = f->lru_next) {
+    if (f->buffer_fill == 0)
+      continue;
+    if ((timeout != 0) && ((now - f->first_buffered) < timeout))
+      continue;
+
+    if (identifier != NULL) {
+      char const *ptr = f->name;
+      if (datadir != NULL)
+        ptr += strlen(datadir) + 1;
+      if (strcmp(ptr, identifier) != 0)
+        continue;
+    }
+
+    csv_file_flush(f);
+  }
+
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* int csv_flush */
+
+/* Flushes the buffers and closes files that haven't been written to for ten
+ * intervals, so that files of values that have disappeared don't stay open
+ * until they drop out of the cache. */
+static int csv_flush_timer(user_data_t __attribute__((unused)) * user_data) {
+  cdtime_t now = cdtime();
+  cdtime_t idle_timeout = 10 * plugin_get_interval();
+  csv_file_t *f;
+
+  pthread_mutex_lock(&files_lock);
+
+  f = lru_head;
+  while (f != NULL) {
+    csv_file_t *next = f->lru_next;
+
+    if ((now - f->last_write) > idle_timeout)
+      csv_file_remove(f);
+    else
+      csv_file_flush(f);
+
+    f = next;
+  }
+
+  pthread_mutex_unlock(&files_lock);
+  return 0;
+} /* int csv_flush_timer */
+
+static int csv_init(void) {
+  pthread_mutex_lock(&files_lock);
+  if ((files != NULL) || use_stdio) {
+    pthread_mutex_unlock(&files_lock);
+    return 0;
+  }
+
+  files = c_avl_create((int (*)(const void *, const void *))strcmp);
+  if (files == NULL) {
+    pthread_mutex_unlock(&files_lock);
+    ERROR("csv plugin: c_avl_create failed.");
     return -1;
   }
+  pthread_mutex_unlock(&files_lock);
 
-  fprintf(csv, "%s\n", values);
+  plugin_register_complex_read(/* group = */ NULL, "csv", csv_flush_timer,
+                               flush_interval, /* user_data = */ NULL);
+
+  return 0;
+} /* int csv_init */
 
-  /* The lock is implicitely released. I we don't release it explicitely
-   * because the `FILE *' may need to flush a cache first */
-  fclose(csv);
+static int csv_shutdown(void) {
+  pthread_mutex_lock(&files_lock);
 
+  while (lru_head != NULL)
+    csv_file_remove(lru_head);
+
+  c_avl_destroy(files);
+  files = NULL;
+
+  pthread_mutex_unlock(&files_lock);
   return 0;
-} /* int csv_write */
+} /* int csv_shutdown */
 
 void module_register(void) {
   plugin_register_config("csv", csv_config, config_keys, config_keys_num);
+  plugin_register_init("csv", csv_init);
   plugin_register_write("csv", csv_write, /* user_data = */ NULL);
+  plugin_register_flush("csv", csv_flush, /* user_data = */ NULL);
+  plugin_register_shutdown("csv", csv_shutdown);
 } /* void module_register */
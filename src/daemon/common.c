@@ -506,6 +506,18 @@ void replace_special(char *buffer, size_t buffer_size) {
   }
 } /* void replace_special */
 
+uint32_t strhash(char const *str) {
+  uint32_t hash = 2166136261U;
+
+  for (unsigned char const *ptr = (unsigned char const *)str; *ptr != 0;
+       ptr++) {
+    hash ^= (uint32_t)*ptr;
+    hash *= 16777619U;
+  }
+
+  return hash;
+} /* uint32_t strhash */
+
 int timeval_cmp(struct timeval tv0, struct timeval tv1, struct timeval *delta) {
   struct timeval *larger;
   struct timeval *smaller;
@@ -869,59 +881,55 @@ int format_name(char *ret, int ret_len, const char *hostname,
   return 0;
 } /* int format_name */
 
+int format_value(strbuf_t *buf, int ds_type, value_t value) /* {{{ */
+{
+  switch (ds_type) {
+  case DS_TYPE_GAUGE:
+    return strbuf_print_double(buf, value.gauge);
+  case DS_TYPE_COUNTER:
+    return strbuf_print_uint(buf, (uint64_t)value.counter);
+  case DS_TYPE_DERIVE:
+    return strbuf_print_int(buf, value.derive);
+  case DS_TYPE_ABSOLUTE:
+    return strbuf_print_uint(buf, value.absolute);
+  }
+
+  ERROR("format_value: Unknown data source type: %i", ds_type);
+  return EINVAL;
+} /* }}} int format_value */
+
 int format_values(char *ret, size_t ret_len, /* {{{ */
                   const data_set_t *ds, const value_list_t *vl,
                   _Bool store_rates) {
-  size_t offset = 0;
-  int status;
-  gauge_t *rates = NULL;
+  gauge_t rates[ds->ds_num];
+  _Bool have_rates = 0;
+  strbuf_t buf;
 
   assert(0 == strcmp(ds->type, vl->type));
 
-  memset(ret, 0, ret_len);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = ssnprintf(ret + offset, ret_len - offset, __VA_ARGS__);           \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (ret_len - offset)) {                       \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  BUFFER_ADD("%.3f", CDTIME_T_TO_DOUBLE(vl->time));
+  strbuf_init_fixed(&buf, ret, ret_len);
+  if (strbuf_print_time(&buf, vl->time) != 0)
+    return -1;
 
   for (size_t i = 0; i < ds->ds_num; i++) {
-    if (ds->ds[i].type == DS_TYPE_GAUGE)
-      BUFFER_ADD(":" GAUGE_FORMAT, vl->values[i].gauge);
-    else if (store_rates) {
-      if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
-      if (rates == NULL) {
-        WARNING("format_values: uc_get_rate failed.");
+    int ds_type = ds->ds[i].type;
+    value_t value = vl->values[i];
+
+    if ((ds_type != DS_TYPE_GAUGE) && store_rates) {
+      if (!have_rates && (uc_get_rates(ds, vl, rates) != 0)) {
+        WARNING("format_values: uc_get_rates failed.");
         return -1;
       }
-      BUFFER_ADD(":" GAUGE_FORMAT, rates[i]);
-    } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD(":%llu", vl->values[i].counter);
-    else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD(":%" PRIi64, vl->values[i].derive);
-    else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD(":%" PRIu64, vl->values[i].absolute);
-    else {
-      ERROR("format_values: Unknown data source type: %i", ds->ds[i].type);
-      sfree(rates);
-      return -1;
+      have_rates = 1;
+      ds_type = DS_TYPE_GAUGE;
+      value.gauge = rates[i];
     }
-  } /* for ds->ds_num */
 
-#undef BUFFER_ADD
+    if ((strbuf_print(&buf, ":") != 0) ||
+        (format_value(&buf, ds_type, value) != 0))
+      return -1;
+  } /* for ds->ds_num */
 
-  sfree(rates);
   return 0;
 } /* }}} int format_values */
 
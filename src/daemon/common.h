@@ -31,6 +31,7 @@
 #include "collectd.h"
 
 #include "plugin.h"
+#include "utils_strbuf.h"
 
 #if HAVE_PWD_H
 #include <pwd.h>
@@ -225,6 +226,16 @@ int escape_string(char *buffer, size_t buffer_size);
  */
 void replace_special(char *buffer, size_t buffer_size);
 
+/*
+ * NAME
+ *   strhash
+ *
+ * DESCRIPTION
+ *   Returns the 32 bit FNV-1a hash of the null-terminated string `str'. The
+ *   hash is not suitable for cryptographic purposes.
+ */
+uint32_t strhash(char const *str);
+
 /*
  * NAME
  *   strunescape
@@ -314,6 +325,9 @@ int format_name(char *ret, int ret_len, const char *hostname,
               (vl)->type, (vl)->type_instance)
 int format_values(char *ret, size_t ret_len, const data_set_t *ds,
                   const value_list_t *vl, _Bool store_rates);
+/* Appends a single value of the given data source type to "buf", gauges with
+ * the shortest representation that reads back as the same double. */
+int format_value(strbuf_t *buf, int ds_type, value_t value);
 
 int parse_identifier(char *str, char **ret_host, char **ret_plugin,
                      char **ret_plugin_instance, char **ret_type,
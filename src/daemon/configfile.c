@@ -110,12 +110,15 @@ static cf_global_option_t cf_global_options[] = {
     {"WriteThreads", NULL, 0, "5"},
     {"WriteQueueLimitHigh", NULL, 0, NULL},
     {"WriteQueueLimitLow", NULL, 0, NULL},
+    {"WriteQueueRingSize", NULL, 0, NULL},
+    {"CacheShards", NULL, 0, "1"},
     {"Timeout", NULL, 0, "2"},
     {"AutoLoadPlugin", NULL, 0, "false"},
     {"CollectInternalStats", NULL, 0, "false"},
     {"PreCacheChain", NULL, 0, "PreCache"},
     {"PostCacheChain", NULL, 0, "PostCache"},
-    {"MaxReadInterval", NULL, 0, "86400"}};
+    {"MaxReadInterval", NULL, 0, "86400"},
+    {"SpreadReads", NULL, 0, "true"}};
 static int cf_global_options_num = STATIC_ARRAY_SIZE(cf_global_options);
 
 static int cf_default_typesdb = 1;
@@ -248,6 +251,8 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
   _Bool global = 0;
   plugin_ctx_t ctx = {0};
   plugin_ctx_t old_ctx;
+  char read_pool[DATA_MAX_NAME_LEN] = "";
+  int read_threads = 0;
   int ret_val;
 
   assert(strcasecmp(ci->key, "LoadPlugin") == 0);
@@ -277,6 +282,10 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
       cf_util_get_cdtime(child, &ctx.flush_interval);
     else if (strcasecmp("FlushTimeout", child->key) == 0)
       cf_util_get_cdtime(child, &ctx.flush_timeout);
+    else if (strcasecmp("ReadThreads", child->key) == 0)
+      cf_util_get_int(child, &read_threads);
+    else if (strcasecmp("ReadPool", child->key) == 0)
+      cf_util_get_string_buffer(child, read_pool, sizeof(read_pool));
     else {
       WARNING("Ignoring unknown LoadPlugin option \"%s\" "
               "for plugin \"%s\"",
@@ -284,6 +293,22 @@ static int dispatch_loadplugin(oconfig_item_t *ci) {
     }
   }
 
+  if (read_threads < 0) {
+    WARNING("Ignoring negative ReadThreads option for plugin \"%s\"", name);
+    read_threads = 0;
+  }
+
+  /* Run the read callbacks in a pool of their own. The pool is named after
+   * the plugin unless a name is given, so that several plugins can share a
+   * pool. */
+  if ((read_threads > 0) || (read_pool[0] != 0)) {
+    ctx.read_pool =
+        plugin_get_read_pool((read_pool[0] != 0) ? read_pool : name,
+                             (read_threads > 0) ? (size_t)read_threads : 1);
+    if (ctx.read_pool == NULL)
+      return -1;
+  }
+
   old_ctx = plugin_set_ctx(ctx);
   ret_val = plugin_load(name, global);
   /* reset to the "global" context */
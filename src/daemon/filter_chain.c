@@ -65,6 +65,32 @@ struct fc_rule_s {
   fc_match_t *matches;
   fc_target_t *targets;
   fc_rule_t *next;
+
+  /* Statistics, updated without holding a lock and only if enabled with
+   * fc_enable_statistics(). */
+  uint64_t checked;
+  uint64_t matched;
+  cdtime_t time;
+}; /* }}} */
+
+/* Rules which can only match value lists with a certain plugin or type name.
+ * `rules' holds positions in the chain's `rules_array' in ascending order. */
+struct fc_index_entry_s;
+typedef struct fc_index_entry_s fc_index_entry_t; /* {{{ */
+struct fc_index_entry_s {
+  uint32_t hash;
+  char key[DATA_MAX_NAME_LEN];
+  size_t *rules;
+  size_t rules_num;
+}; /* }}} */
+
+/* Hash table with open addressing. `size' is either zero or a power of two. */
+struct fc_index_s;
+typedef struct fc_index_s fc_index_t; /* {{{ */
+struct fc_index_s {
+  fc_index_entry_t *entries;
+  size_t size;
+  size_t used;
 }; /* }}} */
 
 /* List of chains, used for `chain_list_head' */
@@ -74,6 +100,26 @@ struct fc_chain_s /* {{{ */
   fc_rule_t *rules;
   fc_target_t *targets;
   fc_chain_t *next;
+
+  /* Built from `rules' by fc_compile_chain. Rules are indexed by the plugin
+   * name they require or, if they don't require one, by the type name they
+   * require. All other rules are "generic" and checked for every value
+   * list. */
+  fc_rule_t **rules_array;
+  size_t rules_num;
+  size_t *generic;
+  size_t generic_num;
+  fc_index_t by_plugin;
+  fc_index_t by_type;
+}; /* }}} */
+
+/* Iterates over the rules of a chain that may match a value list, in the
+ * order in which they have been configured. */
+struct fc_cursor_s;
+typedef struct fc_cursor_s fc_cursor_t; /* {{{ */
+struct fc_cursor_s {
+  const size_t *lists[3];
+  size_t lists_num[3];
 }; /* }}} */
 
 /* Writer configuration. */
@@ -90,6 +136,7 @@ struct fc_writer_s {
 static fc_match_t *match_list_head;
 static fc_target_t *target_list_head;
 static fc_chain_t *chain_list_head;
+static _Bool record_statistics = 0;
 
 /*
  * Private functions
@@ -146,11 +193,31 @@ static void fc_free_rules(fc_rule_t *r) /* {{{ */
   free(r);
 } /* }}} void fc_free_rules */
 
+static void fc_free_index(fc_index_t *idx) /* {{{ */
+{
+  for (size_t i = 0; i < idx->size; i++)
+    sfree(idx->entries[i].rules);
+  sfree(idx->entries);
+  idx->size = 0;
+  idx->used = 0;
+} /* }}} void fc_free_index */
+
+static void fc_free_compiled(fc_chain_t *c) /* {{{ */
+{
+  sfree(c->rules_array);
+  c->rules_num = 0;
+  sfree(c->generic);
+  c->generic_num = 0;
+  fc_free_index(&c->by_plugin);
+  fc_free_index(&c->by_type);
+} /* }}} void fc_free_compiled */
+
 static void fc_free_chains(fc_chain_t *c) /* {{{ */
 {
   if (c == NULL)
     return;
 
+  fc_free_compiled(c);
   fc_free_rules(c->rules);
   fc_free_targets(c->targets);
 
@@ -178,6 +245,241 @@ static char *fc_strdup(const char *orig) /* {{{ */
   return dest;
 } /* }}} char *fc_strdup */
 
+/*
+ * Rule index
+ */
+static fc_index_entry_t *fc_index_slot(fc_index_entry_t *entries, /* {{{ */
+                                       size_t size, uint32_t hash,
+                                       const char *key) {
+  size_t mask = size - 1;
+
+  /* Linear probing. Entries with an empty key are free. */
+  for (size_t i = hash & mask;; i = (i + 1) & mask) {
+    fc_index_entry_t *e = entries + i;
+
+    if (e->key[0] == 0)
+      return e;
+    if ((e->hash == hash) && (strcmp(e->key, key) == 0))
+      return e;
+  }
+} /* }}} fc_index_entry_t *fc_index_slot */
+
+static const fc_index_entry_t *fc_index_get(const fc_index_t *idx, /* {{{ */
+                                            const char *key) {
+  fc_index_entry_t *e;
+
+  if ((idx->size == 0) || (key[0] == 0))
+    return NULL;
+
+  e = fc_index_slot(idx->entries, idx->size, strhash(key), key);
+  if (e->key[0] == 0)
+    return NULL;
+
+  return e;
+} /* }}} const fc_index_entry_t *fc_index_get */
+
+static int fc_index_add(fc_index_t *idx, const char *key, /* {{{ */
+                        size_t pos) {
+  fc_index_entry_t *e;
+  uint32_t hash = strhash(key);
+  size_t *tmp;
+
+  /* Keep the load factor below one half. */
+  if (2 * (idx->used + 1) > idx->size) {
+    size_t size = (idx->size == 0) ? 16 : 2 * idx->size;
+    fc_index_entry_t *entries = calloc(size, sizeof(*entries));
+    if (entries == NULL) {
+      ERROR("fc_index_add: calloc failed.");
+      return -1;
+    }
+
+    for (size_t i = 0; i < idx->size; i++) {
+      if (idx->entries[i].key[0] == 0)
+        continue;
+      e = fc_index_slot(entries, size, idx->entries[i].hash,
+                        idx->entries[i].key);
+      memcpy(e, idx->entries + i, sizeof(*e));
+    }
+
+    sfree(idx->entries);
+    idx->entries = entries;
+    idx->size = size;
+  }
+
+  e = fc_index_slot(idx->entries, idx->size, hash, key);
+
+  tmp = realloc(e->rules, (e->rules_num + 1) * sizeof(*e->rules));
+  if (tmp == NULL) {
+    ERROR("fc_index_add: realloc failed.");
+    return -1;
+  }
+  e->rules = tmp;
+  e->rules[e->rules_num] = pos;
+  e->rules_num++;
+
+  if (e->key[0] == 0) {
+    e->hash = hash;
+    sstrncpy(e->key, key, sizeof(e->key));
+    idx->used++;
+  }
+
+  return 0;
+} /* }}} int fc_index_add */
+
+/* Determines the plugin and type names a value list must have for all matches
+ * of the rule to match. */
+static void fc_rule_key(const fc_rule_t *rule, /* {{{ */
+                        fc_match_key_t *ret_key) {
+  memset(ret_key, 0, sizeof(*ret_key));
+
+  for (fc_match_t *m = rule->matches; m != NULL; m = m->next) {
+    fc_match_key_t key = {{0}};
+
+    if (m->proc.key == NULL)
+      continue;
+    if ((*m->proc.key)(m->user_data, &key) != 0)
+      continue;
+
+    if ((ret_key->plugin[0] == 0) && (key.plugin[0] != 0))
+      sstrncpy(ret_key->plugin, key.plugin, sizeof(ret_key->plugin));
+    if ((ret_key->type[0] == 0) && (key.type[0] != 0))
+      sstrncpy(ret_key->type, key.type, sizeof(ret_key->type));
+  }
+} /* }}} void fc_rule_key */
+
+static int fc_compile_chain(fc_chain_t *chain) /* {{{ */
+{
+  /* The chain is compiled into "new" and only replaces the compiled form of
+   * "chain" once that succeeded, so that a failure leaves a usable chain. */
+  fc_chain_t new = {.rules = chain->rules};
+  size_t rules_num = 0;
+  size_t indexed_num = 0;
+
+  for (fc_rule_t *r = chain->rules; r != NULL; r = r->next)
+    rules_num++;
+  if (rules_num == 0) {
+    fc_free_compiled(chain);
+    return 0;
+  }
+
+  new.rules_array = calloc(rules_num, sizeof(*new.rules_array));
+  new.generic = calloc(rules_num, sizeof(*new.generic));
+  if ((new.rules_array == NULL) || (new.generic == NULL)) {
+    ERROR("fc_compile_chain: calloc failed.");
+    fc_free_compiled(&new);
+    return -1;
+  }
+
+  for (fc_rule_t *r = chain->rules; r != NULL; r = r->next) {
+    size_t pos = new.rules_num;
+    fc_match_key_t key;
+    int status = 0;
+
+    new.rules_array[pos] = r;
+    new.rules_num++;
+
+    fc_rule_key(r, &key);
+    if (key.plugin[0] != 0)
+      status = fc_index_add(&new.by_plugin, key.plugin, pos);
+    else if (key.type[0] != 0)
+      status = fc_index_add(&new.by_type, key.type, pos);
+    else {
+      new.generic[new.generic_num] = pos;
+      new.generic_num++;
+      continue;
+    }
+
+    if (status != 0) {
+      fc_free_compiled(&new);
+      return -1;
+    }
+    indexed_num++;
+  }
+
+  fc_free_compiled(chain);
+  chain->rules_array = new.rules_array;
+  chain->rules_num = new.rules_num;
+  chain->generic = new.generic;
+  chain->generic_num = new.generic_num;
+  chain->by_plugin = new.by_plugin;
+  chain->by_type = new.by_type;
+
+  DEBUG("fc_compile_chain (%s): %zu of %zu rules are indexed.", chain->name,
+        indexed_num, rules_num);
+
+  return 0;
+} /* }}} int fc_compile_chain */
+
+/* Returns the offset of the first element of the sorted `list' which is not
+ * less than `pos'. */
+static size_t fc_lower_bound(const size_t *list, size_t list_num, /* {{{ */
+                             size_t pos) {
+  size_t lo = 0;
+  size_t hi = list_num;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (list[mid] < pos)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  return lo;
+} /* }}} size_t fc_lower_bound */
+
+/* Positions the cursor on the first rule at or after `pos' which may match
+ * `vl'. */
+static void fc_cursor_seek(fc_cursor_t *cursor, /* {{{ */
+                           const fc_chain_t *chain, const value_list_t *vl,
+                           size_t pos) {
+  const fc_index_entry_t *by_plugin = fc_index_get(&chain->by_plugin,
+                                                   vl->plugin);
+  const fc_index_entry_t *by_type = fc_index_get(&chain->by_type, vl->type);
+
+  memset(cursor, 0, sizeof(*cursor));
+  cursor->lists[0] = chain->generic;
+  cursor->lists_num[0] = chain->generic_num;
+  if (by_plugin != NULL) {
+    cursor->lists[1] = by_plugin->rules;
+    cursor->lists_num[1] = by_plugin->rules_num;
+  }
+  if (by_type != NULL) {
+    cursor->lists[2] = by_type->rules;
+    cursor->lists_num[2] = by_type->rules_num;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cursor->lists); i++) {
+    size_t skip =
+        fc_lower_bound(cursor->lists[i], cursor->lists_num[i], pos);
+    cursor->lists[i] += skip;
+    cursor->lists_num[i] -= skip;
+  }
+} /* }}} void fc_cursor_seek */
+
+static fc_rule_t *fc_cursor_next(fc_cursor_t *cursor, /* {{{ */
+                                 const fc_chain_t *chain, size_t *ret_pos) {
+  size_t min = 0;
+  _Bool found = 0;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cursor->lists); i++) {
+    if (cursor->lists_num[i] == 0)
+      continue;
+    if (!found || (cursor->lists[i][0] < cursor->lists[min][0]))
+      min = i;
+    found = 1;
+  }
+
+  if (!found)
+    return NULL;
+
+  *ret_pos = cursor->lists[min][0];
+  cursor->lists[min]++;
+  cursor->lists_num[min]--;
+
+  return chain->rules_array[*ret_pos];
+} /* }}} fc_rule_t *fc_cursor_next */
+
 /*
  * Configuration.
  *
@@ -445,6 +747,14 @@ static int fc_config_add_chain(const oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  /* Rules may have been added to an existing chain, so the whole chain is
+   * compiled again. */
+  if (fc_compile_chain(chain) != 0) {
+    if (new_chain)
+      fc_free_chains(chain);
+    return -1;
+  }
+
   if (chain_list_head != NULL) {
     if (!new_chain)
       return 0;
@@ -809,8 +1119,14 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
 
   DEBUG("fc_process_chain (chain = %s);", chain->name);
 
-  for (fc_rule_t *rule = chain->rules; rule != NULL; rule = rule->next) {
+  fc_cursor_t cursor;
+  fc_rule_t *rule;
+  size_t pos;
+
+  fc_cursor_seek(&cursor, chain, vl, /* pos = */ 0);
+  while ((rule = fc_cursor_next(&cursor, chain, &pos)) != NULL) {
     fc_match_t *match;
+    cdtime_t start = record_statistics ? cdtime() : 0;
     status = FC_TARGET_CONTINUE;
 
     if (rule->name[0] != 0) {
@@ -830,12 +1146,20 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
         break;
     }
 
+    if (record_statistics) {
+      __atomic_fetch_add(&rule->checked, 1, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&rule->time, cdtime() - start, __ATOMIC_RELAXED);
+    }
+
     /* for-loop has been aborted: Either error or no match. */
     if (match != NULL) {
       status = FC_TARGET_CONTINUE;
       continue;
     }
 
+    if (record_statistics)
+      __atomic_fetch_add(&rule->matched, 1, __ATOMIC_RELAXED);
+
     if (rule->name[0] != 0) {
       DEBUG("fc_process_chain (%s): Rule `%s' matches.", chain->name,
             rule->name);
@@ -847,6 +1171,8 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
       /* FIXME: Pass the meta-data to match targets here (when implemented). */
       status =
           (*target->proc.invoke)(ds, vl, /* meta = */ NULL, &target->user_data);
+      /* Targets may have changed the identifier. */
+      plugin_invalidate_vl_ident(vl);
       if (status < 0) {
         WARNING("fc_process_chain (%s): A target failed.", chain->name);
         continue;
@@ -872,7 +1198,11 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
       }
       break;
     }
-  } /* for (rule) */
+
+    /* Targets may have changed the plugin or type name, which decides which
+     * of the remaining rules need to be checked. */
+    fc_cursor_seek(&cursor, chain, vl, pos + 1);
+  } /* while (rule) */
 
   if ((status == FC_TARGET_STOP) || (status == FC_TARGET_RETURN))
     return status;
@@ -886,6 +1216,7 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, /* {{{ */
     /* FIXME: Pass the meta-data to match targets here (when implemented). */
     status =
         (*target->proc.invoke)(ds, vl, /* meta = */ NULL, &target->user_data);
+    plugin_invalidate_vl_ident(vl);
     if (status < 0) {
       WARNING("fc_process_chain (%s): The default target failed.", chain->name);
     } else if (status == FC_TARGET_CONTINUE)
@@ -927,6 +1258,58 @@ int fc_default_action(const data_set_t *ds, value_list_t *vl) /* {{{ */
   return fc_bit_write_invoke(ds, vl, NULL, NULL);
 } /* }}} int fc_default_action */
 
+void fc_enable_statistics(void) /* {{{ */
+{
+  record_statistics = 1;
+} /* }}} void fc_enable_statistics */
+
+int fc_dispatch_statistics(void) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+
+  sstrncpy(vl.plugin, "collectd", sizeof(vl.plugin));
+  vl.interval = plugin_get_interval();
+  vl.values_len = 1;
+
+  for (fc_chain_t *chain = chain_list_head; chain != NULL;
+       chain = chain->next) {
+    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance),
+              "filter_chain-%s", chain->name);
+
+    for (size_t i = 0; i < chain->rules_num; i++) {
+      fc_rule_t *rule = chain->rules_array[i];
+      uint64_t checked = __atomic_load_n(&rule->checked, __ATOMIC_RELAXED);
+      uint64_t matched = __atomic_load_n(&rule->matched, __ATOMIC_RELAXED);
+      cdtime_t time = __atomic_load_n(&rule->time, __ATOMIC_RELAXED);
+      char name[DATA_MAX_NAME_LEN];
+
+      if (rule->name[0] != 0)
+        sstrncpy(name, rule->name, sizeof(name));
+      else
+        ssnprintf(name, sizeof(name), "rule%zu", i);
+
+      sstrncpy(vl.type, "derive", sizeof(vl.type));
+
+      vl.values = &(value_t){.derive = (derive_t)checked};
+      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%s-checked",
+                name);
+      plugin_dispatch_values(&vl);
+
+      vl.values = &(value_t){.derive = (derive_t)matched};
+      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%s-matched",
+                name);
+      plugin_dispatch_values(&vl);
+
+      vl.values = &(value_t){.derive = (derive_t)CDTIME_T_TO_MS(time)};
+      sstrncpy(vl.type, "total_time_in_ms", sizeof(vl.type));
+      sstrncpy(vl.type_instance, name, sizeof(vl.type_instance));
+      plugin_dispatch_values(&vl);
+    }
+  }
+
+  return 0;
+} /* }}} int fc_dispatch_statistics */
+
 int fc_configure(const oconfig_item_t *ci) /* {{{ */
 {
   fc_init_once();
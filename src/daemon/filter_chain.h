@@ -41,11 +41,24 @@
 /*
  * Match functions
  */
+/* Plugin and type names a value list must have in order to be matched. Empty
+ * fields are not constrained. */
+struct fc_match_key_s {
+  char plugin[DATA_MAX_NAME_LEN];
+  char type[DATA_MAX_NAME_LEN];
+};
+typedef struct fc_match_key_s fc_match_key_t;
+
 struct match_proc_s {
   int (*create)(const oconfig_item_t *ci, void **user_data);
   int (*destroy)(void **user_data);
   int (*match)(const data_set_t *ds, const value_list_t *vl,
                notification_meta_t **meta, void **user_data);
+  /* Optional. Fills `ret_key' if the match can only match value lists with a
+   * certain plugin or type name and returns zero. Rules are indexed by these
+   * names, so that a value list is only checked against the rules which may
+   * match it. */
+  int (*key)(void *user_data, fc_match_key_t *ret_key);
 };
 typedef struct match_proc_s match_proc_t;
 
@@ -95,6 +108,17 @@ int fc_process_chain(const data_set_t *ds, value_list_t *vl, fc_chain_t *chain);
 
 int fc_default_action(const data_set_t *ds, value_list_t *vl);
 
+/*
+ * Statistics
+ */
+/* Count the value lists each rule has checked and matched and measure the time
+ * spent in each rule. Without this, processing a chain updates no shared
+ * counters. */
+void fc_enable_statistics(void);
+
+/* Dispatch the statistics of all rules of all chains. */
+int fc_dispatch_statistics(void);
+
 /*
  * Shortcut for global configuration
  */
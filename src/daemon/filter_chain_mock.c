@@ -0,0 +1,40 @@
+/**
+ * collectd - src/daemon/filter_chain_mock.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "filter_chain.h"
+
+/* The filter chain stubs are a separate object of the mock library, so that
+ * they are not linked into tests which include filter_chain.c themselves.
+ * fc_configure() is referenced by daemon/configfile.c, the registration
+ * functions by match and target plugins. */
+
+int fc_configure(const oconfig_item_t *ci) { return ENOTSUP; }
+
+int fc_register_match(const char *name, match_proc_t proc) { return ENOTSUP; }
+
+int fc_register_target(const char *name, target_proc_t proc) {
+  return ENOTSUP;
+}
@@ -0,0 +1,358 @@
+/**
+ * collectd - src/daemon/filter_chain_test.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "filter_chain.c" /* sic */
+#include "testing.h"
+
+/* Positions of the rules invoked by test_target_record(). */
+static int invoked[16];
+static size_t invoked_num;
+
+static int test_match_plugin(const data_set_t *ds, const value_list_t *vl,
+                             notification_meta_t **meta, void **user_data) {
+  return (strcmp(vl->plugin, *user_data) == 0) ? FC_MATCH_MATCHES
+                                                : FC_MATCH_NO_MATCH;
+}
+
+static int test_key_plugin(void *user_data, fc_match_key_t *ret_key) {
+  sstrncpy(ret_key->plugin, user_data, sizeof(ret_key->plugin));
+  return 0;
+}
+
+static int test_match_type(const data_set_t *ds, const value_list_t *vl,
+                           notification_meta_t **meta, void **user_data) {
+  return (strcmp(vl->type, *user_data) == 0) ? FC_MATCH_MATCHES
+                                              : FC_MATCH_NO_MATCH;
+}
+
+static int test_key_type(void *user_data, fc_match_key_t *ret_key) {
+  sstrncpy(ret_key->type, user_data, sizeof(ret_key->type));
+  return 0;
+}
+
+static int test_target_record(const data_set_t *ds, value_list_t *vl,
+                              notification_meta_t **meta, void **user_data) {
+  if (invoked_num < STATIC_ARRAY_SIZE(invoked))
+    invoked[invoked_num++] = *(int *)*user_data;
+  return FC_TARGET_CONTINUE;
+}
+
+/* Renames the plugin of the value list. */
+static int test_target_rename(const data_set_t *ds, value_list_t *vl,
+                              notification_meta_t **meta, void **user_data) {
+  sstrncpy(vl->plugin, *user_data, sizeof(vl->plugin));
+  return FC_TARGET_CONTINUE;
+}
+
+/* The user data of the test matches and targets is not allocated. */
+static int test_destroy(void **user_data) { return 0; }
+
+/* Returns a match which only matches value lists with the given plugin
+ * ("plugin" is set) or type name. */
+static fc_match_t *test_match(char const *plugin, char const *type) {
+  fc_match_t *m = calloc(1, sizeof(*m));
+  if (m == NULL)
+    return NULL;
+
+  m->proc.destroy = test_destroy;
+  if (plugin != NULL) {
+    m->proc.match = test_match_plugin;
+    m->proc.key = test_key_plugin;
+    m->user_data = (void *)plugin;
+  } else {
+    m->proc.match = test_match_type;
+    m->proc.key = test_key_type;
+    m->user_data = (void *)type;
+  }
+  return m;
+}
+
+static fc_target_t *test_target(target_proc_t proc, void *user_data) {
+  fc_target_t *t = calloc(1, sizeof(*t));
+  if (t == NULL)
+    return NULL;
+
+  t->proc = proc;
+  t->proc.destroy = test_destroy;
+  t->user_data = user_data;
+  return t;
+}
+
+static fc_chain_t *test_chain(char const *name) {
+  fc_chain_t *c = calloc(1, sizeof(*c));
+  if (c != NULL)
+    sstrncpy(c->name, name, sizeof(c->name));
+  return c;
+}
+
+/* Appends a rule, which records its position "id" when invoked, to "chain". If
+ * "match" is NULL, the rule matches all value lists. */
+static fc_rule_t *test_add_rule(fc_chain_t *chain, fc_match_t *match,
+                                int *id) {
+  fc_rule_t *r = calloc(1, sizeof(*r));
+  if (r == NULL)
+    return NULL;
+
+  r->matches = match;
+  r->targets = test_target((target_proc_t){.invoke = test_target_record}, id);
+
+  fc_rule_t **pp = &chain->rules;
+  while (*pp != NULL)
+    pp = &(*pp)->next;
+  *pp = r;
+  return r;
+}
+
+static int ids[] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+/* Builds a chain with the rules:
+ *   0: all value lists
+ *   1: plugin "cpu"
+ *   2: type "if_octets"
+ *   3: plugin "memory"
+ *   4: all value lists
+ *   5: plugin "cpu" */
+static fc_chain_t *test_default_chain(void) {
+  fc_chain_t *c = test_chain("test");
+  if (c == NULL)
+    return NULL;
+
+  test_add_rule(c, NULL, &ids[0]);
+  test_add_rule(c, test_match("cpu", NULL), &ids[1]);
+  test_add_rule(c, test_match(NULL, "if_octets"), &ids[2]);
+  test_add_rule(c, test_match("memory", NULL), &ids[3]);
+  test_add_rule(c, NULL, &ids[4]);
+  test_add_rule(c, test_match("cpu", NULL), &ids[5]);
+  return c;
+}
+
+static void test_reset(void) {
+  memset(invoked, 0, sizeof(invoked));
+  invoked_num = 0;
+}
+
+DEF_TEST(compile_chain) {
+  fc_chain_t *c;
+
+  CHECK_NOT_NULL(c = test_default_chain());
+  CHECK_ZERO(fc_compile_chain(c));
+
+  EXPECT_EQ_INT(6, (int)c->rules_num);
+  OK(c->rules_array[0] == c->rules);
+  OK(c->rules_array[5] == c->rules->next->next->next->next->next);
+
+  EXPECT_EQ_INT(2, (int)c->generic_num);
+  EXPECT_EQ_INT(0, (int)c->generic[0]);
+  EXPECT_EQ_INT(4, (int)c->generic[1]);
+
+  fc_index_entry_t const *e;
+  OK((e = fc_index_get(&c->by_plugin, "cpu")) != NULL);
+  EXPECT_EQ_INT(2, (int)e->rules_num);
+  EXPECT_EQ_INT(1, (int)e->rules[0]);
+  EXPECT_EQ_INT(5, (int)e->rules[1]);
+  OK((e = fc_index_get(&c->by_plugin, "memory")) != NULL);
+  EXPECT_EQ_INT(1, (int)e->rules_num);
+  EXPECT_EQ_INT(3, (int)e->rules[0]);
+  OK((e = fc_index_get(&c->by_type, "if_octets")) != NULL);
+  EXPECT_EQ_INT(1, (int)e->rules_num);
+  EXPECT_EQ_INT(2, (int)e->rules[0]);
+  OK(fc_index_get(&c->by_plugin, "interface") == NULL);
+  OK(fc_index_get(&c->by_type, "cpu") == NULL);
+
+  /* Compiling again, e.g. after a rule has been added, replaces the compiled
+   * form. */
+  test_add_rule(c, test_match("interface", NULL), &ids[6]);
+  CHECK_ZERO(fc_compile_chain(c));
+  EXPECT_EQ_INT(7, (int)c->rules_num);
+  OK((e = fc_index_get(&c->by_plugin, "interface")) != NULL);
+  EXPECT_EQ_INT(6, (int)e->rules[0]);
+
+  fc_free_chains(c);
+
+  /* An empty chain compiles to nothing. */
+  CHECK_NOT_NULL(c = test_chain("empty"));
+  CHECK_ZERO(fc_compile_chain(c));
+  EXPECT_EQ_INT(0, (int)c->rules_num);
+  OK(c->rules_array == NULL);
+  fc_free_chains(c);
+
+  return 0;
+}
+
+DEF_TEST(cursor_seek) {
+  struct {
+    char const *plugin;
+    char const *type;
+    size_t pos;
+    int want[8];
+    size_t want_num;
+  } cases[] = {
+      {"cpu", "cpu", 0, {0, 1, 4, 5}, 4},
+      {"cpu", "cpu", 2, {4, 5}, 2},
+      {"cpu", "cpu", 5, {5}, 1},
+      {"cpu", "cpu", 6, {0}, 0},
+      {"memory", "if_octets", 0, {0, 2, 3, 4}, 4},
+      {"memory", "if_octets", 3, {3, 4}, 2},
+      {"interface", "if_octets", 1, {2, 4}, 2},
+      {"interface", "if_packets", 0, {0, 4}, 2},
+  };
+  fc_chain_t *c;
+
+  CHECK_NOT_NULL(c = test_default_chain());
+  CHECK_ZERO(fc_compile_chain(c));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    value_list_t vl = VALUE_LIST_INIT;
+    fc_cursor_t cursor;
+    fc_rule_t *r;
+    size_t pos;
+    size_t n = 0;
+
+    sstrncpy(vl.plugin, cases[i].plugin, sizeof(vl.plugin));
+    sstrncpy(vl.type, cases[i].type, sizeof(vl.type));
+
+    fc_cursor_seek(&cursor, c, &vl, cases[i].pos);
+    while ((r = fc_cursor_next(&cursor, c, &pos)) != NULL) {
+      OK(n < cases[i].want_num);
+      if (n >= cases[i].want_num)
+        break;
+      EXPECT_EQ_INT(cases[i].want[n], (int)pos);
+      OK(r == c->rules_array[pos]);
+      n++;
+    }
+    EXPECT_EQ_INT((int)cases[i].want_num, (int)n);
+  }
+
+  fc_free_chains(c);
+  return 0;
+}
+
+DEF_TEST(process_chain) {
+  fc_chain_t *c;
+
+  CHECK_NOT_NULL(c = test_default_chain());
+  CHECK_ZERO(fc_compile_chain(c));
+
+  /* Only the rules which may match are checked, and only the matching ones
+   * are invoked. */
+  value_list_t vl = VALUE_LIST_INIT;
+  sstrncpy(vl.plugin, "memory", sizeof(vl.plugin));
+  sstrncpy(vl.type, "memory", sizeof(vl.type));
+
+  test_reset();
+  EXPECT_EQ_INT(FC_TARGET_CONTINUE, fc_process_chain(NULL, &vl, c));
+  EXPECT_EQ_INT(3, (int)invoked_num);
+  EXPECT_EQ_INT(0, invoked[0]);
+  EXPECT_EQ_INT(3, invoked[1]);
+  EXPECT_EQ_INT(4, invoked[2]);
+
+  /* Statistics are only recorded when enabled. */
+  EXPECT_EQ_UINT64(0, c->rules_array[3]->checked);
+  fc_enable_statistics();
+  test_reset();
+  EXPECT_EQ_INT(FC_TARGET_CONTINUE, fc_process_chain(NULL, &vl, c));
+  EXPECT_EQ_UINT64(1, c->rules_array[3]->checked);
+  EXPECT_EQ_UINT64(1, c->rules_array[3]->matched);
+  EXPECT_EQ_UINT64(0, c->rules_array[1]->checked);
+  record_statistics = 0;
+
+  /* A target renaming the plugin makes the rules indexed by the new plugin
+   * name eligible, but only those after the renaming rule. */
+  fc_rule_t *r = c->rules_array[3];
+  r->targets->next = test_target(
+      (target_proc_t){.invoke = test_target_rename}, (void *)"cpu");
+
+  test_reset();
+  EXPECT_EQ_INT(FC_TARGET_CONTINUE, fc_process_chain(NULL, &vl, c));
+  EXPECT_EQ_INT(4, (int)invoked_num);
+  EXPECT_EQ_INT(0, invoked[0]);
+  EXPECT_EQ_INT(3, invoked[1]);
+  EXPECT_EQ_INT(4, invoked[2]);
+  EXPECT_EQ_INT(5, invoked[3]);
+
+  fc_free_chains(c);
+  return 0;
+}
+
+DEF_TEST(jump) {
+  fc_chain_t *main_chain;
+  fc_chain_t *sub_chain;
+
+  /* main: 0: all -> jump to "sub", 1: all
+   * sub:  2: plugin "cpu" -> stop, 3: all */
+  CHECK_NOT_NULL(main_chain = test_chain("main"));
+  CHECK_NOT_NULL(sub_chain = test_chain("sub"));
+  main_chain->next = sub_chain;
+  chain_list_head = main_chain;
+
+  fc_rule_t *r = test_add_rule(main_chain, NULL, &ids[0]);
+  r->targets->next = test_target(
+      (target_proc_t){.invoke = fc_bit_jump_invoke}, fc_strdup("sub"));
+  r->targets->next->proc.destroy = fc_bit_jump_destroy;
+  test_add_rule(main_chain, NULL, &ids[1]);
+
+  r = test_add_rule(sub_chain, test_match("cpu", NULL), &ids[2]);
+  r->targets->next =
+      test_target((target_proc_t){.invoke = fc_bit_stop_invoke}, NULL);
+  test_add_rule(sub_chain, NULL, &ids[3]);
+
+  CHECK_ZERO(fc_compile_chain(main_chain));
+  CHECK_ZERO(fc_compile_chain(sub_chain));
+
+  /* The sub chain returns: processing continues in the main chain. */
+  value_list_t vl = VALUE_LIST_INIT;
+  sstrncpy(vl.plugin, "memory", sizeof(vl.plugin));
+  sstrncpy(vl.type, "memory", sizeof(vl.type));
+
+  test_reset();
+  EXPECT_EQ_INT(FC_TARGET_CONTINUE, fc_process_chain(NULL, &vl, main_chain));
+  EXPECT_EQ_INT(3, (int)invoked_num);
+  EXPECT_EQ_INT(0, invoked[0]);
+  EXPECT_EQ_INT(3, invoked[1]);
+  EXPECT_EQ_INT(1, invoked[2]);
+
+  /* The sub chain stops: so does the main chain. */
+  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+
+  test_reset();
+  EXPECT_EQ_INT(FC_TARGET_STOP, fc_process_chain(NULL, &vl, main_chain));
+  EXPECT_EQ_INT(2, (int)invoked_num);
+  EXPECT_EQ_INT(0, invoked[0]);
+  EXPECT_EQ_INT(2, invoked[1]);
+
+  chain_list_head = NULL;
+  fc_free_chains(main_chain);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(compile_chain);
+  RUN_TEST(cursor_seek);
+  RUN_TEST(process_chain);
+  RUN_TEST(jump);
+
+  END_TEST;
+}
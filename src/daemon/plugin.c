@@ -37,10 +37,12 @@
 #include "utils_avltree.h"
 #include "utils_cache.h"
 #include "utils_complain.h"
-#include "utils_heap.h"
+#include "utils_latency.h"
 #include "utils_llist.h"
+#include "utils_queue.h"
 #include "utils_random.h"
 #include "utils_time.h"
+#include "utils_wheel.h"
 
 #if HAVE_PTHREAD_NP_H
 #include <pthread_np.h> /* for pthread_set_name_np(3) */
@@ -61,6 +63,9 @@ typedef struct callback_func_s callback_func_t;
 #define RF_SIMPLE 0
 #define RF_COMPLEX 1
 #define RF_REMOVE 65535
+struct read_pool_s;
+typedef struct read_pool_s read_pool_t;
+
 struct read_func_s {
 /* `read_func_t' "inherits" from `callback_func_t'.
  * The `rf_super' member MUST be the first one in this structure! */
@@ -74,9 +79,53 @@ struct read_func_s {
   cdtime_t rf_interval;
   cdtime_t rf_effective_interval;
   cdtime_t rf_next_read;
+  read_pool_t *rf_pool;
+  /* Run times and the largest delay of the start of a read since the
+   * statistics were last dispatched. Only recorded if "CollectInternalStats"
+   * is enabled. Protected by the lock of "rf_pool". */
+  latency_counter_t *rf_latency;
+  cdtime_t rf_delay_max;
 };
 typedef struct read_func_s read_func_t;
 
+/* Read callbacks are run by pools of read threads. Every pool has its own
+ * lock and keeps its read callbacks in a timing wheel, ordered by the time of
+ * their next read. A slow plugin with a pool of its own therefore can't delay
+ * the read callbacks of other plugins. */
+struct read_pool_s {
+  char *name;
+  size_t threads_num;
+  pthread_t *threads;
+  size_t threads_running;
+
+  pthread_mutex_t lock;
+  _Bool loop;
+  /* Idle threads wait on "cond". One of them, the "timer", waits on
+   * "timer_cond" until the next read callback is due instead and hands that
+   * job over to another idle thread when it wakes up. That way only one
+   * thread wakes up for each read. */
+  pthread_cond_t cond;
+  pthread_cond_t timer_cond;
+  _Bool timer_waiting;
+  cdtime_t timer_next;
+
+  c_wheel_t *wheel;
+  /* Number of read callbacks whose first read has been spread over their
+   * interval. */
+  uint64_t spread_num;
+
+  read_pool_t *next;
+};
+
+/* Name of the pool running all read callbacks of plugins which don't have
+ * a pool of their own. Its size is set with the global "ReadThreads" option. */
+#define READ_POOL_DEFAULT "default"
+
+/* The slots of the read timing wheel cover about 125 ms each, one revolution
+ * covers about a minute. */
+#define READ_WHEEL_RESOLUTION MS_TO_CDTIME_T(125)
+#define READ_WHEEL_SLOTS 512
+
 struct write_queue_s;
 typedef struct write_queue_s write_queue_t;
 struct write_queue_s {
@@ -85,6 +134,12 @@ struct write_queue_s {
   write_queue_t *next;
 };
 
+/* Maximum number of value lists a write thread takes from the ring buffer
+ * write queue at once. */
+#ifndef WRITE_RING_BATCH_SIZE
+#define WRITE_RING_BATCH_SIZE 32
+#endif
+
 struct flush_callback_s {
   char *name;
   cdtime_t timeout;
@@ -114,13 +169,11 @@ static char *plugindir = NULL;
 #ifndef DEFAULT_MAX_READ_INTERVAL
 #define DEFAULT_MAX_READ_INTERVAL TIME_T_TO_CDTIME_T_STATIC(86400)
 #endif
-static c_heap_t *read_heap = NULL;
+/* "read_lock" protects "read_list" and "read_pools". It is always acquired
+ * before the lock of a pool. */
+static read_pool_t *read_pools = NULL;
 static llist_t *read_list;
-static int read_loop = 1;
 static pthread_mutex_t read_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t read_cond = PTHREAD_COND_INITIALIZER;
-static pthread_t *read_threads = NULL;
-static size_t read_threads_num = 0;
 static cdtime_t max_read_interval = DEFAULT_MAX_READ_INTERVAL;
 
 static write_queue_t *write_queue_head;
@@ -132,9 +185,20 @@ static pthread_cond_t write_cond = PTHREAD_COND_INITIALIZER;
 static pthread_t *write_threads = NULL;
 static size_t write_threads_num = 0;
 
+/* Bounded, lock-free alternative to the linked list above. Used instead of
+ * the list if "WriteQueueRingSize" is non-zero. write_lock and write_cond are
+ * then only used to put idle write threads to sleep. */
+static c_queue_t *write_ring = NULL;
+static long write_ring_waiters = 0;
+
 static pthread_key_t plugin_ctx_key;
 static _Bool plugin_ctx_key_initialized = 0;
 
+/* Points to the vl_ident_t of the value list currently being dispatched by
+ * this thread. The vl_ident_t itself lives on the stack of
+ * plugin_dispatch_values_internal(). */
+static pthread_key_t plugin_vl_ident_key;
+
 static long write_limit_high = 0;
 static long write_limit_low = 0;
 
@@ -153,8 +217,110 @@ static const char *plugin_get_dir(void) {
     return plugindir;
 }
 
+static long plugin_write_queue_length(void) /* {{{ */
+{
+  long wql;
+
+  if (write_ring != NULL)
+    return (long)c_queue_length(write_ring);
+
+  pthread_mutex_lock(&write_lock);
+  wql = write_queue_length;
+  pthread_mutex_unlock(&write_lock);
+
+  return wql;
+} /* }}} long plugin_write_queue_length */
+
+/* Dispatches the run time and delay of each read callback, e.g.
+ * "collectd-read-default/duration-cpu-average". The statistics are copied
+ * while holding `read_lock' and dispatched after releasing it: dispatching
+ * may block, and the callbacks it runs may take `read_lock' themselves, e.g.
+ * to register a read callback. */
+static void plugin_dispatch_read_statistics(void) /* {{{ */
+{
+  struct {
+    char pool[DATA_MAX_NAME_LEN];
+    char name[DATA_MAX_NAME_LEN];
+    cdtime_t average;
+    cdtime_t percentile;
+    cdtime_t max;
+    cdtime_t delay;
+  } *stats = NULL;
+  size_t stats_num = 0;
+
+  pthread_mutex_lock(&read_lock);
+  int read_list_size = (read_list != NULL) ? llist_size(read_list) : 0;
+  if (read_list_size > 0)
+    stats = calloc((size_t)read_list_size, sizeof(*stats));
+  if (stats == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    if (read_list_size > 0)
+      ERROR("plugin_dispatch_read_statistics: calloc failed.");
+    return;
+  }
+
+  for (llentry_t *le = llist_head(read_list); le != NULL; le = le->next) {
+    read_func_t *rf = le->value;
+    read_pool_t *pool = rf->rf_pool;
+
+    pthread_mutex_lock(&pool->lock);
+    if ((rf->rf_latency == NULL) ||
+        (latency_counter_get_num(rf->rf_latency) == 0)) {
+      pthread_mutex_unlock(&pool->lock);
+      continue;
+    }
+    stats[stats_num].average = latency_counter_get_average(rf->rf_latency);
+    stats[stats_num].percentile =
+        latency_counter_get_percentile(rf->rf_latency, 99.0);
+    stats[stats_num].max = latency_counter_get_max(rf->rf_latency);
+    stats[stats_num].delay = rf->rf_delay_max;
+    latency_counter_reset(rf->rf_latency);
+    rf->rf_delay_max = 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    sstrncpy(stats[stats_num].pool, pool->name, sizeof(stats[stats_num].pool));
+    sstrncpy(stats[stats_num].name, rf->rf_name, sizeof(stats[stats_num].name));
+    stats_num++;
+  }
+  pthread_mutex_unlock(&read_lock);
+
+  value_list_t vl = VALUE_LIST_INIT;
+  sstrncpy(vl.plugin, "collectd", sizeof(vl.plugin));
+  vl.interval = plugin_get_interval();
+  vl.values_len = 1;
+
+  for (size_t i = 0; i < stats_num; i++) {
+    ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "read-%s",
+              stats[i].pool);
+
+    sstrncpy(vl.type, "duration", sizeof(vl.type));
+    vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(stats[i].average)};
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%s-average",
+              stats[i].name);
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(stats[i].percentile)};
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%s-percentile-99",
+              stats[i].name);
+    plugin_dispatch_values(&vl);
+
+    vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(stats[i].max)};
+    ssnprintf(vl.type_instance, sizeof(vl.type_instance), "%s-maximum",
+              stats[i].name);
+    plugin_dispatch_values(&vl);
+
+    /* The largest delay between the time a read was due and its start. */
+    sstrncpy(vl.type, "delay", sizeof(vl.type));
+    vl.values = &(value_t){.gauge = CDTIME_T_TO_DOUBLE(stats[i].delay)};
+    sstrncpy(vl.type_instance, stats[i].name, sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
+  sfree(stats);
+} /* }}} void plugin_dispatch_read_statistics */
+
 static int plugin_update_internal_statistics(void) { /* {{{ */
-  gauge_t copy_write_queue_length = (gauge_t)write_queue_length;
+  gauge_t copy_write_queue_length = (gauge_t)plugin_write_queue_length();
 
   /* Initialize `vl' */
   value_list_t vl = VALUE_LIST_INIT;
@@ -178,6 +344,26 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
   plugin_dispatch_values(&vl);
 
+  if (write_ring != NULL) {
+    c_queue_stats_t stats;
+    c_queue_stats(write_ring, &stats);
+
+    /* Write queue : Ring buffer occupancy */
+    vl.values = &(value_t){.gauge = 100.0 * copy_write_queue_length /
+                                    (gauge_t)c_queue_size(write_ring)};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "percent", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "occupancy", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+
+    /* Write queue : Lost races between producers or consumers */
+    vl.values = &(value_t){.derive = (derive_t)stats.contended};
+    vl.values_len = 1;
+    sstrncpy(vl.type, "derive", sizeof(vl.type));
+    sstrncpy(vl.type_instance, "contended", sizeof(vl.type_instance));
+    plugin_dispatch_values(&vl);
+  }
+
   /* Cache */
   sstrncpy(vl.plugin_instance, "cache", sizeof(vl.plugin_instance));
 
@@ -188,6 +374,12 @@ static int plugin_update_internal_statistics(void) { /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Read callbacks */
+  plugin_dispatch_read_statistics();
+
+  /* Filter chains */
+  fc_dispatch_statistics();
+
   return 0;
 } /* }}} int plugin_update_internal_statistics */
 
@@ -228,24 +420,90 @@ static void destroy_all_callbacks(llist_t **list) /* {{{ */
   *list = NULL;
 } /* }}} void destroy_all_callbacks */
 
-static void destroy_read_heap(void) /* {{{ */
+static void destroy_read_func(read_func_t *rf) /* {{{ */
 {
-  if (read_heap == NULL)
+  if (rf == NULL)
     return;
 
-  while (42) {
+  sfree(rf->rf_name);
+  latency_counter_destroy(rf->rf_latency);
+  rf->rf_latency = NULL;
+  destroy_callback((callback_func_t *)rf);
+} /* }}} void destroy_read_func */
+
+static void destroy_read_pools(void) /* {{{ */
+{
+  while (read_pools != NULL) {
+    read_pool_t *pool = read_pools;
+    read_pools = pool->next;
+
     read_func_t *rf;
+    while ((rf = c_wheel_get_any(pool->wheel)) != NULL)
+      destroy_read_func(rf);
+    c_wheel_destroy(pool->wheel);
+
+    pthread_cond_destroy(&pool->timer_cond);
+    pthread_cond_destroy(&pool->cond);
+    pthread_mutex_destroy(&pool->lock);
+    sfree(pool->threads);
+    sfree(pool->name);
+    sfree(pool);
+  }
+} /* }}} void destroy_read_pools */
+
+/* Returns the pool called "name", creating it if necessary. `read_lock' must
+ * be held by the caller. */
+static read_pool_t *read_pool_get(char const *name) /* {{{ */
+{
+  read_pool_t **last = &read_pools;
+  for (read_pool_t *pool = read_pools; pool != NULL; pool = pool->next) {
+    if (strcasecmp(name, pool->name) == 0)
+      return pool;
+    last = &pool->next;
+  }
 
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL)
-      break;
-    sfree(rf->rf_name);
-    destroy_callback((callback_func_t *)rf);
+  read_pool_t *pool = calloc(1, sizeof(*pool));
+  if (pool == NULL) {
+    ERROR("plugin: read_pool_get: calloc failed.");
+    return NULL;
+  }
+
+  pool->name = strdup(name);
+  pool->wheel =
+      c_wheel_create(READ_WHEEL_RESOLUTION, READ_WHEEL_SLOTS, cdtime());
+  if ((pool->name == NULL) || (pool->wheel == NULL)) {
+    ERROR("plugin: read_pool_get: Creating the read pool \"%s\" failed.",
+          name);
+    c_wheel_destroy(pool->wheel);
+    sfree(pool->name);
+    sfree(pool);
+    return NULL;
   }
 
-  c_heap_destroy(read_heap);
-  read_heap = NULL;
-} /* }}} void destroy_read_heap */
+  pthread_mutex_init(&pool->lock, /* attr = */ NULL);
+  pool->loop = 1;
+  pthread_cond_init(&pool->cond, /* attr = */ NULL);
+  pthread_cond_init(&pool->timer_cond, /* attr = */ NULL);
+
+  *last = pool;
+  return pool;
+} /* }}} read_pool_t *read_pool_get */
+
+/* Returns the time from now until the first read of a new read callback. The
+ * first reads of consecutive callbacks are offset by the golden ratio times
+ * their interval, modulo the interval. This spreads any number of callbacks
+ * evenly over the interval, instead of reading all of them at once. The
+ * pool's lock must be held by the caller. */
+static cdtime_t read_pool_spread(read_pool_t *pool, /* {{{ */
+                                 cdtime_t interval) {
+  if ((interval == 0) || IS_FALSE(global_option_get("SpreadReads")))
+    return 0;
+
+  double offset = fmod(0.6180339887498949 * (double)pool->spread_num, 1.0);
+  pool->spread_num++;
+
+  return (cdtime_t)(offset * (double)interval);
+} /* }}} cdtime_t read_pool_spread */
 
 static int register_callback(llist_t **list, /* {{{ */
                              const char *name, callback_func_t *cf) {
@@ -430,64 +688,48 @@ static int plugin_load_file(const char *file, _Bool global) {
   return 0;
 }
 
-static void *plugin_read_thread(void __attribute__((unused)) * args) {
-  while (read_loop != 0) {
+static void *plugin_read_thread(void *args) {
+  read_pool_t *pool = args;
+
+  pthread_mutex_lock(&pool->lock);
+  while (pool->loop) {
     read_func_t *rf;
     plugin_ctx_t old_ctx;
     cdtime_t start;
     cdtime_t now;
     cdtime_t elapsed;
+    cdtime_t delay;
     int status;
     int rf_type;
-    int rc;
-
-    /* Get the read function that needs to be read next.
-     * We don't need to hold "read_lock" for the heap, but we need
-     * to call c_heap_get_root() and pthread_cond_wait() in the
-     * same protected block. */
-    pthread_mutex_lock(&read_lock);
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL) {
-      pthread_cond_wait(&read_cond, &read_lock);
-      pthread_mutex_unlock(&read_lock);
-      continue;
-    }
-    pthread_mutex_unlock(&read_lock);
 
-    if (rf->rf_interval == 0) {
-      /* this should not happen, because the interval is set
-       * for each plugin when loading it
-       * XXX: issue a warning? */
-      rf->rf_interval = plugin_get_interval();
-      rf->rf_effective_interval = rf->rf_interval;
+    /* Get a read function that is due. If there is none, either sleep until
+     * the next one is due or, if another thread does that already, until we
+     * are woken up. */
+    rf = c_wheel_get_due(pool->wheel, cdtime());
+    if (rf == NULL) {
+      cdtime_t next;
 
-      rf->rf_next_read = cdtime();
+      if (pool->timer_waiting || (c_wheel_next(pool->wheel, &next) != 0)) {
+        pthread_cond_wait(&pool->cond, &pool->lock);
+      } else {
+        /* In pthread_cond_timedwait, spurious wakeups are possible
+         * (and really happen, at least on NetBSD with > 1 CPU), so the
+         * wheel is looked at again in any case. */
+        pool->timer_waiting = 1;
+        pool->timer_next = next;
+        pthread_cond_timedwait(&pool->timer_cond, &pool->lock,
+                               &CDTIME_T_TO_TIMESPEC(next));
+        pool->timer_waiting = 0;
+      }
+      continue;
     }
 
-    /* sleep until this entry is due,
-     * using pthread_cond_timedwait */
-    pthread_mutex_lock(&read_lock);
-    /* In pthread_cond_timedwait, spurious wakeups are possible
-     * (and really happen, at least on NetBSD with > 1 CPU), thus
-     * we need to re-evaluate the condition every time
-     * pthread_cond_timedwait returns. */
-    rc = 0;
-    while ((read_loop != 0) && (cdtime() < rf->rf_next_read) && rc == 0) {
-      rc = pthread_cond_timedwait(&read_cond, &read_lock,
-                                  &CDTIME_T_TO_TIMESPEC(rf->rf_next_read));
-    }
+    /* Let another idle thread wait for the next read function. */
+    pthread_cond_signal(&pool->cond);
 
-    /* Must hold `read_lock' when accessing `rf->rf_type'. */
+    /* Must hold the pool's lock when accessing `rf->rf_type'. */
     rf_type = rf->rf_type;
-    pthread_mutex_unlock(&read_lock);
-
-    /* Check if we're supposed to stop.. This may have interrupted
-     * the sleep, too. */
-    if (read_loop == 0) {
-      /* Insert `rf' again, so it can be free'd correctly */
-      c_heap_insert(read_heap, rf);
-      break;
-    }
+    pthread_mutex_unlock(&pool->lock);
 
     /* The entry has been marked for deletion. The linked list
      * entry has already been removed by `plugin_unregister_read'.
@@ -497,15 +739,26 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
       DEBUG("plugin_read_thread: Destroying the `%s' "
             "callback.",
             rf->rf_name);
-      sfree(rf->rf_name);
-      destroy_callback((callback_func_t *)rf);
+      destroy_read_func(rf);
       rf = NULL;
+      pthread_mutex_lock(&pool->lock);
       continue;
     }
 
+    if (rf->rf_interval == 0) {
+      /* this should not happen, because the interval is set
+       * for each plugin when loading it
+       * XXX: issue a warning? */
+      rf->rf_interval = plugin_get_interval();
+      rf->rf_effective_interval = rf->rf_interval;
+
+      rf->rf_next_read = cdtime();
+    }
+
     DEBUG("plugin_read_thread: Handling `%s'.", rf->rf_name);
 
     start = cdtime();
+    delay = (start > rf->rf_next_read) ? (start - rf->rf_next_read) : 0;
 
     old_ctx = plugin_set_ctx(rf->rf_ctx);
 
@@ -577,9 +830,28 @@ static void *plugin_read_thread(void __attribute__((unused)) * args) {
     DEBUG("plugin_read_thread: Next read of the `%s' plugin at %.3f.",
           rf->rf_name, CDTIME_T_TO_DOUBLE(rf->rf_next_read));
 
-    /* Re-insert this read function into the heap again. */
-    c_heap_insert(read_heap, rf);
-  } /* while (read_loop) */
+    pthread_mutex_lock(&pool->lock);
+
+    if (record_statistics) {
+      if (rf->rf_latency == NULL)
+        rf->rf_latency = latency_counter_create();
+      if (rf->rf_latency != NULL)
+        latency_counter_add(rf->rf_latency, elapsed);
+      if (delay > rf->rf_delay_max)
+        rf->rf_delay_max = delay;
+    }
+
+    /* Re-insert this read function into the wheel again. This is also done
+     * when shutting down, so it can be free'd correctly. */
+    if (c_wheel_insert(pool->wheel, rf, rf->rf_next_read) != 0) {
+      ERROR("plugin_read_thread: Re-inserting the `%s' read-function "
+            "failed. It will not be read anymore.",
+            rf->rf_name);
+    } else if (pool->timer_waiting && (rf->rf_next_read < pool->timer_next)) {
+      pthread_cond_signal(&pool->timer_cond);
+    }
+  } /* while (pool->loop) */
+  pthread_mutex_unlock(&pool->lock);
 
   pthread_exit(NULL);
   return (void *)0;
@@ -615,58 +887,95 @@ static void set_thread_name(pthread_t tid, char const *name) {
 #endif
 }
 
-static void start_read_threads(size_t num) /* {{{ */
+static void start_read_pool(read_pool_t *pool) /* {{{ */
 {
-  if (read_threads != NULL)
+  if (pool->threads != NULL)
     return;
 
-  read_threads = (pthread_t *)calloc(num, sizeof(pthread_t));
-  if (read_threads == NULL) {
-    ERROR("plugin: start_read_threads: calloc failed.");
+  pool->threads = calloc(pool->threads_num, sizeof(*pool->threads));
+  if (pool->threads == NULL) {
+    ERROR("plugin: start_read_pool: calloc failed.");
     return;
   }
 
-  read_threads_num = 0;
-  for (size_t i = 0; i < num; i++) {
-    int status = pthread_create(read_threads + read_threads_num,
+  pool->threads_running = 0;
+  for (size_t i = 0; i < pool->threads_num; i++) {
+    int status = pthread_create(pool->threads + pool->threads_running,
                                 /* attr = */ NULL, plugin_read_thread,
-                                /* arg = */ NULL);
+                                /* arg = */ pool);
     if (status != 0) {
       char errbuf[1024];
-      ERROR("plugin: start_read_threads: pthread_create failed "
+      ERROR("plugin: start_read_pool: pthread_create failed "
             "with status %i (%s).",
             status, sstrerror(status, errbuf, sizeof(errbuf)));
       return;
     }
 
     char name[THREAD_NAME_MAX];
-    ssnprintf(name, sizeof(name), "reader#%zu", read_threads_num);
-    set_thread_name(read_threads[read_threads_num], name);
+    if (strcasecmp(READ_POOL_DEFAULT, pool->name) == 0)
+      ssnprintf(name, sizeof(name), "reader#%zu", pool->threads_running);
+    else
+      ssnprintf(name, sizeof(name), "rd:%s#%zu", pool->name,
+                pool->threads_running);
+    set_thread_name(pool->threads[pool->threads_running], name);
 
-    read_threads_num++;
+    pool->threads_running++;
   } /* for (i) */
+} /* }}} void start_read_pool */
+
+/* Starts `num' threads for the default pool and the configured number of
+ * threads for all other pools. */
+static void start_read_threads(size_t num) /* {{{ */
+{
+  pthread_mutex_lock(&read_lock);
+
+  read_pool_t *pool = read_pool_get(READ_POOL_DEFAULT);
+  if ((pool != NULL) && (pool->threads_num < num))
+    pool->threads_num = num;
+
+  for (pool = read_pools; pool != NULL; pool = pool->next) {
+    if (pool->threads_num == 0)
+      pool->threads_num = 1;
+    start_read_pool(pool);
+  }
+
+  pthread_mutex_unlock(&read_lock);
 } /* }}} void start_read_threads */
 
 static void stop_read_threads(void) {
-  if (read_threads == NULL)
-    return;
-
-  INFO("collectd: Stopping %zu read threads.", read_threads_num);
+  size_t threads_num = 0;
 
   pthread_mutex_lock(&read_lock);
-  read_loop = 0;
-  DEBUG("plugin: stop_read_threads: Signalling `read_cond'");
-  pthread_cond_broadcast(&read_cond);
+  for (read_pool_t *pool = read_pools; pool != NULL; pool = pool->next) {
+    threads_num += pool->threads_running;
+
+    pthread_mutex_lock(&pool->lock);
+    pool->loop = 0;
+    DEBUG("plugin: stop_read_threads: Signalling the `%s' read pool",
+          pool->name);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_cond_broadcast(&pool->timer_cond);
+    pthread_mutex_unlock(&pool->lock);
+  }
   pthread_mutex_unlock(&read_lock);
 
-  for (size_t i = 0; i < read_threads_num; i++) {
-    if (pthread_join(read_threads[i], NULL) != 0) {
-      ERROR("plugin: stop_read_threads: pthread_join failed.");
+  if (threads_num == 0)
+    return;
+
+  INFO("collectd: Stopping %zu read threads.", threads_num);
+
+  /* The pools are only destroyed after the threads have been stopped, so the
+   * list can be walked without holding `read_lock'. */
+  for (read_pool_t *pool = read_pools; pool != NULL; pool = pool->next) {
+    for (size_t i = 0; i < pool->threads_running; i++) {
+      if (pthread_join(pool->threads[i], NULL) != 0) {
+        ERROR("plugin: stop_read_threads: pthread_join failed.");
+      }
+      pool->threads[i] = (pthread_t)0;
     }
-    read_threads[i] = (pthread_t)0;
+    sfree(pool->threads);
+    pool->threads_running = 0;
   }
-  sfree(read_threads);
-  read_threads_num = 0;
 } /* void stop_read_threads */
 
 static void plugin_value_list_free(value_list_t *vl) /* {{{ */
@@ -736,10 +1045,41 @@ plugin_value_list_clone(value_list_t const *vl_orig) /* {{{ */
   return vl;
 } /* }}} value_list_t *plugin_value_list_clone */
 
+static int plugin_write_ring_enqueue(value_list_t const *vl) /* {{{ */
+{
+  write_queue_t q = {.next = NULL};
+  int status;
+
+  q.vl = plugin_value_list_clone(vl);
+  if (q.vl == NULL)
+    return ENOMEM;
+  q.ctx = plugin_get_ctx();
+
+  status = c_queue_push(write_ring, &q);
+  if (status != 0) {
+    plugin_value_list_free(q.vl);
+    return status;
+  }
+
+  /* Pairs with the barrier in plugin_write_ring_dequeue(): either we see the
+   * sleeping write thread or the write thread sees the new element. */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&write_ring_waiters, __ATOMIC_RELAXED) > 0) {
+    pthread_mutex_lock(&write_lock);
+    pthread_cond_signal(&write_cond);
+    pthread_mutex_unlock(&write_lock);
+  }
+
+  return 0;
+} /* }}} int plugin_write_ring_enqueue */
+
 static int plugin_write_enqueue(value_list_t const *vl) /* {{{ */
 {
   write_queue_t *q;
 
+  if (write_ring != NULL)
+    return plugin_write_ring_enqueue(vl);
+
   q = malloc(sizeof(*q));
   if (q == NULL)
     return ENOMEM;
@@ -806,8 +1146,49 @@ static value_list_t *plugin_write_dequeue(void) /* {{{ */
   return vl;
 } /* }}} value_list_t *plugin_write_dequeue */
 
+/* Takes up to `num' elements from the ring buffer. Blocks until at least one
+ * element is available. Returns zero when the write threads are shutting
+ * down. */
+static size_t plugin_write_ring_dequeue(write_queue_t *batch, /* {{{ */
+                                        size_t num) {
+  while (write_loop) {
+    /* Leave some work to the other write threads if the queue is short. */
+    size_t max = c_queue_length(write_ring);
+    if (write_threads_num > 1)
+      max /= write_threads_num;
+    if (max < 1)
+      max = 1;
+    else if (max > num)
+      max = num;
+
+    size_t n = c_queue_pop(write_ring, batch, max);
+    if (n > 0)
+      return n;
+
+    pthread_mutex_lock(&write_lock);
+    __atomic_add_fetch(&write_ring_waiters, 1, __ATOMIC_SEQ_CST);
+    if (write_loop && (c_queue_length(write_ring) == 0))
+      pthread_cond_wait(&write_cond, &write_lock);
+    __atomic_sub_fetch(&write_ring_waiters, 1, __ATOMIC_SEQ_CST);
+    pthread_mutex_unlock(&write_lock);
+  }
+
+  return 0;
+} /* }}} size_t plugin_write_ring_dequeue */
+
 static void *plugin_write_thread(void __attribute__((unused)) * args) /* {{{ */
 {
+  while (write_loop && (write_ring != NULL)) {
+    write_queue_t batch[WRITE_RING_BATCH_SIZE];
+    size_t n = plugin_write_ring_dequeue(batch, STATIC_ARRAY_SIZE(batch));
+
+    for (size_t i = 0; i < n; i++) {
+      (void)plugin_set_ctx(batch[i].ctx);
+      plugin_dispatch_values_internal(batch[i].vl);
+      plugin_value_list_free(batch[i].vl);
+    }
+  }
+
   while (write_loop) {
     value_list_t *vl = plugin_write_dequeue();
     if (vl == NULL)
@@ -893,6 +1274,20 @@ static void stop_write_threads(void) /* {{{ */
   write_queue_length = 0;
   pthread_mutex_unlock(&write_lock);
 
+  /* The ring itself is not freed: other threads, e.g. the network plugin's
+   * receive thread, may still be dispatching values. */
+  if (write_ring != NULL) {
+    write_queue_t batch[WRITE_RING_BATCH_SIZE];
+    size_t n;
+
+    while ((n = c_queue_pop(write_ring, batch, STATIC_ARRAY_SIZE(batch))) >
+           0) {
+      for (size_t j = 0; j < n; j++)
+        plugin_value_list_free(batch[j].vl);
+      i += n;
+    }
+  }
+
   if (i > 0) {
     WARNING("plugin: %zu value list%s left after shutting down "
             "the write threads.",
@@ -1071,29 +1466,14 @@ int plugin_register_init(const char *name, int (*callback)(void)) {
   return create_register_callback(&list_init, name, (void *)callback, NULL);
 } /* plugin_register_init */
 
-static int plugin_compare_read_func(const void *arg0, const void *arg1) {
-  const read_func_t *rf0;
-  const read_func_t *rf1;
-
-  rf0 = arg0;
-  rf1 = arg1;
-
-  if (rf0->rf_next_read < rf1->rf_next_read)
-    return -1;
-  else if (rf0->rf_next_read > rf1->rf_next_read)
-    return 1;
-  else
-    return 0;
-} /* int plugin_compare_read_func */
-
-/* Add a read function to both, the heap and a linked list. The linked list if
- * used to look-up read functions, especially for the remove function. The heap
- * is used to determine which plugin to read next. */
+/* Add a read function to both, the timing wheel of its pool and a linked
+ * list. The linked list is used to look-up read functions, especially for the
+ * remove function. The wheel is used to determine which plugin to read next. */
 static int plugin_insert_read(read_func_t *rf) {
   int status;
   llentry_t *le;
+  read_pool_t *pool;
 
-  rf->rf_next_read = cdtime();
   rf->rf_effective_interval = rf->rf_interval;
 
   pthread_mutex_lock(&read_lock);
@@ -1107,13 +1487,13 @@ static int plugin_insert_read(read_func_t *rf) {
     }
   }
 
-  if (read_heap == NULL) {
-    read_heap = c_heap_create(plugin_compare_read_func);
-    if (read_heap == NULL) {
-      pthread_mutex_unlock(&read_lock);
-      ERROR("plugin_insert_read: c_heap_create failed.");
-      return -1;
-    }
+  pool = rf->rf_ctx.read_pool;
+  if (pool == NULL)
+    pool = read_pool_get(READ_POOL_DEFAULT);
+  if (pool == NULL) {
+    pthread_mutex_unlock(&read_lock);
+    ERROR("plugin_insert_read: read_pool_get failed.");
+    return -1;
   }
 
   le = llist_search(read_list, rf->rf_name);
@@ -1133,23 +1513,50 @@ static int plugin_insert_read(read_func_t *rf) {
     return -1;
   }
 
-  status = c_heap_insert(read_heap, rf);
+  rf->rf_pool = pool;
+
+  pthread_mutex_lock(&pool->lock);
+  rf->rf_next_read = cdtime() + read_pool_spread(pool, rf->rf_interval);
+  status = c_wheel_insert(pool->wheel, rf, rf->rf_next_read);
   if (status != 0) {
+    pthread_mutex_unlock(&pool->lock);
     pthread_mutex_unlock(&read_lock);
-    ERROR("plugin_insert_read: c_heap_insert failed.");
+    ERROR("plugin_insert_read: c_wheel_insert failed.");
     llentry_destroy(le);
     return -1;
   }
 
+  /* Wake up the thread waiting for the next read function if the new one is
+   * due earlier, or any idle thread if there is none. */
+  if (!pool->timer_waiting)
+    pthread_cond_signal(&pool->cond);
+  else if (rf->rf_next_read < pool->timer_next)
+    pthread_cond_signal(&pool->timer_cond);
+  pthread_mutex_unlock(&pool->lock);
+
   /* This does not fail. */
   llist_append(read_list, le);
 
-  /* Wake up all the read threads. */
-  pthread_cond_broadcast(&read_cond);
   pthread_mutex_unlock(&read_lock);
   return 0;
 } /* int plugin_insert_read */
 
+struct read_pool_s *plugin_get_read_pool(char const *name, /* {{{ */
+                                         size_t threads_num) {
+  read_pool_t *pool;
+
+  if (name == NULL)
+    return NULL;
+
+  pthread_mutex_lock(&read_lock);
+  pool = read_pool_get(name);
+  if ((pool != NULL) && (pool->threads_num < threads_num))
+    pool->threads_num = threads_num;
+  pthread_mutex_unlock(&read_lock);
+
+  return pool;
+} /* }}} struct read_pool_s *plugin_get_read_pool */
+
 int plugin_register_read(const char *name, int (*callback)(void)) {
   read_func_t *rf;
   int status;
@@ -1423,7 +1830,9 @@ int plugin_unregister_read(const char *name) /* {{{ */
 
   rf = le->value;
   assert(rf != NULL);
+  pthread_mutex_lock(&rf->rf_pool->lock);
   rf->rf_type = RF_REMOVE;
+  pthread_mutex_unlock(&rf->rf_pool->lock);
 
   pthread_mutex_unlock(&read_lock);
 
@@ -1475,7 +1884,9 @@ int plugin_unregister_read_group(const char *group) /* {{{ */
 
     rf = le->value;
     assert(rf != NULL);
+    pthread_mutex_lock(&rf->rf_pool->lock);
     rf->rf_type = RF_REMOVE;
+    pthread_mutex_unlock(&rf->rf_pool->lock);
 
     llentry_destroy(le);
 
@@ -1558,6 +1969,7 @@ int plugin_init_all(void) {
 
   if (IS_TRUE(global_option_get("CollectInternalStats"))) {
     record_statistics = 1;
+    fc_enable_statistics();
     plugin_register_read("collectd", plugin_update_internal_statistics);
   }
 
@@ -1593,7 +2005,23 @@ int plugin_init_all(void) {
     write_threads_num = 5;
   }
 
-  if ((list_init == NULL) && (read_heap == NULL))
+  long write_ring_size = global_option_get_long("WriteQueueRingSize",
+                                                /* default = */ 0);
+  if (write_ring_size < 0) {
+    ERROR("WriteQueueRingSize must be positive or zero.");
+    write_ring_size = 0;
+  }
+  if ((write_ring_size > 0) && (write_ring == NULL)) {
+    write_ring = c_queue_create((size_t)write_ring_size, sizeof(write_queue_t));
+    if (write_ring == NULL)
+      ERROR("Allocating the write queue ring buffer failed. "
+            "Falling back to the unbounded write queue.");
+    else
+      INFO("Using a ring buffer with %zu slots as write queue.",
+           c_queue_size(write_ring));
+  }
+
+  if ((list_init == NULL) && (read_pools == NULL))
     return ret;
 
   /* Calling all init callbacks before checking if read callbacks
@@ -1633,7 +2061,7 @@ int plugin_init_all(void) {
       global_option_get_time("MaxReadInterval", DEFAULT_MAX_READ_INTERVAL);
 
   /* Start read-threads */
-  if (read_heap != NULL) {
+  if (read_pools != NULL) {
     const char *rt;
     int num;
 
@@ -1657,42 +2085,40 @@ int plugin_read_all_once(void) {
   int status;
   int return_status = 0;
 
-  if (read_heap == NULL) {
+  if (read_pools == NULL) {
     NOTICE("No read-functions are registered.");
     return 0;
   }
 
-  while (42) {
+  for (read_pool_t *pool = read_pools; pool != NULL; pool = pool->next) {
     read_func_t *rf;
-    plugin_ctx_t old_ctx;
 
-    rf = c_heap_get_root(read_heap);
-    if (rf == NULL)
-      break;
+    while ((rf = c_wheel_get_any(pool->wheel)) != NULL) {
+      plugin_ctx_t old_ctx;
 
-    old_ctx = plugin_set_ctx(rf->rf_ctx);
+      old_ctx = plugin_set_ctx(rf->rf_ctx);
 
-    if (rf->rf_type == RF_SIMPLE) {
-      int (*callback)(void);
+      if (rf->rf_type == RF_SIMPLE) {
+        int (*callback)(void);
 
-      callback = rf->rf_callback;
-      status = (*callback)();
-    } else {
-      plugin_read_cb callback;
+        callback = rf->rf_callback;
+        status = (*callback)();
+      } else {
+        plugin_read_cb callback;
 
-      callback = rf->rf_callback;
-      status = (*callback)(&rf->rf_udata);
-    }
+        callback = rf->rf_callback;
+        status = (*callback)(&rf->rf_udata);
+      }
 
-    plugin_set_ctx(old_ctx);
+      plugin_set_ctx(old_ctx);
 
-    if (status != 0) {
-      NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
-      return_status = -1;
-    }
+      if (status != 0) {
+        NOTICE("read-function of plugin `%s' failed.", rf->rf_name);
+        return_status = -1;
+      }
 
-    sfree(rf->rf_name);
-    destroy_callback((void *)rf);
+      destroy_read_func(rf);
+    }
   }
 
   return return_status;
@@ -1816,7 +2242,7 @@ int plugin_shutdown_all(void) {
   read_list = NULL;
   pthread_mutex_unlock(&read_lock);
 
-  destroy_read_heap();
+  destroy_read_pools();
 
   /* blocks until all write threads have shut down. */
   stop_write_threads();
@@ -1905,11 +2331,48 @@ int plugin_dispatch_missing(const value_list_t *vl) /* {{{ */
   return 0;
 } /* int }}} plugin_dispatch_missing */
 
+static void plugin_vl_ident_update(vl_ident_t *ident) /* {{{ */
+{
+  if (FORMAT_VL(ident->name, sizeof(ident->name), ident->vl) != 0) {
+    ident->valid = 0;
+    return;
+  }
+
+  ident->name_len = strlen(ident->name);
+  ident->hash = strhash(ident->name);
+  ident->valid = 1;
+} /* }}} void plugin_vl_ident_update */
+
+vl_ident_t const *plugin_get_vl_ident(value_list_t const *vl) /* {{{ */
+{
+  vl_ident_t *ident = pthread_getspecific(plugin_vl_ident_key);
+
+  if ((ident == NULL) || (ident->vl != vl))
+    return NULL;
+
+  if (!ident->valid)
+    plugin_vl_ident_update(ident);
+
+  return ident->valid ? ident : NULL;
+} /* }}} vl_ident_t const *plugin_get_vl_ident */
+
+void plugin_invalidate_vl_ident(value_list_t const *vl) /* {{{ */
+{
+  vl_ident_t *ident = pthread_getspecific(plugin_vl_ident_key);
+
+  if ((ident != NULL) && (ident->vl == vl)) {
+    ident->valid = 0;
+    ident->rates = NULL;
+  }
+} /* }}} void plugin_invalidate_vl_ident */
+
 static int plugin_dispatch_values_internal(value_list_t *vl) {
   int status;
   static c_complain_t no_write_complaint = C_COMPLAIN_INIT_STATIC;
 
   data_set_t *ds;
+  vl_ident_t ident = {.vl = vl};
+  void *prev_ident;
 
   _Bool free_meta_data = 0;
 
@@ -1989,6 +2452,12 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   escape_slashes(vl->type, sizeof(vl->type));
   escape_slashes(vl->type_instance, sizeof(vl->type_instance));
 
+  /* Format the identifier once for the cache, the chains and the write
+   * plugins. */
+  plugin_vl_ident_update(&ident);
+  prev_ident = pthread_getspecific(plugin_vl_ident_key);
+  pthread_setspecific(plugin_vl_ident_key, &ident);
+
   if (pre_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, pre_cache_chain);
     if (status < 0) {
@@ -1996,12 +2465,17 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
               "pre-cache chain failed with "
               "status %i (%#x).",
               status, status);
-    } else if (status == FC_TARGET_STOP)
+    } else if (status == FC_TARGET_STOP) {
+      pthread_setspecific(plugin_vl_ident_key, prev_ident);
       return 0;
+    }
   }
 
-  /* Update the value cache */
-  uc_update(ds, vl);
+  /* Update the value cache. The rates are handed to the write plugins
+   * through the identity, so they don't have to look them up again. */
+  gauge_t rates[ds->ds_num];
+  if (uc_update_rates(ds, vl, rates) == 0)
+    ident.rates = rates;
 
   if (post_cache_chain != NULL) {
     status = fc_process_chain(ds, vl, post_cache_chain);
@@ -2014,6 +2488,8 @@ static int plugin_dispatch_values_internal(value_list_t *vl) {
   } else
     fc_default_action(ds, vl);
 
+  pthread_setspecific(plugin_vl_ident_key, prev_ident);
+
   if ((free_meta_data != 0) && (vl->meta != NULL)) {
     meta_data_destroy(vl->meta);
     vl->meta = NULL;
@@ -2028,9 +2504,7 @@ static double get_drop_probability(void) /* {{{ */
   long size;
   long wql;
 
-  pthread_mutex_lock(&write_lock);
-  wql = write_queue_length;
-  pthread_mutex_unlock(&write_lock);
+  wql = plugin_write_queue_length();
 
   if (wql < write_limit_low)
     return 0.0;
@@ -2086,6 +2560,7 @@ static _Bool check_drop_value(void) /* {{{ */
 int plugin_dispatch_values(value_list_t const *vl) {
   int status;
   static pthread_mutex_t statistics_lock = PTHREAD_MUTEX_INITIALIZER;
+  static c_complain_t write_ring_complaint = C_COMPLAIN_INIT_STATIC;
 
   if (check_drop_value()) {
     if (record_statistics) {
@@ -2097,7 +2572,18 @@ int plugin_dispatch_values(value_list_t const *vl) {
   }
 
   status = plugin_write_enqueue(vl);
-  if (status != 0) {
+  if (status == EAGAIN) {
+    /* The ring buffer is full: treat this like hitting WriteQueueLimitHigh. */
+    if (record_statistics) {
+      pthread_mutex_lock(&statistics_lock);
+      stats_values_dropped++;
+      pthread_mutex_unlock(&statistics_lock);
+    }
+    c_complain(LOG_ERR, &write_ring_complaint,
+               "plugin_dispatch_values: The write queue is full. "
+               "Dropping metrics.");
+    return status;
+  } else if (status != 0) {
     char errbuf[1024];
     ERROR("plugin_dispatch_values: plugin_write_enqueue failed "
           "with status %i (%s).",
@@ -2484,6 +2970,8 @@ static plugin_ctx_t *plugin_ctx_create(void) {
 void plugin_init_ctx(void) {
   pthread_key_create(&plugin_ctx_key, plugin_ctx_destructor);
   plugin_ctx_key_initialized = 1;
+
+  pthread_key_create(&plugin_vl_ident_key, /* destructor = */ NULL);
 } /* void plugin_init_ctx */
 
 plugin_ctx_t plugin_get_ctx(void) {
@@ -135,6 +135,24 @@ struct data_set_s {
 };
 typedef struct data_set_s data_set_t;
 
+/*
+ * Identity of a value list: its identifier as formatted by FORMAT_VL() and a
+ * hash of that string. It is computed once when a value list is dispatched,
+ * so that the value cache and write plugins don't have to format the
+ * identifier again and again. See plugin_get_vl_ident().
+ */
+struct vl_ident_s {
+  value_list_t const *vl;
+  _Bool valid;
+  uint32_t hash;
+  size_t name_len;
+  char name[6 * DATA_MAX_NAME_LEN];
+  /* The rates computed by the value cache for this value list, or NULL if
+   * the cache has not been updated (yet), e.g. in the pre-cache chain. */
+  gauge_t const *rates;
+};
+typedef struct vl_ident_s vl_ident_t;
+
 enum notification_meta_type_e {
   NM_TYPE_STRING,
   NM_TYPE_SIGNED_INT,
@@ -174,10 +192,14 @@ struct user_data_s {
 };
 typedef struct user_data_s user_data_t;
 
+struct read_pool_s;
 struct plugin_ctx_s {
   cdtime_t interval;
   cdtime_t flush_interval;
   cdtime_t flush_timeout;
+  /* Pool of read threads running the read callbacks. NULL for the default
+   * pool, see plugin_get_read_pool(). */
+  struct read_pool_s *read_pool;
 };
 typedef struct plugin_ctx_s plugin_ctx_t;
 
@@ -285,6 +307,21 @@ int plugin_register_complex_config(const char *type,
                                    int (*callback)(oconfig_item_t *));
 int plugin_register_init(const char *name, plugin_init_cb callback);
 int plugin_register_read(const char *name, int (*callback)(void));
+/*
+ * NAME
+ *  plugin_get_read_pool
+ *
+ * DESCRIPTION
+ *  Returns the pool of read threads called "name", creating it if necessary.
+ *  The pool is started with at least "threads_num" threads. Read callbacks
+ *  registered while the pool is set in the plugin context are run by this
+ *  pool instead of the default one, so that slow read callbacks don't delay
+ *  other plugins.
+ *
+ * RETURN VALUE
+ *  The pool or NULL if creating it failed.
+ */
+struct read_pool_s *plugin_get_read_pool(char const *name, size_t threads_num);
 /* "user_data" will be freed automatically, unless
  * "plugin_register_complex_read" returns an error (non-zero). */
 int plugin_register_complex_read(const char *group, const char *name,
@@ -440,8 +477,37 @@ plugin_ctx_t plugin_set_ctx(plugin_ctx_t ctx);
  */
 cdtime_t plugin_get_interval(void);
 
+/*
+ * NAME
+ *  plugin_get_vl_ident
+ *
+ * DESCRIPTION
+ *  Returns the identity of `vl' if `vl' is the value list currently being
+ *  dispatched by the calling thread, i.e. when called from a match, target or
+ *  write callback. Returns NULL otherwise, in which case the caller has to
+ *  format the identifier itself. Write callbacks can use the `rates' member
+ *  instead of calling uc_get_rate().
+ */
+vl_ident_t const *plugin_get_vl_ident(value_list_t const *vl);
+
+/*
+ * NAME
+ *  plugin_invalidate_vl_ident
+ *
+ * DESCRIPTION
+ *  Must be called after modifying the host, plugin, plugin instance, type or
+ *  type instance of a value list while it is being dispatched. The identity is
+ *  re-computed the next time plugin_get_vl_ident() is called. The rates are
+ *  dropped, since they belong to the old identifier.
+ */
+void plugin_invalidate_vl_ident(value_list_t const *vl);
+
 /*
  * Context-aware thread management.
+ *
+ * Threads must not be created while reading the configuration: the daemon
+ * forks into the background afterwards and only the forking thread survives.
+ * Create them from an init callback instead.
  */
 
 int plugin_thread_create(pthread_t *thread, const pthread_attr_t *attr,
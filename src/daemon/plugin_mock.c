@@ -56,6 +56,11 @@ int plugin_register_read(const char *name, int (*callback)(void)) {
   return ENOTSUP;
 }
 
+struct read_pool_s *plugin_get_read_pool(char const *name,
+                                         size_t threads_num) {
+  return NULL;
+}
+
 int plugin_register_complex_read(const char *group, const char *name,
                                  int (*callback)(user_data_t *),
                                  cdtime_t interval,
@@ -63,10 +68,26 @@ int plugin_register_complex_read(const char *group, const char *name,
   return ENOTSUP;
 }
 
+int plugin_register_write(const char *name, plugin_write_cb callback,
+                          user_data_t const *user_data) {
+  return ENOTSUP;
+}
+
+int plugin_register_flush(const char *name, plugin_flush_cb callback,
+                          user_data_t const *user_data) {
+  return ENOTSUP;
+}
+
 int plugin_register_shutdown(const char *name, int (*callback)(void)) {
   return ENOTSUP;
 }
 
+int plugin_unregister_read_group(const char *group) { return ENOTSUP; }
+
+int plugin_unregister_write(const char *name) { return ENOTSUP; }
+
+int plugin_unregister_flush(const char *name) { return ENOTSUP; }
+
 int plugin_register_data_set(const data_set_t *ds) { return ENOTSUP; }
 
 int plugin_dispatch_values(value_list_t const *vl) { return ENOTSUP; }
@@ -75,6 +96,17 @@ int plugin_flush(const char *plugin, cdtime_t timeout, const char *identifier) {
   return ENOTSUP;
 }
 
+int plugin_write(const char *plugin, const data_set_t *ds,
+                 const value_list_t *vl) {
+  return ENOTSUP;
+}
+
+void plugin_invalidate_vl_ident(value_list_t const *vl) { /* nop */
+}
+
+void plugin_log_available_writers(void) { /* nop */
+}
+
 static data_source_t magic_ds[] = {{"value", DS_TYPE_DERIVE, 0.0, NAN}};
 static data_set_t magic = {"MAGIC", 1, magic_ds};
 const data_set_t *plugin_get_ds(const char *name) {
@@ -112,8 +144,8 @@ plugin_ctx_t plugin_set_ctx(plugin_ctx_t ctx) {
 
 cdtime_t plugin_get_interval(void) { return mock_context.interval; }
 
-/* TODO(octo): this function is actually from filter_chain.h, but in order not
- * to tumble down that rabbit hole, we're declaring it here. A better solution
- * would be to hard-code the top-level config keys in daemon/collectd.c to avoid
- * having these references in daemon/configfile.c. */
-int fc_configure(const oconfig_item_t *ci) { return ENOTSUP; }
+int plugin_thread_create(pthread_t *thread, const pthread_attr_t *attr,
+                         void *(*start_routine)(void *), void *arg,
+                         char const *name) {
+  return pthread_create(thread, attr, start_routine, arg);
+}
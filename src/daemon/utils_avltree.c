@@ -589,6 +589,35 @@ c_avl_iterator_t *c_avl_get_iterator(c_avl_tree_t *t) {
   return iter;
 } /* c_avl_iterator_t *c_avl_get_iterator */
 
+c_avl_iterator_t *c_avl_get_iterator_after(c_avl_tree_t *t, const void *key) {
+  c_avl_iterator_t *iter;
+
+  if ((t == NULL) || (key == NULL))
+    return NULL;
+
+  iter = calloc(1, sizeof(*iter));
+  if (iter == NULL)
+    return NULL;
+  iter->tree = t;
+
+  /* Position the iterator on the greatest node less than or equal to "key".
+   * If there is none, "node" stays NULL and c_avl_iterator_next() starts at
+   * the smallest node, which then is greater than "key". */
+  for (c_avl_node_t *n = t->root; n != NULL;) {
+    int cmp = t->compare(key, n->key);
+    if (cmp < 0) {
+      n = n->left;
+    } else {
+      iter->node = n;
+      if (cmp == 0)
+        break;
+      n = n->right;
+    }
+  }
+
+  return iter;
+} /* c_avl_iterator_t *c_avl_get_iterator_after */
+
 int c_avl_iterator_next(c_avl_iterator_t *iter, void **key, void **value) {
   c_avl_node_t *n;
 
@@ -29,15 +29,37 @@
 #include "collectd.h"
 
 #include "common.h"
+#include "configfile.h"
 #include "meta_data.h"
 #include "plugin.h"
 #include "utils_avltree.h"
 #include "utils_cache.h"
+#include "utils_wheel.h"
 
 #include <assert.h>
+#include <fnmatch.h>
+
+/* Entries are put into a timing wheel according to the time at which they
+ * time out. Each slot covers 2^30 ns (about one second) and the wheel covers
+ * about 68 minutes. Entries timing out later are checked once per revolution
+ * of the wheel. */
+#define UC_WHEEL_RESOLUTION (((cdtime_t)1) << 30)
+#define UC_WHEEL_SIZE 4096
+
+/* The trees are ordered by the hash of the identifier first. A lookup therefore
+ * mostly compares integers and calls strcmp() only once the hash matches. */
+typedef struct cache_key_s {
+  uint32_t hash;
+  char const *name;
+} cache_key_t;
 
 typedef struct cache_entry_s {
+  /* Must be the first member: the trees' keys point to it. */
+  cache_key_t key;
   char name[6 * DATA_MAX_NAME_LEN];
+  /* Lengths of the host, plugin, plugin instance, type and type instance
+   * within "name", so the identifier doesn't need to be parsed. */
+  uint8_t ident_len[5];
   size_t values_num;
   gauge_t *values_gauge;
   value_t *values_raw;
@@ -53,6 +75,11 @@ typedef struct cache_entry_s {
   int state;
   int hits;
 
+  /* Result of threshold_search() for this entry, valid if
+   * "threshold_generation" equals the current threshold generation. */
+  struct threshold_s *threshold;
+  unsigned int threshold_generation;
+
   /*
    * +-----+-----+-----+-----+-----+-----+-----+-----+-----+----
    * !  0  !  1  !  2  !  3  !  4  !  5  !  6  !  7  !  8  ! ...
@@ -67,22 +94,125 @@ typedef struct cache_entry_s {
   size_t history_length;
 
   meta_data_t *meta;
+
+  /* Local time at which the entry times out. */
+  cdtime_t timeout;
 } cache_entry_t;
 
+/* The cache is split into "shards", each with its own tree and lock, so that
+ * write threads updating different identifiers don't serialize on a single
+ * lock. An identifier's shard is determined by the hash of its name. */
+typedef struct uc_shard_s {
+  pthread_mutex_t lock;
+  c_avl_tree_t *tree;
+
+  /* Holds each entry of the tree exactly once. Updates only set the entry's
+   * "timeout" without touching the wheel; entries which turn out not to have
+   * timed out when they become due are inserted again. If an entry's interval
+   * shrinks, it is therefore only found once its old timeout has passed. */
+  c_wheel_t *wheel;
+} uc_shard_t;
+
 struct uc_iter_s {
+  size_t shard_index;
   c_avl_iterator_t *iter;
 
-  char *name;
+  cache_key_t *key;
   cache_entry_t *entry;
+
+  /* Set by uc_iterator_set_match(). "ident" holds the parsed identifier of
+   * the current entry if "ident_valid" is true. */
+  _Bool have_match;
+  value_list_t match;
+  size_t match_host_len; /* > 0 if the host pattern is a plain string */
+  value_list_t ident;
+  _Bool ident_valid;
+
+  /* Set by uc_iterator_pause(): the key to continue after. */
+  _Bool paused;
+  cache_key_t resume_key;
+  char resume_name[6 * DATA_MAX_NAME_LEN];
 };
 
-static c_avl_tree_t *cache_tree = NULL;
-static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static uc_shard_t *cache_shards = NULL;
+static size_t cache_shards_num = 0;
+
+static uc_shard_t *uc_get_shard_by_hash(uint32_t hash) /* {{{ */
+{
+  return cache_shards + (hash % cache_shards_num);
+} /* }}} uc_shard_t *uc_get_shard_by_hash */
+
+/* `shard->lock' must be held by the caller. */
+static int uc_get_entry(uc_shard_t *shard, char const *name, /* {{{ */
+                        uint32_t hash, cache_entry_t **ret_ce) {
+  cache_key_t key = {.hash = hash, .name = name};
+
+  return c_avl_get(shard->tree, &key, (void *)ret_ce);
+} /* }}} int uc_get_entry */
+
+/* Returns the identifier of `vl' and its hash. If `vl' is being dispatched by
+ * the calling thread, the identifier has already been formatted and `buffer'
+ * is not used. Returns NULL if formatting the identifier failed. */
+static char const *uc_format_vl(value_list_t const *vl, /* {{{ */
+                                char *buffer, size_t buffer_size,
+                                uint32_t *ret_hash) {
+  vl_ident_t const *ident = plugin_get_vl_ident(vl);
+
+  if (ident != NULL) {
+    *ret_hash = ident->hash;
+    return ident->name;
+  }
+
+  if (FORMAT_VL(buffer, buffer_size, vl) != 0)
+    return NULL;
+
+  *ret_hash = strhash(buffer);
+  return buffer;
+} /* }}} char const *uc_format_vl */
 
-static int cache_compare(const cache_entry_t *a, const cache_entry_t *b) {
+/* Computes the time at which "ce" times out. */
+static void uc_entry_set_timeout(cache_entry_t *ce) /* {{{ */
+{
+  ce->timeout = ce->last_update + ce->interval * timeout_g;
+} /* }}} void uc_entry_set_timeout */
+
+static void uc_entry_set_identifier(cache_entry_t *ce, /* {{{ */
+                                    value_list_t const *vl) {
+  char const *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                          vl->type_instance};
+
+  /* The fields are shorter than DATA_MAX_NAME_LEN, so their lengths fit. */
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++)
+    ce->ident_len[i] = (uint8_t)strlen(fields[i]);
+} /* }}} void uc_entry_set_identifier */
+
+/* Copies the identifier of "ce" to "vl". The name has the form
+ * "host/plugin[-plugin_instance]/type[-type_instance]". */
+static void uc_entry_identifier(cache_entry_t const *ce, /* {{{ */
+                                value_list_t *vl) {
+  char *fields[] = {vl->host, vl->plugin, vl->plugin_instance, vl->type,
+                    vl->type_instance};
+  char const *ptr = ce->name;
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(fields); i++) {
+    size_t len = ce->ident_len[i];
+
+    /* Skip the separator, which is omitted for empty instances. */
+    if ((i > 0) && ((len > 0) || ((i != 2) && (i != 4))))
+      ptr++;
+
+    memcpy(fields[i], ptr, len);
+    fields[i][len] = 0;
+    ptr += len;
+  }
+} /* }}} void uc_entry_identifier */
+
+static int cache_compare(const cache_key_t *a, const cache_key_t *b) {
 #if COLLECT_DEBUG
   assert((a != NULL) && (b != NULL));
 #endif
+  if (a->hash != b->hash)
+    return (a->hash < b->hash) ? -1 : 1;
   return strcmp(a->name, b->name);
 } /* int cache_compare */
 
@@ -138,27 +268,23 @@ static void uc_check_range(const data_set_t *ds, cache_entry_t *ce) {
   }
 } /* void uc_check_range */
 
-static int uc_insert(const data_set_t *ds, const value_list_t *vl,
-                     const char *key) {
-  char *key_copy;
+static int uc_insert(uc_shard_t *shard, const data_set_t *ds,
+                     const value_list_t *vl, const char *key, uint32_t hash,
+                     gauge_t *ret_rates) {
   cache_entry_t *ce;
 
-  /* `cache_lock' has been locked by `uc_update' */
-
-  key_copy = strdup(key);
-  if (key_copy == NULL) {
-    ERROR("uc_insert: strdup failed.");
-    return -1;
-  }
+  /* `shard->lock' has been locked by `uc_update_rates' */
 
   ce = cache_alloc(ds->ds_num);
   if (ce == NULL) {
-    sfree(key_copy);
     ERROR("uc_insert: cache_alloc (%zu) failed.", ds->ds_num);
     return -1;
   }
 
   sstrncpy(ce->name, key, sizeof(ce->name));
+  ce->key.hash = hash;
+  ce->key.name = ce->name;
+  uc_entry_set_identifier(ce, vl);
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     switch (ds->ds[i].type) {
@@ -189,7 +315,6 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
       /* This shouldn't happen. */
       ERROR("uc_insert: Don't know how to handle data source type %i.",
             ds->ds[i].type);
-      sfree(key_copy);
       cache_free(ce);
       return -1;
     } /* switch (ds->ds[i].type) */
@@ -203,20 +328,64 @@ static int uc_insert(const data_set_t *ds, const value_list_t *vl,
   ce->interval = vl->interval;
   ce->state = STATE_OKAY;
 
-  if (c_avl_insert(cache_tree, key_copy, ce) != 0) {
-    sfree(key_copy);
+  if (c_avl_insert(shard->tree, &ce->key, ce) != 0) {
+    cache_free(ce);
     ERROR("uc_insert: c_avl_insert failed.");
     return -1;
   }
 
+  uc_entry_set_timeout(ce);
+  if (c_wheel_insert(shard->wheel, ce, ce->timeout) != 0) {
+    c_avl_remove(shard->tree, &ce->key, NULL, NULL);
+    cache_free(ce);
+    ERROR("uc_insert: c_wheel_insert failed.");
+    return -1;
+  }
+
+  if (ret_rates != NULL)
+    memcpy(ret_rates, ce->values_gauge, ds->ds_num * sizeof(*ret_rates));
+
   DEBUG("uc_insert: Added %s to the cache.", key);
   return 0;
 } /* int uc_insert */
 
 int uc_init(void) {
-  if (cache_tree == NULL)
-    cache_tree =
+  long shards_num;
+
+  if (cache_shards != NULL)
+    return 0;
+
+  shards_num = global_option_get_long("CacheShards", /* default = */ 1);
+  if (shards_num < 1) {
+    ERROR("CacheShards must be positive.");
+    shards_num = 1;
+  }
+
+  cache_shards = calloc((size_t)shards_num, sizeof(*cache_shards));
+  if (cache_shards == NULL) {
+    ERROR("uc_init: calloc failed.");
+    return ENOMEM;
+  }
+
+  for (size_t i = 0; i < (size_t)shards_num; i++) {
+    pthread_mutex_init(&cache_shards[i].lock, /* attr = */ NULL);
+    cache_shards[i].tree =
         c_avl_create((int (*)(const void *, const void *))cache_compare);
+    cache_shards[i].wheel =
+        c_wheel_create(UC_WHEEL_RESOLUTION, UC_WHEEL_SIZE, cdtime());
+    if ((cache_shards[i].tree == NULL) || (cache_shards[i].wheel == NULL)) {
+      ERROR("uc_init: Creating cache shard %zu failed.", i);
+      for (size_t j = 0; j <= i; j++) {
+        if (cache_shards[j].tree != NULL)
+          c_avl_destroy(cache_shards[j].tree);
+        c_wheel_destroy(cache_shards[j].wheel);
+        pthread_mutex_destroy(&cache_shards[j].lock);
+      }
+      sfree(cache_shards);
+      return ENOMEM;
+    }
+  }
+  cache_shards_num = (size_t)shards_num;
 
   return 0;
 } /* int uc_init */
@@ -224,44 +393,64 @@ int uc_init(void) {
 int uc_check_timeout(void) {
   struct {
     char *key;
-    cdtime_t time;
-    cdtime_t interval;
+    uint32_t hash;
+    value_list_t vl;
   } *expired = NULL;
   size_t expired_num = 0;
+  size_t expired_size = 0;
 
-  pthread_mutex_lock(&cache_lock);
   cdtime_t now = cdtime();
 
-  /* Build a list of entries to be flushed */
-  c_avl_iterator_t *iter = c_avl_get_iterator(cache_tree);
-  char *key = NULL;
-  cache_entry_t *ce = NULL;
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&ce) == 0) {
-    /* If the entry is fresh enough, continue. */
-    if ((now - ce->last_update) < (ce->interval * timeout_g))
-      continue;
+  /* Build a list of entries to be flushed. Only the slots of the timing
+   * wheel which have passed since the last call are looked at. The shards
+   * are locked one after the other, so only updates of a single shard are
+   * blocked at a time. */
+  for (size_t shard_index = 0; shard_index < cache_shards_num; shard_index++) {
+    uc_shard_t *shard = cache_shards + shard_index;
+    cache_entry_t *ce;
+
+    pthread_mutex_lock(&shard->lock);
+
+    /* Inserting an entry right after getting one from the wheel reuses the
+     * wheel's memory, so it does not fail. */
+    while ((ce = c_wheel_get_due(shard->wheel, now)) != NULL) {
+      /* Has been updated since it was put into the wheel. */
+      if (ce->timeout > now) {
+        c_wheel_insert(shard->wheel, ce, ce->timeout);
+        continue;
+      }
 
-    void *tmp = realloc(expired, (expired_num + 1) * sizeof(*expired));
-    if (tmp == NULL) {
-      ERROR("uc_check_timeout: realloc failed.");
-      continue;
-    }
-    expired = tmp;
+      if (expired_num >= expired_size) {
+        size_t new_size = (expired_size == 0) ? 64 : 2 * expired_size;
+        void *tmp = realloc(expired, new_size * sizeof(*expired));
+        if (tmp == NULL) {
+          ERROR("uc_check_timeout: realloc failed.");
+          c_wheel_insert(shard->wheel, ce, now + 1);
+          break;
+        }
+        expired = tmp;
+        expired_size = new_size;
+      }
 
-    expired[expired_num].key = strdup(key);
-    expired[expired_num].time = ce->last_time;
-    expired[expired_num].interval = ce->interval;
+      expired[expired_num].key = strdup(ce->name);
+      if (expired[expired_num].key == NULL) {
+        ERROR("uc_check_timeout: strdup failed.");
+        c_wheel_insert(shard->wheel, ce, now + 1);
+        break;
+      }
+      expired[expired_num].hash = ce->key.hash;
 
-    if (expired[expired_num].key == NULL) {
-      ERROR("uc_check_timeout: strdup failed.");
-      continue;
-    }
+      value_list_t *vl = &expired[expired_num].vl;
+      memset(vl, 0, sizeof(*vl));
+      vl->time = ce->last_time;
+      vl->interval = ce->interval;
+      uc_entry_identifier(ce, vl);
 
-    expired_num++;
-  } /* while (c_avl_iterator_next) */
+      expired_num++;
+    } /* while (c_wheel_get_due) */
 
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
+  } /* for (shard_index) */
 
   if (expired_num == 0) {
     sfree(expired);
@@ -273,62 +462,69 @@ int uc_check_timeout(void) {
    * including plugin specific meta data, rates, history, …. This must be done
    * without holding the lock, otherwise we will run into a deadlock if a
    * plugin calls the cache interface. */
+  for (size_t i = 0; i < expired_num; i++)
+    plugin_dispatch_missing(&expired[i].vl);
+
+  /* Now actually remove all the values from the cache. Values which have been
+   * updated in the meantime are kept. */
   for (size_t i = 0; i < expired_num; i++) {
-    value_list_t vl = {
-        .time = expired[i].time, .interval = expired[i].interval,
-    };
+    uc_shard_t *shard = uc_get_shard_by_hash(expired[i].hash);
+    cache_key_t key = {.hash = expired[i].hash, .name = expired[i].key};
+    cache_key_t *ret_key = NULL;
+    cache_entry_t *value = NULL;
 
-    if (parse_identifier_vl(expired[i].key, &vl) != 0) {
-      ERROR("uc_check_timeout: parse_identifier_vl (\"%s\") failed.",
-            expired[i].key);
+    pthread_mutex_lock(&shard->lock);
+    if ((uc_get_entry(shard, expired[i].key, expired[i].hash, &value) == 0) &&
+        (value->timeout > now)) {
+      /* The entry was taken out of the wheel above. */
+      if (c_wheel_insert(shard->wheel, value, value->timeout) != 0)
+        ERROR("uc_check_timeout: c_wheel_insert (\"%s\") failed.",
+              expired[i].key);
+      pthread_mutex_unlock(&shard->lock);
+      sfree(expired[i].key);
       continue;
     }
 
-    plugin_dispatch_missing(&vl);
-  } /* for (i = 0; i < expired_num; i++) */
-
-  /* Now actually remove all the values from the cache. We don't re-evaluate
-   * the timestamp again, so in theory it is possible we remove a value after
-   * it is updated here. */
-  pthread_mutex_lock(&cache_lock);
-  for (size_t i = 0; i < expired_num; i++) {
-    char *key = NULL;
-    cache_entry_t *value = NULL;
-
-    if (c_avl_remove(cache_tree, expired[i].key, (void *)&key,
-                     (void *)&value) != 0) {
+    if (c_avl_remove(shard->tree, &key, (void *)&ret_key, (void *)&value) !=
+        0) {
+      pthread_mutex_unlock(&shard->lock);
       ERROR("uc_check_timeout: c_avl_remove (\"%s\") failed.", expired[i].key);
       sfree(expired[i].key);
       continue;
     }
-    sfree(key);
+    pthread_mutex_unlock(&shard->lock);
+
     cache_free(value);
 
     sfree(expired[i].key);
   } /* for (i = 0; i < expired_num; i++) */
-  pthread_mutex_unlock(&cache_lock);
 
   sfree(expired);
   return 0;
 } /* int uc_check_timeout */
 
-int uc_update(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+int uc_update_rates(const data_set_t *ds, const value_list_t *vl,
+                    gauge_t *ret_rates) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   cache_entry_t *ce = NULL;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_update: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_update: formatting the identifier failed.");
     return -1;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
+  status = uc_get_entry(shard, name, hash, &ce);
   if (status != 0) /* entry does not yet exist */
   {
-    status = uc_insert(ds, vl, name);
-    pthread_mutex_unlock(&cache_lock);
+    status = uc_insert(shard, ds, vl, name, hash, ret_rates);
+    pthread_mutex_unlock(&shard->lock);
     return status;
   }
 
@@ -336,7 +532,7 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   assert(ce->values_num == ds->ds_num);
 
   if (ce->last_time >= vl->time) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     NOTICE("uc_update: Value too old: name = %s; value time = %.3f; "
            "last cache update = %.3f;",
            name, CDTIME_T_TO_DOUBLE(vl->time),
@@ -375,7 +571,7 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
 
     default:
       /* This shouldn't happen. */
-      pthread_mutex_unlock(&cache_lock);
+      pthread_mutex_unlock(&shard->lock);
       ERROR("uc_update: Don't know how to handle data source type %i.",
             ds->ds[i].type);
       return -1;
@@ -402,22 +598,31 @@ int uc_update(const data_set_t *ds, const value_list_t *vl) {
   ce->last_time = vl->time;
   ce->last_update = cdtime();
   ce->interval = vl->interval;
+  uc_entry_set_timeout(ce);
 
-  pthread_mutex_unlock(&cache_lock);
+  if (ret_rates != NULL)
+    memcpy(ret_rates, ce->values_gauge, ds->ds_num * sizeof(*ret_rates));
+
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
+} /* int uc_update_rates */
+
+int uc_update(const data_set_t *ds, const value_list_t *vl) {
+  return uc_update_rates(ds, vl, /* ret_rates = */ NULL);
 } /* int uc_update */
 
-int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
-                        size_t *ret_values_num) {
+static int uc_get_rate_by_hash(const char *name, uint32_t hash, /* {{{ */
+                               gauge_t **ret_values, size_t *ret_values_num) {
   gauge_t *ret = NULL;
   size_t ret_num = 0;
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
     assert(ce != NULL);
 
     /* remove missing values from getval */
@@ -441,7 +646,7 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   if (status == 0) {
     *ret_values = ret;
@@ -449,20 +654,29 @@ int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
   }
 
   return status;
+} /* }}} int uc_get_rate_by_hash */
+
+int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
+                        size_t *ret_values_num) {
+  return uc_get_rate_by_hash(name, strhash(name), ret_values,
+                             ret_values_num);
 } /* gauge_t *uc_get_rate_by_name */
 
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   gauge_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_rate: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("utils_cache: uc_get_rate: formatting the identifier failed.");
     return NULL;
   }
 
-  status = uc_get_rate_by_name(name, &ret, &ret_num);
+  status = uc_get_rate_by_hash(name, hash, &ret, &ret_num);
   if (status != 0)
     return NULL;
 
@@ -479,16 +693,91 @@ gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl) {
   return ret;
 } /* gauge_t *uc_get_rate */
 
-int uc_get_value_by_name(const char *name, value_t **ret_values,
-                         size_t *ret_values_num) {
+int uc_get_rates(const data_set_t *ds, const value_list_t *vl,
+                 gauge_t *ret_rates) {
+  struct threshold_s *th;
+  unsigned int generation;
+
+  return uc_get_rate_threshold(ds, vl, ret_rates, &th, &generation);
+} /* int uc_get_rates */
+
+int uc_get_rate_threshold(const data_set_t *ds, const value_list_t *vl,
+                          gauge_t *ret_rates, struct threshold_s **ret_th,
+                          unsigned int *ret_generation) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
+  cache_entry_t *ce = NULL;
+  int status = 0;
+
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_get_rate_threshold: formatting the identifier failed.");
+    return -1;
+  }
+
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
+
+  if (uc_get_entry(shard, name, hash, &ce) != 0) {
+    status = -1;
+  } else if (ce->values_num != ds->ds_num) {
+    ERROR("uc_get_rate_threshold: ds[%s] has %zu values, but the cache "
+          "entry has %zu.",
+          ds->type, ds->ds_num, ce->values_num);
+    status = -1;
+  } else if (ce->state == STATE_MISSING) {
+    status = -1;
+  } else {
+    memcpy(ret_rates, ce->values_gauge, ce->values_num * sizeof(*ret_rates));
+    *ret_th = ce->threshold;
+    *ret_generation = ce->threshold_generation;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return status;
+} /* int uc_get_rate_threshold */
+
+int uc_set_threshold(const value_list_t *vl, struct threshold_s *th,
+                     unsigned int generation) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
+  cache_entry_t *ce = NULL;
+  int status = -1;
+
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_set_threshold: formatting the identifier failed.");
+    return -1;
+  }
+
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
+
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
+    ce->threshold = th;
+    ce->threshold_generation = generation;
+    status = 0;
+  }
+
+  pthread_mutex_unlock(&shard->lock);
+
+  return status;
+} /* int uc_set_threshold */
+
+static int uc_get_value_by_hash(const char *name, uint32_t hash, /* {{{ */
+                                value_t **ret_values, size_t *ret_values_num) {
   value_t *ret = NULL;
   size_t ret_num = 0;
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *) &ce) == 0) {
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
     assert(ce != NULL);
 
     /* remove missing values from getval */
@@ -510,7 +799,7 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
     status = -1;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   if (status == 0) {
     *ret_values = ret;
@@ -518,20 +807,29 @@ int uc_get_value_by_name(const char *name, value_t **ret_values,
   }
 
   return (status);
+} /* }}} int uc_get_value_by_hash */
+
+int uc_get_value_by_name(const char *name, value_t **ret_values,
+                         size_t *ret_values_num) {
+  return uc_get_value_by_hash(name, strhash(name), ret_values,
+                              ret_values_num);
 } /* int uc_get_value_by_name */
 
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   value_t *ret = NULL;
   size_t ret_num = 0;
   int status;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_value: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("utils_cache: uc_get_value: formatting the identifier failed.");
     return (NULL);
   }
 
-  status = uc_get_value_by_name(name, &ret, &ret_num);
+  status = uc_get_value_by_hash(name, hash, &ret, &ret_num);
   if (status != 0)
     return (NULL);
 
@@ -551,16 +849,51 @@ value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl) {
 size_t uc_get_size(void) {
   size_t size_arrays = 0;
 
-  pthread_mutex_lock(&cache_lock);
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  pthread_mutex_unlock(&cache_lock);
+  for (size_t i = 0; i < cache_shards_num; i++) {
+    pthread_mutex_lock(&cache_shards[i].lock);
+    size_arrays += (size_t)c_avl_size(cache_shards[i].tree);
+    pthread_mutex_unlock(&cache_shards[i].lock);
+  }
 
   return size_arrays;
 }
 
+struct uc_name_time_s {
+  char *name;
+  cdtime_t time;
+};
+
+static int uc_name_time_compare(const void *a, const void *b) /* {{{ */
+{
+  return strcmp(((const struct uc_name_time_s *)a)->name,
+                ((const struct uc_name_time_s *)b)->name);
+} /* }}} int uc_name_time_compare */
+
+static void uc_sort_names(char **names, cdtime_t *times, /* {{{ */
+                          size_t number) {
+  struct uc_name_time_s *tmp = calloc(number, sizeof(*tmp));
+  if (tmp == NULL) {
+    ERROR("uc_get_names: calloc failed; the list will not be sorted.");
+    return;
+  }
+
+  for (size_t i = 0; i < number; i++) {
+    tmp[i].name = names[i];
+    tmp[i].time = (times != NULL) ? times[i] : 0;
+  }
+  qsort(tmp, number, sizeof(*tmp), uc_name_time_compare);
+  for (size_t i = 0; i < number; i++) {
+    names[i] = tmp[i].name;
+    if (times != NULL)
+      times[i] = tmp[i].time;
+  }
+
+  sfree(tmp);
+} /* }}} void uc_sort_names */
+
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   c_avl_iterator_t *iter;
-  char *key;
+  cache_key_t *key;
   cache_entry_t *value;
 
   char **names = NULL;
@@ -573,50 +906,60 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
   if ((ret_names == NULL) || (ret_number == NULL))
     return -1;
 
-  pthread_mutex_lock(&cache_lock);
-
-  size_arrays = (size_t)c_avl_size(cache_tree);
-  if (size_arrays < 1) {
-    /* Handle the "no values" case here, to avoid the error message when
-     * calloc() returns NULL. */
-    pthread_mutex_unlock(&cache_lock);
-    return 0;
-  }
+  for (size_t shard_index = 0;
+       (status == 0) && (shard_index < cache_shards_num); shard_index++) {
+    uc_shard_t *shard = cache_shards + shard_index;
 
-  names = calloc(size_arrays, sizeof(*names));
-  times = calloc(size_arrays, sizeof(*times));
-  if ((names == NULL) || (times == NULL)) {
-    ERROR("uc_get_names: calloc failed.");
-    sfree(names);
-    sfree(times);
-    pthread_mutex_unlock(&cache_lock);
-    return ENOMEM;
-  }
+    pthread_mutex_lock(&shard->lock);
 
-  iter = c_avl_get_iterator(cache_tree);
-  while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
-    /* remove missing values when list values */
-    if (value->state == STATE_MISSING)
+    size_t shard_size = (size_t)c_avl_size(shard->tree);
+    if (shard_size < 1) {
+      /* Handle the "no values" case here, to avoid the error message when
+       * realloc() returns NULL. */
+      pthread_mutex_unlock(&shard->lock);
       continue;
+    }
 
-    /* c_avl_size does not return a number smaller than the number of elements
-     * returned by c_avl_iterator_next. */
-    assert(number < size_arrays);
-
-    if (ret_times != NULL)
-      times[number] = value->last_time;
-
-    names[number] = strdup(key);
-    if (names[number] == NULL) {
-      status = -1;
+    char **tmp_names = realloc(names, (number + shard_size) * sizeof(*names));
+    if (tmp_names != NULL)
+      names = tmp_names;
+    cdtime_t *tmp_times =
+        realloc(times, (number + shard_size) * sizeof(*times));
+    if (tmp_times != NULL)
+      times = tmp_times;
+    if ((tmp_names == NULL) || (tmp_times == NULL)) {
+      ERROR("uc_get_names: realloc failed.");
+      pthread_mutex_unlock(&shard->lock);
+      status = ENOMEM;
       break;
     }
+    size_arrays = number + shard_size;
+
+    iter = c_avl_get_iterator(shard->tree);
+    while (c_avl_iterator_next(iter, (void *)&key, (void *)&value) == 0) {
+      /* remove missing values when list values */
+      if (value->state == STATE_MISSING)
+        continue;
+
+      /* c_avl_size does not return a number smaller than the number of elements
+       * returned by c_avl_iterator_next. */
+      assert(number < size_arrays);
+
+      if (ret_times != NULL)
+        times[number] = value->last_time;
+
+      names[number] = strdup(value->name);
+      if (names[number] == NULL) {
+        status = -1;
+        break;
+      }
 
-    number++;
-  } /* while (c_avl_iterator_next) */
+      number++;
+    } /* while (c_avl_iterator_next) */
 
-  c_avl_iterator_destroy(iter);
-  pthread_mutex_unlock(&cache_lock);
+    c_avl_iterator_destroy(iter);
+    pthread_mutex_unlock(&shard->lock);
+  } /* for (shard_index) */
 
   if (status != 0) {
     for (size_t i = 0; i < number; i++) {
@@ -625,9 +968,19 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
     sfree(names);
     sfree(times);
 
-    return -1;
+    return (status == ENOMEM) ? ENOMEM : -1;
+  }
+
+  if (number == 0) {
+    sfree(names);
+    sfree(times);
+    return 0;
   }
 
+  /* The trees are ordered by hash; sort the names so that users, e.g.
+   * LISTVAL, get a stable, alphabetical list. */
+  uc_sort_names(names, times, number);
+
   *ret_names = names;
   if (ret_times != NULL)
     *ret_times = times;
@@ -639,65 +992,75 @@ int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number) {
 } /* int uc_get_names */
 
 int uc_get_state(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   cache_entry_t *ce = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_state: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_get_state: formatting the identifier failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
     assert(ce != NULL);
     ret = ce->state;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_get_state */
 
 int uc_set_state(const data_set_t *ds, const value_list_t *vl, int state) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_state: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_set_state: formatting the identifier failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
     assert(ce != NULL);
     ret = ce->state;
     ce->state = state;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_state */
 
-int uc_get_history_by_name(const char *name, gauge_t *ret_history,
-                           size_t num_steps, size_t num_ds) {
+static int uc_get_history_by_hash(const char *name, uint32_t hash, /* {{{ */
+                                  gauge_t *ret_history, size_t num_steps,
+                                  size_t num_ds) {
   cache_entry_t *ce = NULL;
   int status = 0;
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
+  status = uc_get_entry(shard, name, hash, &ce);
   if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -ENOENT;
   }
 
   if (((size_t)ce->values_num) != num_ds) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return -EINVAL;
   }
 
@@ -709,7 +1072,7 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
     tmp =
         realloc(ce->history, sizeof(*ce->history) * num_steps * ce->values_num);
     if (tmp == NULL) {
-      pthread_mutex_unlock(&cache_lock);
+      pthread_mutex_unlock(&shard->lock);
       return -ENOMEM;
     }
 
@@ -738,87 +1101,108 @@ int uc_get_history_by_name(const char *name, gauge_t *ret_history,
            sizeof(*ret_history) * num_ds);
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return 0;
+} /* }}} int uc_get_history_by_hash */
+
+int uc_get_history_by_name(const char *name, gauge_t *ret_history,
+                           size_t num_steps, size_t num_ds) {
+  return uc_get_history_by_hash(name, strhash(name), ret_history, num_steps,
+                                num_ds);
 } /* int uc_get_history_by_name */
 
 int uc_get_history(const data_set_t *ds, const value_list_t *vl,
                    gauge_t *ret_history, size_t num_steps, size_t num_ds) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("utils_cache: uc_get_history: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("utils_cache: uc_get_history: formatting the identifier failed.");
     return -1;
   }
 
-  return uc_get_history_by_name(name, ret_history, num_steps, num_ds);
+  return uc_get_history_by_hash(name, hash, ret_history, num_steps, num_ds);
 } /* int uc_get_history */
 
 int uc_get_hits(const data_set_t *ds, const value_list_t *vl) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   cache_entry_t *ce = NULL;
   int ret = STATE_ERROR;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_get_hits: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_get_hits: formatting the identifier failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_get_hits */
 
 int uc_set_hits(const data_set_t *ds, const value_list_t *vl, int hits) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_set_hits: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_set_hits: formatting the identifier failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = hits;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_set_hits */
 
 int uc_inc_hits(const data_set_t *ds, const value_list_t *vl, int step) {
-  char name[6 * DATA_MAX_NAME_LEN];
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   cache_entry_t *ce = NULL;
   int ret = -1;
 
-  if (FORMAT_VL(name, sizeof(name), vl) != 0) {
-    ERROR("uc_inc_hits: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("uc_inc_hits: formatting the identifier failed.");
     return STATE_ERROR;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  if (c_avl_get(cache_tree, name, (void *)&ce) == 0) {
+  if (uc_get_entry(shard, name, hash, &ce) == 0) {
     assert(ce != NULL);
     ret = ce->hits;
     ce->hits = ret + step;
   }
 
-  pthread_mutex_unlock(&cache_lock);
+  pthread_mutex_unlock(&shard->lock);
 
   return ret;
 } /* int uc_inc_hits */
@@ -833,10 +1217,12 @@ uc_iter_t *uc_get_iterator(void) {
   if (iter == NULL)
     return NULL;
 
-  pthread_mutex_lock(&cache_lock);
+  iter->shard_index = 0;
+  pthread_mutex_lock(&cache_shards[0].lock);
 
-  iter->iter = c_avl_get_iterator(cache_tree);
+  iter->iter = c_avl_get_iterator(cache_shards[0].tree);
   if (iter->iter == NULL) {
+    pthread_mutex_unlock(&cache_shards[0].lock);
     free(iter);
     return NULL;
   }
@@ -844,37 +1230,143 @@ uc_iter_t *uc_get_iterator(void) {
   return iter;
 } /* uc_iter_t *uc_get_iterator */
 
+/* Returns true if the name of "ce" matches the patterns set with
+ * uc_iterator_set_match(). Fills "iter->ident" as a side effect. */
+static _Bool uc_iterator_match(uc_iter_t *iter, cache_entry_t *ce) /* {{{ */
+{
+  value_list_t *m = &iter->match;
+  value_list_t *vl = &iter->ident;
+
+  /* Check plain host names before parsing the identifier. With many hosts,
+   * most entries are rejected here. */
+  if ((iter->match_host_len > 0) &&
+      ((strncmp(ce->name, m->host, iter->match_host_len) != 0) ||
+       (ce->name[iter->match_host_len] != '/')))
+    return 0;
+
+  uc_entry_identifier(ce, vl);
+  iter->ident_valid = 1;
+
+  return (fnmatch(m->host, vl->host, 0) == 0) &&
+         (fnmatch(m->plugin, vl->plugin, 0) == 0) &&
+         (fnmatch(m->plugin_instance, vl->plugin_instance, 0) == 0) &&
+         (fnmatch(m->type, vl->type, 0) == 0) &&
+         (fnmatch(m->type_instance, vl->type_instance, 0) == 0);
+} /* }}} _Bool uc_iterator_match */
+
 int uc_iterator_next(uc_iter_t *iter, char **ret_name) {
   int status;
 
   if (iter == NULL)
     return -1;
 
-  while ((status = c_avl_iterator_next(iter->iter, (void *)&iter->name,
-                                       (void *)&iter->entry)) == 0) {
-    if (iter->entry->state == STATE_MISSING)
-      continue;
+  if (iter->paused) {
+    uc_shard_t *shard = cache_shards + iter->shard_index;
+
+    pthread_mutex_lock(&shard->lock);
+    iter->iter = c_avl_get_iterator_after(shard->tree, &iter->resume_key);
+    if (iter->iter == NULL) {
+      pthread_mutex_unlock(&shard->lock);
+      return -1;
+    }
+    iter->paused = 0;
+  }
+
+  if (iter->iter == NULL)
+    return -1;
+
+  while (42) {
+    status = c_avl_iterator_next(iter->iter, (void *)&iter->key,
+                                 (void *)&iter->entry);
+    if (status == 0) {
+      iter->ident_valid = 0;
+      if (iter->entry->state == STATE_MISSING)
+        continue;
+      if (iter->have_match && !uc_iterator_match(iter, iter->entry))
+        continue;
+      break;
+    }
+
+    /* Move on to the next shard. */
+    c_avl_iterator_destroy(iter->iter);
+    iter->iter = NULL;
+    pthread_mutex_unlock(&cache_shards[iter->shard_index].lock);
+
+    iter->shard_index++;
+    if (iter->shard_index >= cache_shards_num)
+      break;
 
-    break;
+    pthread_mutex_lock(&cache_shards[iter->shard_index].lock);
+    iter->iter = c_avl_get_iterator(cache_shards[iter->shard_index].tree);
+    if (iter->iter == NULL) {
+      pthread_mutex_unlock(&cache_shards[iter->shard_index].lock);
+      break;
+    }
   }
   if (status != 0) {
-    iter->name = NULL;
+    iter->key = NULL;
     iter->entry = NULL;
     return -1;
   }
 
   if (ret_name != NULL)
-    *ret_name = iter->name;
+    *ret_name = iter->entry->name;
 
   return 0;
 } /* int uc_iterator_next */
 
+int uc_iterator_set_match(uc_iter_t *iter, value_list_t const *match) {
+  if ((iter == NULL) || (match == NULL))
+    return -1;
+
+  sstrncpy(iter->match.host, match->host, sizeof(iter->match.host));
+  sstrncpy(iter->match.plugin, match->plugin, sizeof(iter->match.plugin));
+  sstrncpy(iter->match.plugin_instance, match->plugin_instance,
+           sizeof(iter->match.plugin_instance));
+  sstrncpy(iter->match.type, match->type, sizeof(iter->match.type));
+  sstrncpy(iter->match.type_instance, match->type_instance,
+           sizeof(iter->match.type_instance));
+
+  iter->match_host_len = 0;
+  if (strpbrk(iter->match.host, "*?[\\") == NULL)
+    iter->match_host_len = strlen(iter->match.host);
+
+  iter->have_match = 1;
+  return 0;
+} /* int uc_iterator_set_match */
+
+int uc_iterator_pause(uc_iter_t *iter) {
+  if ((iter == NULL) || (iter->iter == NULL) || iter->paused)
+    return -1;
+
+  /* Not positioned on an entry yet: simply start over. */
+  if (iter->key == NULL) {
+    iter->resume_key.hash = 0;
+    iter->resume_name[0] = 0;
+  } else {
+    iter->resume_key.hash = iter->key->hash;
+    sstrncpy(iter->resume_name, iter->key->name, sizeof(iter->resume_name));
+  }
+  iter->resume_key.name = iter->resume_name;
+
+  c_avl_iterator_destroy(iter->iter);
+  iter->iter = NULL;
+  pthread_mutex_unlock(&cache_shards[iter->shard_index].lock);
+
+  iter->key = NULL;
+  iter->entry = NULL;
+  iter->paused = 1;
+  return 0;
+} /* int uc_iterator_pause */
+
 void uc_iterator_destroy(uc_iter_t *iter) {
   if (iter == NULL)
     return;
 
-  c_avl_iterator_destroy(iter->iter);
-  pthread_mutex_unlock(&cache_lock);
+  if (iter->iter != NULL) {
+    c_avl_iterator_destroy(iter->iter);
+    pthread_mutex_unlock(&cache_shards[iter->shard_index].lock);
+  }
 
   free(iter);
 } /* void uc_iterator_destroy */
@@ -898,7 +1390,7 @@ int uc_iterator_get_values(uc_iter_t *iter, value_t **ret_values,
   if (*ret_values == NULL)
     return -1;
   for (size_t i = 0; i < iter->entry->values_num; ++i)
-    *ret_values[i] = iter->entry->values_raw[i];
+    (*ret_values)[i] = iter->entry->values_raw[i];
 
   *ret_num = iter->entry->values_num;
 
@@ -913,27 +1405,50 @@ int uc_iterator_get_interval(uc_iter_t *iter, cdtime_t *ret_interval) {
   return 0;
 } /* int uc_iterator_get_name */
 
+int uc_iterator_get_identifier(uc_iter_t *iter, value_list_t *vl) {
+  if ((iter == NULL) || (iter->entry == NULL) || (vl == NULL))
+    return -1;
+
+  if (!iter->ident_valid) {
+    uc_entry_identifier(iter->entry, &iter->ident);
+    iter->ident_valid = 1;
+  }
+
+  sstrncpy(vl->host, iter->ident.host, sizeof(vl->host));
+  sstrncpy(vl->plugin, iter->ident.plugin, sizeof(vl->plugin));
+  sstrncpy(vl->plugin_instance, iter->ident.plugin_instance,
+           sizeof(vl->plugin_instance));
+  sstrncpy(vl->type, iter->ident.type, sizeof(vl->type));
+  sstrncpy(vl->type_instance, iter->ident.type_instance,
+           sizeof(vl->type_instance));
+  return 0;
+} /* int uc_iterator_get_identifier */
+
 /*
  * Meta data interface
  */
-/* XXX: This function will acquire `cache_lock' but will not free it! */
-static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
-{
-  char name[6 * DATA_MAX_NAME_LEN];
+/* XXX: This function will acquire the shard's lock but will not free it! The
+ * shard is returned in `ret_shard'. */
+static meta_data_t *uc_get_meta(const value_list_t *vl, /* {{{ */
+                                uc_shard_t **ret_shard) {
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
   cache_entry_t *ce = NULL;
   int status;
 
-  status = FORMAT_VL(name, sizeof(name), vl);
-  if (status != 0) {
-    ERROR("utils_cache: uc_get_meta: FORMAT_VL failed.");
+  name = uc_format_vl(vl, buffer, sizeof(buffer), &hash);
+  if (name == NULL) {
+    ERROR("utils_cache: uc_get_meta: formatting the identifier failed.");
     return NULL;
   }
 
-  pthread_mutex_lock(&cache_lock);
+  uc_shard_t *shard = uc_get_shard_by_hash(hash);
+  pthread_mutex_lock(&shard->lock);
 
-  status = c_avl_get(cache_tree, name, (void *)&ce);
+  status = uc_get_entry(shard, name, hash, &ce);
   if (status != 0) {
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
     return NULL;
   }
   assert(ce != NULL);
@@ -942,8 +1457,9 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
     ce->meta = meta_data_create();
 
   if (ce->meta == NULL)
-    pthread_mutex_unlock(&cache_lock);
+    pthread_mutex_unlock(&shard->lock);
 
+  *ret_shard = shard;
   return ce->meta;
 } /* }}} meta_data_t *uc_get_meta */
 
@@ -952,12 +1468,13 @@ static meta_data_t *uc_get_meta(const value_list_t *vl) /* {{{ */
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
     meta_data_t *meta;                                                         \
+    uc_shard_t *shard;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key);                                         \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
 int uc_meta_data_exists(const value_list_t *vl,
@@ -972,12 +1489,13 @@ int uc_meta_data_exists(const value_list_t *vl,
 #define UC_WRAP(wrap_function)                                                 \
   {                                                                            \
     meta_data_t *meta;                                                         \
+    uc_shard_t *shard;                                                         \
     int status;                                                                \
-    meta = uc_get_meta(vl);                                                    \
+    meta = uc_get_meta(vl, &shard);                                            \
     if (meta == NULL)                                                          \
       return -1;                                                               \
     status = wrap_function(meta, key, value);                                  \
-    pthread_mutex_unlock(&cache_lock);                                         \
+    pthread_mutex_unlock(&shard->lock);                                        \
     return status;                                                             \
   }
         int uc_meta_data_add_string(const value_list_t *vl, const char *key,
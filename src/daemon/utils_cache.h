@@ -39,12 +39,32 @@
 int uc_init(void);
 int uc_check_timeout(void);
 int uc_update(const data_set_t *ds, const value_list_t *vl);
+/* Like uc_update(), but also copies the rates computed for "vl" to
+ * "ret_rates", which must be large enough for ds->ds_num values. */
+int uc_update_rates(const data_set_t *ds, const value_list_t *vl,
+                    gauge_t *ret_rates);
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num);
 gauge_t *uc_get_rate(const data_set_t *ds, const value_list_t *vl);
+/* Like uc_get_rate(), but copies the rates to "ret_rates", which must be large
+ * enough for ds->ds_num values, instead of allocating an array. */
+int uc_get_rates(const data_set_t *ds, const value_list_t *vl,
+                 gauge_t *ret_rates);
 int uc_get_value_by_name(const char *name, value_t **ret_values, size_t *ret_values_num);
 value_t *uc_get_value(const data_set_t *ds, const value_list_t *vl);
 
+/* The threshold found for a value list is memoized in its cache entry, along
+ * with the threshold generation it is valid for (see utils_threshold.h).
+ * uc_get_rate_threshold() copies the rates to "ret_rates", which must be large
+ * enough for ds->ds_num values, and returns the memoized threshold with a
+ * single lookup. An entry which has never been set has generation zero. */
+struct threshold_s;
+int uc_get_rate_threshold(const data_set_t *ds, const value_list_t *vl,
+                          gauge_t *ret_rates, struct threshold_s **ret_th,
+                          unsigned int *ret_generation);
+int uc_set_threshold(const value_list_t *vl, struct threshold_s *th,
+                     unsigned int generation);
+
 size_t uc_get_size(void);
 int uc_get_names(char ***ret_names, cdtime_t **ret_times, size_t *ret_number);
 
@@ -99,6 +119,38 @@ uc_iter_t *uc_get_iterator(void);
 int uc_iterator_next(uc_iter_t *iter, char **ret_name);
 void uc_iterator_destroy(uc_iter_t *iter);
 
+/*
+ * NAME
+ *   uc_iterator_set_match
+ *
+ * DESCRIPTION
+ *   Restrict the iterator to entries whose host, plugin, plugin instance,
+ *   type and type instance match the shell wildcard patterns (see fnmatch(3))
+ *   in the respective fields of `match'. Entries are matched while the cache
+ *   lock is held, so non-matching entries are never handed out.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if an argument is NULL.
+ */
+int uc_iterator_set_match(uc_iter_t *iter, value_list_t const *match);
+
+/*
+ * NAME
+ *   uc_iterator_pause
+ *
+ * DESCRIPTION
+ *   Release the cache lock held by the iterator, e.g. before sending the
+ *   entries read so far over the network. The next call to
+ *   `uc_iterator_next' re-acquires the lock and continues after the current
+ *   entry. Entries added or removed in the meantime may or may not be
+ *   returned. The current entry may not be accessed until then.
+ *
+ * RETURN VALUE
+ *   Zero upon success or non-zero if the iterator is NULL, exhausted or
+ *   already paused.
+ */
+int uc_iterator_pause(uc_iter_t *iter);
+
 /* Return the timestamp of the value at the current position. */
 int uc_iterator_get_time(uc_iter_t *iter, cdtime_t *ret_time);
 /* Return the (raw) value at the current position. */
@@ -106,6 +158,9 @@ int uc_iterator_get_values(uc_iter_t *iter, value_t **ret_values,
                            size_t *ret_num);
 /* Return the interval of the value at the current position. */
 int uc_iterator_get_interval(uc_iter_t *iter, cdtime_t *ret_interval);
+/* Fill the identifier fields (host to type instance) of `vl' from the entry
+ * at the current position. */
+int uc_iterator_get_identifier(uc_iter_t *iter, value_list_t *vl);
 
 /*
  * Meta data interface
@@ -0,0 +1,151 @@
+/**
+ * collectd - src/daemon/utils_cache_bench.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+/* Micro benchmark for the value cache: measures the CPU time per value of
+ * uc_update() followed by uc_get_rate(), the typical sequence for a value list
+ * written by e.g. the Graphite plugin with StoreRates enabled, with and
+ * without the identity being provided by the dispatch code. Also measures
+ * the time uc_check_timeout() blocks when no value has timed out.
+ *
+ * Usage: bench_utils_cache [<identifiers> [<rounds> [<shards>]]] */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_cache.h"
+#include "utils_time.h"
+
+int timeout_g = 2;
+static long shards_num = 1;
+static vl_ident_t *current_ident = NULL;
+static cdtime_t bench_time = 0;
+
+/* Stubs for the functions provided by the daemon. */
+long global_option_get_long(const char *option, long default_value) {
+  if (strcasecmp("CacheShards", option) == 0)
+    return shards_num;
+  return default_value;
+}
+
+int plugin_dispatch_missing(const value_list_t *vl) { return 0; }
+
+vl_ident_t const *plugin_get_vl_ident(value_list_t const *vl) {
+  if ((current_ident == NULL) || (current_ident->vl != vl))
+    return NULL;
+  return current_ident;
+}
+
+static double now_cpu(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec) / 1e9;
+}
+
+static double run(data_set_t const *ds, size_t idents_num, size_t rounds,
+                  _Bool use_ident) {
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t value;
+  vl_ident_t ident = {.vl = &vl};
+  double start;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  vl.interval = TIME_T_TO_CDTIME_T(10);
+  sstrncpy(vl.host, "bench.example.com", sizeof(vl.host));
+  sstrncpy(vl.plugin, "bench", sizeof(vl.plugin));
+  sstrncpy(vl.type, ds->type, sizeof(vl.type));
+
+  start = now_cpu();
+  for (size_t r = 0; r < rounds; r++) {
+    /* Use a new timestamp each round, otherwise the cache rejects the update
+     * as "too old". */
+    bench_time += vl.interval;
+    vl.time = bench_time;
+
+    for (size_t i = 0; i < idents_num; i++) {
+      ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%zu",
+                i % 64);
+      ssnprintf(vl.type_instance, sizeof(vl.type_instance), "instance%zu", i);
+      value.derive = (derive_t)(r * i);
+
+      /* Done once per value list by plugin_dispatch_values_internal(). */
+      if (use_ident) {
+        FORMAT_VL(ident.name, sizeof(ident.name), &vl);
+        ident.name_len = strlen(ident.name);
+        ident.hash = strhash(ident.name);
+        ident.valid = 1;
+        current_ident = &ident;
+      }
+
+      uc_update(ds, &vl);
+      gauge_t *rates = uc_get_rate(ds, &vl);
+      sfree(rates);
+
+      current_ident = NULL;
+    }
+  }
+
+  return (now_cpu() - start) / (double)(idents_num * rounds);
+}
+
+int main(int argc, char **argv) {
+  size_t idents_num = 100000;
+  size_t rounds = 10;
+  data_source_t dsrc = {"value", DS_TYPE_DERIVE, 0.0, NAN};
+  data_set_t ds = {"derive", 1, &dsrc};
+
+  if (argc > 1)
+    idents_num = (size_t)atol(argv[1]);
+  if (argc > 2)
+    rounds = (size_t)atol(argv[2]);
+  if (argc > 3)
+    shards_num = atol(argv[3]);
+  if ((idents_num < 1) || (rounds < 2) || (shards_num < 1)) {
+    fprintf(stderr, "Usage: %s [<identifiers> [<rounds> [<shards>]]]\n",
+            argv[0]);
+    return 1;
+  }
+
+  uc_init();
+
+  /* The first round populates the cache. */
+  run(&ds, idents_num, 1, /* use_ident = */ 0);
+
+  double per_value_format = run(&ds, idents_num, rounds, 0);
+  double per_value_ident = run(&ds, idents_num, rounds, 1);
+
+  double start = now_cpu();
+  uc_check_timeout();
+  double check_timeout = now_cpu() - start;
+
+  printf("identifiers: %zu, rounds: %zu, shards: %ld\n", idents_num, rounds,
+         shards_num);
+  printf("FORMAT_VL per cache call: %8.1f ns/value\n", 1e9 * per_value_format);
+  printf("identity from dispatch:   %8.1f ns/value\n", 1e9 * per_value_ident);
+  printf("uc_check_timeout:         %8.1f us\n", 1e6 * check_timeout);
+
+  return 0;
+}
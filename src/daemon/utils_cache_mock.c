@@ -33,6 +33,12 @@ gauge_t *uc_get_rate(__attribute__((unused)) data_set_t const *ds,
   return NULL;
 }
 
+int uc_get_rates(__attribute__((unused)) data_set_t const *ds,
+                 __attribute__((unused)) value_list_t const *vl,
+                 __attribute__((unused)) gauge_t *ret_rates) {
+  return ENOTSUP;
+}
+
 int uc_get_rate_by_name(const char *name, gauge_t **ret_values,
                         size_t *ret_values_num) {
   return ENOTSUP;
@@ -0,0 +1,232 @@
+/**
+ * collectd - src/daemon/utils_queue.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "utils_queue.h"
+
+/* The queue is an implementation of Dmitry Vyukov's bounded MPMC queue: every
+ * slot carries a sequence number which tells producers and consumers whether
+ * the slot is free for the current "lap" around the ring. Producers and
+ * consumers only ever contend on their own position counter. */
+
+#define CACHE_LINE_SIZE 64
+
+struct c_queue_slot_s {
+  uint64_t seq;
+  /* The element data follows. */
+};
+typedef struct c_queue_slot_s c_queue_slot_t;
+
+struct c_queue_s {
+  unsigned char *slots;
+  size_t size;
+  uint64_t mask;
+  size_t elem_size;
+  size_t stride;
+
+  /* Keep the two hot counters on separate cache lines. */
+  char pad0[CACHE_LINE_SIZE];
+  uint64_t enqueue_pos;
+  char pad1[CACHE_LINE_SIZE - sizeof(uint64_t)];
+  uint64_t dequeue_pos;
+  char pad2[CACHE_LINE_SIZE - sizeof(uint64_t)];
+
+  uint64_t stats_full;
+  uint64_t stats_contended;
+};
+
+#define SLOT(q, pos)                                                           \
+  ((c_queue_slot_t *)((q)->slots + ((pos) & (q)->mask) * (q)->stride))
+#define SLOT_DATA(s) ((unsigned char *)(s) + sizeof(c_queue_slot_t))
+
+c_queue_t *c_queue_create(size_t size, size_t elem_size) /* {{{ */
+{
+  c_queue_t *q;
+  size_t n;
+
+  if ((size == 0) || (elem_size == 0)) {
+    errno = EINVAL;
+    return NULL;
+  }
+
+  n = 2;
+  while (n < size) {
+    if (n > (SIZE_MAX / 2)) {
+      errno = EINVAL;
+      return NULL;
+    }
+    n *= 2;
+  }
+
+  q = calloc(1, sizeof(*q));
+  if (q == NULL)
+    return NULL;
+
+  q->size = n;
+  q->mask = (uint64_t)(n - 1);
+  q->elem_size = elem_size;
+  /* Round the stride up to a multiple of eight so the sequence numbers stay
+   * aligned. */
+  q->stride = (sizeof(c_queue_slot_t) + elem_size + 7) & ~((size_t)7);
+
+  q->slots = calloc(n, q->stride);
+  if (q->slots == NULL) {
+    free(q);
+    return NULL;
+  }
+
+  for (size_t i = 0; i < n; i++)
+    SLOT(q, i)->seq = (uint64_t)i;
+
+  __atomic_store_n(&q->enqueue_pos, 0, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&q->dequeue_pos, 0, __ATOMIC_SEQ_CST);
+
+  return q;
+} /* }}} c_queue_t *c_queue_create */
+
+void c_queue_destroy(c_queue_t *q) /* {{{ */
+{
+  if (q == NULL)
+    return;
+
+  free(q->slots);
+  free(q);
+} /* }}} void c_queue_destroy */
+
+int c_queue_push(c_queue_t *q, void const *elem) /* {{{ */
+{
+  c_queue_slot_t *s;
+  uint64_t pos;
+
+  pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+  while (42) {
+    s = SLOT(q, pos);
+    uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+    int64_t diff = (int64_t)(seq - pos);
+
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&q->enqueue_pos, &pos, pos + 1,
+                                      /* weak = */ 1, __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED))
+        break;
+      /* `pos' has been updated by the failed CAS. */
+      __atomic_fetch_add(&q->stats_contended, 1, __ATOMIC_RELAXED);
+    } else if (diff < 0) {
+      /* The slot still holds an element from the previous lap. */
+      __atomic_fetch_add(&q->stats_full, 1, __ATOMIC_RELAXED);
+      return EAGAIN;
+    } else {
+      /* Another producer claimed this slot. */
+      pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&q->stats_contended, 1, __ATOMIC_RELAXED);
+    }
+  }
+
+  memcpy(SLOT_DATA(s), elem, q->elem_size);
+  __atomic_store_n(&s->seq, pos + 1, __ATOMIC_RELEASE);
+
+  return 0;
+} /* }}} int c_queue_push */
+
+size_t c_queue_pop(c_queue_t *q, void *elems, size_t num) /* {{{ */
+{
+  uint64_t pos;
+  size_t n;
+
+  if (num == 0)
+    return 0;
+
+  pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+  while (42) {
+    /* Count how many consecutive slots are ready to be consumed. */
+    for (n = 0; n < num; n++) {
+      c_queue_slot_t *s = SLOT(q, pos + n);
+      uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+      if (seq != (pos + n + 1))
+        break;
+    }
+
+    if (n == 0) {
+      c_queue_slot_t *s = SLOT(q, pos);
+      uint64_t seq = __atomic_load_n(&s->seq, __ATOMIC_ACQUIRE);
+      int64_t diff = (int64_t)(seq - (pos + 1));
+
+      if (diff < 0) /* empty */
+        return 0;
+
+      /* Another consumer claimed this slot. */
+      pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+      __atomic_fetch_add(&q->stats_contended, 1, __ATOMIC_RELAXED);
+      continue;
+    }
+
+    if (__atomic_compare_exchange_n(&q->dequeue_pos, &pos, pos + n,
+                                    /* weak = */ 1, __ATOMIC_RELAXED,
+                                    __ATOMIC_RELAXED))
+      break;
+    __atomic_fetch_add(&q->stats_contended, 1, __ATOMIC_RELAXED);
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    c_queue_slot_t *s = SLOT(q, pos + i);
+
+    memcpy((unsigned char *)elems + i * q->elem_size, SLOT_DATA(s),
+           q->elem_size);
+    /* Mark the slot as free for the producers' next lap. */
+    __atomic_store_n(&s->seq, pos + i + q->mask + 1, __ATOMIC_RELEASE);
+  }
+
+  return n;
+} /* }}} size_t c_queue_pop */
+
+size_t c_queue_length(c_queue_t *q) /* {{{ */
+{
+  uint64_t dequeue_pos = __atomic_load_n(&q->dequeue_pos, __ATOMIC_SEQ_CST);
+  uint64_t enqueue_pos = __atomic_load_n(&q->enqueue_pos, __ATOMIC_SEQ_CST);
+
+  if (enqueue_pos <= dequeue_pos)
+    return 0;
+  if ((enqueue_pos - dequeue_pos) > q->size)
+    return q->size;
+  return (size_t)(enqueue_pos - dequeue_pos);
+} /* }}} size_t c_queue_length */
+
+size_t c_queue_size(c_queue_t const *q) /* {{{ */
+{
+  return q->size;
+} /* }}} size_t c_queue_size */
+
+void c_queue_stats(c_queue_t *q, c_queue_stats_t *ret_stats) /* {{{ */
+{
+  ret_stats->pushed = __atomic_load_n(&q->enqueue_pos, __ATOMIC_RELAXED);
+  ret_stats->popped = __atomic_load_n(&q->dequeue_pos, __ATOMIC_RELAXED);
+  ret_stats->full = __atomic_load_n(&q->stats_full, __ATOMIC_RELAXED);
+  ret_stats->contended =
+      __atomic_load_n(&q->stats_contended, __ATOMIC_RELAXED);
+} /* }}} void c_queue_stats */
@@ -0,0 +1,122 @@
+/**
+ * collectd - src/daemon/utils_queue.h
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#ifndef UTILS_QUEUE_H
+#define UTILS_QUEUE_H 1
+
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Bounded, lock-free multi-producer / multi-consumer queue. All slots are
+ * allocated when the queue is created; elements are copied into and out of
+ * the slots, so no memory is allocated while pushing or popping.
+ */
+struct c_queue_s;
+typedef struct c_queue_s c_queue_t;
+
+struct c_queue_stats_s {
+  uint64_t pushed;
+  uint64_t popped;
+  /* Number of failed pushes because the queue was full. */
+  uint64_t full;
+  /* Number of compare-and-swap retries, i.e. how often a producer or consumer
+   * lost a race against another thread. */
+  uint64_t contended;
+};
+typedef struct c_queue_stats_s c_queue_stats_t;
+
+/*
+ * NAME
+ *   c_queue_create
+ *
+ * DESCRIPTION
+ *   Allocates a new queue.
+ *
+ * PARAMETERS
+ *   `size'       Number of slots. Rounded up to the next power of two.
+ *   `elem_size'  Size of one element in bytes.
+ *
+ * RETURN VALUE
+ *   A c_queue_t-pointer upon success or NULL upon failure.
+ */
+c_queue_t *c_queue_create(size_t size, size_t elem_size);
+
+/*
+ * NAME
+ *   c_queue_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates a queue. Elements still stored in the queue are lost. The
+ *   caller is responsible for draining the queue first if the elements refer
+ *   to memory that needs to be freed.
+ */
+void c_queue_destroy(c_queue_t *q);
+
+/*
+ * NAME
+ *   c_queue_push
+ *
+ * DESCRIPTION
+ *   Copies `elem_size' bytes from `elem' into the next free slot.
+ *
+ * RETURN VALUE
+ *   Zero upon success, EAGAIN if the queue is full.
+ */
+int c_queue_push(c_queue_t *q, void const *elem);
+
+/*
+ * NAME
+ *   c_queue_pop
+ *
+ * DESCRIPTION
+ *   Removes up to `num' elements from the head of the queue and copies them to
+ *   the array `elems', which must have room for `num' elements. Consecutive
+ *   elements are claimed with a single atomic operation.
+ *
+ * RETURN VALUE
+ *   The number of elements copied to `elems'; zero if the queue is empty.
+ */
+size_t c_queue_pop(c_queue_t *q, void *elems, size_t num);
+
+/*
+ * NAME
+ *   c_queue_length
+ *
+ * DESCRIPTION
+ *   Returns the (approximate) number of elements in the queue. The value may
+ *   be outdated by the time the function returns when other threads are
+ *   accessing the queue.
+ */
+size_t c_queue_length(c_queue_t *q);
+
+/* Returns the number of slots. */
+size_t c_queue_size(c_queue_t const *q);
+
+/* Copies the queue's counters to `ret_stats'. */
+void c_queue_stats(c_queue_t *q, c_queue_stats_t *ret_stats);
+
+#endif /* UTILS_QUEUE_H */
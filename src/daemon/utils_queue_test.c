@@ -0,0 +1,143 @@
+/**
+ * collectd - src/daemon/utils_queue_test.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "collectd.h"
+
+#include "common.h" /* STATIC_ARRAY_SIZE */
+#include "testing.h"
+#include "utils_queue.h"
+
+#include <pthread.h>
+#include <sched.h>
+
+#define PRODUCERS 4
+#define ITEMS_PER_PRODUCER 100000
+
+DEF_TEST(simple) {
+  c_queue_t *q;
+  int values[8];
+
+  CHECK_NOT_NULL(q = c_queue_create(5, sizeof(int)));
+  EXPECT_EQ_INT(8, c_queue_size(q));
+  EXPECT_EQ_INT(0, c_queue_length(q));
+
+  for (int i = 0; i < 8; i++)
+    CHECK_ZERO(c_queue_push(q, &i));
+  EXPECT_EQ_INT(8, c_queue_length(q));
+
+  /* queue is full */
+  int v = 42;
+  EXPECT_EQ_INT(EAGAIN, c_queue_push(q, &v));
+
+  EXPECT_EQ_INT(3, c_queue_pop(q, values, 3));
+  for (int i = 0; i < 3; i++)
+    EXPECT_EQ_INT(i, values[i]);
+
+  /* wrap around */
+  for (int i = 8; i < 11; i++)
+    CHECK_ZERO(c_queue_push(q, &i));
+
+  EXPECT_EQ_INT(8, c_queue_pop(q, values, 8));
+  for (int i = 0; i < 8; i++)
+    EXPECT_EQ_INT(i + 3, values[i]);
+
+  EXPECT_EQ_INT(0, c_queue_pop(q, values, 8));
+  EXPECT_EQ_INT(0, c_queue_length(q));
+
+  c_queue_stats_t stats;
+  c_queue_stats(q, &stats);
+  EXPECT_EQ_UINT64(11, stats.pushed);
+  EXPECT_EQ_UINT64(11, stats.popped);
+  EXPECT_EQ_UINT64(1, stats.full);
+
+  c_queue_destroy(q);
+  return 0;
+}
+
+static void *producer(void *arg) {
+  c_queue_t *q = arg;
+
+  for (int i = 1; i <= ITEMS_PER_PRODUCER; i++) {
+    while (c_queue_push(q, &i) != 0)
+      sched_yield();
+  }
+  return NULL;
+}
+
+struct consumer_s {
+  c_queue_t *q;
+  long count;
+  long sum;
+};
+
+static void *consumer(void *arg) {
+  struct consumer_s *c = arg;
+  int values[16];
+
+  while (c->count < (long)PRODUCERS * ITEMS_PER_PRODUCER) {
+    size_t n = c_queue_pop(c->q, values, STATIC_ARRAY_SIZE(values));
+    if (n == 0) {
+      sched_yield();
+      continue;
+    }
+    for (size_t i = 0; i < n; i++)
+      c->sum += values[i];
+    c->count += (long)n;
+  }
+  return NULL;
+}
+
+DEF_TEST(threads) {
+  pthread_t producers[PRODUCERS];
+  pthread_t consumer_thread;
+  struct consumer_s c = {0};
+
+  CHECK_NOT_NULL(c.q = c_queue_create(1024, sizeof(int)));
+
+  CHECK_ZERO(pthread_create(&consumer_thread, NULL, consumer, &c));
+  for (size_t i = 0; i < PRODUCERS; i++)
+    CHECK_ZERO(pthread_create(&producers[i], NULL, producer, c.q));
+
+  for (size_t i = 0; i < PRODUCERS; i++)
+    CHECK_ZERO(pthread_join(producers[i], NULL));
+  CHECK_ZERO(pthread_join(consumer_thread, NULL));
+
+  EXPECT_EQ_UINT64((uint64_t)PRODUCERS * ITEMS_PER_PRODUCER, c.count);
+  EXPECT_EQ_UINT64((uint64_t)PRODUCERS * ITEMS_PER_PRODUCER *
+                       (ITEMS_PER_PRODUCER + 1) / 2,
+                   c.sum);
+  EXPECT_EQ_INT(0, c_queue_length(c.q));
+
+  c_queue_destroy(c.q);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(simple);
+  RUN_TEST(threads);
+
+  END_TEST;
+}
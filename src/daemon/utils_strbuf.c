@@ -0,0 +1,552 @@
+/**
+ * collectd - src/daemon/utils_strbuf.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_strbuf.h"
+
+#include <math.h>
+
+#define STRBUF_MIN_SIZE 64
+
+static char const strbuf_digit_pairs[] =
+    "0001020304050607080910111213141516171819"
+    "2021222324252627282930313233343536373839"
+    "4041424344454647484950515253545556575859"
+    "6061626364656667686970717273747576777879"
+    "8081828384858687888990919293949596979899";
+
+#ifdef __SIZEOF_INT128__
+typedef unsigned __int128 strbuf_uint128_t;
+
+/* The largest decimal scale used by the exact conversion: 2^55 * 10^21 still
+ * fits into 128 bits. */
+#define STRBUF_SCALE_MAX 21
+#define STRBUF_E19 UINT64_C(10000000000000000000)
+
+static strbuf_uint128_t const strbuf_pow10[STRBUF_SCALE_MAX + 1] = {
+    UINT64_C(1),
+    UINT64_C(10),
+    UINT64_C(100),
+    UINT64_C(1000),
+    UINT64_C(10000),
+    UINT64_C(100000),
+    UINT64_C(1000000),
+    UINT64_C(10000000),
+    UINT64_C(100000000),
+    UINT64_C(1000000000),
+    UINT64_C(10000000000),
+    UINT64_C(100000000000),
+    UINT64_C(1000000000000),
+    UINT64_C(10000000000000),
+    UINT64_C(100000000000000),
+    UINT64_C(1000000000000000),
+    UINT64_C(10000000000000000),
+    UINT64_C(100000000000000000),
+    UINT64_C(1000000000000000000),
+    STRBUF_E19,
+    (strbuf_uint128_t)STRBUF_E19 * 10,
+    (strbuf_uint128_t)STRBUF_E19 * 100,
+};
+#endif
+
+/* Helpers for testing eight bytes at once. STRBUF_HAS_LESS is non-zero if any
+ * byte of "w" is less than "n", which must not exceed 0x80. */
+#define STRBUF_ONES UINT64_C(0x0101010101010101)
+#define STRBUF_HIGHS UINT64_C(0x8080808080808080)
+#define STRBUF_HAS_LESS(w, n) (((w) - (STRBUF_ONES * (n))) & ~(w)&STRBUF_HIGHS)
+#define STRBUF_HAS_BYTE(w, c) STRBUF_HAS_LESS((w) ^ (STRBUF_ONES * (c)), 1)
+
+void strbuf_init_fixed(strbuf_t *buf, char *ptr, size_t size) /* {{{ */
+{
+  *buf = (strbuf_t){.ptr = ptr, .size = size, .fixed = 1};
+  if (size > 0)
+    ptr[0] = 0;
+} /* }}} void strbuf_init_fixed */
+
+void strbuf_destroy(strbuf_t *buf) /* {{{ */
+{
+  if (buf == NULL)
+    return;
+
+  if (!buf->fixed)
+    sfree(buf->ptr);
+  *buf = (strbuf_t){.ptr = NULL};
+} /* }}} void strbuf_destroy */
+
+void strbuf_reset(strbuf_t *buf) /* {{{ */
+{
+  buf->pos = 0;
+  if (buf->size > 0)
+    buf->ptr[0] = 0;
+} /* }}} void strbuf_reset */
+
+/* Makes room for "n" more bytes and the terminating null byte. */
+static int strbuf_reserve(strbuf_t *buf, size_t n) /* {{{ */
+{
+  if ((buf->pos + n) < buf->size)
+    return 0;
+  if (buf->fixed)
+    return ENOMEM;
+
+  size_t new_size = (buf->size < STRBUF_MIN_SIZE) ? STRBUF_MIN_SIZE : buf->size;
+  while (new_size <= (buf->pos + n))
+    new_size *= 2;
+
+  char *new_ptr = realloc(buf->ptr, new_size);
+  if (new_ptr == NULL)
+    return ENOMEM;
+
+  buf->ptr = new_ptr;
+  buf->size = new_size;
+  return 0;
+} /* }}} int strbuf_reserve */
+
+int strbuf_printn(strbuf_t *buf, char const *s, size_t s_len) /* {{{ */
+{
+  if (strbuf_reserve(buf, s_len) != 0)
+    return ENOMEM;
+
+  memcpy(buf->ptr + buf->pos, s, s_len);
+  buf->pos += s_len;
+  buf->ptr[buf->pos] = 0;
+  return 0;
+} /* }}} int strbuf_printn */
+
+int strbuf_print(strbuf_t *buf, char const *s) /* {{{ */
+{
+  return strbuf_printn(buf, s, strlen(s));
+} /* }}} int strbuf_print */
+
+int strbuf_printf(strbuf_t *buf, char const *format, ...) /* {{{ */
+{
+  va_list ap;
+  int status;
+
+  if (strbuf_reserve(buf, 0) != 0)
+    return ENOMEM;
+
+  va_start(ap, format);
+  status = vsnprintf(buf->ptr + buf->pos, buf->size - buf->pos, format, ap);
+  va_end(ap);
+  if (status < 0) {
+    buf->ptr[buf->pos] = 0;
+    return EINVAL;
+  }
+
+  size_t len = (size_t)status;
+  if (len >= (buf->size - buf->pos)) {
+    buf->ptr[buf->pos] = 0;
+    if (strbuf_reserve(buf, len) != 0)
+      return ENOMEM;
+
+    va_start(ap, format);
+    vsnprintf(buf->ptr + buf->pos, buf->size - buf->pos, format, ap);
+    va_end(ap);
+  }
+
+  buf->pos += len;
+  return 0;
+} /* }}} int strbuf_printf */
+
+/* Writes the decimal digits of "value" so that they end just before "end".
+ * Returns a pointer to the first digit. At most 20 bytes are written. */
+static char *strbuf_format_uint(char *end, uint64_t value) /* {{{ */
+{
+  char *ptr = end;
+
+  while (value >= 100) {
+    ptr -= 2;
+    memcpy(ptr, strbuf_digit_pairs + 2 * (value % 100), 2);
+    value /= 100;
+  }
+
+  if (value >= 10) {
+    ptr -= 2;
+    memcpy(ptr, strbuf_digit_pairs + 2 * value, 2);
+  } else {
+    ptr--;
+    *ptr = (char)('0' + value);
+  }
+
+  return ptr;
+} /* }}} char *strbuf_format_uint */
+
+int strbuf_print_uint(strbuf_t *buf, uint64_t value) /* {{{ */
+{
+  char tmp[20];
+  char *ptr = strbuf_format_uint(tmp + sizeof(tmp), value);
+
+  return strbuf_printn(buf, ptr, (size_t)(tmp + sizeof(tmp) - ptr));
+} /* }}} int strbuf_print_uint */
+
+int strbuf_print_int(strbuf_t *buf, int64_t value) /* {{{ */
+{
+  char tmp[21];
+  char *ptr;
+
+  if (value < 0) {
+    ptr = strbuf_format_uint(tmp + sizeof(tmp), UINT64_C(0) - (uint64_t)value);
+    ptr--;
+    *ptr = '-';
+  } else {
+    ptr = strbuf_format_uint(tmp + sizeof(tmp), (uint64_t)value);
+  }
+
+  return strbuf_printn(buf, ptr, (size_t)(tmp + sizeof(tmp) - ptr));
+} /* }}} int strbuf_print_int */
+
+#ifdef __SIZEOF_INT128__
+/* Determines the integers "n" with lo * 10^s <= n * 2^shift <= hi * 10^s,
+ * excluding the bounds unless "inclusive" is set. */
+static void strbuf_scaled_range(uint64_t lo, uint64_t hi, int shift, /* {{{ */
+                                int s, _Bool inclusive,
+                                strbuf_uint128_t *ret_first,
+                                strbuf_uint128_t *ret_last) {
+  strbuf_uint128_t mask = (((strbuf_uint128_t)1) << shift) - 1;
+  strbuf_uint128_t lo_scaled = lo * strbuf_pow10[s];
+  strbuf_uint128_t hi_scaled = hi * strbuf_pow10[s];
+
+  *ret_first = lo_scaled >> shift;
+  if (((lo_scaled & mask) != 0) || !inclusive)
+    (*ret_first)++;
+
+  *ret_last = hi_scaled >> shift;
+  if (((hi_scaled & mask) == 0) && !inclusive)
+    (*ret_last)--;
+} /* }}} void strbuf_scaled_range */
+
+/* Finds the shortest decimal representation m * 10^-s of "value" exactly,
+ * using 128 bit integer arithmetic. The double f * 2^e is read back from all
+ * decimals within half a unit in the last place, i.e. from the interval
+ * (4f - 2) * 2^(e-2) to (4f + 2) * 2^(e-2), so the search is for the
+ * smallest s for which an integer m lies within the interval scaled by 10^s.
+ * Only values below 2^53 whose representation needs at most
+ * STRBUF_SCALE_MAX decimals are handled; false is returned otherwise. */
+static _Bool strbuf_shortest_exact(double value, /* {{{ */
+                                   uint64_t *ret_mantissa, int *ret_scale) {
+  uint64_t bits;
+  memcpy(&bits, &value, sizeof(bits));
+
+  int biased_exponent = (int)((bits >> 52) & 0x7ff);
+  uint64_t f = bits & ((UINT64_C(1) << 52) - 1);
+  if (biased_exponent == 0) /* subnormal */
+    return 0;
+
+  int shift = 1075 - biased_exponent + 2;
+  if ((shift < 2) || (shift > 126))
+    return 0;
+
+  /* Strtod(3) rounds ties to even, so an even "f" includes the bounds. The
+   * interval below a power of two is half as wide. */
+  _Bool inclusive = (f % 2) == 0;
+  _Bool narrow_below = (f == 0) && (biased_exponent > 1);
+  f |= UINT64_C(1) << 52;
+  uint64_t lo = 4 * f - (narrow_below ? 1 : 2);
+  uint64_t hi = 4 * f + 2;
+
+  strbuf_uint128_t first;
+  strbuf_uint128_t last;
+  strbuf_scaled_range(lo, hi, shift, STRBUF_SCALE_MAX, inclusive, &first,
+                      &last);
+  if (first > last)
+    return 0;
+
+  /* Once the interval contains an integer for some s, it does for all larger
+   * ones, so the smallest s is found by bisection. */
+  int s_lo = 0;
+  int s_hi = STRBUF_SCALE_MAX;
+  while (s_lo < s_hi) {
+    int s = s_lo + (s_hi - s_lo) / 2;
+    strbuf_uint128_t s_first;
+    strbuf_uint128_t s_last;
+
+    strbuf_scaled_range(lo, hi, shift, s, inclusive, &s_first, &s_last);
+    if (s_first <= s_last) {
+      s_hi = s;
+      first = s_first;
+      last = s_last;
+    } else {
+      s_lo = s + 1;
+    }
+  }
+
+  /* Of several candidates, pick the one nearest to the value. */
+  strbuf_uint128_t exact = (4 * f) * strbuf_pow10[s_hi];
+  strbuf_uint128_t half = ((strbuf_uint128_t)1) << (shift - 1);
+  strbuf_uint128_t rem = exact & ((half << 1) - 1);
+  strbuf_uint128_t m = exact >> shift;
+  if ((rem > half) || ((rem == half) && (m % 2)))
+    m++;
+
+  if (m < first)
+    m = first;
+  else if (m > last)
+    m = last;
+
+  /* At most 17 digits are needed, so "m" fits into 64 bits. */
+  *ret_mantissa = (uint64_t)m;
+  *ret_scale = s_hi;
+  return 1;
+} /* }}} _Bool strbuf_shortest_exact */
+#endif
+
+/* Finds the shortest decimal digits of the positive, finite "value" which read
+ * back as "value". The digits are stored without leading or trailing zeros,
+ * "ret_exponent" receives the decimal exponent of the first digit. Returns the
+ * number of digits. */
+static size_t strbuf_shortest_digits(double value, char *ret_digits, /* {{{ */
+                                     int *ret_exponent) {
+  char tmp[32];
+  size_t digits_num = 0;
+  int exponent = 0;
+
+  uint64_t mantissa;
+  int scale;
+#ifdef __SIZEOF_INT128__
+  _Bool exact = strbuf_shortest_exact(value, &mantissa, &scale);
+#else
+  _Bool exact = 0;
+#endif
+
+  if (exact) {
+    char *ptr = strbuf_format_uint(tmp + sizeof(tmp), mantissa);
+    digits_num = (size_t)(tmp + sizeof(tmp) - ptr);
+    exponent = ((int)digits_num) - 1 - scale;
+    memcpy(ret_digits, ptr, digits_num);
+  } else {
+    /* Slow path for very large and small values: the first precision from 15
+     * to 17 digits that survives a round trip through strtod(3). 17 digits
+     * always do. */
+    for (int precision = 15; precision <= 17; precision++) {
+      snprintf(tmp, sizeof(tmp), "%.*e", precision - 1, value);
+      if ((precision == 17) || (strtod(tmp, NULL) == value))
+        break;
+    }
+
+    char *e = strchr(tmp, 'e');
+    exponent = atoi(e + 1);
+    ret_digits[digits_num++] = tmp[0];
+    for (char *ptr = tmp + 2; ptr < e; ptr++)
+      ret_digits[digits_num++] = *ptr;
+  }
+
+  while ((digits_num > 1) && (ret_digits[digits_num - 1] == '0'))
+    digits_num--;
+
+  *ret_exponent = exponent;
+  return digits_num;
+} /* }}} size_t strbuf_shortest_digits */
+
+int strbuf_print_double(strbuf_t *buf, double value) /* {{{ */
+{
+  char digits[24];
+  size_t digits_num;
+  int exponent;
+  char tmp[48];
+  size_t pos = 0;
+
+  if (isnan(value))
+    return strbuf_print(buf, signbit(value) ? "-nan" : "nan");
+  if (signbit(value)) {
+    tmp[pos++] = '-';
+    value = -value;
+  }
+  if (isinf(value))
+    return strbuf_printn(buf, (pos > 0) ? "-inf" : "inf", pos + 3);
+  if (value == 0.0) {
+    tmp[pos++] = '0';
+    return strbuf_printn(buf, tmp, pos);
+  }
+
+  digits_num = strbuf_shortest_digits(value, digits, &exponent);
+
+  /* Use the layout of "%.<precision>g", with a precision of at least 15. */
+  int precision = (digits_num > 15) ? (int)digits_num : 15;
+
+  if ((exponent < -4) || (exponent >= precision)) {
+    tmp[pos++] = digits[0];
+    if (digits_num > 1) {
+      tmp[pos++] = '.';
+      memcpy(tmp + pos, digits + 1, digits_num - 1);
+      pos += digits_num - 1;
+    }
+    tmp[pos++] = 'e';
+    tmp[pos++] = (exponent < 0) ? '-' : '+';
+    if (exponent < 0)
+      exponent = -exponent;
+    if (exponent >= 100)
+      tmp[pos++] = (char)('0' + exponent / 100);
+    memcpy(tmp + pos, strbuf_digit_pairs + 2 * (exponent % 100), 2);
+    pos += 2;
+  } else if (exponent >= 0) {
+    size_t int_num = (size_t)exponent + 1;
+
+    for (size_t i = 0; i < int_num; i++)
+      tmp[pos++] = (i < digits_num) ? digits[i] : '0';
+    if (digits_num > int_num) {
+      tmp[pos++] = '.';
+      memcpy(tmp + pos, digits + int_num, digits_num - int_num);
+      pos += digits_num - int_num;
+    }
+  } else {
+    tmp[pos++] = '0';
+    tmp[pos++] = '.';
+    for (int i = -1; i > exponent; i--)
+      tmp[pos++] = '0';
+    memcpy(tmp + pos, digits, digits_num);
+    pos += digits_num;
+  }
+
+  return strbuf_printn(buf, tmp, pos);
+} /* }}} int strbuf_print_double */
+
+int strbuf_print_time(strbuf_t *buf, cdtime_t t) /* {{{ */
+{
+  /* Rounding the double exactly, with ties to even, gives the same result as
+   * printf(3). The fraction is an exact multiple of 2^-frac_bits. */
+  double d = CDTIME_T_TO_DOUBLE(t);
+  uint64_t seconds = (uint64_t)d;
+  double frac = d - (double)seconds;
+  uint64_t millis = 0;
+
+  if (frac != 0.0) {
+    if (seconds == 0)
+      return strbuf_printf(buf, "%.3f", d);
+
+    /* "d" has 53 significant bits, "64 - clz" of them before the point. */
+    int frac_bits = 53 - (64 - __builtin_clzll(seconds));
+    uint64_t m = (uint64_t)(frac * (double)(UINT64_C(1) << frac_bits)) * 1000;
+    uint64_t half = UINT64_C(1) << (frac_bits - 1);
+    uint64_t rem = m & ((half << 1) - 1);
+
+    millis = m >> frac_bits;
+    if ((rem > half) || ((rem == half) && (millis & 1)))
+      millis++;
+    if (millis == 1000) {
+      seconds++;
+      millis = 0;
+    }
+  }
+
+  char tmp[24];
+  char *ptr = strbuf_format_uint(tmp + sizeof(tmp) - 4, seconds);
+  tmp[sizeof(tmp) - 4] = '.';
+  tmp[sizeof(tmp) - 3] = (char)('0' + millis / 100);
+  memcpy(tmp + sizeof(tmp) - 2, strbuf_digit_pairs + 2 * (millis % 100), 2);
+
+  return strbuf_printn(buf, ptr, (size_t)(tmp + sizeof(tmp) - ptr));
+} /* }}} int strbuf_print_time */
+
+int strbuf_print_json_string(strbuf_t *buf, char const *s) /* {{{ */
+{
+  size_t s_len = strlen(s);
+
+  /* Escaping at most doubles the length. Heap buffers are grown up front so
+   * the string can be copied without further checks; fixed buffers are
+   * checked as the output is written. */
+  if (!buf->fixed && (strbuf_reserve(buf, 2 * s_len + 2) != 0))
+    return ENOMEM;
+  if (buf->size == 0)
+    return ENOMEM;
+
+  char *dst = buf->ptr + buf->pos;
+  char *end = buf->ptr + buf->size - 1; /* reserved for the null byte */
+  size_t i = 0;
+
+  if (dst >= end)
+    return ENOMEM;
+  *(dst++) = '"';
+
+  while (i < s_len) {
+    /* Copy eight bytes at once if none of them needs to be escaped. */
+    if (((i + 8) <= s_len) && ((dst + 8) <= end)) {
+      uint64_t w;
+      memcpy(&w, s + i, sizeof(w));
+      if (!(STRBUF_HAS_LESS(w, 0x20) | STRBUF_HAS_BYTE(w, '"') |
+            STRBUF_HAS_BYTE(w, '\\') | (w & STRBUF_HIGHS))) {
+        memcpy(dst, &w, sizeof(w));
+        dst += 8;
+        i += 8;
+        continue;
+      }
+    }
+
+    unsigned char c = (unsigned char)s[i];
+    _Bool escape = (c == '"') || (c == '\\');
+
+    if ((dst + (escape ? 2 : 1)) > end) {
+      buf->ptr[buf->pos] = 0;
+      return ENOMEM;
+    }
+
+    if (escape) {
+      *(dst++) = '\\';
+      *(dst++) = (char)c;
+    } else if ((c < 0x20) || (c >= 0x80)) {
+      *(dst++) = '?';
+    } else {
+      *(dst++) = (char)c;
+    }
+    i++;
+  }
+
+  if (dst >= end) {
+    buf->ptr[buf->pos] = 0;
+    return ENOMEM;
+  }
+  *(dst++) = '"';
+  *dst = 0;
+
+  buf->pos = (size_t)(dst - buf->ptr);
+  return 0;
+} /* }}} int strbuf_print_json_string */
+
+void strbuf_charset_init(strbuf_charset_t *set, char const *chars) /* {{{ */
+{
+  memset(set, 0, sizeof(*set));
+  for (; *chars != 0; chars++)
+    strbuf_charset_add(set, (unsigned char)*chars);
+} /* }}} void strbuf_charset_init */
+
+int strbuf_print_replaced(strbuf_t *buf, char const *s, /* {{{ */
+                          strbuf_charset_t const *reject, char replacement) {
+  size_t s_len = strlen(s);
+
+  if (strbuf_reserve(buf, s_len) != 0)
+    return ENOMEM;
+
+  char *dst = buf->ptr + buf->pos;
+  for (size_t i = 0; i < s_len; i++) {
+    unsigned char c = (unsigned char)s[i];
+    dst[i] = strbuf_charset_contains(reject, c) ? replacement : (char)c;
+  }
+
+  buf->pos += s_len;
+  buf->ptr[buf->pos] = 0;
+  return 0;
+} /* }}} int strbuf_print_replaced */
@@ -0,0 +1,102 @@
+/**
+ * collectd - src/daemon/utils_strbuf.h
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#ifndef UTILS_STRBUF_H
+#define UTILS_STRBUF_H 1
+
+#include "collectd.h"
+
+#include "utils_time.h"
+
+/* A string buffer which is appended to by the strbuf_print* functions. The
+ * buffer is either provided by the caller ("fixed") or allocated and grown on
+ * the heap as needed. In both cases "ptr" is kept null terminated and "pos" is
+ * the length of the string.
+ *
+ * All functions return zero on success. When a fixed buffer is too small, or
+ * growing a heap buffer fails, ENOMEM is returned and the buffer is left
+ * unchanged. */
+typedef struct {
+  char *ptr;
+  size_t pos;
+  size_t size;
+  _Bool fixed;
+} strbuf_t;
+
+/* Initializes an empty heap buffer. No memory is allocated until the first
+ * print; strbuf_destroy() frees it again. */
+#define STRBUF_CREATE                                                          \
+  (strbuf_t) { .ptr = NULL }
+
+void strbuf_init_fixed(strbuf_t *buf, char *ptr, size_t size);
+void strbuf_destroy(strbuf_t *buf);
+void strbuf_reset(strbuf_t *buf);
+
+int strbuf_print(strbuf_t *buf, char const *s);
+int strbuf_printn(strbuf_t *buf, char const *s, size_t s_len);
+int strbuf_printf(strbuf_t *buf, char const *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+int strbuf_print_uint(strbuf_t *buf, uint64_t value);
+int strbuf_print_int(strbuf_t *buf, int64_t value);
+
+/* Prints "value" with the fewest significant digits, but no fewer than "%.15g"
+ * prints, that read back as the same double. Values which "%.15g" prints
+ * without loss are thus printed exactly as "%.15g" would, other values use the
+ * same layout with up to 17 digits. */
+int strbuf_print_double(strbuf_t *buf, double value);
+
+/* Prints the time in seconds with millisecond precision, like "%.3f". */
+int strbuf_print_time(strbuf_t *buf, cdtime_t t);
+
+/* Prints "s" as a quoted JSON string. Quotes and backslashes are escaped,
+ * control characters and bytes outside of ASCII are replaced by '?'. */
+int strbuf_print_json_string(strbuf_t *buf, char const *s);
+
+/* A set of bytes, e.g. the characters to replace with
+ * strbuf_print_replaced(). */
+typedef struct {
+  uint64_t bits[4];
+} strbuf_charset_t;
+
+/* Initializes "set" to the bytes of the null terminated "chars". */
+void strbuf_charset_init(strbuf_charset_t *set, char const *chars);
+
+static inline void strbuf_charset_add(strbuf_charset_t *set, unsigned char c) {
+  set->bits[c / 64] |= UINT64_C(1) << (c % 64);
+}
+
+static inline _Bool strbuf_charset_contains(strbuf_charset_t const *set,
+                                            unsigned char c) {
+  return (set->bits[c / 64] >> (c % 64)) & 1;
+}
+
+/* Prints "s" with every byte contained in "reject" replaced by
+ * "replacement". */
+int strbuf_print_replaced(strbuf_t *buf, char const *s,
+                          strbuf_charset_t const *reject, char replacement);
+
+#endif /* UTILS_STRBUF_H */
@@ -0,0 +1,302 @@
+/**
+ * collectd - src/daemon/utils_strbuf_test.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "collectd.h"
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "testing.h"
+#include "utils_strbuf.h"
+
+DEF_TEST(print) {
+  char buffer[8];
+  strbuf_t buf;
+
+  strbuf_init_fixed(&buf, buffer, sizeof(buffer));
+  CHECK_ZERO(strbuf_print(&buf, "foo"));
+  CHECK_ZERO(strbuf_printf(&buf, "%d", 42));
+  EXPECT_EQ_STR("foo42", buffer);
+
+  /* a fixed buffer is left unchanged if the string does not fit */
+  OK(strbuf_print(&buf, "bar") != 0);
+  OK(strbuf_printf(&buf, "%s", "bar") != 0);
+  EXPECT_EQ_STR("foo42", buffer);
+  EXPECT_EQ_INT(5, (int)buf.pos);
+  CHECK_ZERO(strbuf_print(&buf, "ba"));
+  EXPECT_EQ_STR("foo42ba", buffer);
+
+  /* heap buffers grow */
+  buf = STRBUF_CREATE;
+  for (int i = 0; i < 100; i++) {
+    CHECK_ZERO(strbuf_print(&buf, "0123456789"));
+    CHECK_ZERO(strbuf_printf(&buf, "%d", i % 10));
+  }
+  EXPECT_EQ_INT(1100, (int)buf.pos);
+  EXPECT_EQ_INT(1100, (int)strlen(buf.ptr));
+  EXPECT_EQ_STR("01234567899", buf.ptr + 1089);
+
+  strbuf_reset(&buf);
+  EXPECT_EQ_STR("", buf.ptr);
+  strbuf_destroy(&buf);
+
+  return 0;
+}
+
+DEF_TEST(print_int) {
+  int64_t cases[] = {0,         1,          9,          10,       99,
+                     100,       -1,         -10,        12345678, INT64_MAX,
+                     INT64_MIN, 1000000000, -999999999};
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char want[32];
+    char got[32];
+    strbuf_t buf;
+
+    snprintf(want, sizeof(want), "%" PRIi64, cases[i]);
+    strbuf_init_fixed(&buf, got, sizeof(got));
+    CHECK_ZERO(strbuf_print_int(&buf, cases[i]));
+    EXPECT_EQ_STR(want, got);
+
+    snprintf(want, sizeof(want), "%" PRIu64, (uint64_t)cases[i]);
+    strbuf_reset(&buf);
+    CHECK_ZERO(strbuf_print_uint(&buf, (uint64_t)cases[i]));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  return 0;
+}
+
+/* Returns the number of significant digits in a formatted double. */
+static int significant_digits(char const *s) {
+  char digits[32];
+  int n = 0;
+
+  for (; (*s != 0) && (*s != 'e'); s++) {
+    if ((*s < '0') || (*s > '9') || ((n == 0) && (*s == '0')))
+      continue;
+    digits[n++] = *s;
+  }
+  while ((n > 0) && (digits[n - 1] == '0'))
+    n--;
+
+  return n;
+}
+
+/* Returns the smallest number of significant digits which survive the round
+ * trip through strtod(3). */
+static int shortest_digits(double value) {
+  for (int precision = 1; precision < 17; precision++) {
+    char tmp[32];
+    snprintf(tmp, sizeof(tmp), "%.*e", precision - 1, value);
+    if (strtod(tmp, NULL) == value)
+      return precision;
+  }
+  return 17;
+}
+
+DEF_TEST(print_double) {
+  struct {
+    double value;
+    char const *want;
+  } cases[] = {
+      {0.0, "0"},
+      {-0.0, "-0"},
+      {42.0, "42"},
+      {-1.5, "-1.5"},
+      {0.1, "0.1"},
+      {0.0001, "0.0001"},
+      {0.00001, "1e-05"},
+      {123456789012345.0, "123456789012345"},
+      {1e15, "1e+15"},
+      {1e100, "1e+100"},
+      {1.0 / 3.0, "0.3333333333333333"},
+      {0.1 + 0.2, "0.30000000000000004"},
+      {1234567890123456.0, "1234567890123456"},
+      {5e-324, "4.94065645841247e-324"},
+      {1.7976931348623157e308, "1.7976931348623157e+308"},
+      {INFINITY, "inf"},
+      {-INFINITY, "-inf"},
+      {NAN, "nan"},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    strbuf_t buf = STRBUF_CREATE;
+
+    CHECK_ZERO(strbuf_print_double(&buf, cases[i].value));
+    EXPECT_EQ_STR(cases[i].want, buf.ptr);
+    strbuf_destroy(&buf);
+  }
+
+  /* Random doubles survive the round trip with the fewest possible digits.
+   * Those which "%.15g" prints without loss are printed identically. */
+  uint64_t state = 0x2545F4914F6CDD1DULL;
+  for (int i = 0; i < 100000; i++) {
+    double value;
+    char got[32];
+    char want[32];
+    strbuf_t buf;
+
+    state ^= state << 13;
+    state ^= state >> 7;
+    state ^= state << 17;
+    if (i % 3 == 0) {
+      memcpy(&value, &state, sizeof(value));
+      if (!isfinite(value))
+        continue;
+    } else if (i % 3 == 1) {
+      /* values with few digits, as typically collected */
+      value = (double)(int64_t)(state % 2000000001) / pow(10, (double)(i % 12));
+    } else {
+      /* rates and averages */
+      value = (double)(state % 100000000) / (double)((state >> 32) % 997 + 1);
+    }
+
+    strbuf_init_fixed(&buf, got, sizeof(got));
+    if (strbuf_print_double(&buf, value) != 0 || strtod(got, NULL) != value) {
+      printf("not ok - round trip of %.17g: \"%s\"\n", value, got);
+      return -1;
+    }
+
+    /* subnormals have fewer digits than "%.15g" prints */
+    if ((fpclassify(value) == FP_NORMAL) &&
+        (significant_digits(got) != shortest_digits(value))) {
+      printf("not ok - %.17g: \"%s\" is not the shortest representation\n",
+             value, got);
+      return -1;
+    }
+
+    snprintf(want, sizeof(want), GAUGE_FORMAT, value);
+    if ((strtod(want, NULL) == value) && (strcmp(want, got) != 0)) {
+      printf("not ok - %.17g: got \"%s\", want \"%s\"\n", value, got, want);
+      return -1;
+    }
+  }
+  OK1(1, "round trips");
+
+  return 0;
+}
+
+DEF_TEST(print_time) {
+  cdtime_t cases[] = {
+      0,
+      TIME_T_TO_CDTIME_T(1480063672),
+      MS_TO_CDTIME_T(1480063672125),
+      MS_TO_CDTIME_T(10500),
+      DOUBLE_TO_CDTIME_T(0.0625),
+      DOUBLE_TO_CDTIME_T(1.0005),
+      DOUBLE_TO_CDTIME_T(1.9999),
+      1073741823,
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char want[32];
+    char got[32];
+    strbuf_t buf;
+
+    snprintf(want, sizeof(want), "%.3f", CDTIME_T_TO_DOUBLE(cases[i]));
+    strbuf_init_fixed(&buf, got, sizeof(got));
+    CHECK_ZERO(strbuf_print_time(&buf, cases[i]));
+    EXPECT_EQ_STR(want, got);
+  }
+
+  /* every millisecond fraction and the ties in between */
+  for (uint64_t i = 0; i < 20000; i++) {
+    cdtime_t t = TIME_T_TO_CDTIME_T(1480063672) + i * 53687;
+    char want[32];
+    char got[32];
+    strbuf_t buf;
+
+    snprintf(want, sizeof(want), "%.3f", CDTIME_T_TO_DOUBLE(t));
+    strbuf_init_fixed(&buf, got, sizeof(got));
+    if ((strbuf_print_time(&buf, t) != 0) || (strcmp(want, got) != 0)) {
+      printf("not ok - time %" PRIu64 ": got \"%s\", want \"%s\"\n", t, got,
+             want);
+      return -1;
+    }
+  }
+
+  return 0;
+}
+
+DEF_TEST(print_json_string) {
+  struct {
+    char const *in;
+    char const *want;
+  } cases[] = {
+      {"", "\"\""},
+      {"foo", "\"foo\""},
+      {"a\"b\\c", "\"a\\\"b\\\\c\""},
+      {"tab\there", "\"tab?here\""},
+      {"a long string without special characters",
+       "\"a long string without special characters\""},
+      {"0123456789abcdef\"0123456789\n", "\"0123456789abcdef\\\"0123456789?\""},
+      {"caf\xc3\xa9 au lait", "\"caf?? au lait\""},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    strbuf_t buf = STRBUF_CREATE;
+
+    CHECK_ZERO(strbuf_print_json_string(&buf, cases[i].in));
+    EXPECT_EQ_STR(cases[i].want, buf.ptr);
+    strbuf_destroy(&buf);
+  }
+
+  /* nothing is written if the string does not fit */
+  char buffer[12];
+  strbuf_t buf;
+  strbuf_init_fixed(&buf, buffer, sizeof(buffer));
+  CHECK_ZERO(strbuf_print(&buf, "x"));
+  OK(strbuf_print_json_string(&buf, "0123456789") != 0);
+  EXPECT_EQ_STR("x", buffer);
+
+  return 0;
+}
+
+DEF_TEST(print_replaced) {
+  strbuf_t buf = STRBUF_CREATE;
+  strbuf_charset_t set;
+
+  strbuf_charset_init(&set, ". ");
+  CHECK_ZERO(strbuf_print_replaced(&buf, "a.b c", &set, '_'));
+  CHECK_ZERO(strbuf_print_replaced(&buf, "", &set, '_'));
+  strbuf_charset_init(&set, ".");
+  strbuf_charset_add(&set, 0xff);
+  CHECK_ZERO(strbuf_print_replaced(&buf, ".x.\xff", &set, '@'));
+  EXPECT_EQ_STR("a_b_c@x@@", buf.ptr);
+
+  strbuf_destroy(&buf);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(print);
+  RUN_TEST(print_int);
+  RUN_TEST(print_double);
+  RUN_TEST(print_time);
+  RUN_TEST(print_json_string);
+  RUN_TEST(print_replaced);
+
+  END_TEST;
+}
@@ -28,6 +28,7 @@
 
 #include "common.h"
 #include "utils_avltree.h"
+#include "utils_cache.h"
 #include "utils_threshold.h"
 
 #include <pthread.h>
@@ -39,6 +40,10 @@ c_avl_tree_t *threshold_tree = NULL;
 pthread_mutex_t threshold_lock = PTHREAD_MUTEX_INITIALIZER;
 /* }}} */
 
+/* Incremented whenever the thresholds change. Starts at one, because cache
+ * entries without a memoized threshold have generation zero. */
+static unsigned int threshold_generation = 1;
+
 /*
  * threshold_t *threshold_get
  *
@@ -133,3 +138,43 @@ int ut_search_threshold(const value_list_t *vl, /* {{{ */
 
   return 0;
 } /* }}} int ut_search_threshold */
+
+void threshold_invalidate(void) /* {{{ */
+{
+  unsigned int generation =
+      __atomic_add_fetch(&threshold_generation, 1, __ATOMIC_RELEASE);
+  /* Skip zero when wrapping around. */
+  if (generation == 0)
+    __atomic_add_fetch(&threshold_generation, 1, __ATOMIC_RELEASE);
+} /* }}} void threshold_invalidate */
+
+int ut_lookup_threshold(const data_set_t *ds, const value_list_t *vl, /* {{{ */
+                        gauge_t *ret_rates, threshold_t **ret_th) {
+  threshold_t *th = NULL;
+  unsigned int memo_generation = 0;
+  unsigned int generation;
+
+  if ((ds == NULL) || (vl == NULL) || (ret_rates == NULL) || (ret_th == NULL))
+    return EINVAL;
+
+  generation = __atomic_load_n(&threshold_generation, __ATOMIC_ACQUIRE);
+
+  if (uc_get_rate_threshold(ds, vl, ret_rates, &th, &memo_generation) != 0)
+    return -1;
+
+  if (memo_generation != generation) {
+    /* The generation is read before searching, so a change of the thresholds
+     * during the search invalidates the result memoized here. */
+    pthread_mutex_lock(&threshold_lock);
+    th = threshold_search(vl);
+    pthread_mutex_unlock(&threshold_lock);
+
+    uc_set_threshold(vl, th, generation);
+  }
+
+  if (th == NULL)
+    return ENOENT;
+
+  *ret_th = th;
+  return 0;
+} /* }}} int ut_lookup_threshold */
@@ -60,4 +60,17 @@ threshold_t *threshold_search(const value_list_t *vl);
 
 int ut_search_threshold(const value_list_t *vl, threshold_t *ret_threshold);
 
+/* Marks the results of threshold_search() memoized in the value cache as
+ * stale. Must be called whenever "threshold_tree" is modified. */
+void threshold_invalidate(void);
+
+/* Looks up the thresholds of "vl" like threshold_search() and copies the
+ * rates of "vl" to "ret_rates", which must hold ds->ds_num values. The result
+ * of the search is memoized in the value cache, so "threshold_lock" is only
+ * taken the first time a value list is checked and after the thresholds have
+ * changed. Returns ENOENT if there is no threshold for "vl" and -1 if "vl" is
+ * not in the cache. */
+int ut_lookup_threshold(const data_set_t *ds, const value_list_t *vl,
+                        gauge_t *ret_rates, threshold_t **ret_th);
+
 #endif /* UTILS_THRESHOLD_H */
@@ -0,0 +1,207 @@
+/**
+ * collectd - src/daemon/utils_threshold_bench.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+/* Micro benchmark for the threshold lookup done by the threshold plugin for
+ * every value list: the number of value lists per second for which the
+ * thresholds and rates are looked up, once with threshold_search() and
+ * uc_get_rate() and once with the memoizing ut_lookup_threshold(). Half of the
+ * value lists have a host specific threshold, the other half fall back to the
+ * global threshold of their type after trying all other combinations.
+ *
+ * Usage: bench_utils_threshold [<thresholds> [<identifiers> [<threads>]]] */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_avltree.h"
+#include "utils_cache.h"
+#include "utils_threshold.h"
+
+#define ROUNDS 10
+
+int timeout_g = 2;
+
+/* Stubs for the functions provided by the daemon. */
+long global_option_get_long(const char *option, long default_value) {
+  if (strcasecmp("CacheShards", option) == 0)
+    return 16;
+  return default_value;
+}
+
+int plugin_dispatch_missing(const value_list_t *vl) { return 0; }
+
+vl_ident_t const *plugin_get_vl_ident(value_list_t const *vl) { return NULL; }
+
+static data_source_t dsrc = {"value", DS_TYPE_GAUGE, 0.0, NAN};
+static data_set_t ds = {"gauge", 1, &dsrc};
+
+static size_t idents_num = 100000;
+static size_t threads_num = 1;
+static _Bool use_memo;
+
+static void init_vl(value_list_t *vl, size_t i) {
+  ssnprintf(vl->host, sizeof(vl->host), "host%zu.example.com", i % 1000);
+  sstrncpy(vl->plugin, "bench", sizeof(vl->plugin));
+  ssnprintf(vl->plugin_instance, sizeof(vl->plugin_instance), "%zu", i / 1000);
+  sstrncpy(vl->type, "gauge", sizeof(vl->type));
+}
+
+static void add_threshold(char const *host, char const *plugin) {
+  threshold_t *th = calloc(1, sizeof(*th));
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  sstrncpy(th->host, host, sizeof(th->host));
+  sstrncpy(th->plugin, plugin, sizeof(th->plugin));
+  sstrncpy(th->type, "gauge", sizeof(th->type));
+  th->warning_min = th->failure_min = NAN;
+  th->warning_max = th->failure_max = 100.0;
+
+  format_name(name, sizeof(name), th->host, th->plugin, th->plugin_instance,
+              th->type, th->type_instance);
+  c_avl_insert(threshold_tree, strdup(name), th);
+}
+
+static void *check_thread(void *arg) {
+  size_t thread_index = (size_t)(uintptr_t)arg;
+  value_list_t vl = VALUE_LIST_INIT;
+  size_t found = 0;
+
+  for (size_t r = 0; r < ROUNDS; r++) {
+    for (size_t i = thread_index; i < idents_num; i += threads_num) {
+      threshold_t *th = NULL;
+
+      init_vl(&vl, i);
+
+      if (use_memo) {
+        gauge_t values[ds.ds_num];
+        if (ut_lookup_threshold(&ds, &vl, values, &th) == 0)
+          found++;
+      } else {
+        pthread_mutex_lock(&threshold_lock);
+        th = threshold_search(&vl);
+        pthread_mutex_unlock(&threshold_lock);
+
+        gauge_t *values = uc_get_rate(&ds, &vl);
+        if ((th != NULL) && (values != NULL))
+          found++;
+        sfree(values);
+      }
+    }
+  }
+
+  return (void *)found;
+}
+
+static double now_wall(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec) / 1e9;
+}
+
+/* Returns the number of value lists checked per second. */
+static double run(_Bool memo) {
+  pthread_t threads[threads_num];
+  size_t found = 0;
+  double start;
+
+  use_memo = memo;
+  start = now_wall();
+
+  for (size_t i = 0; i < threads_num; i++)
+    pthread_create(threads + i, NULL, check_thread, (void *)(uintptr_t)i);
+
+  for (size_t i = 0; i < threads_num; i++) {
+    void *ret;
+    pthread_join(threads[i], &ret);
+    found += (size_t)ret;
+  }
+
+  double elapsed = now_wall() - start;
+  size_t checked = ROUNDS * idents_num;
+
+  if (found != checked)
+    fprintf(stderr, "Found %zu of %zu thresholds.\n", found, checked);
+
+  return (double)checked / elapsed;
+}
+
+int main(int argc, char **argv) {
+  size_t thresholds_num = 1000;
+
+  if (argc > 1)
+    thresholds_num = (size_t)atol(argv[1]);
+  if (argc > 2)
+    idents_num = (size_t)atol(argv[2]);
+  if (argc > 3)
+    threads_num = (size_t)atol(argv[3]);
+  if ((idents_num < 1) || (threads_num < 1)) {
+    fprintf(stderr, "Usage: %s [<thresholds> [<identifiers> [<threads>]]]\n",
+            argv[0]);
+    return 1;
+  }
+
+  threshold_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
+  uc_init();
+
+  /* Host specific thresholds for the even hosts, one global threshold and
+   * unrelated thresholds to make the tree larger. */
+  add_threshold("", "");
+  for (size_t i = 0; i < 1000; i += 2) {
+    char host[DATA_MAX_NAME_LEN];
+    ssnprintf(host, sizeof(host), "host%zu.example.com", i);
+    add_threshold(host, "bench");
+  }
+  for (size_t i = 0; i + 501 < thresholds_num; i++) {
+    char plugin[DATA_MAX_NAME_LEN];
+    ssnprintf(plugin, sizeof(plugin), "other%zu", i);
+    add_threshold("", plugin);
+  }
+
+  for (size_t i = 0; i < idents_num; i++) {
+    value_list_t vl = VALUE_LIST_INIT;
+    value_t value = {.gauge = 42.0};
+
+    init_vl(&vl, i);
+    vl.values = &value;
+    vl.values_len = 1;
+    vl.time = TIME_T_TO_CDTIME_T(1);
+    vl.interval = TIME_T_TO_CDTIME_T(10);
+    uc_update(&ds, &vl);
+  }
+
+  /* The first memoized run fills the cache entries. */
+  run(/* memo = */ 1);
+
+  double search = run(/* memo = */ 0);
+  double memo = run(/* memo = */ 1);
+
+  printf("thresholds: %zu, identifiers: %zu, threads: %zu\n",
+         (size_t)c_avl_size(threshold_tree), idents_num, threads_num);
+  printf("threshold_search:    %10.0f checks/s\n", search);
+  printf("ut_lookup_threshold: %10.0f checks/s\n", memo);
+
+  return 0;
+}
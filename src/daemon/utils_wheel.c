@@ -0,0 +1,229 @@
+/**
+ * collectd - src/daemon/utils_wheel.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include <errno.h>
+#include <stdlib.h>
+
+#include "utils_wheel.h"
+
+/* Entries are kept in singly linked lists, one per slot. Slot
+ * (tick & mask) holds the entries due during "tick", where a tick is the time
+ * shifted right by "bits". Entries due before the wheel's current tick are put
+ * into the current slot. All ticks before the current tick have been emptied
+ * of due entries, so only the slots from the current tick on need to be
+ * looked at. Removed entries are kept on a free list and reused. */
+
+struct c_wheel_entry_s;
+typedef struct c_wheel_entry_s c_wheel_entry_t;
+struct c_wheel_entry_s {
+  void *ptr;
+  cdtime_t when;
+  c_wheel_entry_t *next;
+};
+
+struct c_wheel_s {
+  c_wheel_entry_t **slots;
+  uint64_t mask;
+  unsigned int bits;
+
+  uint64_t tick;
+  size_t size;
+
+  c_wheel_entry_t *free_list;
+};
+
+static uint64_t c_wheel_tick(c_wheel_t const *w, cdtime_t t) /* {{{ */
+{
+  return ((uint64_t)t) >> w->bits;
+} /* }}} uint64_t c_wheel_tick */
+
+static void *c_wheel_unlink(c_wheel_t *w, c_wheel_entry_t **pp) /* {{{ */
+{
+  c_wheel_entry_t *e = *pp;
+  void *ptr = e->ptr;
+
+  *pp = e->next;
+  e->ptr = NULL;
+  e->next = w->free_list;
+  w->free_list = e;
+  w->size--;
+
+  return ptr;
+} /* }}} void *c_wheel_unlink */
+
+c_wheel_t *c_wheel_create(cdtime_t resolution, size_t slots_num, /* {{{ */
+                          cdtime_t now) {
+  c_wheel_t *w = calloc(1, sizeof(*w));
+  if (w == NULL)
+    return NULL;
+
+  while ((w->bits < 63) && ((((cdtime_t)1) << w->bits) < resolution))
+    w->bits++;
+
+  size_t n = 1;
+  while (n < slots_num)
+    n <<= 1;
+  w->mask = (uint64_t)(n - 1);
+
+  w->slots = calloc(n, sizeof(*w->slots));
+  if (w->slots == NULL) {
+    free(w);
+    return NULL;
+  }
+
+  w->tick = c_wheel_tick(w, now);
+  return w;
+} /* }}} c_wheel_t *c_wheel_create */
+
+void c_wheel_destroy(c_wheel_t *w) /* {{{ */
+{
+  if (w == NULL)
+    return;
+
+  for (uint64_t i = 0; i <= w->mask; i++)
+    while (w->slots[i] != NULL)
+      c_wheel_unlink(w, w->slots + i);
+
+  while (w->free_list != NULL) {
+    c_wheel_entry_t *next = w->free_list->next;
+    free(w->free_list);
+    w->free_list = next;
+  }
+
+  free(w->slots);
+  free(w);
+} /* }}} void c_wheel_destroy */
+
+int c_wheel_insert(c_wheel_t *w, void *ptr, cdtime_t when) /* {{{ */
+{
+  c_wheel_entry_t *e = w->free_list;
+  if (e != NULL)
+    w->free_list = e->next;
+  else if ((e = malloc(sizeof(*e))) == NULL)
+    return ENOMEM;
+
+  uint64_t tick = c_wheel_tick(w, when);
+  if (tick < w->tick)
+    tick = w->tick;
+
+  c_wheel_entry_t **head = w->slots + (tick & w->mask);
+  e->ptr = ptr;
+  e->when = when;
+  e->next = *head;
+  *head = e;
+  w->size++;
+
+  return 0;
+} /* }}} int c_wheel_insert */
+
+void *c_wheel_get_due(c_wheel_t *w, cdtime_t now) /* {{{ */
+{
+  uint64_t now_tick = c_wheel_tick(w, now);
+
+  if (w->size == 0) {
+    if (w->tick < now_tick)
+      w->tick = now_tick;
+    return NULL;
+  }
+
+  /* Everything that was passed by more than one revolution is in one of the
+   * slots of the last revolution. */
+  if (now_tick > w->tick + w->mask)
+    w->tick = now_tick - w->mask;
+
+  for (uint64_t tick = w->tick;; tick++) {
+    for (c_wheel_entry_t **pp = w->slots + (tick & w->mask); *pp != NULL;
+         pp = &(*pp)->next)
+      if ((*pp)->when <= now)
+        return c_wheel_unlink(w, pp);
+
+    /* The clock may go backwards, so "now_tick" may be before "w->tick". */
+    if (tick >= now_tick)
+      break;
+    w->tick = tick + 1;
+  }
+
+  return NULL;
+} /* }}} void *c_wheel_get_due */
+
+void *c_wheel_get_any(c_wheel_t *w) /* {{{ */
+{
+  if (w->size == 0)
+    return NULL;
+
+  for (uint64_t i = 0; i <= w->mask; i++) {
+    c_wheel_entry_t **head = w->slots + ((w->tick + i) & w->mask);
+    if (*head != NULL)
+      return c_wheel_unlink(w, head);
+  }
+
+  return NULL;
+} /* }}} void *c_wheel_get_any */
+
+int c_wheel_next(c_wheel_t *w, cdtime_t *ret_when) /* {{{ */
+{
+  if (w->size == 0)
+    return ENOENT;
+
+  /* The first slot with an entry for the current revolution has the next
+   * entry. */
+  for (uint64_t tick = w->tick; tick <= w->tick + w->mask; tick++) {
+    _Bool found = 0;
+    cdtime_t min = 0;
+
+    for (c_wheel_entry_t *e = w->slots[tick & w->mask]; e != NULL;
+         e = e->next) {
+      if (c_wheel_tick(w, e->when) > tick)
+        continue;
+      if (!found || (e->when < min))
+        min = e->when;
+      found = 1;
+    }
+
+    if (found) {
+      *ret_when = min;
+      return 0;
+    }
+  }
+
+  /* All entries are more than one revolution away. */
+  _Bool found = 0;
+  cdtime_t min = 0;
+  for (uint64_t i = 0; i <= w->mask; i++)
+    for (c_wheel_entry_t *e = w->slots[i]; e != NULL; e = e->next) {
+      if (!found || (e->when < min))
+        min = e->when;
+      found = 1;
+    }
+
+  *ret_when = min;
+  return 0;
+} /* }}} int c_wheel_next */
+
+size_t c_wheel_size(c_wheel_t const *w) /* {{{ */
+{
+  return w->size;
+} /* }}} size_t c_wheel_size */
@@ -0,0 +1,129 @@
+/**
+ * collectd - src/daemon/utils_wheel.h
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#ifndef UTILS_WHEEL_H
+#define UTILS_WHEEL_H 1
+
+#include "utils_time.h"
+
+/*
+ * Hashed timing wheel. Pointers are stored together with the (absolute) time
+ * at which they are due, in the slot covering that time. Inserting is O(1),
+ * finding a due pointer only looks at the slots between the previous and the
+ * current time. Times further in the future than one revolution of the wheel
+ * share slots with earlier times and are skipped until they are due.
+ *
+ * The wheel does not do any locking.
+ */
+struct c_wheel_s;
+typedef struct c_wheel_s c_wheel_t;
+
+/*
+ * NAME
+ *   c_wheel_create
+ *
+ * DESCRIPTION
+ *   Allocates a new timing wheel.
+ *
+ * PARAMETERS
+ *   `resolution'  Time covered by one slot. Rounded up to the next power of
+ *                 two.
+ *   `slots_num'   Number of slots. Rounded up to the next power of two.
+ *   `now'         Current time. Pointers inserted with an earlier time are
+ *                 due immediately.
+ *
+ * RETURN VALUE
+ *   A c_wheel_t-pointer upon success or NULL upon failure.
+ */
+c_wheel_t *c_wheel_create(cdtime_t resolution, size_t slots_num, cdtime_t now);
+
+/*
+ * NAME
+ *   c_wheel_destroy
+ *
+ * DESCRIPTION
+ *   Deallocates a timing wheel. Stored pointers are lost, but of course not
+ *   freed. Use `c_wheel_get_any' to drain the wheel first.
+ */
+void c_wheel_destroy(c_wheel_t *w);
+
+/*
+ * NAME
+ *   c_wheel_insert
+ *
+ * DESCRIPTION
+ *   Stores `ptr' in the wheel, to be returned by `c_wheel_get_due' at or after
+ *   `when'. The same pointer may be stored more than once.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOMEM if allocating memory failed.
+ */
+int c_wheel_insert(c_wheel_t *w, void *ptr, cdtime_t when);
+
+/*
+ * NAME
+ *   c_wheel_get_due
+ *
+ * DESCRIPTION
+ *   Removes one pointer which is due at `now' from the wheel and returns it.
+ *   Pointers due within the same slot are not necessarily returned in order.
+ *
+ * RETURN VALUE
+ *   The pointer passed to `c_wheel_insert' or NULL if no pointer is due.
+ */
+void *c_wheel_get_due(c_wheel_t *w, cdtime_t now);
+
+/*
+ * NAME
+ *   c_wheel_get_any
+ *
+ * DESCRIPTION
+ *   Removes any pointer from the wheel, regardless of when it is due, and
+ *   returns it.
+ *
+ * RETURN VALUE
+ *   The pointer passed to `c_wheel_insert' or NULL if the wheel is empty.
+ */
+void *c_wheel_get_any(c_wheel_t *w);
+
+/*
+ * NAME
+ *   c_wheel_next
+ *
+ * DESCRIPTION
+ *   Looks up the time at which the next pointer is due, e.g. to decide how
+ *   long to sleep. Usually only the next non-empty slot is looked at; only if
+ *   all pointers are more than one revolution away are all of them looked at.
+ *
+ * RETURN VALUE
+ *   Zero upon success, ENOENT if the wheel is empty.
+ */
+int c_wheel_next(c_wheel_t *w, cdtime_t *ret_when);
+
+/* Returns the number of pointers stored in the wheel. */
+size_t c_wheel_size(c_wheel_t const *w);
+
+#endif /* UTILS_WHEEL_H */
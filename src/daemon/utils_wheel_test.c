@@ -0,0 +1,129 @@
+/**
+ * collectd - src/daemon/utils_wheel_test.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "collectd.h"
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "testing.h"
+#include "utils_wheel.h"
+
+DEF_TEST(due) {
+  /* 8 slots of 16 time units each, i.e. one revolution is 128 units. */
+  int values[] = {0, 1, 2, 3, 4, 5};
+  cdtime_t when[] = {90, 100, 115, 116, 300, 1000};
+  c_wheel_t *w;
+  cdtime_t next;
+
+  CHECK_NOT_NULL(w = c_wheel_create(10, 5, 100));
+  EXPECT_EQ_INT(ENOENT, c_wheel_next(w, &next));
+  OK(c_wheel_get_due(w, 100) == NULL);
+
+  /* Insert in reverse order, so the order of the lists doesn't matter. */
+  for (int i = (int)STATIC_ARRAY_SIZE(values) - 1; i >= 0; i--)
+    CHECK_ZERO(c_wheel_insert(w, &values[i], when[i]));
+  EXPECT_EQ_INT(6, (int)c_wheel_size(w));
+
+  CHECK_ZERO(c_wheel_next(w, &next));
+  EXPECT_EQ_UINT64(90, next);
+
+  /* 90 and 100 are due, 115 is in the same slot, but not yet due. */
+  int seen = 0;
+  for (int i = 0; i < 2; i++) {
+    int *ret;
+    CHECK_NOT_NULL(ret = c_wheel_get_due(w, 100));
+    OK((*ret == 0) || (*ret == 1));
+    seen |= 1 << *ret;
+  }
+  EXPECT_EQ_INT(3, seen);
+  OK(c_wheel_get_due(w, 100) == NULL);
+
+  CHECK_ZERO(c_wheel_next(w, &next));
+  EXPECT_EQ_UINT64(115, next);
+
+  int *ret;
+  CHECK_NOT_NULL(ret = c_wheel_get_due(w, 115));
+  EXPECT_EQ_INT(2, *ret);
+  CHECK_NOT_NULL(ret = c_wheel_get_due(w, 120));
+  EXPECT_EQ_INT(3, *ret);
+
+  /* 300 shares a slot with 160-175 and 1000 with 224-239. Neither is due
+   * then. */
+  OK(c_wheel_get_due(w, 180) == NULL);
+  OK(c_wheel_get_due(w, 240) == NULL);
+  CHECK_ZERO(c_wheel_next(w, &next));
+  EXPECT_EQ_UINT64(300, next);
+
+  /* More than one revolution is passed at once. */
+  CHECK_NOT_NULL(ret = c_wheel_get_due(w, 2000));
+  OK((*ret == 4) || (*ret == 5));
+  CHECK_NOT_NULL(ret = c_wheel_get_due(w, 2000));
+  OK((*ret == 4) || (*ret == 5));
+  OK(c_wheel_get_due(w, 2000) == NULL);
+  EXPECT_EQ_INT(0, (int)c_wheel_size(w));
+
+  /* Times in the past are due immediately, also if the clock went
+   * backwards. */
+  CHECK_ZERO(c_wheel_insert(w, &values[0], 10));
+  CHECK_NOT_NULL(ret = c_wheel_get_due(w, 1990));
+  EXPECT_EQ_INT(0, *ret);
+
+  c_wheel_destroy(w);
+  return 0;
+}
+
+DEF_TEST(drain) {
+  int values[100];
+  c_wheel_t *w;
+
+  CHECK_NOT_NULL(w = c_wheel_create(1, 16, 0));
+  for (int i = 0; i < 100; i++) {
+    values[i] = i;
+    CHECK_ZERO(c_wheel_insert(w, &values[i], (cdtime_t)(i * 37) % 1000));
+  }
+
+  int seen[100] = {0};
+  for (int i = 0; i < 100; i++) {
+    int *ret;
+    CHECK_NOT_NULL(ret = c_wheel_get_any(w));
+    seen[*ret]++;
+  }
+  OK(c_wheel_get_any(w) == NULL);
+  for (int i = 0; i < 100; i++)
+    EXPECT_EQ_INT(1, seen[i]);
+
+  /* Entries are reused after draining. */
+  for (int i = 0; i < 10; i++)
+    CHECK_ZERO(c_wheel_insert(w, &values[i], 5));
+  c_wheel_destroy(w);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(due);
+  RUN_TEST(drain);
+
+  END_TEST;
+}
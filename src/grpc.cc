@@ -29,15 +29,17 @@
 #include <google/protobuf/util/time_util.h>
 #include <grpc++/grpc++.h>
 
+#include <chrono>
+#include <condition_variable>
+#include <deque>
 #include <fstream>
 #include <iostream>
-#include <queue>
+#include <mutex>
 #include <vector>
 
 #include "collectd.grpc.pb.h"
 
 extern "C" {
-#include <fnmatch.h>
 #include <stdbool.h>
 
 #include "collectd.h"
@@ -45,6 +47,7 @@ extern "C" {
 #include "plugin.h"
 
 #include "daemon/utils_cache.h"
+#include "daemon/utils_complain.h"
 }
 
 using collectd::Collectd;
@@ -69,27 +72,17 @@ struct Listener {
 static std::vector<Listener> listeners;
 static grpc::string default_addr("0.0.0.0:50051");
 
+/* Number of completion queues, each served by one thread. */
+static size_t workers_num = 1;
+
+/* Number of value lists QueryValues reads from the cache at once. The cache
+ * is not locked while they are sent. */
+static const size_t query_batch_size = 128;
+
 /*
  * helper functions
  */
 
-static bool ident_matches(const value_list_t *vl, const value_list_t *matcher) {
-  if (fnmatch(matcher->host, vl->host, 0))
-    return false;
-
-  if (fnmatch(matcher->plugin, vl->plugin, 0))
-    return false;
-  if (fnmatch(matcher->plugin_instance, vl->plugin_instance, 0))
-    return false;
-
-  if (fnmatch(matcher->type, vl->type, 0))
-    return false;
-  if (fnmatch(matcher->type_instance, vl->type_instance, 0))
-    return false;
-
-  return true;
-} /* ident_matches */
-
 static grpc::string read_file(const char *filename) {
   std::ifstream f;
   grpc::string s, content;
@@ -165,10 +158,10 @@ static grpc::Status marshal_value_list(const value_list_t *vl,
                         grpc::string("failed to retrieve data-set for values"));
   }
 
-  auto t = TimeUtil::NanosecondsToTimestamp(CDTIME_T_TO_NS(vl->time));
-  auto d = TimeUtil::NanosecondsToDuration(CDTIME_T_TO_NS(vl->interval));
-  msg->set_allocated_time(new google::protobuf::Timestamp(t));
-  msg->set_allocated_interval(new google::protobuf::Duration(d));
+  *msg->mutable_time() =
+      TimeUtil::NanosecondsToTimestamp(CDTIME_T_TO_NS(vl->time));
+  *msg->mutable_interval() =
+      TimeUtil::NanosecondsToDuration(CDTIME_T_TO_NS(vl->interval));
 
   for (size_t i = 0; i < vl->values_len; ++i) {
     auto v = msg->add_values();
@@ -197,8 +190,11 @@ static grpc::Status marshal_value_list(const value_list_t *vl,
   return grpc::Status::OK;
 } /* marshal_value_list */
 
+/* The values are stored in "values", which is reused between calls, and
+ * "vl->values" points into it. */
 static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
-                                         value_list_t *vl) {
+                                         value_list_t *vl,
+                                         std::vector<value_t> *values) {
   vl->time = NS_TO_CDTIME_T(TimeUtil::TimestampToNanoseconds(msg.time()));
   vl->interval =
       NS_TO_CDTIME_T(TimeUtil::DurationToNanoseconds(msg.interval()));
@@ -207,176 +203,264 @@ static grpc::Status unmarshal_value_list(const collectd::types::ValueList &msg,
   if (!status.ok())
     return status;
 
-  value_t *values = NULL;
-  size_t values_len = 0;
-
-  status = grpc::Status::OK;
-  for (auto v : msg.values()) {
-    value_t *val =
-        (value_t *)realloc(values, (values_len + 1) * sizeof(*values));
-    if (!val) {
-      status = grpc::Status(grpc::StatusCode::RESOURCE_EXHAUSTED,
-                            grpc::string("failed to allocate values array"));
-      break;
-    }
-
-    values = val;
-    val = values + values_len;
-    values_len++;
+  values->clear();
+  for (auto &v : msg.values()) {
+    value_t val;
 
     switch (v.value_case()) {
     case collectd::types::Value::ValueCase::kCounter:
-      val->counter = counter_t(v.counter());
+      val.counter = counter_t(v.counter());
       break;
     case collectd::types::Value::ValueCase::kGauge:
-      val->gauge = gauge_t(v.gauge());
+      val.gauge = gauge_t(v.gauge());
       break;
     case collectd::types::Value::ValueCase::kDerive:
-      val->derive = derive_t(v.derive());
+      val.derive = derive_t(v.derive());
       break;
     case collectd::types::Value::ValueCase::kAbsolute:
-      val->absolute = absolute_t(v.absolute());
+      val.absolute = absolute_t(v.absolute());
       break;
     default:
-      status = grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
-                            grpc::string("unknown value type"));
-      break;
+      return grpc::Status(grpc::StatusCode::INVALID_ARGUMENT,
+                          grpc::string("unknown value type"));
     }
 
-    if (!status.ok())
-      break;
-  }
-  if (status.ok()) {
-    vl->values = values;
-    vl->values_len = values_len;
-  } else if (values) {
-    free(values);
+    values->push_back(val);
   }
 
-  return status;
+  vl->values = values->data();
+  vl->values_len = values->size();
+  return grpc::Status::OK;
 } /* unmarshal_value_list() */
 
 /*
  * Collectd service
+ *
+ * The service is implemented asynchronously: each call is an object driven by
+ * the events of a completion queue, so a few threads serve any number of
+ * concurrent streams.
  */
-class CollectdImpl : public collectd::Collectd::Service {
+
+/* The tag of every operation on a completion queue is the call it belongs
+ * to. Proceed() is invoked with the outcome of that operation. */
+class Call {
 public:
-  grpc::Status
-  QueryValues(grpc::ServerContext *ctx, QueryValuesRequest const *req,
-              grpc::ServerWriter<QueryValuesResponse> *writer) override {
-    value_list_t match;
-    auto status = unmarshal_ident(req->identifier(), &match, false);
-    if (!status.ok()) {
-      return status;
-    }
+  virtual ~Call() = default;
+  virtual void Proceed(bool ok) = 0;
+};
 
-    std::queue<value_list_t> value_lists;
-    status = this->queryValuesRead(&match, &value_lists);
-    if (status.ok()) {
-      status = this->queryValuesWrite(ctx, writer, &value_lists);
-    }
+class PutValuesCall final : public Call {
+public:
+  PutValuesCall(Collectd::AsyncService *service,
+                grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), reader_(&ctx_) {
+    service_->RequestPutValues(&ctx_, &reader_, cq_, cq_, this);
+  }
 
-    while (!value_lists.empty()) {
-      auto vl = value_lists.front();
-      value_lists.pop();
-      sfree(vl.values);
-    }
+  void Proceed(bool ok) override {
+    switch (state_) {
+    case State::REQUEST:
+      if (!ok) { /* shutting down */
+        delete this;
+        return;
+      }
 
-    return status;
-  }
+      /* accept the next stream */
+      new PutValuesCall(service_, cq_);
 
-  grpc::Status PutValues(grpc::ServerContext *ctx,
-                         grpc::ServerReader<PutValuesRequest> *reader,
-                         PutValuesResponse *res) override {
-    PutValuesRequest req;
+      state_ = State::READ;
+      reader_.Read(&req_, this);
+      break;
 
-    while (reader->Read(&req)) {
-      value_list_t vl = {0};
-      auto status = unmarshal_value_list(req.value_list(), &vl);
-      if (!status.ok())
-        return status;
+    case State::READ: {
+      if (!ok) { /* the client is done writing */
+        state_ = State::FINISH;
+        reader_.Finish(res_, grpc::Status::OK, this);
+        break;
+      }
 
-      if (plugin_dispatch_values(&vl))
-        return grpc::Status(
+      value_list_t vl = {0};
+      auto status = unmarshal_value_list(req_.value_list(), &vl, &values_);
+      if (status.ok() && plugin_dispatch_values(&vl))
+        status = grpc::Status(
             grpc::StatusCode::INTERNAL,
             grpc::string("failed to enqueue values for writing"));
+
+      if (!status.ok()) {
+        state_ = State::FINISH;
+        reader_.FinishWithError(status, this);
+        break;
+      }
+
+      reader_.Read(&req_, this);
+      break;
     }
 
-    res->Clear();
-    return grpc::Status::OK;
+    case State::FINISH:
+      delete this;
+      break;
+    }
   }
 
 private:
-  grpc::Status queryValuesRead(value_list_t const *match,
-                               std::queue<value_list_t> *value_lists) {
-    uc_iter_t *iter;
-    if ((iter = uc_get_iterator()) == NULL) {
-      return grpc::Status(
-          grpc::StatusCode::INTERNAL,
-          grpc::string("failed to query values: cannot create iterator"));
-    }
+  enum class State { REQUEST, READ, FINISH };
 
-    grpc::Status status = grpc::Status::OK;
-    char *name = NULL;
-    while (uc_iterator_next(iter, &name) == 0) {
-      value_list_t vl;
-      if (parse_identifier_vl(name, &vl) != 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to parse identifier"));
-        break;
-      }
+  Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  State state_ = State::REQUEST;
 
-      if (!ident_matches(&vl, match))
-        continue;
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncReader<PutValuesResponse, PutValuesRequest> reader_;
+  PutValuesRequest req_;
+  PutValuesResponse res_;
 
-      if (uc_iterator_get_time(iter, &vl.time) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value timestamp"));
-        break;
+  /* reused for the values of all received value lists */
+  std::vector<value_t> values_;
+};
+
+class QueryValuesCall final : public Call {
+public:
+  QueryValuesCall(Collectd::AsyncService *service,
+                  grpc::ServerCompletionQueue *cq)
+      : service_(service), cq_(cq), writer_(&ctx_) {
+    service_->RequestQueryValues(&ctx_, &req_, &writer_, cq_, cq_, this);
+  }
+
+  ~QueryValuesCall() { uc_iterator_destroy(iter_); }
+
+  void Proceed(bool ok) override {
+    switch (state_) {
+    case State::REQUEST:
+      if (!ok) { /* shutting down */
+        delete this;
+        return;
       }
-      if (uc_iterator_get_interval(iter, &vl.interval) < 0) {
-        status =
-            grpc::Status(grpc::StatusCode::INTERNAL,
-                         grpc::string("failed to retrieve value interval"));
+
+      /* accept the next call */
+      new QueryValuesCall(service_, cq_);
+
+      Start();
+      break;
+
+    case State::WRITE:
+      if (!ok) { /* the client went away */
+        Finish(grpc::Status::CANCELLED);
         break;
       }
-      if (uc_iterator_get_values(iter, &vl.values, &vl.values_len) < 0) {
-        status = grpc::Status(grpc::StatusCode::INTERNAL,
-                              grpc::string("failed to retrieve values"));
-        break;
+      WriteNext();
+      break;
+
+    case State::FINISH:
+      delete this;
+      break;
+    }
+  }
+
+private:
+  enum class State { REQUEST, WRITE, FINISH };
+
+  void Start() {
+    value_list_t match = {0};
+    auto status = unmarshal_ident(req_.identifier(), &match, false);
+    if (!status.ok()) {
+      Finish(status);
+      return;
+    }
+
+    iter_ = uc_get_iterator();
+    if (iter_ == NULL) {
+      Finish(grpc::Status(
+          grpc::StatusCode::INTERNAL,
+          grpc::string("failed to query values: cannot create iterator")));
+      return;
+    }
+    uc_iterator_set_match(iter_, &match);
+
+    WriteNext();
+  }
+
+  /* Sends the next value list, reading the next batch from the cache once
+   * the current one has been sent. Writes of a batch are corked, so a batch
+   * is sent in as few packets as possible. */
+  void WriteNext() {
+    if (batch_pos_ >= batch_num_) {
+      auto status = ReadBatch();
+      if (!status.ok() || (batch_num_ == 0)) {
+        Finish(status);
+        return;
       }
+    }
 
-      value_lists->push(vl);
-    } // while (uc_iterator_next(iter, &name) == 0)
+    grpc::WriteOptions opts;
+    if (batch_pos_ + 1 < batch_num_)
+      opts.set_buffer_hint();
 
-    uc_iterator_destroy(iter);
-    return status;
+    state_ = State::WRITE;
+    writer_.Write(batch_[batch_pos_++], opts, this);
   }
 
-  grpc::Status queryValuesWrite(grpc::ServerContext *ctx,
-                                grpc::ServerWriter<QueryValuesResponse> *writer,
-                                std::queue<value_list_t> *value_lists) {
-    while (!value_lists->empty()) {
-      auto vl = value_lists->front();
-      QueryValuesResponse res;
-      res.Clear();
+  /* Reads up to query_batch_size matching value lists. The messages of the
+   * previous batch are reused. The cache lock is released before returning. */
+  grpc::Status ReadBatch() {
+    grpc::Status status = grpc::Status::OK;
 
-      auto status = marshal_value_list(&vl, res.mutable_value_list());
-      if (!status.ok()) {
-        return status;
+    batch_num_ = 0;
+    batch_pos_ = 0;
+    if (iter_ == NULL)
+      return status;
+
+    while (batch_num_ < query_batch_size) {
+      if (uc_iterator_next(iter_, NULL) != 0) {
+        uc_iterator_destroy(iter_);
+        iter_ = NULL;
+        break;
       }
 
-      if (!writer->Write(res)) {
-        return grpc::Status::CANCELLED;
+      value_list_t vl = {0};
+      if ((uc_iterator_get_identifier(iter_, &vl) != 0) ||
+          (uc_iterator_get_time(iter_, &vl.time) != 0) ||
+          (uc_iterator_get_interval(iter_, &vl.interval) != 0) ||
+          (uc_iterator_get_values(iter_, &vl.values, &vl.values_len) != 0)) {
+        status = grpc::Status(grpc::StatusCode::INTERNAL,
+                              grpc::string("failed to retrieve values"));
+        break;
       }
 
-      value_lists->pop();
+      if (batch_.size() <= batch_num_)
+        batch_.emplace_back();
+      auto res = &batch_[batch_num_];
+      res->Clear();
+
+      status = marshal_value_list(&vl, res->mutable_value_list());
       sfree(vl.values);
+      if (!status.ok())
+        break;
+
+      batch_num_++;
     }
 
-    return grpc::Status::OK;
+    if (iter_ != NULL)
+      uc_iterator_pause(iter_);
+    return status;
+  }
+
+  void Finish(grpc::Status const &status) {
+    state_ = State::FINISH;
+    writer_.Finish(status, this);
   }
+
+  Collectd::AsyncService *service_;
+  grpc::ServerCompletionQueue *cq_;
+  State state_ = State::REQUEST;
+
+  grpc::ServerContext ctx_;
+  grpc::ServerAsyncWriter<QueryValuesResponse> writer_;
+  QueryValuesRequest req_;
+
+  uc_iter_t *iter_ = NULL;
+  std::vector<QueryValuesResponse> batch_;
+  size_t batch_num_ = 0;
+  size_t batch_pos_ = 0;
 };
 
 /*
@@ -384,7 +468,7 @@ private:
  */
 class CollectdServer final {
 public:
-  void Start() {
+  int Start() {
     auto auth = grpc::InsecureServerCredentials();
 
     grpc::ServerBuilder builder;
@@ -408,27 +492,137 @@ public:
       }
     }
 
-    builder.RegisterService(&collectd_service_);
+    builder.RegisterService(&service_);
+    for (size_t i = 0; i < workers_num; i++)
+      cqs_.push_back(builder.AddCompletionQueue());
 
     server_ = builder.BuildAndStart();
+    if (!server_) {
+      ERROR("grpc: Failed to start server");
+      return -1;
+    }
+
+    for (auto &cq : cqs_) {
+      new PutValuesCall(&service_, cq.get());
+      new QueryValuesCall(&service_, cq.get());
+
+      pthread_t thread;
+      int status = plugin_thread_create(&thread, NULL, CollectdServer::Work,
+                                        cq.get(), "grpc worker");
+      if (status != 0) {
+        char errbuf[1024];
+        ERROR("grpc: Starting a worker thread failed: %s",
+              sstrerror(status, errbuf, sizeof(errbuf)));
+        continue;
+      }
+      threads_.push_back(thread);
+    }
+
+    return 0;
   } /* Start() */
 
-  void Shutdown() { server_->Shutdown(); } /* Shutdown() */
+  void Shutdown() {
+    /* PutValues streams of agents are never closed by the client: cancel
+     * whatever is still running after a grace period */
+    if (server_)
+      server_->Shutdown(std::chrono::system_clock::now() +
+                        std::chrono::seconds(5));
+
+    /* outstanding operations complete with ok == false, which lets the calls
+     * clean up; Next() returns false once the queue is drained */
+    for (auto &cq : cqs_)
+      cq->Shutdown();
+    for (auto thread : threads_)
+      pthread_join(thread, NULL);
+    threads_.clear();
+
+    /* drain queues which had no worker thread */
+    void *tag;
+    bool ok;
+    for (auto &cq : cqs_)
+      while (cq->Next(&tag, &ok))
+        static_cast<Call *>(tag)->Proceed(ok);
+  } /* Shutdown() */
 
 private:
-  CollectdImpl collectd_service_;
+  static void *Work(void *arg) {
+    auto cq = static_cast<grpc::ServerCompletionQueue *>(arg);
+    void *tag;
+    bool ok;
+
+    while (cq->Next(&tag, &ok))
+      static_cast<Call *>(tag)->Proceed(ok);
+
+    return NULL;
+  } /* Work() */
+
+  Collectd::AsyncService service_;
+  std::vector<std::unique_ptr<grpc::ServerCompletionQueue>> cqs_;
+  std::vector<pthread_t> threads_;
 
   std::unique_ptr<grpc::Server> server_;
 }; /* class CollectdServer */
 
+/*
+ * gRPC client implementation
+ *
+ * Value lists are queued by the write callback and sent by a separate thread
+ * over a single, long-lived PutValues stream. Writes of a batch are corked.
+ * Write() blocks while the server's flow control window is exhausted; the
+ * queue then grows up to QueueLength, after which the oldest value lists are
+ * dropped.
+ */
 class CollectdClient final {
 public:
-  CollectdClient(std::shared_ptr<grpc::ChannelInterface> channel)
-      : stub_(Collectd::NewStub(channel)) {}
+  CollectdClient(grpc::string addr, bool use_ssl,
+                 grpc::SslCredentialsOptions ssl_opts, size_t batch_size,
+                 size_t queue_length)
+      : addr_(addr), use_ssl_(use_ssl), ssl_opts_(ssl_opts),
+        batch_size_(batch_size), queue_length_(queue_length) {
+    C_COMPLAIN_INIT(&send_complaint_);
+    C_COMPLAIN_INIT(&queue_complaint_);
+  }
 
-  int PutValues(value_list_t const *vl) {
-    grpc::ClientContext ctx;
+  ~CollectdClient() { Stop(); }
+
+  /* Creates the channel and the client thread. gRPC starts threads of its own,
+   * so this must not be called before the daemon forked, i.e. not before the
+   * init callback. */
+  int Start() {
+    auto channel_creds = use_ssl_ ? grpc::SslCredentials(ssl_opts_)
+                                  : grpc::InsecureChannelCredentials();
+    stub_ = Collectd::NewStub(grpc::CreateChannel(addr_, channel_creds));
+
+    int status = plugin_thread_create(&thread_, NULL, CollectdClient::Run,
+                                      this, "grpc client");
+    if (status != 0) {
+      char errbuf[1024];
+      ERROR("grpc: Starting the client thread for %s failed: %s",
+            addr_.c_str(), sstrerror(status, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    running_ = true;
+    return 0;
+  } /* int Start */
+
+  /* Stops the client thread. A write blocked on an unresponsive server is
+   * cancelled; value lists that have not been sent by then are dropped. */
+  void Stop() {
+    if (!running_)
+      return;
+
+    {
+      std::lock_guard<std::mutex> lock(lock_);
+      stop_ = true;
+      if (ctx_)
+        ctx_->TryCancel();
+    }
+    cond_.notify_all();
+    pthread_join(thread_, NULL);
+    running_ = false;
+  } /* void Stop */
 
+  int PutValues(value_list_t const *vl) {
     PutValuesRequest req;
     auto status = marshal_value_list(vl, req.mutable_value_list());
     if (!status.ok()) {
@@ -436,29 +630,148 @@ public:
       return -1;
     }
 
-    PutValuesResponse res;
-    auto stream = stub_->PutValues(&ctx, &res);
-    if (!stream->Write(req)) {
-      NOTICE("grpc: Broken stream.");
-      /* intentionally not returning. */
+    std::lock_guard<std::mutex> lock(lock_);
+
+    if (queue_.size() >= queue_length_) {
+      queue_.pop_front();
+      c_complain(LOG_WARNING, &queue_complaint_,
+                 "grpc: The queue for %s is full. Dropping the oldest value "
+                 "lists.",
+                 addr_.c_str());
+    } else if (queue_.size() < queue_length_ / 2) {
+      c_release(LOG_INFO, &queue_complaint_,
+                "grpc: The queue for %s is no longer full.", addr_.c_str());
     }
 
-    stream->WritesDone();
-    status = stream->Finish();
-    if (!status.ok()) {
-      ERROR("grpc: Error while closing stream.");
-      return -1;
-    }
+    queue_.push_back(std::move(req));
+    if (queue_.size() == 1)
+      cond_.notify_one();
 
     return 0;
   } /* int PutValues */
 
 private:
+  static void *Run(void *arg) {
+    static_cast<CollectdClient *>(arg)->Send();
+    return NULL;
+  }
+
+  void Send() {
+    std::vector<PutValuesRequest> batch;
+    auto retry_delay = std::chrono::seconds(1);
+
+    std::unique_lock<std::mutex> lock(lock_);
+    while (true) {
+      cond_.wait(lock, [this] { return stop_ || !queue_.empty(); });
+      if (queue_.empty())
+        break;
+
+      batch.clear();
+      while (!queue_.empty() && (batch.size() < batch_size_)) {
+        batch.push_back(std::move(queue_.front()));
+        queue_.pop_front();
+      }
+
+      lock.unlock();
+      size_t sent = WriteBatch(batch);
+      lock.lock();
+
+      if (sent == batch.size()) {
+        retry_delay = std::chrono::seconds(1);
+        continue;
+      }
+
+      if (stop_) {
+        ERROR("grpc: Dropping %zu value lists for %s on shutdown.",
+              batch.size() - sent + queue_.size(), addr_.c_str());
+        queue_.clear();
+        break;
+      }
+
+      /* put back what was not sent, keeping the queue's limit */
+      for (size_t i = batch.size(); i > sent; i--) {
+        if (queue_.size() >= queue_length_)
+          break;
+        queue_.push_front(std::move(batch[i - 1]));
+      }
+
+      cond_.wait_for(lock, retry_delay, [this] { return stop_; });
+      if (retry_delay < std::chrono::seconds(32))
+        retry_delay *= 2;
+    }
+    lock.unlock();
+
+    if (stream_) {
+      stream_->WritesDone();
+      auto status = stream_->Finish();
+      if (!status.ok() &&
+          (status.error_code() != grpc::StatusCode::CANCELLED))
+        ERROR("grpc: Closing the stream to %s failed: %s", addr_.c_str(),
+              status.error_message().c_str());
+      stream_.reset();
+    }
+  } /* void Send */
+
+  /* Returns the number of value lists written. Value lists written before a
+   * failure may nevertheless be lost. */
+  size_t WriteBatch(std::vector<PutValuesRequest> const &batch) {
+    if (!stream_) {
+      /* ctx_ is replaced under lock_, so that Stop() can cancel it. */
+      std::lock_guard<std::mutex> lock(lock_);
+      if (stop_)
+        return 0;
+      ctx_.reset(new grpc::ClientContext());
+      stream_ = stub_->PutValues(ctx_.get(), &res_);
+    }
+
+    for (size_t i = 0; i < batch.size(); i++) {
+      grpc::WriteOptions opts;
+      if (i + 1 < batch.size())
+        opts.set_buffer_hint();
+
+      if (!stream_->Write(batch[i], opts)) {
+        auto status = stream_->Finish();
+        stream_.reset();
+        c_complain(LOG_ERR, &send_complaint_,
+                   "grpc: Sending values to %s failed: %s", addr_.c_str(),
+                   status.error_message().c_str());
+        return i;
+      }
+    }
+
+    c_release(LOG_INFO, &send_complaint_,
+              "grpc: Sending values to %s succeeded again.", addr_.c_str());
+    return batch.size();
+  } /* size_t WriteBatch */
+
   std::unique_ptr<Collectd::Stub> stub_;
+  grpc::string addr_;
+  bool use_ssl_;
+  grpc::SslCredentialsOptions ssl_opts_;
+  size_t batch_size_;
+  size_t queue_length_;
+
+  /* only used by the client thread; ctx_ is only replaced with lock_ held */
+  std::unique_ptr<grpc::ClientContext> ctx_;
+  std::unique_ptr<grpc::ClientWriter<PutValuesRequest>> stream_;
+  PutValuesResponse res_;
+  c_complain_t send_complaint_;
+
+  std::mutex lock_;
+  std::condition_variable cond_;
+  std::deque<PutValuesRequest> queue_;
+  c_complain_t queue_complaint_;
+  bool stop_ = false;
+
+  pthread_t thread_;
+  bool running_ = false;
 };
 
 static CollectdServer *server = nullptr;
 
+/* clients configured with <Server> blocks; owned by their write callbacks */
+static std::vector<CollectdClient *> clients;
+
 /*
  * collectd plugin interface
  */
@@ -547,6 +860,8 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
 
   grpc::SslCredentialsOptions ssl_opts;
   bool use_ssl = false;
+  int batch_size = 64;
+  int queue_length = 65536;
 
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
@@ -573,6 +888,16 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
         return -1;
       }
       ssl_opts.pem_cert_chain = read_file(cert);
+    } else if (!strcasecmp("BatchSize", child->key)) {
+      if (cf_util_get_int(child, &batch_size) || (batch_size < 1)) {
+        ERROR("grpc: Option `%s` expects a positive integer", child->key);
+        return -1;
+      }
+    } else if (!strcasecmp("QueueLength", child->key)) {
+      if (cf_util_get_int(child, &queue_length) || (queue_length < 1)) {
+        ERROR("grpc: Option `%s` expects a positive integer", child->key);
+        return -1;
+      }
     } else {
       WARNING("grpc: Option `%s` not allowed in <%s> block.", child->key,
               ci->key);
@@ -583,16 +908,9 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
   auto service = grpc::string(ci->values[1].value.string);
   auto addr = node + ":" + service;
 
-  CollectdClient *client;
-  if (use_ssl) {
-    auto channel_creds = grpc::SslCredentials(ssl_opts);
-    auto channel = grpc::CreateChannel(addr, channel_creds);
-    client = new CollectdClient(channel);
-  } else {
-    auto channel =
-        grpc::CreateChannel(addr, grpc::InsecureChannelCredentials());
-    client = new CollectdClient(channel);
-  }
+  /* The client is started by c_grpc_init(). */
+  auto client = new CollectdClient(addr, use_ssl, ssl_opts, (size_t)batch_size,
+                                   (size_t)queue_length);
 
   auto callback_name = grpc::string("grpc/") + addr;
   user_data_t ud = {
@@ -600,6 +918,7 @@ static int c_grpc_config_server(oconfig_item_t *ci) {
   };
 
   plugin_register_write(callback_name.c_str(), c_grpc_write, &ud);
+  clients.push_back(client);
   return 0;
 } /* c_grpc_config_server() */
 
@@ -615,6 +934,13 @@ static int c_grpc_config(oconfig_item_t *ci) {
     } else if (!strcasecmp("Server", child->key)) {
       if (c_grpc_config_server(child))
         return -1;
+    } else if (!strcasecmp("Workers", child->key)) {
+      int tmp = 0;
+      if (cf_util_get_int(child, &tmp) || (tmp < 1)) {
+        ERROR("grpc: Option `%s` expects a positive integer", child->key);
+        return -1;
+      }
+      workers_num = (size_t)tmp;
     }
 
     else {
@@ -626,17 +952,29 @@ static int c_grpc_config(oconfig_item_t *ci) {
 } /* c_grpc_config() */
 
 static int c_grpc_init(void) {
+  for (auto client : clients)
+    if (client->Start() != 0)
+      return -1;
+
   server = new CollectdServer();
   if (!server) {
     ERROR("grpc: Failed to create server");
     return -1;
   }
 
-  server->Start();
+  if (server->Start() != 0) {
+    server->Shutdown();
+    delete server;
+    server = nullptr;
+    return -1;
+  }
   return 0;
 } /* c_grpc_init() */
 
 static int c_grpc_shutdown(void) {
+  /* The clients are stopped and freed with their write callbacks. */
+  clients.clear();
+
   if (!server)
     return 0;
 
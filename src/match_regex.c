@@ -83,6 +83,8 @@ static void mr_free_regex(mr_regex_t *r) /* {{{ */
 
   if (r->next != NULL)
     mr_free_regex(r->next);
+
+  sfree(r);
 } /* }}} void mr_free_regex */
 
 static void mr_free_match(mr_match_t *m) /* {{{ */
@@ -306,6 +308,64 @@ static int mr_destroy(void **user_data) /* {{{ */
   return 0;
 } /* }}} int mr_destroy */
 
+/* Checks whether `re_str' only matches one string, i.e. is of the form
+ * "^literal$", and copies that string to `buffer'. `buffer' is only modified
+ * if the regular expression is a literal. */
+static int mr_regex_literal(const char *re_str, /* {{{ */
+                            char *buffer, size_t buffer_size) {
+  char literal[DATA_MAX_NAME_LEN];
+  size_t len = strlen(re_str);
+  size_t pos = 0;
+
+  if ((len < 2) || (re_str[0] != '^') || (re_str[len - 1] != '$'))
+    return -1;
+
+  for (size_t i = 1; i < len - 1; i++) {
+    char c = re_str[i];
+
+    if (c == '\\') {
+      i++;
+      c = re_str[i];
+      /* A trailing backslash would escape the `$' anchor and escaped letters
+       * and digits are not necessarily literals. */
+      if ((i >= len - 1) || isalnum((unsigned char)c))
+        return -1;
+    } else if (strchr(".[]()*+?{}|^$", c) != NULL) {
+      return -1;
+    }
+
+    if ((pos >= buffer_size - 1) || (pos >= sizeof(literal) - 1))
+      return -1;
+    literal[pos++] = c;
+  }
+
+  literal[pos] = 0;
+  memcpy(buffer, literal, pos + 1);
+  return 0;
+} /* }}} int mr_regex_literal */
+
+static void mr_regexen_literal(mr_regex_t *re_head, /* {{{ */
+                               char *buffer, size_t buffer_size) {
+  for (mr_regex_t *re = re_head; re != NULL; re = re->next)
+    if (mr_regex_literal(re->re_str, buffer, buffer_size) == 0)
+      return;
+} /* }}} void mr_regexen_literal */
+
+static int mr_key(void *user_data, fc_match_key_t *ret_key) /* {{{ */
+{
+  mr_match_t *m = user_data;
+
+  /* All regular expressions need to match, so any one of them which only
+   * matches a single name restricts the value lists that may be matched. */
+  if ((m == NULL) || m->invert)
+    return -1;
+
+  mr_regexen_literal(m->plugin, ret_key->plugin, sizeof(ret_key->plugin));
+  mr_regexen_literal(m->type, ret_key->type, sizeof(ret_key->type));
+
+  return 0;
+} /* }}} int mr_key */
+
 static int mr_match(const data_set_t __attribute__((unused)) * ds, /* {{{ */
                     const value_list_t *vl,
                     notification_meta_t __attribute__((unused)) * *meta,
@@ -362,5 +422,6 @@ void module_register(void) {
   mproc.create = mr_create;
   mproc.destroy = mr_destroy;
   mproc.match = mr_match;
+  mproc.key = mr_key;
   fc_register_match("regex", mproc);
 } /* module_register */
@@ -0,0 +1,213 @@
+/**
+ * collectd - src/match_regex_test.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "daemon/filter_chain.c" /* sic */
+#include "match_regex.c"        /* sic */
+#include "testing.h"
+
+/* mr_create() is not tested, so the configuration parser is not needed. */
+int cf_util_get_boolean(const oconfig_item_t *ci, _Bool *ret_bool) {
+  return ENOTSUP;
+}
+
+DEF_TEST(regex_literal) {
+  struct {
+    char const *re;
+    char const *want; /* NULL if the regex is not a literal */
+  } cases[] = {
+      {"^cpu$", "cpu"},
+      {"^if_octets$", "if_octets"},
+      {"^$", ""},
+      {"^cpu\\.0$", "cpu.0"},
+      {"^a\\-b$", "a-b"},
+      /* not anchored */
+      {"cpu", NULL},
+      {"^cpu", NULL},
+      {"cpu$", NULL},
+      {"^", NULL},
+      /* meta characters */
+      {"^cpu.$", NULL},
+      {"^(cpu|memory)$", NULL},
+      {"^cpu[0-9]$", NULL},
+      {"^cpu+$", NULL},
+      {"^c^pu$", NULL},
+      {"^cpu.*$", NULL},
+      {"^cpu|^memory$", NULL},
+      /* escaped letters and digits are not necessarily literals */
+      {"^cpu\\d$", NULL},
+      {"^cpu\\1$", NULL},
+      /* a trailing backslash escapes the anchor */
+      {"^cpu\\$", NULL},
+  };
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    char buffer[DATA_MAX_NAME_LEN] = "unchanged";
+
+    if (cases[i].want == NULL) {
+      OK1(mr_regex_literal(cases[i].re, buffer, sizeof(buffer)) != 0,
+          cases[i].re);
+      /* Nothing is left behind in the buffer. */
+      EXPECT_EQ_STR("unchanged", buffer);
+      continue;
+    }
+    CHECK_ZERO(mr_regex_literal(cases[i].re, buffer, sizeof(buffer)));
+    EXPECT_EQ_STR(cases[i].want, buffer);
+  }
+
+  /* The literal must fit into the buffer, including the null byte. */
+  char small[4] = "";
+  OK(mr_regex_literal("^cpu0$", small, sizeof(small)) != 0);
+  EXPECT_EQ_STR("", small);
+  CHECK_ZERO(mr_regex_literal("^cpu$", small, sizeof(small)));
+  EXPECT_EQ_STR("cpu", small);
+
+  return 0;
+}
+
+DEF_TEST(key) {
+  mr_match_t *m;
+  fc_match_key_t key = {{0}};
+
+  CHECK_NOT_NULL(m = calloc(1, sizeof(*m)));
+
+  /* Any literal one of the regular expressions restricts the value lists which
+   * may match, since all of them need to match. */
+  CHECK_ZERO(mr_add_regex(&m->plugin, "^c", "Plugin"));
+  CHECK_ZERO(mr_add_regex(&m->plugin, "^cpu$", "Plugin"));
+  CHECK_ZERO(mr_add_regex(&m->type, "^if_", "Type"));
+  CHECK_ZERO(mr_add_regex(&m->type_instance, "^idle$", "TypeInstance"));
+
+  CHECK_ZERO(mr_key(m, &key));
+  EXPECT_EQ_STR("cpu", key.plugin);
+  EXPECT_EQ_STR("", key.type);
+
+  /* The key must agree with the match. */
+  value_list_t vl = VALUE_LIST_INIT;
+  void *user_data = m;
+  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+  sstrncpy(vl.type, "if_octets", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "idle", sizeof(vl.type_instance));
+  EXPECT_EQ_INT(FC_MATCH_MATCHES, mr_match(NULL, &vl, NULL, &user_data));
+  sstrncpy(vl.plugin, "cpufreq", sizeof(vl.plugin));
+  EXPECT_EQ_INT(FC_MATCH_NO_MATCH, mr_match(NULL, &vl, NULL, &user_data));
+
+  /* Anchored regular expressions which are not literals yield no key. */
+  char const *not_literal[] = {"^cpu.*$", "^cpu[0-9]$", "^cpu|^memory$"};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(not_literal); i++) {
+    mr_match_t *nm;
+    CHECK_NOT_NULL(nm = calloc(1, sizeof(*nm)));
+    CHECK_ZERO(mr_add_regex(&nm->plugin, not_literal[i], "Plugin"));
+
+    memset(&key, 0, sizeof(key));
+    CHECK_ZERO(mr_key(nm, &key));
+    EXPECT_EQ_STR("", key.plugin);
+    EXPECT_EQ_STR("", key.type);
+    mr_free_match(nm);
+  }
+
+  /* An inverted match may match any value list. */
+  m->invert = 1;
+  memset(&key, 0, sizeof(key));
+  OK(mr_key(m, &key) != 0);
+
+  mr_free_match(m);
+  return 0;
+}
+
+static int chain_invoked;
+
+static int test_target_count(const data_set_t *ds, value_list_t *vl,
+                             notification_meta_t **meta, void **user_data) {
+  chain_invoked++;
+  return FC_TARGET_CONTINUE;
+}
+
+/* Checks that rules using the "regex" match are indexed so that they are
+ * still checked for all value lists they may match. */
+DEF_TEST(chain) {
+  struct {
+    char const *re;
+    char const *plugin;
+    _Bool want;
+  } cases[] = {
+      {"^cpu$", "cpu", 1},
+      {"^cpu$", "cpufreq", 0},
+      {"^cpu.*$", "cpu", 1},
+      {"^cpu.*$", "cpufreq", 1},
+      {"^cpu[0-9]$", "cpu0", 1},
+      {"^cpu|^memory$", "memory", 1},
+      {"^cpu|^memory$", "cpufreq", 1},
+      {"^cpu|^memory$", "df", 0},
+  };
+
+  module_register();
+  fc_match_t *registered = match_list_head;
+  CHECK_NOT_NULL(registered);
+  EXPECT_EQ_STR("regex", registered->name);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cases); i++) {
+    fc_chain_t *c;
+    fc_rule_t *r;
+    fc_match_t *match;
+    fc_target_t *target;
+    mr_match_t *m;
+
+    CHECK_NOT_NULL(c = calloc(1, sizeof(*c)));
+    CHECK_NOT_NULL(r = calloc(1, sizeof(*r)));
+    CHECK_NOT_NULL(match = calloc(1, sizeof(*match)));
+    CHECK_NOT_NULL(target = calloc(1, sizeof(*target)));
+    CHECK_NOT_NULL(m = calloc(1, sizeof(*m)));
+    CHECK_ZERO(mr_add_regex(&m->plugin, cases[i].re, "Plugin"));
+
+    match->proc = registered->proc;
+    match->user_data = m;
+    target->proc.invoke = test_target_count;
+    r->matches = match;
+    r->targets = target;
+    c->rules = r;
+    CHECK_ZERO(fc_compile_chain(c));
+
+    value_list_t vl = VALUE_LIST_INIT;
+    sstrncpy(vl.plugin, cases[i].plugin, sizeof(vl.plugin));
+    sstrncpy(vl.type, "gauge", sizeof(vl.type));
+
+    chain_invoked = 0;
+    EXPECT_EQ_INT(FC_TARGET_CONTINUE, fc_process_chain(NULL, &vl, c));
+    OK1(chain_invoked == (cases[i].want ? 1 : 0), cases[i].re);
+
+    fc_free_chains(c);
+  }
+
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(regex_literal);
+  RUN_TEST(key);
+  RUN_TEST(chain);
+
+  END_TEST;
+}
@@ -24,6 +24,7 @@
 
 #define _DEFAULT_SOURCE
 #define _BSD_SOURCE /* For struct ip_mreq */
+#define _GNU_SOURCE /* For recvmmsg(2) and sendmmsg(2) */
 
 #include "collectd.h"
 
@@ -117,12 +118,13 @@ struct sockent_client {
 
 struct sockent_server {
   int *fd;
+  /* Index of the worker reading each file descriptor. */
+  size_t *fd_worker;
   size_t fd_num;
 #if HAVE_GCRYPT_H
   int security_level;
   char *auth_file;
   fbhash_t *userdb;
-  gcry_cipher_hd_t cypher;
 #endif
 };
 
@@ -250,14 +252,57 @@ struct part_encryption_aes256_s {
 };
 typedef struct part_encryption_aes256_s part_encryption_aes256_t;
 
+/* Entries and their packet buffers are recycled: the dispatch thread puts them
+ * back into the receive pool after parsing. */
 struct receive_list_entry_s {
   char *data;
   int data_len;
-  int fd;
+  sockent_t *se;
   struct receive_list_entry_s *next;
 };
 typedef struct receive_list_entry_s receive_list_entry_t;
 
+/* Each worker has a receive thread, reading its own set of sockets, and a
+ * dispatch thread, parsing the packets. With more than one worker, each
+ * worker has its own socket for every unicast address and the kernel
+ * distributes the packets among them (SO_REUSEPORT). */
+struct network_worker_s {
+  size_t index;
+
+  /* The sockets read by this worker and the socket entry each one belongs
+   * to, so packets don't need to be matched with their socket entry. */
+  struct pollfd *pollfd;
+  sockent_t **sockent;
+  size_t fds_num;
+
+  receive_list_entry_t *receive_list_head;
+  receive_list_entry_t *receive_list_tail;
+  pthread_mutex_t receive_list_lock;
+  pthread_cond_t receive_list_cond;
+  uint64_t receive_list_length;
+
+  receive_list_entry_t *receive_pool_head;
+  size_t receive_pool_size;
+  pthread_mutex_t receive_pool_lock;
+
+  int receive_thread_running;
+  pthread_t receive_thread_id;
+  int dispatch_thread_running;
+  pthread_t dispatch_thread_id;
+
+#if HAVE_GCRYPT_H
+  /* Used by the dispatch thread to decrypt packets. */
+  gcry_cipher_hd_t cypher;
+#endif
+
+  /* Written by this worker's threads only. */
+  derive_t stats_octets_rx;
+  derive_t stats_packets_rx;
+  derive_t stats_values_dispatched;
+  derive_t stats_values_not_dispatched;
+};
+typedef struct network_worker_s network_worker_t;
+
 /*
  * Private variables
  */
@@ -266,26 +311,29 @@ static int network_config_ttl = 0;
 static size_t network_config_packet_size = 1452;
 static _Bool network_config_forward = 0;
 static _Bool network_config_stats = 0;
+static size_t network_config_workers = 1;
 
 static sockent_t *sending_sockets = NULL;
 
-static receive_list_entry_t *receive_list_head = NULL;
-static receive_list_entry_t *receive_list_tail = NULL;
-static pthread_mutex_t receive_list_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t receive_list_cond = PTHREAD_COND_INITIALIZER;
-static uint64_t receive_list_length = 0;
+/* Number of packets received with one recvmmsg(2) call and the maximum number
+ * of such calls for one socket before the other sockets are checked. */
+#define RECEIVE_BATCH_SIZE 64
+#define RECEIVE_BATCH_MAX 16
+/* Maximum number of unused entries kept in the receive pool. */
+#define RECEIVE_POOL_MAX 4096
 
 static sockent_t *listen_sockets = NULL;
-static struct pollfd *listen_sockets_pollfd = NULL;
-static size_t listen_sockets_num = 0;
+
+static network_worker_t *workers = NULL;
+static size_t workers_num = 0;
+/* Worker for the next socket which can't be shared using SO_REUSEPORT. */
+static size_t workers_next = 0;
+/* Points to the worker of the dispatch thread. */
+static pthread_key_t workers_key;
 
 /* The receive and dispatch threads will run as long as `listen_loop' is set to
  * zero. */
 static int listen_loop = 0;
-static int receive_thread_running = 0;
-static pthread_t receive_thread_id;
-static int dispatch_thread_running = 0;
-static pthread_t dispatch_thread_id;
 
 /* Buffer in which to-be-sent network packets are constructed. */
 static char *send_buffer;
@@ -297,16 +345,12 @@ static pthread_mutex_t send_buffer_lock = PTHREAD_MUTEX_INITIALIZER;
 
 /* XXX: These counters are incremented from one place only. The spot in which
  * the values are incremented is either only reachable by one thread (the
- * dispatch thread, for example) or locked by some lock (send_buffer_lock for
- * example). Only if neither is true, the stats_lock is acquired. The counters
- * are always read without holding a lock in the hope that writing 8 bytes to
- * memory is an atomic operation. */
-static derive_t stats_octets_rx = 0;
+ * write thread holding the send buffer, for example) or locked by some lock
+ * (send_buffer_lock for example). Only if neither is true, the stats_lock is
+ * acquired. The counters are always read without holding a lock in the hope
+ * that writing 8 bytes to memory is an atomic operation. */
 static derive_t stats_octets_tx = 0;
-static derive_t stats_packets_rx = 0;
 static derive_t stats_packets_tx = 0;
-static derive_t stats_values_dispatched = 0;
-static derive_t stats_values_not_dispatched = 0;
 static derive_t stats_values_sent = 0;
 static derive_t stats_values_not_sent = 0;
 static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -390,6 +434,15 @@ static _Bool check_send_notify_okay(const notification_t *n) /* {{{ */
   return !received;
 } /* }}} _Bool check_send_notify_okay */
 
+/* Returns the worker of the calling dispatch thread. */
+static network_worker_t *network_current_worker(void) /* {{{ */
+{
+  network_worker_t *w = pthread_getspecific(workers_key);
+
+  assert(w != NULL);
+  return w;
+} /* }}} network_worker_t *network_current_worker */
+
 static int network_dispatch_values(value_list_t *vl, /* {{{ */
                                    const char *username) {
   int status;
@@ -407,7 +460,7 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
           "NOT dispatching %s.",
           name);
 #endif
-    stats_values_not_dispatched++;
+    network_current_worker()->stats_values_not_dispatched++;
     return 0;
   }
 
@@ -438,7 +491,7 @@ static int network_dispatch_values(value_list_t *vl, /* {{{ */
   }
 
   plugin_dispatch_values(vl);
-  stats_values_dispatched++;
+  network_current_worker()->stats_values_dispatched++;
 
   meta_data_destroy(vl->meta);
   vl->meta = NULL;
@@ -522,7 +575,8 @@ static gcry_cipher_hd_t network_get_aes256_cypher(sockent_t *se, /* {{{ */
   } else {
     char *secret;
 
-    cyper_ptr = &se->data.server.cypher;
+    /* Packets are decrypted by several dispatch threads concurrently. */
+    cyper_ptr = &network_current_worker()->cypher;
 
     if (username == NULL)
       return NULL;
@@ -1521,11 +1575,10 @@ static void free_sockent_server(struct sockent_server *ses) /* {{{ */
   }
 
   sfree(ses->fd);
+  sfree(ses->fd_worker);
 #if HAVE_GCRYPT_H
   sfree(ses->auth_file);
   fbh_destroy(ses->userdb);
-  if (ses->cypher != NULL)
-    gcry_cipher_close(ses->cypher);
 #endif
 } /* }}} void free_sockent_server */
 
@@ -1551,6 +1604,17 @@ static void sockent_destroy(sockent_t *se) /* {{{ */
   }
 } /* }}} void sockent_destroy */
 
+static _Bool network_addr_is_multicast(struct sockaddr_storage const *addr) {
+  if (addr->ss_family == AF_INET) {
+    struct sockaddr_in const *sa = (struct sockaddr_in const *)addr;
+    return IN_MULTICAST(ntohl(sa->sin_addr.s_addr)) ? 1 : 0;
+  } else if (addr->ss_family == AF_INET6) {
+    struct sockaddr_in6 const *sa = (struct sockaddr_in6 const *)addr;
+    return IN6_IS_ADDR_MULTICAST(&sa->sin6_addr) ? 1 : 0;
+  }
+  return 0;
+} /* _Bool network_addr_is_multicast */
+
 /*
  * int network_set_ttl
  *
@@ -1696,7 +1760,7 @@ static int network_set_interface(const sockent_t *se,
 } /* }}} network_set_interface */
 
 static int network_bind_socket(int fd, const struct addrinfo *ai,
-                               const int interface_idx) {
+                               const int interface_idx, _Bool reuse_port) {
 #if KERNEL_SOLARIS
   char loop = 0;
 #else
@@ -1712,6 +1776,19 @@ static int network_bind_socket(int fd, const struct addrinfo *ai,
     return -1;
   }
 
+#ifdef SO_REUSEPORT
+  /* let the kernel distribute the packets among the workers' sockets */
+  if (reuse_port &&
+      (setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes)) == -1)) {
+    char errbuf[1024];
+    ERROR("network plugin: setsockopt (reuseport): %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+#else
+  assert(!reuse_port);
+#endif
+
   DEBUG("fd = %i; calling `bind'", fd);
 
   if (bind(fd, ai->ai_addr, ai->ai_addrlen) == -1) {
@@ -1849,12 +1926,12 @@ static sockent_t *sockent_create(int type) /* {{{ */
 
   if (type == SOCKENT_TYPE_SERVER) {
     se->data.server.fd = NULL;
+    se->data.server.fd_worker = NULL;
     se->data.server.fd_num = 0;
 #if HAVE_GCRYPT_H
     se->data.server.security_level = SECURITY_LEVEL_NONE;
     se->data.server.auth_file = NULL;
     se->data.server.userdb = NULL;
-    se->data.server.cypher = NULL;
 #endif
   } else {
     se->data.client.fd = -1;
@@ -2070,34 +2147,63 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
 
   for (struct addrinfo *ai_ptr = ai_list; ai_ptr != NULL;
        ai_ptr = ai_ptr->ai_next) {
-    int *tmp;
+    /* Every worker gets its own socket for unicast addresses. Multicast
+     * packets would be delivered to each of these sockets, so only one
+     * socket is opened for multicast addresses. */
+    size_t sockets_num = network_addr_is_multicast(
+                             (struct sockaddr_storage *)ai_ptr->ai_addr)
+                             ? 1
+                             : network_config_workers;
+
+    for (size_t i = 0; i < sockets_num; i++) {
+      int *tmp;
+      size_t *tmp_worker;
+      size_t worker;
+
+      tmp = realloc(se->data.server.fd,
+                    sizeof(*tmp) * (se->data.server.fd_num + 1));
+      if (tmp == NULL) {
+        ERROR("network plugin: realloc failed.");
+        break;
+      }
+      se->data.server.fd = tmp;
+      tmp = se->data.server.fd + se->data.server.fd_num;
 
-    tmp = realloc(se->data.server.fd,
-                  sizeof(*tmp) * (se->data.server.fd_num + 1));
-    if (tmp == NULL) {
-      ERROR("network plugin: realloc failed.");
-      continue;
-    }
-    se->data.server.fd = tmp;
-    tmp = se->data.server.fd + se->data.server.fd_num;
+      tmp_worker = realloc(se->data.server.fd_worker,
+                           sizeof(*tmp_worker) * (se->data.server.fd_num + 1));
+      if (tmp_worker == NULL) {
+        ERROR("network plugin: realloc failed.");
+        break;
+      }
+      se->data.server.fd_worker = tmp_worker;
 
-    *tmp = socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
-    if (*tmp < 0) {
-      char errbuf[1024];
-      ERROR("network plugin: socket(2) failed: %s",
-            sstrerror(errno, errbuf, sizeof(errbuf)));
-      continue;
-    }
+      *tmp =
+          socket(ai_ptr->ai_family, ai_ptr->ai_socktype, ai_ptr->ai_protocol);
+      if (*tmp < 0) {
+        char errbuf[1024];
+        ERROR("network plugin: socket(2) failed: %s",
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+        break;
+      }
 
-    status = network_bind_socket(*tmp, ai_ptr, se->interface);
-    if (status != 0) {
-      close(*tmp);
-      *tmp = -1;
-      continue;
-    }
+      status = network_bind_socket(*tmp, ai_ptr, se->interface,
+                                   /* reuse_port = */ (sockets_num > 1));
+      if (status != 0) {
+        close(*tmp);
+        *tmp = -1;
+        break;
+      }
+
+      if (sockets_num > 1) {
+        worker = i;
+      } else {
+        worker = workers_next;
+        workers_next = (workers_next + 1) % network_config_workers;
+      }
 
-    se->data.server.fd_num++;
-    continue;
+      se->data.server.fd_worker[se->data.server.fd_num] = worker;
+      se->data.server.fd_num++;
+    }
   } /* for (ai_list) */
 
   freeaddrinfo(ai_list);
@@ -2107,6 +2213,28 @@ static int sockent_server_listen(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_server_listen */
 
+static int network_workers_create(void) /* {{{ */
+{
+  workers = calloc(network_config_workers, sizeof(*workers));
+  if (workers == NULL) {
+    ERROR("network plugin: calloc failed.");
+    return -1;
+  }
+  workers_num = network_config_workers;
+
+  for (size_t i = 0; i < workers_num; i++) {
+    network_worker_t *w = workers + i;
+
+    w->index = i;
+    pthread_mutex_init(&w->receive_list_lock, /* attr = */ NULL);
+    pthread_cond_init(&w->receive_list_cond, /* attr = */ NULL);
+    pthread_mutex_init(&w->receive_pool_lock, /* attr = */ NULL);
+  }
+
+  pthread_key_create(&workers_key, /* destructor = */ NULL);
+  return 0;
+} /* }}} int network_workers_create */
+
 /* Add a sockent to the global list of sockets */
 static int sockent_add(sockent_t *se) /* {{{ */
 {
@@ -2116,25 +2244,34 @@ static int sockent_add(sockent_t *se) /* {{{ */
     return -1;
 
   if (se->type == SOCKENT_TYPE_SERVER) {
-    struct pollfd *tmp;
-
-    tmp = realloc(listen_sockets_pollfd,
-                  sizeof(*tmp) * (listen_sockets_num + se->data.server.fd_num));
-    if (tmp == NULL) {
-      ERROR("network plugin: realloc failed.");
+    if ((workers == NULL) && (network_workers_create() != 0))
       return -1;
-    }
-    listen_sockets_pollfd = tmp;
-    tmp = listen_sockets_pollfd + listen_sockets_num;
 
     for (size_t i = 0; i < se->data.server.fd_num; i++) {
-      memset(tmp + i, 0, sizeof(*tmp));
-      tmp[i].fd = se->data.server.fd[i];
-      tmp[i].events = POLLIN | POLLPRI;
-      tmp[i].revents = 0;
-    }
+      network_worker_t *w = workers + se->data.server.fd_worker[i];
+      struct pollfd *tmp;
+      sockent_t **tmp_se;
 
-    listen_sockets_num += se->data.server.fd_num;
+      tmp = realloc(w->pollfd, sizeof(*tmp) * (w->fds_num + 1));
+      if (tmp == NULL) {
+        ERROR("network plugin: realloc failed.");
+        return -1;
+      }
+      w->pollfd = tmp;
+
+      tmp_se = realloc(w->sockent, sizeof(*tmp_se) * (w->fds_num + 1));
+      if (tmp_se == NULL) {
+        ERROR("network plugin: realloc failed.");
+        return -1;
+      }
+      w->sockent = tmp_se;
+
+      w->pollfd[w->fds_num] = (struct pollfd){
+          .fd = se->data.server.fd[i], .events = POLLIN | POLLPRI,
+      };
+      w->sockent[w->fds_num] = se;
+      w->fds_num++;
+    }
 
     if (listen_sockets == NULL) {
       listen_sockets = se;
@@ -2157,66 +2294,185 @@ static int sockent_add(sockent_t *se) /* {{{ */
   return 0;
 } /* }}} int sockent_add */
 
-static void *dispatch_thread(void __attribute__((unused)) * arg) /* {{{ */
+/* Returns up to `num' entries from the pool of recycled receive buffers,
+ * allocating new ones if the pool runs dry. Returns the number of entries
+ * stored in `ret_ents'. */
+static size_t receive_pool_get(network_worker_t *w, /* {{{ */
+                               receive_list_entry_t **ret_ents, size_t num) {
+  size_t have = 0;
+
+  pthread_mutex_lock(&w->receive_pool_lock);
+  while ((have < num) && (w->receive_pool_head != NULL)) {
+    ret_ents[have] = w->receive_pool_head;
+    w->receive_pool_head = w->receive_pool_head->next;
+    ret_ents[have]->next = NULL;
+    w->receive_pool_size--;
+    have++;
+  }
+  pthread_mutex_unlock(&w->receive_pool_lock);
+
+  while (have < num) {
+    receive_list_entry_t *ent = calloc(1, sizeof(*ent));
+    if (ent == NULL) {
+      ERROR("network plugin: calloc failed.");
+      break;
+    }
+
+    ent->data = malloc(network_config_packet_size);
+    if (ent->data == NULL) {
+      ERROR("network plugin: malloc failed.");
+      sfree(ent);
+      break;
+    }
+
+    ret_ents[have] = ent;
+    have++;
+  }
+
+  return have;
+} /* }}} size_t receive_pool_get */
+
+static void receive_entry_free(receive_list_entry_t *ent) /* {{{ */
 {
+  if (ent == NULL)
+    return;
+
+  sfree(ent->data);
+  sfree(ent);
+} /* }}} void receive_entry_free */
+
+/* Puts the list starting at `head' back into the pool. Entries exceeding
+ * RECEIVE_POOL_MAX are freed, so a burst doesn't pin memory forever. */
+static void receive_pool_put(network_worker_t *w, /* {{{ */
+                             receive_list_entry_t *head) {
+  pthread_mutex_lock(&w->receive_pool_lock);
+  while ((head != NULL) && (w->receive_pool_size < RECEIVE_POOL_MAX)) {
+    receive_list_entry_t *next = head->next;
+
+    head->next = w->receive_pool_head;
+    w->receive_pool_head = head;
+    w->receive_pool_size++;
+
+    head = next;
+  }
+  pthread_mutex_unlock(&w->receive_pool_lock);
+
+  while (head != NULL) {
+    receive_list_entry_t *next = head->next;
+    receive_entry_free(head);
+    head = next;
+  }
+} /* }}} void receive_pool_put */
+
+static void receive_pool_destroy(network_worker_t *w) /* {{{ */
+{
+  pthread_mutex_lock(&w->receive_pool_lock);
+  while (w->receive_pool_head != NULL) {
+    receive_list_entry_t *next = w->receive_pool_head->next;
+    receive_entry_free(w->receive_pool_head);
+    w->receive_pool_head = next;
+  }
+  w->receive_pool_size = 0;
+  pthread_mutex_unlock(&w->receive_pool_lock);
+} /* }}} void receive_pool_destroy */
+
+static void *dispatch_thread(void *arg) /* {{{ */
+{
+  network_worker_t *w = arg;
+
+  pthread_setspecific(workers_key, w);
+
   while (42) {
-    receive_list_entry_t *ent;
-    sockent_t *se;
+    receive_list_entry_t *head;
 
     /* Lock and wait for more data to come in */
-    pthread_mutex_lock(&receive_list_lock);
-    while ((listen_loop == 0) && (receive_list_head == NULL))
-      pthread_cond_wait(&receive_list_cond, &receive_list_lock);
-
-    /* Remove the head entry and unlock */
-    ent = receive_list_head;
-    if (ent != NULL)
-      receive_list_head = ent->next;
-    receive_list_length--;
-    pthread_mutex_unlock(&receive_list_lock);
+    pthread_mutex_lock(&w->receive_list_lock);
+    while ((listen_loop == 0) && (w->receive_list_head == NULL))
+      pthread_cond_wait(&w->receive_list_cond, &w->receive_list_lock);
+
+    /* Take the entire list, so the lock is acquired once per batch of packets
+     * rather than once per packet. */
+    head = w->receive_list_head;
+    w->receive_list_head = NULL;
+    w->receive_list_tail = NULL;
+    w->receive_list_length = 0;
+    pthread_mutex_unlock(&w->receive_list_lock);
 
     /* Check whether we are supposed to exit. We do NOT check `listen_loop'
      * because we dispatch all missing packets before shutting down. */
-    if (ent == NULL)
+    if (head == NULL)
       break;
 
-    /* Look for the correct `sockent_t' */
-    se = listen_sockets;
-    while (se != NULL) {
-      size_t i;
+    for (receive_list_entry_t *ent = head; ent != NULL; ent = ent->next)
+      parse_packet(ent->se, ent->data, ent->data_len, /* flags = */ 0,
+                   /* username = */ NULL);
 
-      for (i = 0; i < se->data.server.fd_num; i++)
-        if (se->data.server.fd[i] == ent->fd)
-          break;
+    /* Recycle the entries and their buffers. */
+    receive_pool_put(w, head);
+  } /* while (42) */
 
-      if (i < se->data.server.fd_num)
-        break;
+  return NULL;
+} /* }}} void *dispatch_thread */
 
-      se = se->next;
-    }
+/* Receives up to `ents_num' packets from `fd' into the buffers of `ents'.
+ * Returns the number of packets received or -1 on error. */
+static int network_recv_batch(int fd, sockent_t *se, /* {{{ */
+                              receive_list_entry_t **ents, size_t ents_num) {
+#if HAVE_RECVMMSG
+  struct mmsghdr msgs[ents_num];
+  struct iovec iovs[ents_num];
+  int status;
 
-    if (se == NULL) {
-      ERROR("network plugin: Got packet from FD %i, but can't "
-            "find an appropriate socket entry.",
-            ent->fd);
-      sfree(ent->data);
-      sfree(ent);
-      continue;
-    }
+  memset(msgs, 0, sizeof(msgs));
+  for (size_t i = 0; i < ents_num; i++) {
+    iovs[i].iov_base = ents[i]->data;
+    iovs[i].iov_len = network_config_packet_size;
+    msgs[i].msg_hdr.msg_iov = iovs + i;
+    msgs[i].msg_hdr.msg_iovlen = 1;
+  }
 
-    parse_packet(se, ent->data, ent->data_len, /* flags = */ 0,
-                 /* username = */ NULL);
-    sfree(ent->data);
-    sfree(ent);
-  } /* while (42) */
+  /* poll(2) told us that at least one packet is waiting. Don't block if there
+   * are fewer packets than buffers. */
+  status = recvmmsg(fd, msgs, (unsigned int)ents_num, MSG_DONTWAIT,
+                    /* timeout = */ NULL);
+  if (status < 0) {
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK) || (errno == EINTR))
+      return 0;
+    return -1;
+  }
 
-  return NULL;
-} /* }}} void *dispatch_thread */
+  for (int i = 0; i < status; i++) {
+    ents[i]->se = se;
+    ents[i]->data_len = (int)msgs[i].msg_len;
+  }
+
+  return status;
+#else
+  ssize_t buffer_len;
+
+  if (ents_num < 1)
+    return 0;
+
+  buffer_len =
+      recv(fd, ents[0]->data, network_config_packet_size, 0 /* no flags */);
+  if (buffer_len < 0) {
+    if (errno == EINTR)
+      return 0;
+    return -1;
+  }
+
+  ents[0]->se = se;
+  ents[0]->data_len = (int)buffer_len;
+
+  return 1;
+#endif
+} /* }}} int network_recv_batch */
 
-static int network_receive(void) /* {{{ */
+static int network_receive(network_worker_t *w) /* {{{ */
 {
-  char buffer[network_config_packet_size];
-  int buffer_len;
+  /* Buffers owned by this thread which haven't been used yet. */
+  receive_list_entry_t *spare[RECEIVE_BATCH_SIZE];
+  size_t spare_num = 0;
 
   int status = 0;
 
@@ -2224,122 +2480,139 @@ static int network_receive(void) /* {{{ */
   receive_list_entry_t *private_list_tail;
   uint64_t private_list_length;
 
-  assert(listen_sockets_num > 0);
+  assert(w->fds_num > 0);
 
   private_list_head = NULL;
   private_list_tail = NULL;
   private_list_length = 0;
 
   while (listen_loop == 0) {
-    status = poll(listen_sockets_pollfd, listen_sockets_num, -1);
-    if (status <= 0) {
+    int ready = poll(w->pollfd, w->fds_num, -1);
+    if (ready <= 0) {
       char errbuf[1024];
       if (errno == EINTR)
         continue;
       ERROR("network plugin: poll(2) failed: %s",
             sstrerror(errno, errbuf, sizeof(errbuf)));
+      status = -1;
       break;
     }
 
-    for (size_t i = 0; (i < listen_sockets_num) && (status > 0); i++) {
-      receive_list_entry_t *ent;
-
-      if ((listen_sockets_pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
+    for (size_t i = 0; (i < w->fds_num) && (ready > 0); i++) {
+      if ((w->pollfd[i].revents & (POLLIN | POLLPRI)) == 0)
         continue;
-      status--;
-
-      buffer_len = recv(listen_sockets_pollfd[i].fd, buffer, sizeof(buffer),
-                        0 /* no flags */);
-      if (buffer_len < 0) {
-        char errbuf[1024];
-        status = (errno != 0) ? errno : -1;
-        ERROR("network plugin: recv(2) failed: %s",
-              sstrerror(errno, errbuf, sizeof(errbuf)));
-        break;
-      }
-
-      stats_octets_rx += ((uint64_t)buffer_len);
-      stats_packets_rx++;
-
-      /* TODO: Possible performance enhancement: Do not free
-       * these entries in the dispatch thread but put them in
-       * another list, so we don't have to allocate more and
-       * more of these structures. */
-      ent = calloc(1, sizeof(*ent));
-      if (ent == NULL) {
-        ERROR("network plugin: calloc failed.");
-        status = ENOMEM;
-        break;
-      }
-
-      ent->data = malloc(network_config_packet_size);
-      if (ent->data == NULL) {
-        sfree(ent);
-        ERROR("network plugin: malloc failed.");
-        status = ENOMEM;
+      ready--;
+
+      /* Drain the socket, but read at most RECEIVE_BATCH_MAX batches so that
+       * the other sockets aren't starved. */
+      for (int batch = 0; batch < RECEIVE_BATCH_MAX; batch++) {
+        size_t batch_size;
+        int received;
+
+        if (spare_num < RECEIVE_BATCH_SIZE)
+          spare_num += receive_pool_get(w, spare + spare_num,
+                                        RECEIVE_BATCH_SIZE - spare_num);
+        if (spare_num == 0) {
+          status = ENOMEM;
+          break;
+        }
+        batch_size = spare_num;
+
+        received = network_recv_batch(w->pollfd[i].fd, w->sockent[i], spare,
+                                      batch_size);
+        if (received < 0) {
+          char errbuf[1024];
+          status = (errno != 0) ? errno : -1;
+          ERROR("network plugin: recv(2) failed: %s",
+                sstrerror(errno, errbuf, sizeof(errbuf)));
+          break;
+        }
+
+        for (int j = 0; j < received; j++) {
+          receive_list_entry_t *ent = spare[j];
+
+          w->stats_octets_rx += ((uint64_t)ent->data_len);
+          w->stats_packets_rx++;
+
+          ent->next = NULL;
+          if (private_list_head == NULL)
+            private_list_head = ent;
+          else
+            private_list_tail->next = ent;
+          private_list_tail = ent;
+          private_list_length++;
+        }
+
+        /* Move the unused buffers to the front. */
+        spare_num -= (size_t)received;
+        memmove(spare, spare + received, spare_num * sizeof(*spare));
+
+#if HAVE_RECVMMSG
+        /* A short read means the socket has been drained. */
+        if ((size_t)received < batch_size)
+          break;
+#else
+        /* Without recvmmsg(2) there is no way to tell whether more packets
+         * are waiting, so go back to poll(2) rather than block. */
         break;
+#endif
       }
-      ent->fd = listen_sockets_pollfd[i].fd;
-      ent->next = NULL;
-
-      memcpy(ent->data, buffer, buffer_len);
-      ent->data_len = buffer_len;
-
-      if (private_list_head == NULL)
-        private_list_head = ent;
-      else
-        private_list_tail->next = ent;
-      private_list_tail = ent;
-      private_list_length++;
 
       /* Do not block here. Blocking here has led to
        * insufficient performance in the past. */
-      if (pthread_mutex_trylock(&receive_list_lock) == 0) {
-        assert(((receive_list_head == NULL) && (receive_list_length == 0)) ||
-               ((receive_list_head != NULL) && (receive_list_length != 0)));
-
-        if (receive_list_head == NULL)
-          receive_list_head = private_list_head;
+      if ((private_list_head != NULL) &&
+          (pthread_mutex_trylock(&w->receive_list_lock) == 0)) {
+        assert(((w->receive_list_head == NULL) &&
+                (w->receive_list_length == 0)) ||
+               ((w->receive_list_head != NULL) &&
+                (w->receive_list_length != 0)));
+
+        if (w->receive_list_head == NULL)
+          w->receive_list_head = private_list_head;
         else
-          receive_list_tail->next = private_list_head;
-        receive_list_tail = private_list_tail;
-        receive_list_length += private_list_length;
+          w->receive_list_tail->next = private_list_head;
+        w->receive_list_tail = private_list_tail;
+        w->receive_list_length += private_list_length;
 
-        pthread_cond_signal(&receive_list_cond);
-        pthread_mutex_unlock(&receive_list_lock);
+        pthread_cond_signal(&w->receive_list_cond);
+        pthread_mutex_unlock(&w->receive_list_lock);
 
         private_list_head = NULL;
         private_list_tail = NULL;
         private_list_length = 0;
       }
 
-      status = 0;
+      if (status != 0)
+        break;
     } /* for (listen_sockets_pollfd) */
 
     if (status != 0)
       break;
   } /* while (listen_loop == 0) */
 
+  for (size_t i = 0; i < spare_num; i++)
+    receive_entry_free(spare[i]);
+
   /* Make sure everything is dispatched before exiting. */
   if (private_list_head != NULL) {
-    pthread_mutex_lock(&receive_list_lock);
+    pthread_mutex_lock(&w->receive_list_lock);
 
-    if (receive_list_head == NULL)
-      receive_list_head = private_list_head;
+    if (w->receive_list_head == NULL)
+      w->receive_list_head = private_list_head;
     else
-      receive_list_tail->next = private_list_head;
-    receive_list_tail = private_list_tail;
-    receive_list_length += private_list_length;
+      w->receive_list_tail->next = private_list_head;
+    w->receive_list_tail = private_list_tail;
+    w->receive_list_length += private_list_length;
 
-    pthread_cond_signal(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
+    pthread_cond_signal(&w->receive_list_cond);
+    pthread_mutex_unlock(&w->receive_list_lock);
   }
 
   return status;
 } /* }}} int network_receive */
 
-static void *receive_thread(void __attribute__((unused)) * arg) {
-  return network_receive() ? (void *)1 : (void *)0;
+static void *receive_thread(void *arg) {
+  return network_receive(arg) ? (void *)1 : (void *)0;
 } /* void *receive_thread */
 
 static void network_init_buffer(void) {
@@ -2531,8 +2804,90 @@ static void network_send_buffer_encrypted(sockent_t *se, /* {{{ */
 #undef BUFFER_ADD
 #endif /* HAVE_GCRYPT_H */
 
+#if HAVE_SENDMMSG
+/* Maximum number of servers a packet is sent to with one sendmmsg(2) call. */
+#define SEND_BATCH_SIZE 64
+
+/* Sends the same packet to all servers in `servers' using as few system calls
+ * as possible. Servers with the same address family, interface and address
+ * class (unicast / multicast) have identical socket options, so the packet is
+ * sent to all of them with one sendmmsg(2) call over the first server's
+ * socket. Servers the kernel didn't accept the packet for are retried with
+ * network_send_buffer_plain(), which takes care of error handling. */
+static void network_send_buffer_mmsg(sockent_t **servers, /* {{{ */
+                                     size_t servers_num, const char *buffer,
+                                     size_t buffer_size) {
+  struct iovec iov = {.iov_base = (void *)buffer, .iov_len = buffer_size};
+  struct mmsghdr msgs[SEND_BATCH_SIZE];
+  sockent_t *group[SEND_BATCH_SIZE];
+
+  if (servers_num == 1) {
+    network_send_buffer_plain(servers[0], buffer, buffer_size);
+    return;
+  }
+
+  /* Make sure all sockets are open and addresses are resolved. Servers that
+   * can't be connected are dropped from the list. */
+  for (size_t i = 0; i < servers_num;) {
+    if (sockent_client_connect(servers[i]) == 0) {
+      i++;
+      continue;
+    }
+    servers_num--;
+    servers[i] = servers[servers_num];
+  }
+
+  while (servers_num > 0) {
+    /* The first remaining server determines the group. */
+    sa_family_t family = servers[0]->data.client.addr->ss_family;
+    int interface = servers[0]->interface;
+    _Bool multicast = network_addr_is_multicast(servers[0]->data.client.addr);
+    size_t group_num = 0;
+    int status;
+
+    memset(msgs, 0, sizeof(msgs));
+    for (size_t i = 0; i < servers_num;) {
+      struct sockent_client *client = &servers[i]->data.client;
+
+      if ((servers[i]->interface != interface) ||
+          (client->addr->ss_family != family) ||
+          (network_addr_is_multicast(client->addr) != multicast)) {
+        i++;
+        continue;
+      }
+
+      msgs[group_num].msg_hdr.msg_name = client->addr;
+      msgs[group_num].msg_hdr.msg_namelen = client->addrlen;
+      msgs[group_num].msg_hdr.msg_iov = &iov;
+      msgs[group_num].msg_hdr.msg_iovlen = 1;
+      group[group_num] = servers[i];
+      group_num++;
+
+      /* Remove the server from the list. */
+      servers_num--;
+      servers[i] = servers[servers_num];
+    }
+
+    do {
+      status = sendmmsg(group[0]->data.client.fd, msgs, (unsigned int)group_num,
+                        /* flags = */ 0);
+    } while ((status < 0) && (errno == EINTR));
+    if (status < 0)
+      status = 0;
+
+    for (size_t i = (size_t)status; i < group_num; i++)
+      network_send_buffer_plain(group[i], buffer, buffer_size);
+  } /* while (servers_num > 0) */
+} /* }}} void network_send_buffer_mmsg */
+#endif /* HAVE_SENDMMSG */
+
 static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
 {
+#if HAVE_SENDMMSG
+  sockent_t *plain[SEND_BATCH_SIZE];
+  size_t plain_num = 0;
+#endif
+
   DEBUG("network plugin: network_send_buffer: buffer_len = %zu", buffer_len);
 
   for (sockent_t *se = sending_sockets; se != NULL; se = se->next) {
@@ -2543,8 +2898,26 @@ static void network_send_buffer(char *buffer, size_t buffer_len) /* {{{ */
       network_send_buffer_signed(se, buffer, buffer_len);
     else /* if (se->data.client.security_level == SECURITY_LEVEL_NONE) */
 #endif   /* HAVE_GCRYPT_H */
+    {
+#if HAVE_SENDMMSG
+      /* Signed and encrypted packets differ per server; plain-text packets
+       * are identical and are sent in one go below. */
+      if (plain_num == SEND_BATCH_SIZE) {
+        network_send_buffer_mmsg(plain, plain_num, buffer, buffer_len);
+        plain_num = 0;
+      }
+      plain[plain_num] = se;
+      plain_num++;
+#else
       network_send_buffer_plain(se, buffer, buffer_len);
+#endif
+    }
   } /* for (sending_sockets) */
+
+#if HAVE_SENDMMSG
+  if (plain_num > 0)
+    network_send_buffer_mmsg(plain, plain_num, buffer, buffer_len);
+#endif
 } /* }}} void network_send_buffer */
 
 static int add_to_buffer(char *buffer, size_t buffer_size, /* {{{ */
@@ -2707,6 +3080,34 @@ static int network_config_set_ttl(const oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int network_config_set_ttl */
 
+static int network_config_set_workers(const oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  if (cf_util_get_int(ci, &tmp) != 0)
+    return -1;
+  if (tmp < 1) {
+    WARNING("network plugin: The `Workers' option must be positive.");
+    return -1;
+  }
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("network plugin: Multiple workers require SO_REUSEPORT, which is "
+            "not supported on this system. Using one worker.");
+    tmp = 1;
+  }
+#endif
+  /* Sockets are assigned to workers when they are opened. */
+  if ((workers != NULL) && ((size_t)tmp != workers_num)) {
+    WARNING("network plugin: The `Workers' option can't be changed after "
+            "sockets have been opened. Ignoring it.");
+    return -1;
+  }
+
+  network_config_workers = (size_t)tmp;
+  return 0;
+} /* }}} int network_config_set_workers */
+
 static int network_config_set_interface(const oconfig_item_t *ci, /* {{{ */
                                         int *interface) {
   char if_name[256];
@@ -2924,6 +3325,8 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
     oconfig_item_t *child = ci->children + i;
     if (strcasecmp("TimeToLive", child->key) == 0)
       network_config_set_ttl(child);
+    else if (strcasecmp("Workers", child->key) == 0)
+      network_config_set_workers(child);
   }
 
   for (int i = 0; i < ci->children_num; i++) {
@@ -2933,7 +3336,8 @@ static int network_config(oconfig_item_t *ci) /* {{{ */
       network_config_add_listen(child);
     else if (strcasecmp("Server", child->key) == 0)
       network_config_add_server(child);
-    else if (strcasecmp("TimeToLive", child->key) == 0) {
+    else if ((strcasecmp("TimeToLive", child->key) == 0) ||
+             (strcasecmp("Workers", child->key) == 0)) {
       /* Handled earlier */
     } else if (strcasecmp("MaxPacketSize", child->key) == 0)
       network_config_set_buffer_size(child);
@@ -3020,24 +3424,44 @@ static int network_notification(const notification_t *n,
 static int network_shutdown(void) {
   listen_loop++;
 
-  /* Kill the listening thread */
-  if (receive_thread_running != 0) {
-    INFO("network plugin: Stopping receive thread.");
-    pthread_kill(receive_thread_id, SIGTERM);
-    pthread_join(receive_thread_id, NULL /* no return value */);
-    memset(&receive_thread_id, 0, sizeof(receive_thread_id));
-    receive_thread_running = 0;
-  }
+  for (size_t i = 0; i < workers_num; i++) {
+    network_worker_t *w = workers + i;
 
-  /* Shutdown the dispatching thread */
-  if (dispatch_thread_running != 0) {
-    INFO("network plugin: Stopping dispatch thread.");
-    pthread_mutex_lock(&receive_list_lock);
-    pthread_cond_broadcast(&receive_list_cond);
-    pthread_mutex_unlock(&receive_list_lock);
-    pthread_join(dispatch_thread_id, /* ret = */ NULL);
-    dispatch_thread_running = 0;
-  }
+    /* Kill the listening thread */
+    if (w->receive_thread_running != 0) {
+      INFO("network plugin: Stopping receive thread #%zu.", i);
+      pthread_kill(w->receive_thread_id, SIGTERM);
+      pthread_join(w->receive_thread_id, NULL /* no return value */);
+      memset(&w->receive_thread_id, 0, sizeof(w->receive_thread_id));
+      w->receive_thread_running = 0;
+    }
+
+    /* Shutdown the dispatching thread */
+    if (w->dispatch_thread_running != 0) {
+      INFO("network plugin: Stopping dispatch thread #%zu.", i);
+      pthread_mutex_lock(&w->receive_list_lock);
+      pthread_cond_broadcast(&w->receive_list_cond);
+      pthread_mutex_unlock(&w->receive_list_lock);
+      pthread_join(w->dispatch_thread_id, /* ret = */ NULL);
+      w->dispatch_thread_running = 0;
+    }
+
+    receive_pool_destroy(w);
+#if HAVE_GCRYPT_H
+    if (w->cypher != NULL)
+      gcry_cipher_close(w->cypher);
+#endif
+    sfree(w->pollfd);
+    sfree(w->sockent);
+    pthread_mutex_destroy(&w->receive_list_lock);
+    pthread_cond_destroy(&w->receive_list_cond);
+    pthread_mutex_destroy(&w->receive_pool_lock);
+  }
+  /* The key is created together with the workers. */
+  if (workers != NULL)
+    pthread_key_delete(workers_key);
+  sfree(workers);
+  workers_num = 0;
 
   sockent_destroy(listen_sockets);
 
@@ -3058,29 +3482,68 @@ static int network_shutdown(void) {
   return 0;
 } /* int network_shutdown */
 
+static void network_stats_worker_read(network_worker_t *w) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[1];
+
+  vl.values = values;
+  vl.values_len = 1;
+  vl.time = 0;
+  sstrncpy(vl.plugin, "network", sizeof(vl.plugin));
+  ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "worker%zu",
+            w->index);
+
+  vl.values[0].derive = w->stats_octets_rx;
+  sstrncpy(vl.type, "if_rx_octets", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].derive = w->stats_packets_rx;
+  sstrncpy(vl.type, "if_rx_packets", sizeof(vl.type));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].derive = w->stats_values_dispatched;
+  sstrncpy(vl.type, "total_values", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "dispatch-accepted", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].derive = w->stats_values_not_dispatched;
+  sstrncpy(vl.type_instance, "dispatch-rejected", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].gauge = (gauge_t)w->receive_list_length;
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  vl.type_instance[0] = 0;
+  plugin_dispatch_values(&vl);
+} /* }}} void network_stats_worker_read */
+
 static int network_stats_read(void) /* {{{ */
 {
-  derive_t copy_octets_rx;
+  derive_t copy_octets_rx = 0;
   derive_t copy_octets_tx;
-  derive_t copy_packets_rx;
+  derive_t copy_packets_rx = 0;
   derive_t copy_packets_tx;
-  derive_t copy_values_dispatched;
-  derive_t copy_values_not_dispatched;
+  derive_t copy_values_dispatched = 0;
+  derive_t copy_values_not_dispatched = 0;
   derive_t copy_values_sent;
   derive_t copy_values_not_sent;
-  derive_t copy_receive_list_length;
+  derive_t copy_receive_list_length = 0;
   value_list_t vl = VALUE_LIST_INIT;
   value_t values[2];
 
-  copy_octets_rx = stats_octets_rx;
+  for (size_t i = 0; i < workers_num; i++) {
+    network_worker_t *w = workers + i;
+
+    copy_octets_rx += w->stats_octets_rx;
+    copy_packets_rx += w->stats_packets_rx;
+    copy_values_dispatched += w->stats_values_dispatched;
+    copy_values_not_dispatched += w->stats_values_not_dispatched;
+    copy_receive_list_length += (derive_t)w->receive_list_length;
+  }
   copy_octets_tx = stats_octets_tx;
-  copy_packets_rx = stats_packets_rx;
   copy_packets_tx = stats_packets_tx;
-  copy_values_dispatched = stats_values_dispatched;
-  copy_values_not_dispatched = stats_values_not_dispatched;
   copy_values_sent = stats_values_sent;
   copy_values_not_sent = stats_values_not_sent;
-  copy_receive_list_length = receive_list_length;
 
   /* Initialize `vl' */
   vl.values = values;
@@ -3126,6 +3589,11 @@ static int network_stats_read(void) /* {{{ */
   vl.type_instance[0] = 0;
   plugin_dispatch_values(&vl);
 
+  /* Per-worker statistics */
+  if (workers_num > 1)
+    for (size_t i = 0; i < workers_num; i++)
+      network_stats_worker_read(workers + i);
+
   return 0;
 } /* }}} int network_stats_read */
 
@@ -3158,36 +3626,42 @@ static int network_init(void) {
                                  /* user_data = */ NULL);
   }
 
-  /* If no threads need to be started, return here. */
-  if ((listen_sockets_num == 0) ||
-      ((dispatch_thread_running != 0) && (receive_thread_running != 0)))
-    return 0;
-
-  if (dispatch_thread_running == 0) {
+  for (size_t i = 0; i < workers_num; i++) {
+    network_worker_t *w = workers + i;
+    char thread_name[16];
     int status;
-    status = plugin_thread_create(&dispatch_thread_id, NULL /* no attributes */,
-                                  dispatch_thread, NULL /* no argument */,
-                                  "network disp");
-    if (status != 0) {
-      char errbuf[1024];
-      ERROR("network: pthread_create failed: %s",
-            sstrerror(errno, errbuf, sizeof(errbuf)));
-    } else {
-      dispatch_thread_running = 1;
+
+    /* Workers without sockets, e.g. when only multicast addresses are
+     * configured, have nothing to do. */
+    if (w->fds_num == 0)
+      continue;
+
+    if (w->dispatch_thread_running == 0) {
+      ssnprintf(thread_name, sizeof(thread_name), "network disp%zu", i);
+      status = plugin_thread_create(&w->dispatch_thread_id,
+                                    NULL /* no attributes */, dispatch_thread,
+                                    w, thread_name);
+      if (status != 0) {
+        char errbuf[1024];
+        ERROR("network: pthread_create failed: %s",
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+      } else {
+        w->dispatch_thread_running = 1;
+      }
     }
-  }
 
-  if (receive_thread_running == 0) {
-    int status;
-    status = plugin_thread_create(&receive_thread_id, NULL /* no attributes */,
-                                  receive_thread, NULL /* no argument */,
-                                  "network recv");
-    if (status != 0) {
-      char errbuf[1024];
-      ERROR("network: pthread_create failed: %s",
-            sstrerror(errno, errbuf, sizeof(errbuf)));
-    } else {
-      receive_thread_running = 1;
+    if (w->receive_thread_running == 0) {
+      ssnprintf(thread_name, sizeof(thread_name), "network recv%zu", i);
+      status = plugin_thread_create(&w->receive_thread_id,
+                                    NULL /* no attributes */, receive_thread,
+                                    w, thread_name);
+      if (status != 0) {
+        char errbuf[1024];
+        ERROR("network: pthread_create failed: %s",
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+      } else {
+        w->receive_thread_running = 1;
+      }
     }
   }
 
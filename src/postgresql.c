@@ -99,12 +99,40 @@ typedef struct {
   int params_num;
 } c_psql_user_data_t;
 
+typedef enum {
+  C_PSQL_COPY_TEXT = 0,
+  C_PSQL_COPY_BINARY,
+} c_psql_copy_format_t;
+
 typedef struct {
   char *name;
   char *statement;
   _Bool store_rates;
+
+  /* If set, rows are buffered and sent using "COPY ... FROM STDIN". */
+  char *copy_table;
+  char *copy_statement;
+  c_psql_copy_format_t copy_format;
+  size_t buffer_size;
+  cdtime_t flush_interval;
 } c_psql_writer_t;
 
+/* Rows of a COPY writer waiting to be sent over one connection. */
+typedef struct {
+  char *data;
+  size_t size;
+  size_t fill;
+  size_t rows;
+  cdtime_t first_row;
+} c_psql_copy_buffer_t;
+
+/* Write position in a COPY buffer. Rows are encoded in place; the encoding
+ * functions fail once the end of the buffer has been reached. */
+typedef struct {
+  char *ptr;
+  char *end;
+} c_psql_copy_cursor_t;
+
 typedef struct {
   PGconn *conn;
   c_complain_t conn_complaint;
@@ -121,6 +149,8 @@ typedef struct {
 
   c_psql_writer_t **writers;
   size_t writers_num;
+  /* one per writer, only used by COPY writers */
+  c_psql_copy_buffer_t *copy_buffers;
 
   /* make sure we don't access the database object in parallel */
   pthread_mutex_t db_lock;
@@ -197,6 +227,9 @@ static int c_psql_commit(c_psql_database_t *db) {
   return status;
 } /* c_psql_commit */
 
+static void c_psql_copy_flush_older(c_psql_database_t *db, size_t idx,
+                                    cdtime_t timeout);
+
 static c_psql_database_t *c_psql_database_new(const char *name) {
   c_psql_database_t **tmp;
   c_psql_database_t *db;
@@ -233,6 +266,7 @@ static c_psql_database_t *c_psql_database_new(const char *name) {
 
   db->writers = NULL;
   db->writers_num = 0;
+  db->copy_buffers = NULL;
 
   pthread_mutex_init(&db->db_lock, /* attrs = */ NULL);
 
@@ -271,6 +305,10 @@ static void c_psql_database_delete(void *data) {
   /* wait for the lock to be released by the last writer */
   pthread_mutex_lock(&db->db_lock);
 
+  /* send the rows still buffered by COPY writers */
+  for (size_t i = 0; i < db->writers_num; ++i)
+    c_psql_copy_flush_older(db, i, /* timeout = */ 0);
+
   if (db->next_commit > 0)
     c_psql_commit(db);
 
@@ -285,6 +323,11 @@ static void c_psql_database_delete(void *data) {
   sfree(db->queries);
   db->queries_num = 0;
 
+  if (db->copy_buffers != NULL)
+    for (size_t i = 0; i < db->writers_num; ++i)
+      sfree(db->copy_buffers[i].data);
+  sfree(db->copy_buffers);
+
   sfree(db->writers);
   db->writers_num = 0;
 
@@ -396,6 +439,357 @@ static int c_psql_check_connection(c_psql_database_t *db) {
   return 0;
 } /* c_psql_check_connection */
 
+/* Microseconds between the Unix epoch and the PostgreSQL epoch, 2000-01-01. */
+#define C_PSQL_EPOCH_OFFSET_US 946684800000000LL
+
+static int c_psql_copy_put(c_psql_copy_cursor_t *c, const void *data,
+                           size_t len) {
+  if ((size_t)(c->end - c->ptr) < len)
+    return -1;
+
+  memcpy(c->ptr, data, len);
+  c->ptr += len;
+  return 0;
+} /* c_psql_copy_put */
+
+/* Appends the "len" lower bytes of "value" in network byte order. */
+static int c_psql_copy_put_int(c_psql_copy_cursor_t *c, uint64_t value,
+                               size_t len) {
+  if ((size_t)(c->end - c->ptr) < len)
+    return -1;
+
+  for (size_t i = 0; i < len; ++i)
+    c->ptr[i] = (char)(value >> (8 * (len - 1 - i)));
+  c->ptr += len;
+  return 0;
+} /* c_psql_copy_put_int */
+
+/* Appends a column in text format, followed by "delim". Backslashes and
+ * control characters are escaped; NULL is written as "\N". */
+static int c_psql_copy_text_string(c_psql_copy_cursor_t *c, const char *str,
+                                   char delim) {
+  if (str == NULL)
+    return c_psql_copy_put(c, "\\N", 2) || c_psql_copy_put(c, &delim, 1);
+
+  for (; *str != '\0'; ++str) {
+    char esc = 0;
+
+    if (*str == '\\')
+      esc = '\\';
+    else if (*str == '\n')
+      esc = 'n';
+    else if (*str == '\r')
+      esc = 'r';
+    else if (*str == '\t')
+      esc = 't';
+
+    if (esc != 0) {
+      if ((c->end - c->ptr) < 2)
+        return -1;
+      *(c->ptr++) = '\\';
+      *(c->ptr++) = esc;
+    } else {
+      if (c->ptr >= c->end)
+        return -1;
+      *(c->ptr++) = *str;
+    }
+  }
+
+  return c_psql_copy_put(c, &delim, 1);
+} /* c_psql_copy_text_string */
+
+/* Appends a column in binary format: its length, followed by the data. NULL
+ * has a length of -1 and no data. */
+static int c_psql_copy_binary_string(c_psql_copy_cursor_t *c,
+                                     const char *str) {
+  size_t len;
+
+  if (str == NULL)
+    return c_psql_copy_put_int(c, (uint32_t)-1, 4);
+
+  len = strlen(str);
+  return c_psql_copy_put_int(c, (uint64_t)len, 4) ||
+         c_psql_copy_put(c, str, len);
+} /* c_psql_copy_binary_string */
+
+static int c_psql_copy_text_value(c_psql_copy_cursor_t *c, int ds_type,
+                                  value_t value, const gauge_t *rate) {
+  size_t avail = (size_t)(c->end - c->ptr);
+  int status;
+
+  if ((ds_type == DS_TYPE_GAUGE) || (rate != NULL)) {
+    gauge_t g = (rate != NULL) ? *rate : value.gauge;
+
+    /* float8in() doesn't accept "nan" and "inf" on all versions */
+    if (isnan(g))
+      status = ssnprintf(c->ptr, avail, "NaN\n");
+    else if (isinf(g))
+      status = ssnprintf(c->ptr, avail, "%sInfinity\n", (g < 0) ? "-" : "");
+    else
+      status = ssnprintf(c->ptr, avail, GAUGE_FORMAT "\n", g);
+  } else if (ds_type == DS_TYPE_COUNTER)
+    status = ssnprintf(c->ptr, avail, "%llu\n", value.counter);
+  else if (ds_type == DS_TYPE_DERIVE)
+    status = ssnprintf(c->ptr, avail, "%" PRIi64 "\n", value.derive);
+  else
+    status = ssnprintf(c->ptr, avail, "%" PRIu64 "\n", value.absolute);
+
+  if ((status < 1) || ((size_t)status >= avail))
+    return -1;
+
+  c->ptr += status;
+  return 0;
+} /* c_psql_copy_text_value */
+
+static int c_psql_copy_binary_value(c_psql_copy_cursor_t *c, int ds_type,
+                                    value_t value, const gauge_t *rate) {
+  double d;
+  uint64_t bits;
+
+  if (rate != NULL)
+    d = (double)*rate;
+  else if (ds_type == DS_TYPE_GAUGE)
+    d = (double)value.gauge;
+  else if (ds_type == DS_TYPE_COUNTER)
+    d = (double)value.counter;
+  else if (ds_type == DS_TYPE_DERIVE)
+    d = (double)value.derive;
+  else
+    d = (double)value.absolute;
+
+  memcpy(&bits, &d, sizeof(bits));
+  return c_psql_copy_put_int(c, 8, 4) || c_psql_copy_put_int(c, bits, 8);
+} /* c_psql_copy_binary_value */
+
+/* Appends one row per data source of "vl". The columns are: time, host,
+ * plugin, plugin instance, type, type instance, data source name, data source
+ * type and value. "time_str" is only used by the text format. */
+static int c_psql_copy_encode(c_psql_copy_cursor_t *c,
+                              const c_psql_writer_t *writer,
+                              const data_set_t *ds, const value_list_t *vl,
+                              const gauge_t *rates, const char *time_str) {
+#define VALUE_OR_NULL(v) ((((v) == NULL) || (*(v) == '\0')) ? NULL : (v))
+  const char *plugin_instance = VALUE_OR_NULL(vl->plugin_instance);
+  const char *type_instance = VALUE_OR_NULL(vl->type_instance);
+#undef VALUE_OR_NULL
+
+  for (size_t i = 0; i < ds->ds_num; ++i) {
+    const char *ds_type = (rates != NULL) ? "gauge"
+                                          : DS_TYPE_TO_STRING(ds->ds[i].type);
+    const gauge_t *rate = NULL;
+
+    if ((rates != NULL) && (ds->ds[i].type != DS_TYPE_GAUGE))
+      rate = rates + i;
+
+    if (writer->copy_format == C_PSQL_COPY_BINARY) {
+      int64_t us = (int64_t)CDTIME_T_TO_US(vl->time) - C_PSQL_EPOCH_OFFSET_US;
+
+      if (c_psql_copy_put_int(c, 9, 2) || c_psql_copy_put_int(c, 8, 4) ||
+          c_psql_copy_put_int(c, (uint64_t)us, 8) ||
+          c_psql_copy_binary_string(c, vl->host) ||
+          c_psql_copy_binary_string(c, vl->plugin) ||
+          c_psql_copy_binary_string(c, plugin_instance) ||
+          c_psql_copy_binary_string(c, vl->type) ||
+          c_psql_copy_binary_string(c, type_instance) ||
+          c_psql_copy_binary_string(c, ds->ds[i].name) ||
+          c_psql_copy_binary_string(c, ds_type) ||
+          c_psql_copy_binary_value(c, ds->ds[i].type, vl->values[i], rate))
+        return -1;
+    } else {
+      if (c_psql_copy_text_string(c, time_str, '\t') ||
+          c_psql_copy_text_string(c, vl->host, '\t') ||
+          c_psql_copy_text_string(c, vl->plugin, '\t') ||
+          c_psql_copy_text_string(c, plugin_instance, '\t') ||
+          c_psql_copy_text_string(c, vl->type, '\t') ||
+          c_psql_copy_text_string(c, type_instance, '\t') ||
+          c_psql_copy_text_string(c, ds->ds[i].name, '\t') ||
+          c_psql_copy_text_string(c, ds_type, '\t') ||
+          c_psql_copy_text_value(c, ds->ds[i].type, vl->values[i], rate))
+        return -1;
+    }
+  }
+
+  return 0;
+} /* c_psql_copy_encode */
+
+static int c_psql_copy_send(c_psql_database_t *db, const char *statement,
+                            const char *data, size_t data_len) {
+  PGresult *res;
+  int status = 0;
+
+  res = PQexec(db->conn, statement);
+  if (PGRES_COPY_IN != PQresultStatus(res)) {
+    PQclear(res);
+    return -1;
+  }
+  PQclear(res);
+
+  if (PQputCopyData(db->conn, data, (int)data_len) != 1)
+    status = -1;
+  if (PQputCopyEnd(db->conn, (status == 0) ? NULL : "sending data failed") !=
+      1)
+    status = -1;
+
+  while ((res = PQgetResult(db->conn)) != NULL) {
+    if (PGRES_COMMAND_OK != PQresultStatus(res))
+      status = -1;
+    PQclear(res);
+  }
+
+  return status;
+} /* c_psql_copy_send */
+
+/* Sends the rows buffered for writer "idx". The rows are dropped if that
+ * fails. You must hold "db_lock". */
+static int c_psql_copy_flush(c_psql_database_t *db, size_t idx) {
+  c_psql_writer_t *writer = db->writers[idx];
+  c_psql_copy_buffer_t *buf = db->copy_buffers + idx;
+  int status;
+
+  if (buf->rows == 0)
+    return 0;
+
+  /* Space for the trailer has been reserved by c_psql_copy_write(). */
+  if (writer->copy_format == C_PSQL_COPY_BINARY) {
+    buf->data[buf->fill++] = (char)0xff;
+    buf->data[buf->fill++] = (char)0xff;
+  }
+
+  status =
+      c_psql_copy_send(db, writer->copy_statement, buf->data, buf->fill);
+  if ((status != 0) && (CONNECTION_OK != PQstatus(db->conn)) &&
+      (0 == c_psql_check_connection(db))) {
+    /* try again */
+    status =
+        c_psql_copy_send(db, writer->copy_statement, buf->data, buf->fill);
+  }
+
+  if (status != 0) {
+    log_err("Failed to copy %zu rows to %s: %s", buf->rows, writer->copy_table,
+            PQerrorMessage(db->conn));
+
+    /* this will abort any current transaction -> restart */
+    if (db->next_commit > 0)
+      c_psql_commit(db);
+  } else {
+    log_debug("Copied %zu rows to %s.", buf->rows, writer->copy_table);
+  }
+
+  buf->fill = 0;
+  buf->rows = 0;
+  return status;
+} /* c_psql_copy_flush */
+
+/* Sends the rows of writer "idx" if the oldest one has been buffered for at
+ * least "timeout". Rows are kept while the database is unreachable. You must
+ * hold "db_lock". */
+static void c_psql_copy_flush_older(c_psql_database_t *db, size_t idx,
+                                    cdtime_t timeout) {
+  c_psql_copy_buffer_t *buf;
+
+  if ((db->copy_buffers == NULL) || (db->writers[idx]->copy_table == NULL))
+    return;
+
+  buf = db->copy_buffers + idx;
+  if (buf->rows == 0)
+    return;
+  if ((timeout > 0) && ((cdtime() - buf->first_row) < timeout))
+    return;
+
+  if (0 != c_psql_check_connection(db))
+    return;
+
+  c_psql_copy_flush(db, idx);
+} /* c_psql_copy_flush_older */
+
+/* Appends the rows of "vl" to the buffer of writer "idx", sending the buffer
+ * first if it is full. You must hold "db_lock". */
+static int c_psql_copy_write(c_psql_database_t *db, size_t idx,
+                             const data_set_t *ds, const value_list_t *vl,
+                             const char *time_str) {
+  c_psql_writer_t *writer = db->writers[idx];
+  c_psql_copy_buffer_t *buf = db->copy_buffers + idx;
+  _Bool binary = (writer->copy_format == C_PSQL_COPY_BINARY);
+  gauge_t *rates = NULL;
+  int status;
+
+  if (writer->store_rates) {
+    for (size_t i = 0; i < ds->ds_num; ++i) {
+      if (ds->ds[i].type == DS_TYPE_GAUGE)
+        continue;
+
+      rates = uc_get_rate(ds, vl);
+      if (rates == NULL) {
+        log_err("c_psql_write: Failed to determine rate");
+        return -1;
+      }
+      break;
+    }
+  }
+
+  while (42) {
+    c_psql_copy_cursor_t c = {
+        .ptr = buf->data + buf->fill,
+        /* keep room for the binary trailer */
+        .end = buf->data + buf->size - (binary ? 2 : 0),
+    };
+
+    /* header: signature, flags and header extension length */
+    if (binary && (buf->fill == 0))
+      status = c_psql_copy_put(&c, "PGCOPY\n\377\r\n\0", 11) ||
+               c_psql_copy_put_int(&c, 0, 4) || c_psql_copy_put_int(&c, 0, 4);
+    else
+      status = 0;
+
+    if (status == 0)
+      status = c_psql_copy_encode(&c, writer, ds, vl, rates, time_str);
+
+    if (status == 0) {
+      if (buf->rows == 0)
+        buf->first_row = cdtime();
+      buf->fill = (size_t)(c.ptr - buf->data);
+      buf->rows += ds->ds_num;
+      break;
+    }
+
+    if (buf->rows == 0) {
+      log_err("Writer \"%s\": The rows of %s/%s don't fit into a buffer of "
+              "%zu bytes.",
+              writer->name, vl->host, vl->plugin, buf->size);
+      break;
+    }
+
+    /* The buffer is full: send it and try again. Should that fail, the
+     * buffer is empty nonetheless. */
+    c_psql_copy_flush(db, idx);
+  }
+
+  sfree(rates);
+  return status;
+} /* c_psql_copy_write */
+
+static int c_psql_copy_timer(user_data_t *ud) {
+  c_psql_database_t *db;
+
+  if ((ud == NULL) || (ud->data == NULL)) {
+    log_err("c_psql_copy_timer: Invalid user data.");
+    return -1;
+  }
+
+  db = ud->data;
+
+  pthread_mutex_lock(&db->db_lock);
+
+  for (size_t i = 0; i < db->writers_num; ++i)
+    c_psql_copy_flush_older(db, i, db->writers[i]->flush_interval);
+
+  if ((db->next_commit > 0) && (cdtime() > db->next_commit))
+    c_psql_commit(db);
+
+  pthread_mutex_unlock(&db->db_lock);
+  return 0;
+} /* c_psql_copy_timer */
+
 static PGresult *c_psql_exec_query_noparams(c_psql_database_t *db,
                                             udb_query_t *q) {
   return PQexec(db->conn, udb_query_get_statement(q));
@@ -834,6 +1228,15 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
 
     writer = db->writers[i];
 
+    if (writer->copy_table != NULL) {
+      if (c_psql_copy_write(db, i, ds, vl, time_str) != 0) {
+        pthread_mutex_unlock(&db->db_lock);
+        return -1;
+      }
+      success = 1;
+      continue;
+    }
+
     if (values_type_to_sqlarray(ds, values_type_str, sizeof(values_type_str),
                                 writer->store_rates) == NULL) {
       pthread_mutex_unlock(&db->db_lock);
@@ -900,9 +1303,9 @@ static int c_psql_write(const data_set_t *ds, const value_list_t *vl,
   return 0;
 } /* c_psql_write */
 
-/* We cannot flush single identifiers as all we do is to commit the currently
- * running transaction, thus making sure that all written data is actually
- * visible to everybody. */
+/* We cannot flush single identifiers as all we do is to send the rows buffered
+ * by COPY writers and to commit the currently running transaction, thus making
+ * sure that all written data is actually visible to everybody. */
 static int c_psql_flush(cdtime_t timeout,
                         __attribute__((unused)) const char *ident,
                         user_data_t *ud) {
@@ -917,11 +1320,18 @@ static int c_psql_flush(cdtime_t timeout,
   for (size_t i = 0; i < dbs_num; ++i) {
     c_psql_database_t *db = dbs[i];
 
+    pthread_mutex_lock(&db->db_lock);
+
+    for (size_t j = 0; j < db->writers_num; ++j)
+      c_psql_copy_flush_older(db, j, timeout);
+
     /* don't commit if the timeout is larger than the regular commit
      * interval as in that case all requested data has already been
      * committed */
     if ((db->next_commit > 0) && (db->commit_interval > timeout))
       c_psql_commit(db);
+
+    pthread_mutex_unlock(&db->db_lock);
   }
   return 0;
 } /* c_psql_flush */
@@ -954,6 +1364,12 @@ static int c_psql_shutdown(void) {
   queries = NULL;
   queries_num = 0;
 
+  for (size_t i = 0; i < writers_num; ++i) {
+    sfree(writers[i].name);
+    sfree(writers[i].statement);
+    sfree(writers[i].copy_table);
+    sfree(writers[i].copy_statement);
+  }
   sfree(writers);
   writers = NULL;
   writers_num = 0;
@@ -1089,6 +1505,11 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
   writer->name = sstrdup(ci->values[0].value.string);
   writer->statement = NULL;
   writer->store_rates = 1;
+  writer->copy_table = NULL;
+  writer->copy_statement = NULL;
+  writer->copy_format = C_PSQL_COPY_TEXT;
+  writer->buffer_size = 262144;
+  writer->flush_interval = 0;
 
   for (int i = 0; i < ci->children_num; ++i) {
     oconfig_item_t *c = ci->children + i;
@@ -1097,11 +1518,69 @@ static int c_psql_config_writer(oconfig_item_t *ci) {
       status = cf_util_get_string(c, &writer->statement);
     else if (strcasecmp("StoreRates", c->key) == 0)
       status = cf_util_get_boolean(c, &writer->store_rates);
+    else if (strcasecmp("CopyTable", c->key) == 0)
+      status = cf_util_get_string(c, &writer->copy_table);
+    else if (strcasecmp("CopyFormat", c->key) == 0) {
+      char format[16];
+
+      status = cf_util_get_string_buffer(c, format, sizeof(format));
+      if (status != 0)
+        ;
+      else if (strcasecmp("text", format) == 0)
+        writer->copy_format = C_PSQL_COPY_TEXT;
+      else if (strcasecmp("binary", format) == 0)
+        writer->copy_format = C_PSQL_COPY_BINARY;
+      else {
+        log_err("Writer \"%s\": Invalid CopyFormat \"%s\". "
+                "Expected \"text\" or \"binary\".",
+                writer->name, format);
+        status = -1;
+      }
+    } else if (strcasecmp("BufferSize", c->key) == 0) {
+      int tmp = 0;
+
+      status = cf_util_get_int(c, &tmp);
+      if ((status == 0) && (tmp < 1024)) {
+        log_err("Writer \"%s\": BufferSize must be at least 1024 bytes.",
+                writer->name);
+        status = -1;
+      }
+      writer->buffer_size = (size_t)tmp;
+    } else if (strcasecmp("FlushInterval", c->key) == 0)
+      status = cf_util_get_cdtime(c, &writer->flush_interval);
     else
       log_warn("Ignoring unknown config key \"%s\".", c->key);
+
+    if (status != 0)
+      break;
+  }
+
+  if ((status == 0) && ((writer->statement == NULL) ==
+                        (writer->copy_table == NULL))) {
+    log_err("Writer \"%s\": Exactly one of \"Statement\" and "
+            "\"CopyTable\" is required.",
+            writer->name);
+    status = -1;
+  }
+
+  if ((status == 0) && (writer->copy_table != NULL)) {
+    char statement[1024];
+
+    status = ssnprintf(statement, sizeof(statement),
+                       "COPY %s FROM STDIN (FORMAT %s)", writer->copy_table,
+                       (writer->copy_format == C_PSQL_COPY_BINARY) ? "binary"
+                                                                   : "text");
+    if ((status < 0) || ((size_t)status >= sizeof(statement))) {
+      log_err("Writer \"%s\": CopyTable is too long.", writer->name);
+      status = -1;
+    } else {
+      writer->copy_statement = sstrdup(statement);
+      status = 0;
+    }
   }
 
   if (status != 0) {
+    sfree(writer->copy_table);
     sfree(writer->statement);
     sfree(writer->name);
     return status;
@@ -1116,6 +1595,7 @@ static int c_psql_config_database(oconfig_item_t *ci) {
 
   char cb_name[DATA_MAX_NAME_LEN];
   static _Bool have_flush = 0;
+  cdtime_t copy_interval = 0;
 
   if ((1 != ci->values_num) || (OCONFIG_TYPE_STRING != ci->values[0].type)) {
     log_err("<Database> expects a single string argument.");
@@ -1179,6 +1659,34 @@ static int c_psql_config_database(oconfig_item_t *ci) {
     }
   }
 
+  for (size_t i = 0; i < db->writers_num; ++i) {
+    c_psql_writer_t *writer = db->writers[i];
+
+    if (writer->copy_table == NULL)
+      continue;
+
+    if (db->copy_buffers == NULL) {
+      db->copy_buffers = calloc(db->writers_num, sizeof(*db->copy_buffers));
+      if (db->copy_buffers == NULL) {
+        log_err("Out of memory.");
+        c_psql_database_delete(db);
+        return -1;
+      }
+    }
+
+    db->copy_buffers[i].data = malloc(writer->buffer_size);
+    if (db->copy_buffers[i].data == NULL) {
+      log_err("Out of memory.");
+      c_psql_database_delete(db);
+      return -1;
+    }
+    db->copy_buffers[i].size = writer->buffer_size;
+
+    if ((writer->flush_interval > 0) &&
+        ((copy_interval == 0) || (writer->flush_interval < copy_interval)))
+      copy_interval = writer->flush_interval;
+  }
+
   for (int i = 0; (size_t)i < db->queries_num; ++i) {
     c_psql_user_data_t *data;
     data = udb_query_get_user_data(db->queries[i]);
@@ -1216,6 +1724,18 @@ static int c_psql_config_database(oconfig_item_t *ci) {
     /* flush this connection only */
     ++db->ref_cnt;
     plugin_register_flush(cb_name, c_psql_flush, &ud);
+
+    if (db->copy_buffers != NULL) {
+      char timer_name[DATA_MAX_NAME_LEN];
+
+      ssnprintf(timer_name, sizeof(timer_name), "%s-copy", cb_name);
+
+      /* send buffered rows once they are "FlushInterval" old; without that
+       * option, rows are sent every interval */
+      ++db->ref_cnt;
+      plugin_register_complex_read("postgresql", timer_name, c_psql_copy_timer,
+                                   /* interval = */ copy_interval, &ud);
+    }
   } else if (db->commit_interval > 0) {
     log_warn("Database '%s': You do not have any writers assigned to "
              "this database connection. Setting 'CommitInterval' does "
@@ -0,0 +1,238 @@
+/**
+ * collectd - src/postgresql_test.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ **/
+
+#include "postgresql.c"
+
+#include "testing.h"
+
+static data_source_t test_dsrc[] = {
+    {"rx", DS_TYPE_DERIVE, 0, NAN}, {"tx", DS_TYPE_GAUGE, 0, NAN},
+};
+static data_set_t test_ds = {"test", STATIC_ARRAY_SIZE(test_dsrc), test_dsrc};
+
+static value_t test_values[] = {{.derive = -42}, {.gauge = 0.5}};
+
+static value_list_t test_vl(void) {
+  value_list_t vl = VALUE_LIST_INIT;
+
+  vl.values = test_values;
+  vl.values_len = STATIC_ARRAY_SIZE(test_values);
+  /* 2000-01-01 00:00:01 UTC */
+  vl.time = TIME_T_TO_CDTIME_T(946684801);
+  sstrncpy(vl.host, "ex\\am\tple", sizeof(vl.host));
+  sstrncpy(vl.plugin, "interface", sizeof(vl.plugin));
+  sstrncpy(vl.type, "if_octets", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "eth\n0", sizeof(vl.type_instance));
+  return vl;
+}
+
+DEF_TEST(copy_text) {
+  c_psql_writer_t writer = {.copy_format = C_PSQL_COPY_TEXT};
+  value_list_t vl = test_vl();
+  char buffer[256];
+  c_psql_copy_cursor_t c = {buffer, buffer + sizeof(buffer)};
+
+  CHECK_ZERO(c_psql_copy_encode(&c, &writer, &test_ds, &vl, NULL, "T"));
+  *c.ptr = '\0';
+  EXPECT_EQ_STR("T\tex\\\\am\\tple\tinterface\t\\N\tif_octets\teth\\n0\trx\t"
+                "derive\t-42\n"
+                "T\tex\\\\am\\tple\tinterface\t\\N\tif_octets\teth\\n0\ttx\t"
+                "gauge\t0.5\n",
+                buffer);
+
+  /* rates replace non-gauge values and are stored as gauges */
+  gauge_t rates[] = {NAN, 7.0};
+  test_values[1].gauge = -INFINITY;
+  c.ptr = buffer;
+  CHECK_ZERO(c_psql_copy_encode(&c, &writer, &test_ds, &vl, rates, "T"));
+  *c.ptr = '\0';
+  EXPECT_EQ_STR("T\tex\\\\am\\tple\tinterface\t\\N\tif_octets\teth\\n0\trx\t"
+                "gauge\tNaN\n"
+                "T\tex\\\\am\\tple\tinterface\t\\N\tif_octets\teth\\n0\ttx\t"
+                "gauge\t-Infinity\n",
+                buffer);
+  test_values[1].gauge = 0.5;
+
+  /* encoding fails instead of overrunning the end of the buffer */
+  for (size_t size = 0; size < 90; size += 10) {
+    c.ptr = buffer;
+    c.end = buffer + size;
+    OK(c_psql_copy_encode(&c, &writer, &test_ds, &vl, NULL, "T") != 0);
+    OK(c.ptr <= c.end);
+  }
+
+  return 0;
+}
+
+DEF_TEST(copy_binary) {
+  c_psql_writer_t writer = {.copy_format = C_PSQL_COPY_BINARY};
+  value_list_t vl = test_vl();
+  char buffer[256];
+  c_psql_copy_cursor_t c = {buffer, buffer + sizeof(buffer)};
+
+  vl.values_len = 1;
+  test_ds.ds_num = 1;
+  CHECK_ZERO(c_psql_copy_encode(&c, &writer, &test_ds, &vl, NULL, NULL));
+  test_ds.ds_num = STATIC_ARRAY_SIZE(test_dsrc);
+
+  static const char expect[] =
+      "\x00\x09"                         /* field count */
+      "\x00\x00\x00\x08"                 /* time */
+      "\x00\x00\x00\x00\x00\x0f\x42\x40" /* one second after the PG epoch */
+      "\x00\x00\x00\x09"
+      "ex\\am\tple"
+      "\x00\x00\x00\x09"
+      "interface"
+      "\xff\xff\xff\xff" /* no plugin instance */
+      "\x00\x00\x00\x09"
+      "if_octets"
+      "\x00\x00\x00\x05"
+      "eth\n0"
+      "\x00\x00\x00\x02"
+      "rx"
+      "\x00\x00\x00\x06"
+      "derive"
+      "\x00\x00\x00\x08"
+      "\xc0\x45\x00\x00\x00\x00\x00\x00"; /* -42.0 */
+
+  EXPECT_EQ_INT((int)sizeof(expect) - 1, (int)(c.ptr - buffer));
+  OK(memcmp(expect, buffer, sizeof(expect) - 1) == 0);
+
+  return 0;
+}
+
+DEF_TEST(copy_buffer) {
+  c_psql_writer_t writer = {.name = "test",
+                            .copy_table = "test",
+                            .copy_format = C_PSQL_COPY_BINARY,
+                            .buffer_size = 1024};
+  c_psql_writer_t *writer_ptr = &writer;
+  c_psql_copy_buffer_t buffer = {0};
+  c_psql_database_t db = {
+      .writers = &writer_ptr, .writers_num = 1, .copy_buffers = &buffer,
+  };
+  value_list_t vl = test_vl();
+
+  buffer.data = malloc(writer.buffer_size);
+  buffer.size = writer.buffer_size;
+
+  CHECK_ZERO(c_psql_copy_write(&db, 0, &test_ds, &vl, NULL));
+  EXPECT_EQ_INT(2, (int)buffer.rows);
+  OK(memcmp(buffer.data, "PGCOPY\n\377\r\n\0", 11) == 0);
+
+  /* the header is only written once */
+  size_t fill = buffer.fill;
+  CHECK_ZERO(c_psql_copy_write(&db, 0, &test_ds, &vl, NULL));
+  EXPECT_EQ_INT(4, (int)buffer.rows);
+  EXPECT_EQ_INT((int)(2 * fill - 19), (int)buffer.fill);
+
+  /* rows that never fit are rejected */
+  buffer.size = 64;
+  buffer.fill = 0;
+  buffer.rows = 0;
+  OK(c_psql_copy_write(&db, 0, &test_ds, &vl, NULL) != 0);
+  EXPECT_EQ_INT(0, (int)buffer.rows);
+
+  sfree(buffer.data);
+  return 0;
+}
+
+/* Copies rows into a temporary table of the database described by the usual
+ * libpq environment variables. Skipped unless PGDATABASE is set. */
+DEF_TEST(copy_live) {
+  if (getenv("PGDATABASE") == NULL) {
+    printf("ok - # SKIP PGDATABASE is not set\n");
+    return 0;
+  }
+
+  c_psql_copy_format_t formats[] = {C_PSQL_COPY_TEXT, C_PSQL_COPY_BINARY};
+  PGconn *conn = PQconnectdb("");
+  PGresult *res;
+
+  if (PQstatus(conn) != CONNECTION_OK) {
+    printf("not ok - connecting: %s\n", PQerrorMessage(conn));
+    PQfinish(conn);
+    return -1;
+  }
+
+  res = PQexec(conn, "CREATE TEMPORARY TABLE c_psql_copy_test ("
+                     "time timestamp with time zone, host text, plugin text, "
+                     "plugin_instance text, type text, type_instance text, "
+                     "dsname text, dstype text, value double precision)");
+  EXPECT_EQ_INT(PGRES_COMMAND_OK, PQresultStatus(res));
+  PQclear(res);
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(formats); ++i) {
+    c_psql_writer_t writer = {
+        .name = "test",
+        .copy_table = "c_psql_copy_test",
+        .copy_statement = (formats[i] == C_PSQL_COPY_BINARY)
+                              ? "COPY c_psql_copy_test FROM STDIN "
+                                "(FORMAT binary)"
+                              : "COPY c_psql_copy_test FROM STDIN "
+                                "(FORMAT text)",
+        .copy_format = formats[i],
+        .buffer_size = 4096,
+    };
+    c_psql_writer_t *writer_ptr = &writer;
+    c_psql_copy_buffer_t buffer = {.size = writer.buffer_size};
+    c_psql_database_t db = {
+        .conn = conn,
+        .writers = &writer_ptr,
+        .writers_num = 1,
+        .copy_buffers = &buffer,
+    };
+    value_list_t vl = test_vl();
+    char time_str[RFC3339NANO_SIZE];
+
+    buffer.data = malloc(buffer.size);
+    CHECK_ZERO(rfc3339nano_local(time_str, sizeof(time_str), vl.time));
+
+    /* enough rows to fill the buffer a couple of times */
+    for (int j = 0; j < 100; ++j)
+      CHECK_ZERO(c_psql_copy_write(&db, 0, &test_ds, &vl, time_str));
+    CHECK_ZERO(c_psql_copy_flush(&db, 0));
+    sfree(buffer.data);
+  }
+
+  res = PQexec(conn, "SELECT count(*), "
+                     "count(DISTINCT (time, host, type_instance)), "
+                     "sum(value) FROM c_psql_copy_test");
+  EXPECT_EQ_INT(PGRES_TUPLES_OK, PQresultStatus(res));
+  EXPECT_EQ_STR("400", PQgetvalue(res, 0, 0));
+  EXPECT_EQ_STR("1", PQgetvalue(res, 0, 1));
+  EXPECT_EQ_STR("-8300", PQgetvalue(res, 0, 2));
+  PQclear(res);
+
+  PQfinish(conn);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(copy_text);
+  RUN_TEST(copy_binary);
+  RUN_TEST(copy_buffer);
+  RUN_TEST(copy_live);
+
+  END_TEST;
+}
@@ -28,6 +28,7 @@
 #include "common.h"
 #include "plugin.h"
 #include "utils_avltree.h"
+#include "utils_complain.h"
 #include "utils_random.h"
 #include "utils_rrdcreate.h"
 
@@ -37,31 +38,66 @@
  * Private types
  */
 struct rrd_cache_s {
+  char *filename;
+  /* The formatted values, separated by null bytes. The buffer is handed to a
+   * queue thread as a whole, so adding a value only allocates memory if the
+   * buffer needs to grow. */
+  char *values;
+  size_t values_size;
+  size_t values_fill;
   int values_num;
-  char **values;
+  /* Initial size of the next buffer, derived from the last one written. */
+  size_t values_size_hint;
+  dev_t dev;
+  ino_t ino;
   cdtime_t first_value;
   cdtime_t last_value;
   int64_t random_variation;
   enum { FLAG_NONE = 0x00, FLAG_QUEUED = 0x01, FLAG_FLUSHQ = 0x02 } flags;
+  /* Entries holding values, ordered by the time of their first value. */
+  struct rrd_cache_s *age_prev;
+  struct rrd_cache_s *age_next;
 };
 typedef struct rrd_cache_s rrd_cache_t;
 
-enum rrd_queue_dir_e { QUEUE_INSERT_FRONT, QUEUE_INSERT_BACK };
-typedef enum rrd_queue_dir_e rrd_queue_dir_t;
-
 struct rrd_queue_s {
   char *filename;
+  dev_t dev;
+  ino_t ino;
   struct rrd_queue_s *next;
 };
 typedef struct rrd_queue_s rrd_queue_t;
 
+/* Every file is written by the same queue thread, chosen by the hash of its
+ * name, so updates of one file are never reordered. */
+struct rrd_queue_thread_s {
+  pthread_t thread;
+  _Bool running;
+  pthread_cond_t cond;
+
+  rrd_queue_t *queue_head;
+  rrd_queue_t *queue_tail;
+  rrd_queue_t *flushq_head;
+  rrd_queue_t *flushq_tail;
+  /* Number of files queued or in "batch". */
+  size_t queue_num;
+
+  /* Only used by the thread itself: the queue entries taken in one go, sorted
+   * by their location on disk, and the argument vector for rrd_update. */
+  rrd_queue_t *batch;
+  const char **argv;
+  size_t argv_num;
+};
+typedef struct rrd_queue_thread_s rrd_queue_thread_t;
+
 /*
  * Private variables
  */
 static const char *config_keys[] = {
     "CacheTimeout", "CacheFlush",      "CreateFilesAsync", "DataDir",
     "StepSize",     "HeartBeat",       "RRARows",          "RRATimespan",
-    "XFF",          "WritesPerSecond", "RandomTimeout"};
+    "XFF",          "WritesPerSecond", "RandomTimeout",    "QueueThreads",
+    "CacheMaxSize", "ReportStats"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 /* If datadir is zero, the daemon's basedir is used. If stepsize or heartbeat
@@ -82,6 +118,7 @@ static rrdcreate_config_t rrdcreate_config = {
     /* consolidation_functions_num = */ 0,
 
     /* async = */ 0};
+static _Bool report_stats = 0;
 
 /* XXX: If you need to lock both, cache_lock and queue_lock, at the same time,
  * ALWAYS lock `cache_lock' first! */
@@ -92,14 +129,20 @@ static cdtime_t cache_flush_last;
 static c_avl_tree_t *cache = NULL;
 static pthread_mutex_t cache_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static rrd_queue_t *queue_head = NULL;
-static rrd_queue_t *queue_tail = NULL;
-static rrd_queue_t *flushq_head = NULL;
-static rrd_queue_t *flushq_tail = NULL;
-static pthread_t queue_thread;
-static int queue_thread_running = 1;
+/* Memory used by the cache, including the buffers being written by the queue
+ * threads. Protected by "cache_lock", like the variables below. */
+static size_t cache_max_size = 0;
+static size_t cache_size = 0;
+static cdtime_t cache_shrink_last = 0;
+static c_complain_t cache_complaint = C_COMPLAIN_INIT_STATIC;
+static rrd_cache_t *age_head = NULL;
+static rrd_cache_t *age_tail = NULL;
+static uint64_t stats_values_written = 0;
+static uint64_t stats_values_dropped = 0;
+
+static size_t queue_threads_num = 1;
+static rrd_queue_thread_t *queue_threads = NULL;
 static pthread_mutex_t queue_lock = PTHREAD_MUTEX_INITIALIZER;
-static pthread_cond_t queue_cond = PTHREAD_COND_INITIALIZER;
 
 #if !HAVE_THREADSAFE_LIBRRD
 static pthread_mutex_t librrd_lock = PTHREAD_MUTEX_INITIALIZER;
@@ -167,83 +210,30 @@ static int srrd_update(char *filename, char *template, int argc,
 } /* int srrd_update */
 #endif /* !HAVE_THREADSAFE_LIBRRD */
 
-static int value_list_to_string_multiple(char *buffer, int buffer_len,
-                                         const data_set_t *ds,
-                                         const value_list_t *vl) {
-  int offset;
+static int value_list_to_string(char *buffer, int buffer_len,
+                                const data_set_t *ds, const value_list_t *vl) {
+  strbuf_t buf;
   int status;
-  time_t tt;
-
-  memset(buffer, '\0', buffer_len);
 
-  tt = CDTIME_T_TO_TIME_T(vl->time);
-  status = ssnprintf(buffer, buffer_len, "%u", (unsigned int)tt);
-  if ((status < 1) || (status >= buffer_len))
-    return -1;
-  offset = status;
+  strbuf_init_fixed(&buf, buffer, (size_t)buffer_len);
+  status = strbuf_print_uint(&buf, (uint64_t)CDTIME_T_TO_TIME_T(vl->time));
+  if (status != 0)
+    return status;
 
   for (size_t i = 0; i < ds->ds_num; i++) {
     if ((ds->ds[i].type != DS_TYPE_COUNTER) &&
         (ds->ds[i].type != DS_TYPE_GAUGE) &&
         (ds->ds[i].type != DS_TYPE_DERIVE) &&
         (ds->ds[i].type != DS_TYPE_ABSOLUTE))
-      return -1;
-
-    if (ds->ds[i].type == DS_TYPE_COUNTER)
-      status = ssnprintf(buffer + offset, buffer_len - offset, ":%llu",
-                         vl->values[i].counter);
-    else if (ds->ds[i].type == DS_TYPE_GAUGE)
-      status = ssnprintf(buffer + offset, buffer_len - offset, ":" GAUGE_FORMAT,
-                         vl->values[i].gauge);
-    else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      status = ssnprintf(buffer + offset, buffer_len - offset, ":%" PRIi64,
-                         vl->values[i].derive);
-    else /*if (ds->ds[i].type == DS_TYPE_ABSOLUTE) */
-      status = ssnprintf(buffer + offset, buffer_len - offset, ":%" PRIu64,
-                         vl->values[i].absolute);
-
-    if ((status < 1) || (status >= (buffer_len - offset)))
-      return -1;
+      return EINVAL;
 
-    offset += status;
+    status = strbuf_print(&buf, ":");
+    if (status == 0)
+      status = format_value(&buf, ds->ds[i].type, vl->values[i]);
+    if (status != 0)
+      return status;
   } /* for ds->ds_num */
 
-  return 0;
-} /* int value_list_to_string_multiple */
-
-static int value_list_to_string(char *buffer, int buffer_len,
-                                const data_set_t *ds, const value_list_t *vl) {
-  int status;
-  time_t tt;
-
-  if (ds->ds_num != 1)
-    return value_list_to_string_multiple(buffer, buffer_len, ds, vl);
-
-  tt = CDTIME_T_TO_TIME_T(vl->time);
-  switch (ds->ds[0].type) {
-  case DS_TYPE_DERIVE:
-    status = ssnprintf(buffer, buffer_len, "%u:%" PRIi64, (unsigned)tt,
-                       vl->values[0].derive);
-    break;
-  case DS_TYPE_GAUGE:
-    status = ssnprintf(buffer, buffer_len, "%u:" GAUGE_FORMAT, (unsigned)tt,
-                       vl->values[0].gauge);
-    break;
-  case DS_TYPE_COUNTER:
-    status = ssnprintf(buffer, buffer_len, "%u:%llu", (unsigned)tt,
-                       vl->values[0].counter);
-    break;
-  case DS_TYPE_ABSOLUTE:
-    status = ssnprintf(buffer, buffer_len, "%u:%" PRIu64, (unsigned)tt,
-                       vl->values[0].absolute);
-    break;
-  default:
-    return EINVAL;
-  }
-
-  if ((status < 1) || (status >= buffer_len))
-    return ENOMEM;
-
   return 0;
 } /* int value_list_to_string */
 
@@ -283,36 +273,171 @@ static int value_list_to_filename(char *buffer, size_t buffer_size,
   return 0;
 } /* int value_list_to_filename */
 
-static void *rrd_queue_thread(void __attribute__((unused)) * data) {
-  struct timeval tv_next_update;
-  struct timeval tv_now;
+static int rrd_queue_compare(rrd_queue_t const *a, rrd_queue_t const *b) {
+  if (a->dev != b->dev)
+    return (a->dev < b->dev) ? -1 : 1;
+  if (a->ino != b->ino)
+    return (a->ino < b->ino) ? -1 : 1;
+  return strcmp(a->filename, b->filename);
+} /* int rrd_queue_compare */
+
+/* Sorts a list of queue entries by device and inode number, so that files are
+ * written roughly in the order they are stored on disk. */
+static rrd_queue_t *rrd_queue_sort(rrd_queue_t *list) {
+  rrd_queue_t *slow;
+  rrd_queue_t *fast;
+  rrd_queue_t *second;
+  rrd_queue_t *head = NULL;
+  rrd_queue_t **tail = &head;
+
+  if ((list == NULL) || (list->next == NULL))
+    return list;
+
+  slow = list;
+  fast = list->next;
+  while ((fast != NULL) && (fast->next != NULL)) {
+    slow = slow->next;
+    fast = fast->next->next;
+  }
+  second = slow->next;
+  slow->next = NULL;
 
-  gettimeofday(&tv_next_update, /* timezone = */ NULL);
+  list = rrd_queue_sort(list);
+  second = rrd_queue_sort(second);
 
-  while (42) {
-    rrd_queue_t *queue_entry;
-    rrd_cache_t *cache_entry;
-    char **values;
-    int values_num;
-    int status;
+  while ((list != NULL) && (second != NULL)) {
+    if (rrd_queue_compare(list, second) <= 0) {
+      *tail = list;
+      list = list->next;
+    } else {
+      *tail = second;
+      second = second->next;
+    }
+    tail = &(*tail)->next;
+  }
+  *tail = (list != NULL) ? list : second;
+
+  return head;
+} /* rrd_queue_t *rrd_queue_sort */
+
+static void rrd_age_link(rrd_cache_t *rc) {
+  rc->age_prev = age_tail;
+  rc->age_next = NULL;
+  if (age_tail != NULL)
+    age_tail->age_next = rc;
+  else
+    age_head = rc;
+  age_tail = rc;
+} /* void rrd_age_link */
+
+static void rrd_age_unlink(rrd_cache_t *rc) {
+  if (rc->age_prev != NULL)
+    rc->age_prev->age_next = rc->age_next;
+  else
+    age_head = rc->age_next;
+  if (rc->age_next != NULL)
+    rc->age_next->age_prev = rc->age_prev;
+  else
+    age_tail = rc->age_prev;
+  rc->age_prev = NULL;
+  rc->age_next = NULL;
+} /* void rrd_age_unlink */
+
+/* Takes the values of a file from the cache and writes them to disk. */
+static void rrd_queue_write(rrd_queue_thread_t *qt,
+                            rrd_queue_t const *queue_entry) {
+  rrd_cache_t *rc = NULL;
+  char *values = NULL;
+  size_t values_size = 0;
+  int values_num = 0;
+  char *ptr;
+
+  /* We now need the cache lock so the entry isn't updated while
+   * we take its values */
+  pthread_mutex_lock(&cache_lock);
+
+  /* A file may be queued twice, e.g. when it was flushed while waiting in a
+   * batch. The second time around there's nothing left to do. */
+  if ((c_avl_get(cache, queue_entry->filename, (void *)&rc) == 0) &&
+      (rc->values_num > 0)) {
+    values = rc->values;
+    values_size = rc->values_size;
+    values_num = rc->values_num;
+
+    rc->values_size_hint = rc->values_fill + rc->values_fill / 4;
+    rc->values = NULL;
+    rc->values_size = 0;
+    rc->values_fill = 0;
+    rc->values_num = 0;
+    rc->flags = FLAG_NONE;
+    rrd_age_unlink(rc);
+  }
+
+  pthread_mutex_unlock(&cache_lock);
+
+  if (values == NULL)
+    return;
+
+  if (qt->argv_num < (size_t)values_num) {
+    const char **tmp = realloc(qt->argv, values_num * sizeof(*tmp));
+    if (tmp == NULL) {
+      ERROR("rrdtool plugin: realloc failed. Dropping %i value%s of %s.",
+            values_num, (values_num == 1) ? "" : "s", queue_entry->filename);
+      values_num = 0;
+    } else {
+      qt->argv = tmp;
+      qt->argv_num = (size_t)values_num;
+    }
+  }
+
+  ptr = values;
+  for (int i = 0; i < values_num; i++) {
+    qt->argv[i] = ptr;
+    ptr += strlen(ptr) + 1;
+  }
 
-    values = NULL;
-    values_num = 0;
+  /* Write the values to the RRD-file */
+  if (values_num > 0) {
+    srrd_update(queue_entry->filename, NULL, values_num, qt->argv);
+    DEBUG("rrdtool plugin: queue thread: Wrote %i value%s to %s", values_num,
+          (values_num == 1) ? "" : "s", queue_entry->filename);
+  }
+
+  sfree(values);
+
+  pthread_mutex_lock(&cache_lock);
+  cache_size -= values_size;
+  stats_values_written += (uint64_t)values_num;
+  pthread_mutex_unlock(&cache_lock);
+} /* void rrd_queue_write */
+
+static void *rrd_queue_thread(void *data) {
+  rrd_queue_thread_t *qt = data;
+  /* Every thread writes its share of "WritesPerSecond". */
+  cdtime_t write_interval =
+      DOUBLE_TO_CDTIME_T(write_rate * (double)queue_threads_num);
+  cdtime_t next_update = cdtime();
+
+  while (42) {
+    rrd_queue_t *queue_entry = NULL;
+    rrd_queue_t *batch = NULL;
 
     pthread_mutex_lock(&queue_lock);
     /* Wait for values to arrive */
     while (42) {
       struct timespec ts_wait;
+      int status;
 
-      while ((flushq_head == NULL) && (queue_head == NULL) &&
-             (do_shutdown == 0))
-        pthread_cond_wait(&queue_cond, &queue_lock);
+      while ((qt->flushq_head == NULL) && (qt->queue_head == NULL) &&
+             (qt->batch == NULL) && (do_shutdown == 0))
+        pthread_cond_wait(&qt->cond, &queue_lock);
 
-      if ((flushq_head == NULL) && (queue_head == NULL))
+      if ((qt->flushq_head == NULL) && (qt->queue_head == NULL) &&
+          (qt->batch == NULL))
         break;
 
       /* Don't delay if there's something to flush */
-      if (flushq_head != NULL)
+      if (qt->flushq_head != NULL)
         break;
 
       /* Don't delay if we're shutting down */
@@ -320,99 +445,59 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
         break;
 
       /* Don't delay if no delay was configured. */
-      if (write_rate <= 0.0)
+      if (write_interval == 0)
         break;
 
-      gettimeofday(&tv_now, /* timezone = */ NULL);
-      status = timeval_cmp(tv_next_update, tv_now, NULL);
       /* We're good to go */
-      if (status <= 0)
+      if (cdtime() >= next_update)
         break;
 
       /* We're supposed to wait a bit with this update, so we'll
        * wait for the next addition to the queue or to the end of
        * the wait period - whichever comes first. */
-      ts_wait.tv_sec = tv_next_update.tv_sec;
-      ts_wait.tv_nsec = 1000 * tv_next_update.tv_usec;
-
-      status = pthread_cond_timedwait(&queue_cond, &queue_lock, &ts_wait);
+      ts_wait = CDTIME_T_TO_TIMESPEC(next_update);
+      status = pthread_cond_timedwait(&qt->cond, &queue_lock, &ts_wait);
       if (status == ETIMEDOUT)
         break;
     } /* while (42) */
 
-    /* XXX: If you need to lock both, cache_lock and queue_lock, at
-     * the same time, ALWAYS lock `cache_lock' first! */
-
-    /* We're in the shutdown phase */
-    if ((flushq_head == NULL) && (queue_head == NULL)) {
-      pthread_mutex_unlock(&queue_lock);
-      break;
-    }
-
-    if (flushq_head != NULL) {
+    if (qt->flushq_head != NULL) {
       /* Dequeue the first flush entry */
-      queue_entry = flushq_head;
-      if (flushq_head == flushq_tail)
-        flushq_head = flushq_tail = NULL;
-      else
-        flushq_head = flushq_head->next;
-    } else /* if (queue_head != NULL) */
-    {
-      /* Dequeue the first regular entry */
-      queue_entry = queue_head;
-      if (queue_head == queue_tail)
-        queue_head = queue_tail = NULL;
-      else
-        queue_head = queue_head->next;
+      queue_entry = qt->flushq_head;
+      qt->flushq_head = queue_entry->next;
+      if (qt->flushq_head == NULL)
+        qt->flushq_tail = NULL;
+    } else if ((qt->batch == NULL) && (qt->queue_head != NULL)) {
+      /* Take all regular entries at once, so they can be sorted */
+      batch = qt->queue_head;
+      qt->queue_head = qt->queue_tail = NULL;
     }
 
     /* Unlock the queue again */
     pthread_mutex_unlock(&queue_lock);
 
-    /* We now need the cache lock so the entry isn't updated while
-     * we make a copy of its values */
-    pthread_mutex_lock(&cache_lock);
+    if (batch != NULL)
+      qt->batch = rrd_queue_sort(batch);
 
-    status = c_avl_get(cache, queue_entry->filename, (void *)&cache_entry);
-
-    if (status == 0) {
-      values = cache_entry->values;
-      values_num = cache_entry->values_num;
-
-      cache_entry->values = NULL;
-      cache_entry->values_num = 0;
-      cache_entry->flags = FLAG_NONE;
+    if ((queue_entry == NULL) && (qt->batch != NULL)) {
+      queue_entry = qt->batch;
+      qt->batch = queue_entry->next;
     }
 
-    pthread_mutex_unlock(&cache_lock);
+    /* We're in the shutdown phase */
+    if (queue_entry == NULL)
+      break;
 
-    if (status != 0) {
-      sfree(queue_entry->filename);
-      sfree(queue_entry);
-      continue;
-    }
+    /* Update `next_update' */
+    if (write_interval > 0)
+      next_update = cdtime() + write_interval;
 
-    /* Update `tv_next_update' */
-    if (write_rate > 0.0) {
-      gettimeofday(&tv_now, /* timezone = */ NULL);
-      tv_next_update.tv_sec = tv_now.tv_sec;
-      tv_next_update.tv_usec =
-          tv_now.tv_usec + ((suseconds_t)(1000000 * write_rate));
-      while (tv_next_update.tv_usec > 1000000) {
-        tv_next_update.tv_sec++;
-        tv_next_update.tv_usec -= 1000000;
-      }
-    }
+    rrd_queue_write(qt, queue_entry);
 
-    /* Write the values to the RRD-file */
-    srrd_update(queue_entry->filename, NULL, values_num, (const char **)values);
-    DEBUG("rrdtool plugin: queue thread: Wrote %i value%s to %s", values_num,
-          (values_num == 1) ? "" : "s", queue_entry->filename);
+    pthread_mutex_lock(&queue_lock);
+    qt->queue_num--;
+    pthread_mutex_unlock(&queue_lock);
 
-    for (int i = 0; i < values_num; i++) {
-      sfree(values[i]);
-    }
-    sfree(values);
     sfree(queue_entry->filename);
     sfree(queue_entry);
   } /* while (42) */
@@ -421,45 +506,66 @@ static void *rrd_queue_thread(void __attribute__((unused)) * data) {
   return (void *)0;
 } /* void *rrd_queue_thread */
 
-static int rrd_queue_enqueue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+static int rrd_queue_enqueue(rrd_cache_t const *rc, _Bool flush) {
+  rrd_queue_thread_t *qt;
   rrd_queue_t *queue_entry;
 
+  if (queue_threads == NULL)
+    return -1;
+  qt = queue_threads + (strhash(rc->filename) % queue_threads_num);
+
   queue_entry = malloc(sizeof(*queue_entry));
   if (queue_entry == NULL)
     return -1;
 
-  queue_entry->filename = strdup(filename);
+  queue_entry->filename = strdup(rc->filename);
   if (queue_entry->filename == NULL) {
     free(queue_entry);
     return -1;
   }
 
+  queue_entry->dev = rc->dev;
+  queue_entry->ino = rc->ino;
   queue_entry->next = NULL;
 
   pthread_mutex_lock(&queue_lock);
 
-  if (*tail == NULL)
-    *head = queue_entry;
-  else
-    (*tail)->next = queue_entry;
-  *tail = queue_entry;
+  if (flush) {
+    if (qt->flushq_tail == NULL)
+      qt->flushq_head = queue_entry;
+    else
+      qt->flushq_tail->next = queue_entry;
+    qt->flushq_tail = queue_entry;
+  } else {
+    if (qt->queue_tail == NULL)
+      qt->queue_head = queue_entry;
+    else
+      qt->queue_tail->next = queue_entry;
+    qt->queue_tail = queue_entry;
+  }
+  qt->queue_num++;
 
-  pthread_cond_signal(&queue_cond);
+  pthread_cond_signal(&qt->cond);
   pthread_mutex_unlock(&queue_lock);
 
   return 0;
 } /* int rrd_queue_enqueue */
 
-static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
-                             rrd_queue_t **tail) {
+/* Removes a file from the regular queue. Fails if the file isn't queued or a
+ * queue thread has already taken it. */
+static int rrd_queue_dequeue(const char *filename) {
+  rrd_queue_thread_t *qt;
   rrd_queue_t *this;
   rrd_queue_t *prev;
 
+  if (queue_threads == NULL)
+    return -1;
+  qt = queue_threads + (strhash(filename) % queue_threads_num);
+
   pthread_mutex_lock(&queue_lock);
 
   prev = NULL;
-  this = *head;
+  this = qt->queue_head;
 
   while (this != NULL) {
     if (strcmp(this->filename, filename) == 0)
@@ -475,12 +581,14 @@ static int rrd_queue_dequeue(const char *filename, rrd_queue_t **head,
   }
 
   if (prev == NULL)
-    *head = this->next;
+    qt->queue_head = this->next;
   else
     prev->next = this->next;
 
   if (this->next == NULL)
-    *tail = prev;
+    qt->queue_tail = prev;
+
+  qt->queue_num--;
 
   pthread_mutex_unlock(&queue_lock);
 
@@ -518,7 +626,7 @@ static void rrd_cache_flush(cdtime_t timeout) {
     else if (rc->values_num > 0) {
       int status;
 
-      status = rrd_queue_enqueue(key, &queue_head, &queue_tail);
+      status = rrd_queue_enqueue(rc, /* flush = */ 0);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
     } else /* ancient and no values -> waste of memory */
@@ -549,6 +657,9 @@ static void rrd_cache_flush(cdtime_t timeout) {
     assert(rc->values == NULL);
     assert(rc->values_num == 0);
 
+    cache_size -= sizeof(*rc) + strlen(key) + 1;
+
+    /* "key" and "rc->filename" are the same string. */
     sfree(rc);
     sfree(key);
     keys[i] = NULL;
@@ -590,14 +701,14 @@ static int rrd_cache_flush_identifier(cdtime_t timeout,
   if (rc->flags == FLAG_FLUSHQ) {
     status = 0;
   } else if (rc->flags == FLAG_QUEUED) {
-    rrd_queue_dequeue(key, &queue_head, &queue_tail);
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    rrd_queue_dequeue(key);
+    status = rrd_queue_enqueue(rc, /* flush = */ 1);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   } else if ((now - rc->first_value) < timeout) {
     status = 0;
   } else if (rc->values_num > 0) {
-    status = rrd_queue_enqueue(key, &flushq_head, &flushq_tail);
+    status = rrd_queue_enqueue(rc, /* flush = */ 1);
     if (status == 0)
       rc->flags = FLAG_FLUSHQ;
   }
@@ -605,6 +716,56 @@ static int rrd_cache_flush_identifier(cdtime_t timeout,
   return status;
 } /* int rrd_cache_flush_identifier */
 
+/* Checks whether "size" more bytes fit into the cache. If they don't, the new
+ * value is dropped: the values already in the cache are older and are written
+ * first. You must hold "cache_lock". */
+static _Bool rrd_cache_reserve(size_t size) {
+  if ((cache_max_size == 0) || ((cache_size + size) <= cache_max_size)) {
+    if (cache_size <= (cache_max_size / 4 * 3))
+      c_release(LOG_INFO, &cache_complaint,
+                "rrdtool plugin: The cache accepts new values again.");
+    return 1;
+  }
+
+  stats_values_dropped++;
+  c_complain(LOG_WARNING, &cache_complaint,
+             "rrdtool plugin: The cache is full (%zu bytes). New values are "
+             "dropped until the queue threads have caught up.",
+             cache_size);
+  return 0;
+} /* _Bool rrd_cache_reserve */
+
+/* Once the cache uses more than three quarters of "CacheMaxSize", the files
+ * with the oldest values are flushed until the entries on their way to disk
+ * account for everything above half of it. Memory is only released once the
+ * values have been written, so this is done at most once per second. You
+ * must hold "cache_lock". */
+static void rrd_cache_shrink(void) {
+  cdtime_t now;
+  size_t excess;
+  size_t queued = 0;
+
+  if ((cache_max_size == 0) || (cache_size <= (cache_max_size / 4 * 3)))
+    return;
+
+  now = cdtime();
+  if ((now - cache_shrink_last) < TIME_T_TO_CDTIME_T(1))
+    return;
+  cache_shrink_last = now;
+
+  excess = cache_size - cache_max_size / 2;
+  for (rrd_cache_t *rc = age_head; (rc != NULL) && (queued < excess);
+       rc = rc->age_next) {
+    if ((rc->flags == FLAG_NONE) &&
+        (rrd_queue_enqueue(rc, /* flush = */ 1) == 0))
+      rc->flags = FLAG_FLUSHQ;
+    queued += rc->values_size;
+  }
+
+  DEBUG("rrdtool plugin: Cache size is %zu bytes, %zu bytes are queued.",
+        cache_size, queued);
+} /* void rrd_cache_shrink */
+
 static int64_t rrd_get_random_variation(void) {
   long min;
   long max;
@@ -626,10 +787,9 @@ static int64_t rrd_get_random_variation(void) {
 } /* int64_t rrd_get_random_variation */
 
 static int rrd_cache_insert(const char *filename, const char *value,
-                            cdtime_t value_time) {
+                            cdtime_t value_time, struct stat const *statbuf) {
   rrd_cache_t *rc = NULL;
-  int new_rc = 0;
-  char **values_new;
+  size_t value_size = strlen(value) + 1;
 
   pthread_mutex_lock(&cache_lock);
 
@@ -641,21 +801,41 @@ static int rrd_cache_insert(const char *filename, const char *value,
     return -1;
   }
 
+  rrd_cache_shrink();
+
   c_avl_get(cache, filename, (void *)&rc);
 
   if (rc == NULL) {
-    rc = malloc(sizeof(*rc));
+    size_t filename_size = strlen(filename) + 1;
+
+    if (!rrd_cache_reserve(sizeof(*rc) + filename_size)) {
+      pthread_mutex_unlock(&cache_lock);
+      return -1;
+    }
+
+    rc = calloc(1, sizeof(*rc));
     if (rc == NULL) {
       pthread_mutex_unlock(&cache_lock);
       return -1;
     }
-    rc->values_num = 0;
-    rc->values = NULL;
-    rc->first_value = 0;
-    rc->last_value = 0;
+    rc->filename = strdup(filename);
+    if (rc->filename == NULL) {
+      pthread_mutex_unlock(&cache_lock);
+      ERROR("rrdtool plugin: strdup failed.");
+      sfree(rc);
+      return -1;
+    }
     rc->random_variation = rrd_get_random_variation();
     rc->flags = FLAG_NONE;
-    new_rc = 1;
+
+    /* The entry owns its name; it's used as the key, too. */
+    c_avl_insert(cache, rc->filename, rc);
+    cache_size += sizeof(*rc) + filename_size;
+  }
+
+  if (statbuf != NULL) {
+    rc->dev = statbuf->st_dev;
+    rc->ino = statbuf->st_ino;
   }
 
   assert(value_time > 0); /* plugin_dispatch() ensures this. */
@@ -667,54 +847,41 @@ static int rrd_cache_insert(const char *filename, const char *value,
     return -1;
   }
 
-  values_new =
-      realloc((void *)rc->values, (rc->values_num + 1) * sizeof(char *));
-  if (values_new == NULL) {
-    char errbuf[1024];
-    void *cache_key = NULL;
-
-    sstrerror(errno, errbuf, sizeof(errbuf));
-
-    c_avl_remove(cache, filename, &cache_key, NULL);
-    pthread_mutex_unlock(&cache_lock);
-
-    ERROR("rrdtool plugin: realloc failed: %s", errbuf);
-
-    sfree(cache_key);
-    sfree(rc->values);
-    sfree(rc);
-    return -1;
-  }
-  rc->values = values_new;
-
-  rc->values[rc->values_num] = strdup(value);
-  if (rc->values[rc->values_num] != NULL)
-    rc->values_num++;
-
-  if (rc->values_num == 1)
-    rc->first_value = value_time;
-  rc->last_value = value_time;
-
-  /* Insert if this is the first value */
-  if (new_rc == 1) {
-    void *cache_key = strdup(filename);
+  if ((rc->values_fill + value_size) > rc->values_size) {
+    size_t size_new = (rc->values_size > 0) ? 2 * rc->values_size
+                                            : rc->values_size_hint;
+    char *tmp;
 
-    if (cache_key == NULL) {
-      char errbuf[1024];
-      sstrerror(errno, errbuf, sizeof(errbuf));
+    if (size_new < 128)
+      size_new = 128;
+    while (size_new < (rc->values_fill + value_size))
+      size_new *= 2;
 
+    if (!rrd_cache_reserve(size_new - rc->values_size)) {
       pthread_mutex_unlock(&cache_lock);
+      return -1;
+    }
 
-      ERROR("rrdtool plugin: strdup failed: %s", errbuf);
-
-      sfree(rc->values[0]);
-      sfree(rc->values);
-      sfree(rc);
+    tmp = realloc(rc->values, size_new);
+    if (tmp == NULL) {
+      pthread_mutex_unlock(&cache_lock);
+      ERROR("rrdtool plugin: realloc failed.");
       return -1;
     }
+    cache_size += size_new - rc->values_size;
+    rc->values = tmp;
+    rc->values_size = size_new;
+  }
 
-    c_avl_insert(cache, cache_key, rc);
+  memcpy(rc->values + rc->values_fill, value, value_size);
+  rc->values_fill += value_size;
+  rc->values_num++;
+
+  if (rc->values_num == 1) {
+    rc->first_value = value_time;
+    rrd_age_link(rc);
   }
+  rc->last_value = value_time;
 
   DEBUG("rrdtool plugin: rrd_cache_insert: file = %s; "
         "values_num = %i; age = %.3f;",
@@ -728,7 +895,7 @@ static int rrd_cache_insert(const char *filename, const char *value,
     if (rc->flags == FLAG_NONE) {
       int status;
 
-      status = rrd_queue_enqueue(filename, &queue_head, &queue_tail);
+      status = rrd_queue_enqueue(rc, /* flush = */ 0);
       if (status == 0)
         rc->flags = FLAG_QUEUED;
 
@@ -764,6 +931,7 @@ static int rrd_cache_destroy(void) /* {{{ */
   while (c_avl_pick(cache, &key, &value) == 0) {
     rrd_cache_t *rc;
 
+    /* "key" and "rc->filename" are the same string. */
     sfree(key);
     key = NULL;
 
@@ -773,14 +941,15 @@ static int rrd_cache_destroy(void) /* {{{ */
     if (rc->values_num > 0)
       non_empty++;
 
-    for (int i = 0; i < rc->values_num; i++)
-      sfree(rc->values[i]);
     sfree(rc->values);
     sfree(rc);
   }
 
   c_avl_destroy(cache);
   cache = NULL;
+  cache_size = 0;
+  age_head = NULL;
+  age_tail = NULL;
 
   if (non_empty > 0) {
     INFO("rrdtool plugin: %i cache %s had values when destroying the cache.",
@@ -794,6 +963,61 @@ static int rrd_cache_destroy(void) /* {{{ */
   return 0;
 } /* }}} int rrd_cache_destroy */
 
+static int rrd_stats_read(void) /* {{{ */
+{
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[1];
+  cdtime_t now = cdtime();
+  gauge_t queued = 0.0;
+
+  pthread_mutex_lock(&cache_lock);
+  gauge_t size = (gauge_t)cache_size;
+  gauge_t age = 0.0;
+  if ((age_head != NULL) && (now > age_head->first_value))
+    age = CDTIME_T_TO_DOUBLE(now - age_head->first_value);
+  derive_t written = (derive_t)stats_values_written;
+  derive_t dropped = (derive_t)stats_values_dropped;
+  pthread_mutex_unlock(&cache_lock);
+
+  pthread_mutex_lock(&queue_lock);
+  for (size_t i = 0; (queue_threads != NULL) && (i < queue_threads_num); i++)
+    queued += (gauge_t)queue_threads[i].queue_num;
+  pthread_mutex_unlock(&queue_lock);
+
+  vl.values = values;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "rrdtool", sizeof(vl.plugin));
+
+  /* Memory used by cached values */
+  sstrncpy(vl.type, "bytes", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "cache", sizeof(vl.type_instance));
+  vl.values[0].gauge = size;
+  plugin_dispatch_values(&vl);
+
+  /* Files waiting to be written */
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "files", sizeof(vl.type_instance));
+  vl.values[0].gauge = queued;
+  plugin_dispatch_values(&vl);
+
+  /* Age of the oldest value not yet written */
+  sstrncpy(vl.type, "duration", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "queue_age", sizeof(vl.type_instance));
+  vl.values[0].gauge = age;
+  plugin_dispatch_values(&vl);
+
+  sstrncpy(vl.type, "total_values", sizeof(vl.type));
+  sstrncpy(vl.type_instance, "written", sizeof(vl.type_instance));
+  vl.values[0].derive = written;
+  plugin_dispatch_values(&vl);
+
+  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+  vl.values[0].derive = dropped;
+  plugin_dispatch_values(&vl);
+
+  return 0;
+} /* }}} int rrd_stats_read */
+
 static int rrd_compare_numeric(const void *a_ptr, const void *b_ptr) {
   int a = *((int *)a_ptr);
   int b = *((int *)b_ptr);
@@ -809,6 +1033,7 @@ static int rrd_compare_numeric(const void *a_ptr, const void *b_ptr) {
 static int rrd_write(const data_set_t *ds, const value_list_t *vl,
                      user_data_t __attribute__((unused)) * user_data) {
   struct stat statbuf;
+  struct stat *statp = &statbuf;
   char filename[512];
   char values[512];
   int status;
@@ -834,6 +1059,7 @@ static int rrd_write(const data_set_t *ds, const value_list_t *vl,
         return -1;
       else if (rrdcreate_config.async)
         return 0;
+      statp = NULL;
     } else {
       char errbuf[1024];
       ERROR("stat(%s) failed: %s", filename,
@@ -845,7 +1071,7 @@ static int rrd_write(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
-  status = rrd_cache_insert(filename, values, vl->time);
+  status = rrd_cache_insert(filename, values, vl->time, statp);
 
   return status;
 } /* int rrd_write */
@@ -1005,6 +1231,28 @@ static int rrd_config(const char *key, const char *value) {
     } else {
       random_timeout = DOUBLE_TO_CDTIME_T(tmp);
     }
+  } else if (strcasecmp("QueueThreads", key) == 0) {
+    int tmp = atoi(value);
+    if (tmp < 1) {
+      fprintf(stderr, "rrdtool: `QueueThreads' must "
+                      "be greater than 0.\n");
+      ERROR("rrdtool: `QueueThreads' must "
+            "be greater than 0.");
+      return 1;
+    }
+    queue_threads_num = (size_t)tmp;
+  } else if (strcasecmp("CacheMaxSize", key) == 0) {
+    double tmp = atof(value);
+    if (tmp < 0.0) {
+      fprintf(stderr, "rrdtool: `CacheMaxSize' must "
+                      "be greater than or equal to zero.\n");
+      ERROR("rrdtool: `CacheMaxSize' must "
+            "be greater than or equal to zero.");
+      return 1;
+    }
+    cache_max_size = (size_t)tmp;
+  } else if (strcasecmp("ReportStats", key) == 0) {
+    report_stats = IS_TRUE(value);
   } else {
     return -1;
   }
@@ -1012,33 +1260,51 @@ static int rrd_config(const char *key, const char *value) {
 } /* int rrd_config */
 
 static int rrd_shutdown(void) {
+  size_t queued = 0;
+
   pthread_mutex_lock(&cache_lock);
   rrd_cache_flush(0);
   pthread_mutex_unlock(&cache_lock);
 
   pthread_mutex_lock(&queue_lock);
   do_shutdown = 1;
-  pthread_cond_signal(&queue_cond);
+  for (size_t i = 0; (queue_threads != NULL) && (i < queue_threads_num); i++) {
+    pthread_cond_signal(&queue_threads[i].cond);
+    queued += queue_threads[i].queue_num;
+  }
   pthread_mutex_unlock(&queue_lock);
 
-  if ((queue_thread_running != 0) &&
-      ((queue_head != NULL) || (flushq_head != NULL))) {
-    INFO("rrdtool plugin: Shutting down the queue thread. "
+  if (queue_threads == NULL) {
+    rrd_cache_destroy();
+    return 0;
+  }
+
+  if (queued > 0) {
+    INFO("rrdtool plugin: Shutting down the queue threads. "
          "This may take a while.");
-  } else if (queue_thread_running != 0) {
-    INFO("rrdtool plugin: Shutting down the queue thread.");
+  } else {
+    INFO("rrdtool plugin: Shutting down the queue threads.");
   }
 
   /* Wait for all the values to be written to disk before returning. */
-  if (queue_thread_running != 0) {
-    pthread_join(queue_thread, NULL);
-    memset(&queue_thread, 0, sizeof(queue_thread));
-    queue_thread_running = 0;
-    DEBUG("rrdtool plugin: queue_thread exited.");
+  for (size_t i = 0; i < queue_threads_num; i++) {
+    rrd_queue_thread_t *qt = queue_threads + i;
+
+    if (qt->running) {
+      pthread_join(qt->thread, NULL);
+      qt->running = 0;
+    }
+    pthread_cond_destroy(&qt->cond);
+    sfree(qt->argv);
   }
+  DEBUG("rrdtool plugin: queue threads exited.");
 
   rrd_cache_destroy();
 
+  pthread_mutex_lock(&queue_lock);
+  sfree(queue_threads);
+  pthread_mutex_unlock(&queue_lock);
+
   return 0;
 } /* int rrd_shutdown */
 
@@ -1071,14 +1337,37 @@ static int rrd_init(void) {
 
   pthread_mutex_unlock(&cache_lock);
 
-  status =
-      plugin_thread_create(&queue_thread, /* attr = */ NULL, rrd_queue_thread,
-                           /* args = */ NULL, "rrdtool queue");
-  if (status != 0) {
-    ERROR("rrdtool plugin: Cannot create queue-thread.");
+  queue_threads = calloc(queue_threads_num, sizeof(*queue_threads));
+  if (queue_threads == NULL) {
+    ERROR("rrdtool plugin: calloc failed.");
     return -1;
   }
-  queue_thread_running = 1;
+
+  for (size_t i = 0; i < queue_threads_num; i++) {
+    rrd_queue_thread_t *qt = queue_threads + i;
+
+    pthread_cond_init(&qt->cond, /* attr = */ NULL);
+    status = plugin_thread_create(&qt->thread, /* attr = */ NULL,
+                                  rrd_queue_thread, qt, "rrdtool queue");
+    if (status != 0) {
+      ERROR("rrdtool plugin: Cannot create queue-thread.");
+      pthread_cond_destroy(&qt->cond);
+      if (i == 0) {
+        sfree(queue_threads);
+        return -1;
+      }
+      /* Nothing has been queued yet, so the files can still be
+       * distributed across fewer threads. */
+      pthread_mutex_lock(&queue_lock);
+      queue_threads_num = i;
+      pthread_mutex_unlock(&queue_lock);
+      break;
+    }
+    qt->running = 1;
+  }
+
+  if (report_stats)
+    plugin_register_read("rrdtool", rrd_stats_read);
 
   DEBUG("rrdtool plugin: rrd_init: datadir = %s; stepsize = %lu;"
         " heartbeat = %i; rrarows = %i; xff = %lf;",
@@ -35,6 +35,10 @@
 
 #include <fnmatch.h>
 
+#ifndef CSNMP_DEFAULT_MAX_REPETITIONS
+#define CSNMP_DEFAULT_MAX_REPETITIONS 10
+#endif
+
 /*
  * Private data structes
  */
@@ -67,6 +71,66 @@ struct data_definition_s {
 };
 typedef struct data_definition_s data_definition_t;
 
+/* These two types are used to cache values in `csnmp_table_response' to handle
+ * gaps in tables. */
+struct csnmp_list_instances_s {
+  oid_t suffix;
+  char instance[DATA_MAX_NAME_LEN];
+  struct csnmp_list_instances_s *next;
+};
+typedef struct csnmp_list_instances_s csnmp_list_instances_t;
+
+struct csnmp_table_values_s {
+  oid_t suffix;
+  value_t value;
+  struct csnmp_table_values_s *next;
+};
+typedef struct csnmp_table_values_s csnmp_table_values_t;
+
+/* State of one table walk. The walk is driven by the responses to
+ * asynchronous GETNEXT or GETBULK requests. */
+struct csnmp_table_s {
+  const data_set_t *ds;
+
+  size_t oid_list_len;
+  /* Holds the last OID returned by the device. We use this in the GETNEXT /
+   * GETBULK request to proceed. */
+  oid_t *oid_list;
+  /* Set to false when an OID has left its subtree so we don't re-request it
+   * again. */
+  _Bool *oid_list_todo;
+  /* Index into "oid_list" of each variable in the current request. */
+  size_t *request_columns;
+  size_t request_columns_num;
+
+  /* `value_list_head' and `value_list_tail' implement a linked list for each
+   * value. `instance_list_head' and `instance_list_tail' implement a linked
+   * list of instance names. This is used to jump gaps in the table. */
+  csnmp_list_instances_t *instance_list_head;
+  csnmp_list_instances_t *instance_list_tail;
+  csnmp_table_values_t **value_list_head;
+  csnmp_table_values_t **value_list_tail;
+};
+typedef struct csnmp_table_s csnmp_table_t;
+
+struct host_definition_s;
+
+/* A poller thread. Polls of all hosts assigned to it are multiplexed over the
+ * hosts' asynchronous sessions. */
+struct csnmp_engine_s {
+  pthread_t thread;
+  _Bool thread_running;
+  pthread_mutex_t lock;
+  int wakeup_fd[2];
+  _Bool shutdown;
+
+  /* Hosts waiting to be polled. Protected by "lock". */
+  struct host_definition_s *queue;
+  /* Hosts with outstanding requests. Only used by the poller thread. */
+  struct host_definition_s *active;
+};
+typedef struct csnmp_engine_s csnmp_engine_t;
+
 struct host_definition_s {
   char *name;
   char *address;
@@ -86,39 +150,45 @@ struct host_definition_s {
   int security_level;
   char *context;
 
+  int max_repetitions;
+
   void *sess_handle;
   c_complain_t complaint;
   cdtime_t interval;
   data_definition_t **data_list;
   int data_list_len;
-};
-typedef struct host_definition_s host_definition_t;
 
-/* These two types are used to cache values in `csnmp_read_table' to handle
- * gaps in tables. */
-struct csnmp_list_instances_s {
-  oid_t suffix;
-  char instance[DATA_MAX_NAME_LEN];
-  struct csnmp_list_instances_s *next;
+  /* Poll state. "poll_active" is protected by the engine's lock; the other
+   * fields are only used by the poller thread while "poll_active" is set. */
+  size_t engine_index;
+  csnmp_engine_t *engine;
+  _Bool poll_active;
+  _Bool poll_done;
+  _Bool poll_close_session;
+  int poll_data_index;
+  int poll_success;
+  csnmp_table_t *poll_table;
+  c_complain_t poll_complaint;
+  struct host_definition_s *poll_next;
 };
-typedef struct csnmp_list_instances_s csnmp_list_instances_t;
-
-struct csnmp_table_values_s {
-  oid_t suffix;
-  value_t value;
-  struct csnmp_table_values_s *next;
-};
-typedef struct csnmp_table_values_s csnmp_table_values_t;
+typedef struct host_definition_s host_definition_t;
 
 /*
  * Private variables
  */
 static data_definition_t *data_head = NULL;
 
+static size_t engines_num = 1;
+static csnmp_engine_t *engines = NULL;
+static size_t hosts_num = 0;
+
 /*
  * Prototypes
  */
 static int csnmp_read_host(user_data_t *ud);
+static void csnmp_engines_stop(void);
+static void csnmp_table_free(data_definition_t const *data,
+                             csnmp_table_t *table);
 
 /*
  * Private functions
@@ -184,6 +254,15 @@ static void csnmp_host_definition_destroy(void *arg) /* {{{ */
     DEBUG("snmp plugin: Destroying host definition for host `%s'.", hd->name);
   }
 
+  /* Host definitions are freed after the read threads have been stopped.
+   * Stop the poller threads, too, before freeing anything they may use. */
+  csnmp_engines_stop();
+
+  if ((hd->poll_table != NULL) && (hd->poll_data_index < hd->data_list_len)) {
+    csnmp_table_free(hd->data_list[hd->poll_data_index], hd->poll_table);
+    hd->poll_table = NULL;
+  }
+
   csnmp_host_close_session(hd);
 
   sfree(hd->name);
@@ -216,6 +295,7 @@ static void csnmp_host_definition_destroy(void *arg) /* {{{ */
  *      +-> csnmp_config_add_host_auth_protocol
  *      +-> csnmp_config_add_host_priv_protocol
  *      +-> csnmp_config_add_host_security_level
+ *      +-> csnmp_config_add_host_max_repetitions
  */
 static void call_snmp_init_once(void) {
   static int have_init = 0;
@@ -576,6 +656,25 @@ static int csnmp_config_add_host_security_level(host_definition_t *hd,
   return 0;
 } /* int csnmp_config_add_host_security_level */
 
+static int csnmp_config_add_host_max_repetitions(host_definition_t *hd,
+                                                 oconfig_item_t *ci) {
+  int max_repetitions = 0;
+  int status;
+
+  status = cf_util_get_int(ci, &max_repetitions);
+  if (status != 0)
+    return status;
+
+  if (max_repetitions < 0) {
+    WARNING("snmp plugin: `MaxRepetitions' must not be negative.");
+    return -1;
+  }
+
+  hd->max_repetitions = max_repetitions;
+
+  return 0;
+} /* int csnmp_config_add_host_max_repetitions */
+
 static int csnmp_config_add_host(oconfig_item_t *ci) {
   host_definition_t *hd;
   int status = 0;
@@ -587,7 +686,9 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
   if (hd == NULL)
     return -1;
   hd->version = 2;
+  hd->max_repetitions = CSNMP_DEFAULT_MAX_REPETITIONS;
   C_COMPLAIN_INIT(&hd->complaint);
+  C_COMPLAIN_INIT(&hd->poll_complaint);
 
   status = cf_util_get_string(ci, &hd->name);
   if (status != 0) {
@@ -626,6 +727,8 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
       status = csnmp_config_add_host_security_level(hd, option);
     else if (strcasecmp("Context", option->key) == 0)
       status = cf_util_get_string(option, &hd->context);
+    else if (strcasecmp("MaxRepetitions", option->key) == 0)
+      status = csnmp_config_add_host_max_repetitions(hd, option);
     else {
       WARNING(
           "snmp plugin: csnmp_config_add_host: Option `%s' not allowed here.",
@@ -703,6 +806,14 @@ static int csnmp_config_add_host(oconfig_item_t *ci) {
         "= %i }",
         hd->name, hd->address, hd->community, hd->version);
 
+  /* GETBULK has been introduced with SNMPv2. */
+  if (hd->version == 1)
+    hd->max_repetitions = 0;
+
+  /* Hosts are distributed over the poller threads round robin. */
+  hd->engine_index = hosts_num;
+  hosts_num++;
+
   ssnprintf(cb_name, sizeof(cb_name), "snmp-%s", hd->name);
 
   status = plugin_register_complex_read(
@@ -728,7 +839,13 @@ static int csnmp_config(oconfig_item_t *ci) {
       csnmp_config_add_data(child);
     else if (strcasecmp("Host", child->key) == 0)
       csnmp_config_add_host(child);
-    else {
+    else if (strcasecmp("PollerThreads", child->key) == 0) {
+      int tmp = 0;
+      if ((cf_util_get_int(child, &tmp) != 0) || (tmp < 1))
+        WARNING("snmp plugin: `PollerThreads' must be a positive number.");
+      else
+        engines_num = (size_t)tmp;
+    } else {
       WARNING("snmp plugin: Ignoring unknown config option `%s'.", child->key);
     }
   } /* for (ci->children) */
@@ -1027,22 +1144,14 @@ static int csnmp_strvbcopy(char *dst, /* {{{ */
 
 static int csnmp_instance_list_add(csnmp_list_instances_t **head,
                                    csnmp_list_instances_t **tail,
-                                   const struct snmp_pdu *res,
+                                   struct variable_list *vb,
                                    const host_definition_t *hd,
                                    const data_definition_t *dd) {
   csnmp_list_instances_t *il;
-  struct variable_list *vb;
   oid_t vb_name;
   int status;
   uint32_t is_matched;
 
-  /* Set vb on the last variable */
-  for (vb = res->variables; (vb != NULL) && (vb->next_variable != NULL);
-       vb = vb->next_variable)
-    /* do nothing */;
-  if (vb == NULL)
-    return -1;
-
   csnmp_oid_init(&vb_name, vb->name, vb->name_length);
 
   il = calloc(1, sizeof(*il));
@@ -1253,284 +1362,271 @@ static int csnmp_dispatch_table(host_definition_t *host,
   return (0);
 } /* int csnmp_dispatch_table */
 
-static int csnmp_read_table(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
-  struct variable_list *vb;
+static void csnmp_table_free(data_definition_t const *data, /* {{{ */
+                             csnmp_table_t *table) {
+  if (table == NULL)
+    return;
 
-  const data_set_t *ds;
+  while (table->instance_list_head != NULL) {
+    csnmp_list_instances_t *next = table->instance_list_head->next;
+    sfree(table->instance_list_head);
+    table->instance_list_head = next;
+  }
 
-  size_t oid_list_len = data->values_len + 1;
-  /* Holds the last OID returned by the device. We use this in the GETNEXT
-   * request to proceed. */
-  oid_t oid_list[oid_list_len];
-  /* Set to false when an OID has left its subtree so we don't re-request it
-   * again. */
-  _Bool oid_list_todo[oid_list_len];
+  if (table->value_list_head != NULL) {
+    for (size_t i = 0; i < data->values_len; i++) {
+      while (table->value_list_head[i] != NULL) {
+        csnmp_table_values_t *next = table->value_list_head[i]->next;
+        sfree(table->value_list_head[i]);
+        table->value_list_head[i] = next;
+      }
+    }
+  }
 
-  int status;
-  size_t i;
+  sfree(table->value_list_head);
+  sfree(table->value_list_tail);
+  sfree(table->oid_list);
+  sfree(table->oid_list_todo);
+  sfree(table->request_columns);
+  sfree(table);
+} /* }}} void csnmp_table_free */
 
-  /* `value_list_head' and `value_list_tail' implement a linked list for each
-   * value. `instance_list_head' and `instance_list_tail' implement a linked
-   * list of
-   * instance names. This is used to jump gaps in the table. */
-  csnmp_list_instances_t *instance_list_head;
-  csnmp_list_instances_t *instance_list_tail;
-  csnmp_table_values_t **value_list_head;
-  csnmp_table_values_t **value_list_tail;
+static csnmp_table_t *csnmp_table_create(host_definition_t *host, /* {{{ */
+                                         data_definition_t *data) {
+  const data_set_t *ds;
+  csnmp_table_t *table;
 
-  DEBUG("snmp plugin: csnmp_read_table (host = %s, data = %s)", host->name,
+  DEBUG("snmp plugin: csnmp_table_create (host = %s, data = %s)", host->name,
         data->name);
 
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_table: host->sess_handle == NULL");
-    return -1;
-  }
-
   ds = plugin_get_ds(data->type);
   if (!ds) {
     ERROR("snmp plugin: DataSet `%s' not defined.", data->type);
-    return -1;
+    return NULL;
   }
 
   if (ds->ds_num != data->values_len) {
     ERROR("snmp plugin: DataSet `%s' requires %zu values, but config talks "
           "about %zu",
           data->type, ds->ds_num, data->values_len);
-    return -1;
+    return NULL;
   }
   assert(data->values_len > 0);
 
-  /* We need a copy of all the OIDs, because GETNEXT will destroy them. */
-  memcpy(oid_list, data->values, data->values_len * sizeof(oid_t));
-  if (data->instance.oid.oid_len > 0)
-    memcpy(oid_list + data->values_len, &data->instance.oid, sizeof(oid_t));
-  else /* no InstanceFrom option specified. */
-    oid_list_len--;
-
-  for (i = 0; i < oid_list_len; i++)
-    oid_list_todo[i] = 1;
-
+  table = calloc(1, sizeof(*table));
+  if (table == NULL) {
+    ERROR("snmp plugin: csnmp_table_create: calloc failed.");
+    return NULL;
+  }
+  table->ds = ds;
+
+  table->oid_list_len = data->values_len + 1;
+  table->oid_list = calloc(table->oid_list_len, sizeof(*table->oid_list));
+  table->oid_list_todo =
+      calloc(table->oid_list_len, sizeof(*table->oid_list_todo));
+  table->request_columns =
+      calloc(table->oid_list_len, sizeof(*table->request_columns));
   /* We're going to construct n linked lists, one for each "value".
    * value_list_head will contain pointers to the heads of these linked lists,
    * value_list_tail will contain pointers to the tail of the lists. */
-  value_list_head = calloc(data->values_len, sizeof(*value_list_head));
-  value_list_tail = calloc(data->values_len, sizeof(*value_list_tail));
-  if ((value_list_head == NULL) || (value_list_tail == NULL)) {
-    ERROR("snmp plugin: csnmp_read_table: calloc failed.");
-    sfree(value_list_head);
-    sfree(value_list_tail);
-    return -1;
+  table->value_list_head =
+      calloc(data->values_len, sizeof(*table->value_list_head));
+  table->value_list_tail =
+      calloc(data->values_len, sizeof(*table->value_list_tail));
+  if ((table->oid_list == NULL) || (table->oid_list_todo == NULL) ||
+      (table->request_columns == NULL) || (table->value_list_head == NULL) ||
+      (table->value_list_tail == NULL)) {
+    ERROR("snmp plugin: csnmp_table_create: calloc failed.");
+    csnmp_table_free(data, table);
+    return NULL;
   }
 
-  instance_list_head = NULL;
-  instance_list_tail = NULL;
-
-  status = 0;
-  while (status == 0) {
-    int oid_list_todo_num;
-
-    req = snmp_pdu_create(SNMP_MSG_GETNEXT);
-    if (req == NULL) {
-      ERROR("snmp plugin: snmp_pdu_create failed.");
-      status = -1;
-      break;
-    }
-
-    oid_list_todo_num = 0;
-    for (i = 0; i < oid_list_len; i++) {
-      /* Do not rerequest already finished OIDs */
-      if (!oid_list_todo[i])
-        continue;
-      oid_list_todo_num++;
-      snmp_add_null_var(req, oid_list[i].oid, oid_list[i].oid_len);
-    }
-
-    if (oid_list_todo_num == 0) {
-      /* The request is still empty - so we are finished */
-      DEBUG("snmp plugin: all variables have left their subtree");
-      status = 0;
-      break;
-    }
+  /* We need a copy of all the OIDs, because the walk will modify them. */
+  memcpy(table->oid_list, data->values, data->values_len * sizeof(oid_t));
+  if (data->instance.oid.oid_len > 0)
+    memcpy(table->oid_list + data->values_len, &data->instance.oid,
+           sizeof(oid_t));
+  else /* no InstanceFrom option specified. */
+    table->oid_list_len--;
 
-    res = NULL;
-    status = snmp_sess_synch_response(host->sess_handle, req, &res);
-    if ((status != STAT_SUCCESS) || (res == NULL)) {
-      char *errstr = NULL;
+  for (size_t i = 0; i < table->oid_list_len; i++)
+    table->oid_list_todo[i] = 1;
 
-      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+  return table;
+} /* }}} csnmp_table_t *csnmp_table_create */
 
-      c_complain(LOG_ERR, &host->complaint,
-                 "snmp plugin: host %s: snmp_sess_synch_response failed: %s",
-                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+/* Creates the next request of a table walk. Returns NULL when all columns have
+ * left their subtree, i.e. when the walk is complete. */
+static struct snmp_pdu *csnmp_table_request(host_definition_t *host, /* {{{ */
+                                            csnmp_table_t *table) {
+  struct snmp_pdu *req;
 
-      if (res != NULL)
-        snmp_free_pdu(res);
-      res = NULL;
+  table->request_columns_num = 0;
+  for (size_t i = 0; i < table->oid_list_len; i++) {
+    /* Do not rerequest already finished OIDs */
+    if (!table->oid_list_todo[i])
+      continue;
+    table->request_columns[table->request_columns_num] = i;
+    table->request_columns_num++;
+  }
 
-      /* snmp_synch_response already freed our PDU */
-      req = NULL;
-      sfree(errstr);
-      csnmp_host_close_session(host);
+  if (table->request_columns_num == 0) {
+    /* The request is still empty - so we are finished */
+    DEBUG("snmp plugin: all variables have left their subtree");
+    return NULL;
+  }
 
-      status = -1;
-      break;
+  if (host->max_repetitions > 0) {
+    req = snmp_pdu_create(SNMP_MSG_GETBULK);
+    if (req != NULL) {
+      req->non_repeaters = 0;
+      req->max_repetitions = host->max_repetitions;
     }
+  } else {
+    req = snmp_pdu_create(SNMP_MSG_GETNEXT);
+  }
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
+    return NULL;
+  }
 
-    status = 0;
-    assert(res != NULL);
-    c_release(LOG_INFO, &host->complaint,
-              "snmp plugin: host %s: snmp_sess_synch_response successful.",
-              host->name);
+  for (size_t i = 0; i < table->request_columns_num; i++) {
+    oid_t *o = table->oid_list + table->request_columns[i];
+    snmp_add_null_var(req, o->oid, o->oid_len);
+  }
 
-    vb = res->variables;
-    if (vb == NULL) {
-      status = -1;
-      break;
-    }
+  return req;
+} /* }}} struct snmp_pdu *csnmp_table_request */
 
-    for (vb = res->variables, i = 0; (vb != NULL);
-         vb = vb->next_variable, i++) {
-      /* Calculate value index from todo list */
-      while ((i < oid_list_len) && !oid_list_todo[i])
-        i++;
-
-      /* An instance is configured and the res variable we process is the
-       * instance value (last index) */
-      if ((data->instance.oid.oid_len > 0) && (i == data->values_len)) {
-        if ((vb->type == SNMP_ENDOFMIBVIEW) ||
-            (snmp_oid_ncompare(
-                 data->instance.oid.oid, data->instance.oid.oid_len, vb->name,
-                 vb->name_length, data->instance.oid.oid_len) != 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; Instance left its subtree.",
-                host->name, data->name);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+/* Adds the variables of a GETNEXT or GETBULK response to the table. The
+ * response of a GETBULK request contains up to "max-repetitions" rows of the
+ * requested columns, i.e. the n-th variable belongs to the column requested at
+ * position (n % columns). */
+static int csnmp_table_response(host_definition_t *host, /* {{{ */
+                                data_definition_t *data, csnmp_table_t *table,
+                                struct snmp_pdu *res) {
+  struct variable_list *vb;
+  size_t n;
 
-        /* Allocate a new `csnmp_list_instances_t', insert the instance name and
-         * add it to the list */
-        if (csnmp_instance_list_add(&instance_list_head, &instance_list_tail,
-                                    res, host, data) != 0) {
-          ERROR("snmp plugin: host %s: csnmp_instance_list_add failed.",
-                host->name);
-          status = -1;
-          break;
-        }
-      } else /* The variable we are processing is a normal value */
-      {
-        csnmp_table_values_t *vt;
-        oid_t vb_name;
-        oid_t suffix;
-        int ret;
-
-        csnmp_oid_init(&vb_name, vb->name, vb->name_length);
-
-        /* Calculate the current suffix. This is later used to check that the
-         * suffix is increasing. This also checks if we left the subtree */
-        ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
-        if (ret != 0) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %zu; "
-                "Value probably left its subtree.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  if (res->variables == NULL)
+    return -1;
 
-        /* Make sure the OIDs returned by the agent are increasing. Otherwise
-         * our
-         * table matching algorithm will get confused. */
-        if ((value_list_tail[i] != NULL) &&
-            (csnmp_oid_compare(&suffix, &value_list_tail[i]->suffix) <= 0)) {
-          DEBUG("snmp plugin: host = %s; data = %s; i = %zu; "
-                "Suffix is not increasing.",
-                host->name, data->name, i);
-          oid_list_todo[i] = 0;
-          continue;
-        }
+  for (vb = res->variables, n = 0; vb != NULL; vb = vb->next_variable, n++) {
+    size_t i = table->request_columns[n % table->request_columns_num];
 
-        vt = calloc(1, sizeof(*vt));
-        if (vt == NULL) {
-          ERROR("snmp plugin: calloc failed.");
-          status = -1;
-          break;
-        }
+    /* This column has left its subtree earlier in this response. */
+    if (!table->oid_list_todo[i])
+      continue;
 
-        vt->value =
-            csnmp_value_list_to_value(vb, ds->ds[i].type, data->scale,
-                                      data->shift, host->name, data->name);
-        memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
-        vt->next = NULL;
-
-        if (value_list_tail[i] == NULL)
-          value_list_head[i] = vt;
-        else
-          value_list_tail[i]->next = vt;
-        value_list_tail[i] = vt;
+    /* An instance is configured and the res variable we process is the
+     * instance value (last index) */
+    if ((data->instance.oid.oid_len > 0) && (i == data->values_len)) {
+      if ((vb->type == SNMP_ENDOFMIBVIEW) ||
+          (snmp_oid_ncompare(data->instance.oid.oid, data->instance.oid.oid_len,
+                             vb->name, vb->name_length,
+                             data->instance.oid.oid_len) != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; Instance left its subtree.",
+              host->name, data->name);
+        table->oid_list_todo[i] = 0;
+        continue;
       }
 
-      /* Copy OID to oid_list[i] */
-      memcpy(oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
-      oid_list[i].oid_len = vb->name_length;
+      /* Allocate a new `csnmp_list_instances_t', insert the instance name and
+       * add it to the list */
+      if (csnmp_instance_list_add(&table->instance_list_head,
+                                  &table->instance_list_tail, vb, host,
+                                  data) != 0) {
+        ERROR("snmp plugin: host %s: csnmp_instance_list_add failed.",
+              host->name);
+        return -1;
+      }
+    } else /* The variable we are processing is a normal value */
+    {
+      csnmp_table_values_t *vt;
+      oid_t vb_name;
+      oid_t suffix;
+      int ret;
+
+      csnmp_oid_init(&vb_name, vb->name, vb->name_length);
+
+      /* Calculate the current suffix. This is later used to check that the
+       * suffix is increasing. This also checks if we left the subtree */
+      ret = csnmp_oid_suffix(&suffix, &vb_name, data->values + i);
+      if ((vb->type == SNMP_ENDOFMIBVIEW) || (ret != 0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %zu; "
+              "Value probably left its subtree.",
+              host->name, data->name, i);
+        table->oid_list_todo[i] = 0;
+        continue;
+      }
 
-    } /* for (vb = res->variables ...) */
+      /* Make sure the OIDs returned by the agent are increasing. Otherwise our
+       * table matching algorithm will get confused. */
+      if ((table->value_list_tail[i] != NULL) &&
+          (csnmp_oid_compare(&suffix, &table->value_list_tail[i]->suffix) <=
+           0)) {
+        DEBUG("snmp plugin: host = %s; data = %s; i = %zu; "
+              "Suffix is not increasing.",
+              host->name, data->name, i);
+        table->oid_list_todo[i] = 0;
+        continue;
+      }
 
-    if (res != NULL)
-      snmp_free_pdu(res);
-    res = NULL;
-  } /* while (status == 0) */
+      vt = calloc(1, sizeof(*vt));
+      if (vt == NULL) {
+        ERROR("snmp plugin: calloc failed.");
+        return -1;
+      }
 
-  if (res != NULL)
-    snmp_free_pdu(res);
-  res = NULL;
+      vt->value =
+          csnmp_value_list_to_value(vb, table->ds->ds[i].type, data->scale,
+                                    data->shift, host->name, data->name);
+      memcpy(&vt->suffix, &suffix, sizeof(vt->suffix));
+      vt->next = NULL;
 
-  if (req != NULL)
-    snmp_free_pdu(req);
-  req = NULL;
+      if (table->value_list_tail[i] == NULL)
+        table->value_list_head[i] = vt;
+      else
+        table->value_list_tail[i]->next = vt;
+      table->value_list_tail[i] = vt;
+    }
 
-  if (status == 0)
-    csnmp_dispatch_table(host, data, instance_list_head, value_list_head);
+    /* Copy OID to oid_list[i] */
+    memcpy(table->oid_list[i].oid, vb->name, sizeof(oid) * vb->name_length);
+    table->oid_list[i].oid_len = vb->name_length;
+  } /* for (vb = res->variables ...) */
 
-  /* Free all allocated variables here */
-  while (instance_list_head != NULL) {
-    csnmp_list_instances_t *next = instance_list_head->next;
-    sfree(instance_list_head);
-    instance_list_head = next;
-  }
+  return 0;
+} /* }}} int csnmp_table_response */
 
-  for (i = 0; i < data->values_len; i++) {
-    while (value_list_head[i] != NULL) {
-      csnmp_table_values_t *next = value_list_head[i]->next;
-      sfree(value_list_head[i]);
-      value_list_head[i] = next;
-    }
+static struct snmp_pdu *csnmp_value_request(data_definition_t *data) /* {{{ */
+{
+  struct snmp_pdu *req;
+
+  req = snmp_pdu_create(SNMP_MSG_GET);
+  if (req == NULL) {
+    ERROR("snmp plugin: snmp_pdu_create failed.");
+    return NULL;
   }
 
-  sfree(value_list_head);
-  sfree(value_list_tail);
+  for (size_t i = 0; i < data->values_len; i++)
+    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
 
-  return 0;
-} /* int csnmp_read_table */
+  return req;
+} /* }}} struct snmp_pdu *csnmp_value_request */
 
-static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
-  struct snmp_pdu *req;
-  struct snmp_pdu *res = NULL;
+static int csnmp_value_response(host_definition_t *host, /* {{{ */
+                                data_definition_t *data,
+                                struct snmp_pdu *res) {
   struct variable_list *vb;
 
   const data_set_t *ds;
   value_list_t vl = VALUE_LIST_INIT;
 
-  int status;
   size_t i;
 
-  DEBUG("snmp plugin: csnmp_read_value (host = %s, data = %s)", host->name,
-        data->name);
-
-  if (host->sess_handle == NULL) {
-    DEBUG("snmp plugin: csnmp_read_value: host->sess_handle == NULL");
-    return -1;
-  }
+  DEBUG("snmp plugin: csnmp_value_response (host = %s, data = %s)",
+        host->name, data->name);
 
   ds = plugin_get_ds(data->type);
   if (!ds) {
@@ -1563,35 +1659,6 @@ static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
 
   vl.interval = host->interval;
 
-  req = snmp_pdu_create(SNMP_MSG_GET);
-  if (req == NULL) {
-    ERROR("snmp plugin: snmp_pdu_create failed.");
-    sfree(vl.values);
-    return -1;
-  }
-
-  for (i = 0; i < data->values_len; i++)
-    snmp_add_null_var(req, data->values[i].oid, data->values[i].oid_len);
-
-  status = snmp_sess_synch_response(host->sess_handle, req, &res);
-
-  if ((status != STAT_SUCCESS) || (res == NULL)) {
-    char *errstr = NULL;
-
-    snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
-    ERROR("snmp plugin: host %s: snmp_sess_synch_response failed: %s",
-          host->name, (errstr == NULL) ? "Unknown problem" : errstr);
-
-    if (res != NULL)
-      snmp_free_pdu(res);
-
-    sfree(errstr);
-    sfree(vl.values);
-    csnmp_host_close_session(host);
-
-    return -1;
-  }
-
   for (vb = res->variables; vb != NULL; vb = vb->next_variable) {
 #if COLLECT_DEBUG
     char buffer[1024];
@@ -1607,55 +1674,394 @@ static int csnmp_read_value(host_definition_t *host, data_definition_t *data) {
                                       data->shift, host->name, data->name);
   } /* for (res->variables) */
 
-  snmp_free_pdu(res);
-
   DEBUG("snmp plugin: -> plugin_dispatch_values (&vl);");
   plugin_dispatch_values(&vl);
   sfree(vl.values);
 
   return 0;
-} /* int csnmp_read_value */
+} /* }}} int csnmp_value_response */
+
+/*
+ * Poller threads
+ *
+ * The read callback of a host only hands the host to its poller thread. The
+ * poller thread sends the requests with snmp_sess_async_send() and waits for
+ * the responses of all its hosts with select(2). Each response is handled in
+ * csnmp_poll_callback(), which sends the next request of the host. Data
+ * definitions of one host are polled one after another, so there is at most
+ * one outstanding request per host.
+ */
+static int csnmp_poll_callback(int operation, netsnmp_session *sess, int reqid,
+                               netsnmp_pdu *pdu, void *magic);
+
+/* Sends the next request of a poll or marks the poll as done. Returns only
+ * after a request has been sent successfully or the poll is done. */
+static void csnmp_poll_next(host_definition_t *host) /* {{{ */
+{
+  while (host->poll_data_index < host->data_list_len) {
+    data_definition_t *data = host->data_list[host->poll_data_index];
+    struct snmp_pdu *req = NULL;
+
+    if (!data->is_table) {
+      req = csnmp_value_request(data);
+    } else {
+      if (host->poll_table == NULL)
+        host->poll_table = csnmp_table_create(host, data);
+      if (host->poll_table != NULL) {
+        req = csnmp_table_request(host, host->poll_table);
+
+        /* The walk is complete. */
+        if (req == NULL) {
+          csnmp_dispatch_table(host, data, host->poll_table->instance_list_head,
+                               host->poll_table->value_list_head);
+          csnmp_table_free(data, host->poll_table);
+          host->poll_table = NULL;
+          host->poll_success++;
+          host->poll_data_index++;
+          continue;
+        }
+      }
+    }
+
+    if (req == NULL) {
+      csnmp_table_free(data, host->poll_table);
+      host->poll_table = NULL;
+      host->poll_data_index++;
+      continue;
+    }
+
+    if (snmp_sess_async_send(host->sess_handle, req, csnmp_poll_callback,
+                             host) == 0) {
+      char *errstr = NULL;
+
+      snmp_sess_error(host->sess_handle, NULL, NULL, &errstr);
+      c_complain(LOG_ERR, &host->complaint,
+                 "snmp plugin: host %s: snmp_sess_async_send failed: %s",
+                 host->name, (errstr == NULL) ? "Unknown problem" : errstr);
+      sfree(errstr);
+
+      snmp_free_pdu(req);
+      csnmp_table_free(data, host->poll_table);
+      host->poll_table = NULL;
+      host->poll_close_session = 1;
+      break;
+    }
+
+    return;
+  }
+
+  host->poll_done = 1;
+} /* }}} void csnmp_poll_next */
+
+static int csnmp_poll_callback(int operation, /* {{{ */
+                               netsnmp_session *sess __attribute__((unused)),
+                               int reqid __attribute__((unused)),
+                               netsnmp_pdu *pdu, void *magic) {
+  host_definition_t *host = magic;
+  data_definition_t *data;
+
+  /* E.g. outstanding requests of a session being closed. */
+  if (host->poll_done || (host->poll_data_index >= host->data_list_len))
+    return 1;
+  data = host->data_list[host->poll_data_index];
+
+  if ((operation != NETSNMP_CALLBACK_OP_RECEIVED_MESSAGE) || (pdu == NULL)) {
+    c_complain(LOG_ERR, &host->complaint,
+               "snmp plugin: host %s: Request failed: %s", host->name,
+               (operation == NETSNMP_CALLBACK_OP_TIMED_OUT) ? "Timeout"
+                                                            : "Unknown problem");
+
+    /* The session must not be closed from within its own callback. */
+    csnmp_table_free(data, host->poll_table);
+    host->poll_table = NULL;
+    host->poll_close_session = 1;
+    host->poll_done = 1;
+    return 1;
+  }
+
+  c_release(LOG_INFO, &host->complaint,
+            "snmp plugin: host %s: Request successful.", host->name);
+
+  if (data->is_table) {
+    if (csnmp_table_response(host, data, host->poll_table, pdu) != 0) {
+      csnmp_table_free(data, host->poll_table);
+      host->poll_table = NULL;
+      host->poll_data_index++;
+    }
+  } else {
+    if (csnmp_value_response(host, data, pdu) == 0)
+      host->poll_success++;
+    host->poll_data_index++;
+  }
+
+  csnmp_poll_next(host);
+  return 1;
+} /* }}} int csnmp_poll_callback */
+
+/* Called by the poller thread when a poll is complete. */
+static void csnmp_poll_finish(csnmp_engine_t *engine, /* {{{ */
+                              host_definition_t *host) {
+  DEBUG("snmp plugin: host %s: Poll done, %i of %i data definitions read.",
+        host->name, host->poll_success, host->data_list_len);
+
+  if (host->poll_close_session)
+    csnmp_host_close_session(host);
+
+  pthread_mutex_lock(&engine->lock);
+  host->poll_active = 0;
+  pthread_mutex_unlock(&engine->lock);
+} /* }}} void csnmp_poll_finish */
+
+static void *csnmp_engine_thread(void *arg) /* {{{ */
+{
+  csnmp_engine_t *engine = arg;
+  netsnmp_large_fd_set fdset;
+
+  netsnmp_large_fd_set_init(&fdset, FD_SETSIZE);
+
+  while (42) {
+    host_definition_t *queue;
+    host_definition_t **host_ptr;
+    struct timeval timeout = {.tv_sec = 1};
+    int fds_num;
+    int status;
+
+    pthread_mutex_lock(&engine->lock);
+    if (engine->shutdown) {
+      pthread_mutex_unlock(&engine->lock);
+      break;
+    }
+    queue = engine->queue;
+    engine->queue = NULL;
+    pthread_mutex_unlock(&engine->lock);
+
+    /* Start new polls. */
+    while (queue != NULL) {
+      host_definition_t *host = queue;
+      queue = host->poll_next;
+
+      host->poll_done = 0;
+      host->poll_close_session = 0;
+      host->poll_data_index = 0;
+      host->poll_success = 0;
+      csnmp_poll_next(host);
+
+      host->poll_next = engine->active;
+      engine->active = host;
+    }
+
+    /* Collect the sockets and the earliest timeout of all sessions.
+     * snmp_sess_select_info2() resets "block" if a session has no outstanding
+     * requests, so merge the timeouts ourselves. */
+    NETSNMP_LARGE_FD_ZERO(&fdset);
+    NETSNMP_LARGE_FD_SET(engine->wakeup_fd[0], &fdset);
+    fds_num = engine->wakeup_fd[0] + 1;
+
+    for (host_definition_t *host = engine->active; host != NULL;
+         host = host->poll_next) {
+      struct timeval host_timeout = {0};
+      int block = 1;
+
+      if (host->poll_done)
+        continue;
+
+      snmp_sess_select_info2(host->sess_handle, &fds_num, &fdset,
+                             &host_timeout, &block);
+      if (!block && timercmp(&host_timeout, &timeout, <))
+        timeout = host_timeout;
+    }
+
+    status = netsnmp_large_fd_set_select(fds_num, &fdset, NULL, NULL,
+                                         (engine->active != NULL) ? &timeout
+                                                                  : NULL);
+    if ((status < 0) && (errno != EINTR)) {
+      char errbuf[1024];
+      ERROR("snmp plugin: select failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      /* Don't spin if select fails for some reason. */
+      nanosleep(&(struct timespec){.tv_nsec = 100000000}, NULL);
+      continue;
+    }
+
+    if ((status > 0) &&
+        NETSNMP_LARGE_FD_ISSET(engine->wakeup_fd[0], &fdset)) {
+      char buffer[64];
+      while (read(engine->wakeup_fd[0], buffer, sizeof(buffer)) > 0)
+        /* drain */;
+    }
+
+    /* Handle responses and timeouts. The callbacks send the next requests. */
+    for (host_definition_t *host = engine->active; host != NULL;
+         host = host->poll_next) {
+      if (host->poll_done)
+        continue;
+      if (status > 0)
+        snmp_sess_read2(host->sess_handle, &fdset);
+      if (!host->poll_done)
+        snmp_sess_timeout(host->sess_handle);
+    }
+
+    /* Remove completed polls. */
+    host_ptr = &engine->active;
+    while (*host_ptr != NULL) {
+      host_definition_t *host = *host_ptr;
+
+      if (!host->poll_done) {
+        host_ptr = &host->poll_next;
+        continue;
+      }
+
+      *host_ptr = host->poll_next;
+      host->poll_next = NULL;
+      csnmp_poll_finish(engine, host);
+    }
+  } /* while (42) */
+
+  netsnmp_large_fd_set_cleanup(&fdset);
+  return NULL;
+} /* }}} void *csnmp_engine_thread */
+
+static int csnmp_engines_start(void) /* {{{ */
+{
+  if (engines != NULL)
+    return 0;
+
+  engines = calloc(engines_num, sizeof(*engines));
+  if (engines == NULL) {
+    ERROR("snmp plugin: calloc failed.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < engines_num; i++) {
+    csnmp_engine_t *engine = engines + i;
+    int status;
+
+    pthread_mutex_init(&engine->lock, /* attr = */ NULL);
+    engine->wakeup_fd[0] = -1;
+    engine->wakeup_fd[1] = -1;
+
+    if (pipe(engine->wakeup_fd) != 0) {
+      char errbuf[1024];
+      ERROR("snmp plugin: pipe failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    fcntl(engine->wakeup_fd[0], F_SETFL,
+          fcntl(engine->wakeup_fd[0], F_GETFL) | O_NONBLOCK);
+    fcntl(engine->wakeup_fd[1], F_SETFL,
+          fcntl(engine->wakeup_fd[1], F_GETFL) | O_NONBLOCK);
+
+    status = plugin_thread_create(&engine->thread, /* attr = */ NULL,
+                                  csnmp_engine_thread, engine, "snmp");
+    if (status != 0) {
+      ERROR("snmp plugin: Starting poller thread failed.");
+      return -1;
+    }
+    engine->thread_running = 1;
+  }
+
+  return 0;
+} /* }}} int csnmp_engines_start */
+
+static void csnmp_engines_stop(void) /* {{{ */
+{
+  if (engines == NULL)
+    return;
+
+  for (size_t i = 0; i < engines_num; i++) {
+    csnmp_engine_t *engine = engines + i;
+
+    if (!engine->thread_running)
+      continue;
+
+    pthread_mutex_lock(&engine->lock);
+    engine->shutdown = 1;
+    pthread_mutex_unlock(&engine->lock);
+    if (write(engine->wakeup_fd[1], "", 1) < 0) {
+      /* The thread wakes up within one second anyway. */
+    }
+
+    pthread_join(engine->thread, /* retval = */ NULL);
+    engine->thread_running = 0;
+  }
+} /* }}} void csnmp_engines_stop */
+
+static void csnmp_engines_free(void) /* {{{ */
+{
+  if (engines == NULL)
+    return;
+
+  csnmp_engines_stop();
+
+  for (size_t i = 0; i < engines_num; i++) {
+    csnmp_engine_t *engine = engines + i;
+
+    if (engine->wakeup_fd[0] >= 0)
+      close(engine->wakeup_fd[0]);
+    if (engine->wakeup_fd[1] >= 0)
+      close(engine->wakeup_fd[1]);
+    pthread_mutex_destroy(&engine->lock);
+  }
 
+  sfree(engines);
+} /* }}} void csnmp_engines_free */
+
+/* Hands the host to its poller thread. The values are dispatched by the poller
+ * thread once all data definitions have been read. */
 static int csnmp_read_host(user_data_t *ud) {
   host_definition_t *host;
-  int status;
-  int success;
-  int i;
+  csnmp_engine_t *engine;
 
   host = ud->data;
 
   if (host->interval == 0)
     host->interval = plugin_get_interval();
 
+  if (engines == NULL)
+    return -1;
+
+  if (host->engine == NULL)
+    host->engine = engines + (host->engine_index % engines_num);
+  engine = host->engine;
+
+  pthread_mutex_lock(&engine->lock);
+  _Bool busy = host->poll_active;
+  pthread_mutex_unlock(&engine->lock);
+
+  if (busy) {
+    c_complain(LOG_WARNING, &host->poll_complaint,
+               "snmp plugin: host %s: The previous poll has not finished "
+               "yet. Skipping this interval.",
+               host->name);
+    return 0;
+  }
+  c_release(LOG_INFO, &host->poll_complaint,
+            "snmp plugin: host %s: Polls finish in time again.", host->name);
+
+  /* While no poll is active, the session is only used by this thread. */
   if (host->sess_handle == NULL)
     csnmp_host_open_session(host);
 
   if (host->sess_handle == NULL)
     return -1;
 
-  success = 0;
-  for (i = 0; i < host->data_list_len; i++) {
-    data_definition_t *data = host->data_list[i];
-
-    if (data->is_table)
-      status = csnmp_read_table(host, data);
-    else
-      status = csnmp_read_value(host, data);
+  pthread_mutex_lock(&engine->lock);
+  host->poll_active = 1;
+  host->poll_next = engine->queue;
+  engine->queue = host;
+  pthread_mutex_unlock(&engine->lock);
 
-    if (status == 0)
-      success++;
+  if (write(engine->wakeup_fd[1], "", 1) < 0) {
+    /* The pipe is full, i.e. the poller thread will wake up anyway. */
   }
 
-  if (success == 0)
-    return -1;
-
   return 0;
 } /* int csnmp_read_host */
 
 static int csnmp_init(void) {
   call_snmp_init_once();
 
-  return 0;
+  return csnmp_engines_start();
 } /* int csnmp_init */
 
 static int csnmp_shutdown(void) {
@@ -1664,6 +2070,8 @@ static int csnmp_shutdown(void) {
 
   /* When we get here, the read threads have been stopped and all the
    * `host_definition_t' will be freed. */
+  csnmp_engines_free();
+
   DEBUG("snmp plugin: Destroying all data definitions.");
 
   data_this = data_head;
@@ -0,0 +1,521 @@
+/**
+ * collectd - src/snmp_bench.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+/* Benchmark for the snmp plugin's poller threads: a stand-in agent serves a
+ * table with one Counter32 column (ifInOctets) on a local UDP port and
+ * answers each request after a configurable delay, simulating the round trip
+ * to a remote device. Many hosts walk this table as often as possible and the
+ * number of completed polls per second is reported for GETNEXT and GETBULK
+ * with one and with several poller threads.
+ *
+ * Usage: bench_snmp [<hosts> [<rows> [<delay ms> [<seconds>]]]] */
+
+#include "snmp.c"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+
+#define AGENT_PACKET_SIZE 1472
+#define AGENT_QUEUE_SIZE 8192
+
+static oid const agent_column[] = {1, 3, 6, 1, 2, 1, 2, 2, 1, 10};
+static size_t agent_rows = 100;
+static cdtime_t agent_delay = 0;
+static uint64_t agent_requests = 0;
+static _Bool agent_shutdown = 0;
+
+struct agent_response_s {
+  cdtime_t due;
+  struct sockaddr_in addr;
+  uint8_t data[AGENT_PACKET_SIZE];
+  size_t size;
+};
+typedef struct agent_response_s agent_response_t;
+
+static agent_response_t *agent_queue;
+static size_t agent_queue_head;
+static size_t agent_queue_fill;
+
+static cdtime_t now_real(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return TIMESPEC_TO_CDTIME_T(&ts);
+}
+
+/*
+ * Minimal BER encoding and decoding of SNMPv2c messages.
+ */
+static int ber_read_header(uint8_t const *buf, size_t size, size_t *pos,
+                           uint8_t *tag, size_t *len) {
+  if (*pos + 2 > size)
+    return -1;
+
+  *tag = buf[(*pos)++];
+  size_t l = buf[(*pos)++];
+  if (l & 0x80) {
+    size_t n = l & 0x7f;
+    if ((n == 0) || (n > sizeof(size_t)) || (*pos + n > size))
+      return -1;
+    l = 0;
+    for (size_t i = 0; i < n; i++)
+      l = (l << 8) | buf[(*pos)++];
+  }
+
+  if (*pos + l > size)
+    return -1;
+  *len = l;
+  return 0;
+}
+
+static int ber_read_int(uint8_t const *buf, size_t size, size_t *pos,
+                        long *ret) {
+  uint8_t tag;
+  size_t len;
+
+  if ((ber_read_header(buf, size, pos, &tag, &len) != 0) || (tag != 0x02) ||
+      (len == 0) || (len > sizeof(long)))
+    return -1;
+
+  long v = (buf[*pos] & 0x80) ? -1 : 0;
+  for (size_t i = 0; i < len; i++)
+    v = (long)(((unsigned long)v << 8) | buf[*pos + i]);
+  *pos += len;
+  *ret = v;
+  return 0;
+}
+
+static int ber_read_oid(uint8_t const *buf, size_t size, size_t *pos,
+                        oid_t *ret) {
+  uint8_t tag;
+  size_t len;
+
+  if ((ber_read_header(buf, size, pos, &tag, &len) != 0) || (tag != 0x06) ||
+      (len == 0))
+    return -1;
+
+  ret->oid[0] = buf[*pos] / 40;
+  ret->oid[1] = buf[*pos] % 40;
+  ret->oid_len = 2;
+
+  oid sub = 0;
+  for (size_t i = 1; i < len; i++) {
+    sub = (sub << 7) | (buf[*pos + i] & 0x7f);
+    if (buf[*pos + i] & 0x80)
+      continue;
+    if (ret->oid_len >= MAX_OID_LEN)
+      return -1;
+    ret->oid[ret->oid_len++] = sub;
+    sub = 0;
+  }
+
+  *pos += len;
+  return 0;
+}
+
+/* Writes a tag and length in front of the "len" bytes at "buf". */
+static size_t ber_wrap(uint8_t *buf, size_t len, uint8_t tag) {
+  uint8_t hdr[4] = {tag};
+  size_t hdr_len;
+
+  if (len < 0x80) {
+    hdr[1] = (uint8_t)len;
+    hdr_len = 2;
+  } else if (len < 0x100) {
+    hdr[1] = 0x81;
+    hdr[2] = (uint8_t)len;
+    hdr_len = 3;
+  } else {
+    hdr[1] = 0x82;
+    hdr[2] = (uint8_t)(len >> 8);
+    hdr[3] = (uint8_t)len;
+    hdr_len = 4;
+  }
+
+  memmove(buf + hdr_len, buf, len);
+  memcpy(buf, hdr, hdr_len);
+  return hdr_len + len;
+}
+
+static size_t ber_write_uint(uint8_t *buf, uint8_t tag, uint64_t v) {
+  uint8_t tmp[9];
+  size_t n = 0;
+
+  do {
+    tmp[n++] = (uint8_t)v;
+    v >>= 8;
+  } while (v != 0);
+  /* Positive numbers must not have the sign bit set. */
+  if (tmp[n - 1] & 0x80)
+    tmp[n++] = 0;
+
+  for (size_t i = 0; i < n; i++)
+    buf[i] = tmp[n - 1 - i];
+  return ber_wrap(buf, n, tag);
+}
+
+static size_t ber_write_oid(uint8_t *buf, oid_t const *o) {
+  size_t n = 0;
+
+  buf[n++] = (uint8_t)(40 * o->oid[0] + o->oid[1]);
+  for (size_t i = 2; i < o->oid_len; i++) {
+    uint8_t tmp[10];
+    size_t tmp_len = 0;
+    oid sub = o->oid[i];
+
+    do {
+      tmp[tmp_len++] = (uint8_t)(sub & 0x7f);
+      sub >>= 7;
+    } while (sub != 0);
+    while (tmp_len > 0) {
+      tmp_len--;
+      buf[n++] = tmp[tmp_len] | ((tmp_len > 0) ? 0x80 : 0);
+    }
+  }
+
+  return ber_wrap(buf, n, 0x06);
+}
+
+/* Returns the row following "o" in the agent's table, or zero at the end of
+ * the MIB view. */
+static size_t agent_next_row(oid_t const *o) {
+  size_t column_len = STATIC_ARRAY_SIZE(agent_column);
+  int cmp = snmp_oid_ncompare(o->oid, o->oid_len, agent_column, column_len,
+                              column_len);
+
+  if (cmp < 0)
+    return 1;
+  if (cmp > 0)
+    return 0;
+  if (o->oid_len == column_len)
+    return 1;
+  if (o->oid[column_len] < agent_rows)
+    return o->oid[column_len] + 1;
+  return 0;
+}
+
+/* Appends the variable binding for the row following "o" and moves "o" to
+ * that row. Returns zero if it does not fit. */
+static size_t agent_add_next(uint8_t *buf, size_t size, oid_t *o) {
+  uint8_t vb[64];
+  size_t row = agent_next_row(o);
+  size_t n;
+
+  if (row == 0) {
+    n = ber_write_oid(vb, o);
+    vb[n++] = SNMP_ENDOFMIBVIEW;
+    vb[n++] = 0;
+  } else {
+    o->oid_len = STATIC_ARRAY_SIZE(agent_column) + 1;
+    memcpy(o->oid, agent_column, sizeof(agent_column));
+    o->oid[o->oid_len - 1] = row;
+    n = ber_write_oid(vb, o);
+    n += ber_write_uint(vb + n, ASN_COUNTER, 1000 * row);
+  }
+  n = ber_wrap(vb, n, 0x30);
+
+  if (n > size)
+    return 0;
+  memcpy(buf, vb, n);
+  return n;
+}
+
+/* Builds the response to one request. Returns the size of the response or
+ * zero if the request is invalid. The stand-in only serves one table, so GET
+ * requests are answered like GETNEXT requests. */
+static size_t agent_respond(uint8_t const *req, size_t req_size, uint8_t *res) {
+  size_t pos = 0;
+  uint8_t tag;
+  size_t len;
+  long version, reqid, non_repeaters, max_repetitions;
+  uint8_t const *community;
+  size_t community_len;
+  uint8_t command;
+  oid_t oids[64];
+  size_t oids_num = 0;
+
+  if ((ber_read_header(req, req_size, &pos, &tag, &len) != 0) ||
+      (tag != 0x30) ||
+      (ber_read_int(req, req_size, &pos, &version) != 0) ||
+      (ber_read_header(req, req_size, &pos, &tag, &len) != 0) || (tag != 0x04))
+    return 0;
+  community = req + pos;
+  community_len = len;
+  pos += len;
+
+  if ((ber_read_header(req, req_size, &pos, &command, &len) != 0) ||
+      (ber_read_int(req, req_size, &pos, &reqid) != 0) ||
+      (ber_read_int(req, req_size, &pos, &non_repeaters) != 0) ||
+      (ber_read_int(req, req_size, &pos, &max_repetitions) != 0) ||
+      (ber_read_header(req, req_size, &pos, &tag, &len) != 0) || (tag != 0x30))
+    return 0;
+
+  while ((pos < req_size) && (oids_num < STATIC_ARRAY_SIZE(oids))) {
+    if ((ber_read_header(req, req_size, &pos, &tag, &len) != 0) ||
+        (tag != 0x30))
+      return 0;
+    size_t end = pos + len;
+    if (ber_read_oid(req, req_size, &pos, &oids[oids_num]) != 0)
+      return 0;
+    oids_num++;
+    pos = end;
+  }
+
+  if (command != SNMP_MSG_GETBULK) {
+    non_repeaters = (long)oids_num;
+    max_repetitions = 0;
+  }
+  if (non_repeaters < 0)
+    non_repeaters = 0;
+  if ((size_t)non_repeaters > oids_num)
+    non_repeaters = (long)oids_num;
+
+  /* Variable bindings go to the end of the buffer so there is room for the
+   * headers. Stop adding repetitions when the packet is full, like real
+   * agents do. */
+  uint8_t vbs[AGENT_PACKET_SIZE];
+  size_t vbs_size = AGENT_PACKET_SIZE - 64 - community_len;
+  size_t n = 0;
+
+  for (size_t i = 0; i < oids_num; i++) {
+    if ((i >= (size_t)non_repeaters) && (command == SNMP_MSG_GETBULK))
+      break;
+    size_t added = agent_add_next(vbs + n, vbs_size - n, &oids[i]);
+    if (added == 0)
+      return 0;
+    n += added;
+  }
+  for (long r = 0; r < max_repetitions; r++) {
+    _Bool full = 0;
+    for (size_t i = (size_t)non_repeaters; i < oids_num; i++) {
+      size_t added = agent_add_next(vbs + n, vbs_size - n, &oids[i]);
+      if (added == 0) {
+        full = 1;
+        break;
+      }
+      n += added;
+    }
+    if (full)
+      break;
+  }
+
+  size_t res_len = 0;
+  res_len += ber_write_uint(res + res_len, 0x02, (uint64_t)version);
+  memcpy(res + res_len, community, community_len);
+  res_len += ber_wrap(res + res_len, community_len, 0x04);
+
+  uint8_t *pdu = res + res_len;
+  size_t pdu_len = 0;
+  pdu_len += ber_write_uint(pdu + pdu_len, 0x02, (uint64_t)reqid);
+  pdu_len += ber_write_uint(pdu + pdu_len, 0x02, 0);
+  pdu_len += ber_write_uint(pdu + pdu_len, 0x02, 0);
+  memcpy(pdu + pdu_len, vbs, n);
+  pdu_len += ber_wrap(pdu + pdu_len, n, 0x30);
+  res_len += ber_wrap(pdu, pdu_len, SNMP_MSG_RESPONSE);
+
+  return ber_wrap(res, res_len, 0x30);
+}
+
+static void *agent_thread(void *arg) {
+  int fd = *(int *)arg;
+
+  while (!agent_shutdown) {
+    cdtime_t now = now_real();
+    int timeout_ms = 100;
+
+    /* Send the responses which are due. */
+    while (agent_queue_fill > 0) {
+      agent_response_t *r = agent_queue + agent_queue_head;
+      if (r->due > now) {
+        timeout_ms = (int)CDTIME_T_TO_MS(r->due - now) + 1;
+        break;
+      }
+      sendto(fd, r->data, r->size, 0, (struct sockaddr *)&r->addr,
+             sizeof(r->addr));
+      agent_queue_head = (agent_queue_head + 1) % AGENT_QUEUE_SIZE;
+      agent_queue_fill--;
+    }
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (poll(&pfd, 1, timeout_ms) <= 0)
+      continue;
+
+    while (agent_queue_fill < AGENT_QUEUE_SIZE) {
+      uint8_t req[AGENT_PACKET_SIZE];
+      agent_response_t *r =
+          agent_queue +
+          ((agent_queue_head + agent_queue_fill) % AGENT_QUEUE_SIZE);
+      socklen_t addr_len = sizeof(r->addr);
+
+      ssize_t status = recvfrom(fd, req, sizeof(req), MSG_DONTWAIT,
+                                (struct sockaddr *)&r->addr, &addr_len);
+      if (status <= 0)
+        break;
+
+      r->size = agent_respond(req, (size_t)status, r->data);
+      if (r->size == 0)
+        continue;
+      r->due = now_real() + agent_delay;
+      agent_queue_fill++;
+      agent_requests++;
+    }
+  }
+
+  return NULL;
+}
+
+static void run(char const *name, size_t hosts_num, int max_repetitions,
+                size_t threads_num, int port, double seconds) {
+  host_definition_t *hosts = calloc(hosts_num, sizeof(*hosts));
+  data_definition_t data = {
+      .name = "ifInOctets", .type = "MAGIC", .is_table = 1, .scale = 1.0,
+  };
+  data_definition_t *data_list[] = {&data};
+  oid_t column;
+  char address[64];
+  _Bool *started = calloc(hosts_num, sizeof(*started));
+  uint64_t polls = 0;
+
+  assert((hosts != NULL) && (started != NULL));
+
+  csnmp_oid_init(&column, agent_column, STATIC_ARRAY_SIZE(agent_column));
+  data.values = &column;
+  data.values_len = 1;
+
+  ssnprintf(address, sizeof(address), "udp:127.0.0.1:%i", port);
+
+  engines_num = threads_num;
+  assert(csnmp_engines_start() == 0);
+
+  for (size_t i = 0; i < hosts_num; i++) {
+    host_definition_t *h = hosts + i;
+
+    h->name = "bench";
+    h->address = address;
+    h->community = "public";
+    h->version = 2;
+    h->max_repetitions = max_repetitions;
+    h->interval = TIME_T_TO_CDTIME_T(10);
+    h->data_list = data_list;
+    h->data_list_len = 1;
+    h->engine_index = i;
+    C_COMPLAIN_INIT(&h->complaint);
+    C_COMPLAIN_INIT(&h->poll_complaint);
+  }
+
+  uint64_t requests_start = agent_requests;
+  cdtime_t start = now_real();
+  cdtime_t end = start + DOUBLE_TO_CDTIME_T(seconds);
+
+  /* Start a new poll of each host as soon as the previous one is done. */
+  while (now_real() < end) {
+    for (size_t i = 0; i < hosts_num; i++) {
+      host_definition_t *h = hosts + i;
+
+      if (started[i]) {
+        pthread_mutex_lock(&h->engine->lock);
+        _Bool busy = h->poll_active;
+        pthread_mutex_unlock(&h->engine->lock);
+        if (busy)
+          continue;
+        polls++;
+      }
+
+      started[i] = (csnmp_read_host(&(user_data_t){.data = h}) == 0);
+    }
+    nanosleep(&(struct timespec){.tv_nsec = 200000}, NULL);
+  }
+
+  double elapsed = CDTIME_T_TO_DOUBLE(now_real() - start);
+  uint64_t requests = agent_requests - requests_start;
+
+  csnmp_engines_free();
+  for (size_t i = 0; i < hosts_num; i++) {
+    csnmp_table_free(&data, hosts[i].poll_table);
+    csnmp_host_close_session(hosts + i);
+  }
+  sfree(hosts);
+  sfree(started);
+
+  printf("%-24s %8.1f polls/s %9.1f requests/s\n", name,
+         (double)polls / elapsed, (double)requests / elapsed);
+}
+
+int main(int argc, char **argv) {
+  size_t hosts_num = 200;
+  double delay_ms = 1.0;
+  double seconds = 3.0;
+
+  if (argc > 1)
+    hosts_num = (size_t)atol(argv[1]);
+  if (argc > 2)
+    agent_rows = (size_t)atol(argv[2]);
+  if (argc > 3)
+    delay_ms = atof(argv[3]);
+  if (argc > 4)
+    seconds = atof(argv[4]);
+  if ((hosts_num < 1) || (agent_rows < 1) || (delay_ms < 0) ||
+      (seconds <= 0)) {
+    fprintf(stderr, "Usage: %s [<hosts> [<rows> [<delay ms> [<seconds>]]]]\n",
+            argv[0]);
+    return 1;
+  }
+  agent_delay = DOUBLE_TO_CDTIME_T(delay_ms / 1000.0);
+
+  /* Don't load any MIBs. */
+  setenv("MIBS", "", /* overwrite = */ 1);
+  call_snmp_init_once();
+
+  int fd = socket(AF_INET, SOCK_DGRAM, 0);
+  struct sockaddr_in sa = {.sin_family = AF_INET,
+                           .sin_addr.s_addr = htonl(INADDR_LOOPBACK)};
+  socklen_t sa_len = sizeof(sa);
+  int buffer_size = 4 * 1024 * 1024;
+  assert(fd >= 0);
+  setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &buffer_size, sizeof(buffer_size));
+  assert(bind(fd, (struct sockaddr *)&sa, sizeof(sa)) == 0);
+  assert(getsockname(fd, (struct sockaddr *)&sa, &sa_len) == 0);
+
+  agent_queue = calloc(AGENT_QUEUE_SIZE, sizeof(*agent_queue));
+  assert(agent_queue != NULL);
+
+  pthread_t agent;
+  assert(pthread_create(&agent, NULL, agent_thread, &fd) == 0);
+
+  printf("%zu hosts, %zu rows, %g ms agent delay\n", hosts_num, agent_rows,
+         delay_ms);
+  run("GETNEXT, 1 thread", hosts_num, 0, 1, ntohs(sa.sin_port), seconds);
+  run("GETBULK 10, 1 thread", hosts_num, 10, 1, ntohs(sa.sin_port), seconds);
+  run("GETBULK 25, 1 thread", hosts_num, 25, 1, ntohs(sa.sin_port), seconds);
+  run("GETBULK 25, 4 threads", hosts_num, 25, 4, ntohs(sa.sin_port), seconds);
+
+  agent_shutdown = 1;
+  pthread_join(agent, NULL);
+  close(fd);
+  sfree(agent_queue);
+
+  return 0;
+}
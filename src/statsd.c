@@ -24,6 +24,8 @@
  *   Florian octo Forster <octo at collectd.org>
  */
 
+#define _GNU_SOURCE /* For recvmmsg(2) */
+
 #include "collectd.h"
 
 #include "common.h"
@@ -33,6 +35,8 @@
 
 #include <netdb.h>
 #include <poll.h>
+#include <sched.h>
+#include <sys/socket.h>
 #include <sys/types.h>
 
 /* AIX doesn't have MSG_DONTWAIT */
@@ -48,6 +52,10 @@
 #define STATSD_DEFAULT_SERVICE "8125"
 #endif
 
+#define STATSD_BUFFER_SIZE 4096
+/* Maximum number of datagrams read from one socket per poll(2) wakeup. */
+#define STATSD_RECEIVE_BATCH 32
+
 enum metric_type_e { STATSD_COUNTER, STATSD_TIMER, STATSD_GAUGE, STATSD_SET };
 typedef enum metric_type_e metric_type_t;
 
@@ -61,13 +69,65 @@ struct statsd_metric_s {
 };
 typedef struct statsd_metric_s statsd_metric_t;
 
+/* A statsd_partial_t holds the updates one worker received for a metric since
+ * the last read. Partials are merged into the statsd_metric_t's in
+ * "metrics_tree" by statsd_read(). */
+struct statsd_partial_s {
+  char *name; /* NULL if the slot is unused */
+  uint32_t hash;
+  metric_type_t type;
+  /* For counters, and gauges unless "gauge_set" is true, "value" is the delta
+   * to be added to the metric. Otherwise it's the last value a gauge was set
+   * to, plus any deltas received after that. */
+  double value;
+  _Bool gauge_set;
+  latency_counter_t *latency;
+  c_avl_tree_t *set;
+  unsigned long updates_num;
+};
+typedef struct statsd_partial_s statsd_partial_t;
+
+/* Open addressing hash map of partials. Only ever accessed by one thread at a
+ * time: by the worker while it's the worker's active map, by statsd_read()
+ * otherwise. */
+struct statsd_map_s {
+  statsd_partial_t *slots;
+  size_t size; /* power of two */
+  size_t used;
+};
+typedef struct statsd_map_s statsd_map_t;
+
+/* Each worker receives on its own set of sockets and aggregates into its own
+ * map, so workers never contend with each other or with the read callback.
+ * statsd_read() takes a worker's map away by flipping "active" and then waits
+ * for the worker to finish the batch it may be processing: "epoch" is odd
+ * while the worker is handling a batch of packets. */
+struct statsd_worker_s {
+  size_t id;
+  pthread_t thread;
+  _Bool running;
+
+  statsd_map_t maps[2];
+  int active;
+  uint64_t epoch;
+
+  char (*buffers)[STATSD_BUFFER_SIZE];
+#if HAVE_RECVMMSG
+  struct mmsghdr *msgs;
+  struct iovec *iovs;
+#endif
+};
+typedef struct statsd_worker_s statsd_worker_t;
+
 static c_avl_tree_t *metrics_tree = NULL;
 static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
 
-static pthread_t network_thread;
-static _Bool network_thread_running = 0;
+static statsd_worker_t *workers = NULL;
+static size_t workers_num = 0;
 static _Bool network_thread_shutdown = 0;
 
+static size_t conf_workers = 1;
+
 static char *conf_node = NULL;
 static char *conf_service = NULL;
 
@@ -145,45 +205,108 @@ static statsd_metric_t *statsd_metric_lookup_unsafe(char const *name, /* {{{ */
   return metric;
 } /* }}} statsd_metric_lookup_unsafe */
 
-static int statsd_metric_set(char const *name, double value, /* {{{ */
-                             metric_type_t type) {
-  statsd_metric_t *metric;
+static void statsd_partial_free(statsd_partial_t *p) /* {{{ */
+{
+  if (p->latency != NULL) {
+    latency_counter_destroy(p->latency);
+    p->latency = NULL;
+  }
 
-  pthread_mutex_lock(&metrics_lock);
+  if (p->set != NULL) {
+    void *key;
+    void *value;
 
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
-    return -1;
+    while (c_avl_pick(p->set, &key, &value) == 0)
+      sfree(key);
+
+    c_avl_destroy(p->set);
+    p->set = NULL;
   }
 
-  metric->value = value;
-  metric->updates_num++;
+  sfree(p->name);
+} /* }}} void statsd_partial_free */
 
-  pthread_mutex_unlock(&metrics_lock);
+static int statsd_map_resize(statsd_map_t *map, size_t size) /* {{{ */
+{
+  statsd_partial_t *slots = calloc(size, sizeof(*slots));
+  if (slots == NULL) {
+    ERROR("statsd plugin: calloc failed.");
+    return ENOMEM;
+  }
 
+  for (size_t i = 0; i < map->size; i++) {
+    statsd_partial_t *p = map->slots + i;
+    if (p->name == NULL)
+      continue;
+
+    size_t j = (size_t)p->hash & (size - 1);
+    while (slots[j].name != NULL)
+      j = (j + 1) & (size - 1);
+    slots[j] = *p;
+  }
+
+  sfree(map->slots);
+  map->slots = slots;
+  map->size = size;
   return 0;
-} /* }}} int statsd_metric_set */
+} /* }}} int statsd_map_resize */
+
+/* Returns the partial for "name" and "type", creating it if necessary. */
+static statsd_partial_t *statsd_map_lookup(statsd_map_t *map, /* {{{ */
+                                           char const *name,
+                                           metric_type_t type) {
+  /* Keep the load factor below 3/4. */
+  if (4 * (map->used + 1) > 3 * map->size) {
+    if (statsd_map_resize(map, (map->size == 0) ? 64 : 2 * map->size) != 0)
+      return NULL;
+  }
 
-static int statsd_metric_add(char const *name, double delta, /* {{{ */
-                             metric_type_t type) {
-  statsd_metric_t *metric;
+  uint32_t hash = strhash(name) + (uint32_t)type;
+  size_t i = (size_t)hash & (map->size - 1);
+  while (map->slots[i].name != NULL) {
+    statsd_partial_t *p = map->slots + i;
+    if ((p->hash == hash) && (p->type == type) && (strcmp(p->name, name) == 0))
+      return p;
+    i = (i + 1) & (map->size - 1);
+  }
 
-  pthread_mutex_lock(&metrics_lock);
+  statsd_partial_t *p = map->slots + i;
+  p->name = strdup(name);
+  if (p->name == NULL) {
+    ERROR("statsd plugin: strdup failed.");
+    return NULL;
+  }
+  p->hash = hash;
+  p->type = type;
+  map->used++;
 
-  metric = statsd_metric_lookup_unsafe(name, type);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  return p;
+} /* }}} statsd_partial_t *statsd_map_lookup */
+
+static int statsd_partial_set(statsd_map_t *map, char const *name, /* {{{ */
+                              double value, metric_type_t type) {
+  statsd_partial_t *p = statsd_map_lookup(map, name, type);
+  if (p == NULL)
     return -1;
-  }
 
-  metric->value += delta;
-  metric->updates_num++;
+  p->value = value;
+  p->gauge_set = 1;
+  p->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
+  return 0;
+} /* }}} int statsd_partial_set */
+
+static int statsd_partial_add(statsd_map_t *map, char const *name, /* {{{ */
+                              double delta, metric_type_t type) {
+  statsd_partial_t *p = statsd_map_lookup(map, name, type);
+  if (p == NULL)
+    return -1;
+
+  p->value += delta;
+  p->updates_num++;
 
   return 0;
-} /* }}} int statsd_metric_add */
+} /* }}} int statsd_partial_add */
 
 static void statsd_metric_free(statsd_metric_t *metric) /* {{{ */
 {
@@ -222,8 +345,9 @@ static int statsd_parse_value(char const *str, value_t *ret_value) /* {{{ */
   return 0;
 } /* }}} int statsd_parse_value */
 
-static int statsd_handle_counter(char const *name, /* {{{ */
-                                 char const *value_str, char const *extra) {
+static int statsd_handle_counter(statsd_map_t *map, /* {{{ */
+                                 char const *name, char const *value_str,
+                                 char const *extra) {
   value_t value;
   value_t scale;
   int status;
@@ -248,12 +372,12 @@ static int statsd_handle_counter(char const *name, /* {{{ */
 
   /* Changes to the counter are added to (statsd_metric_t*)->value. ->counter is
    * only updated in statsd_metric_submit_unsafe(). */
-  return statsd_metric_add(name, (double)(value.gauge / scale.gauge),
-                           STATSD_COUNTER);
+  return statsd_partial_add(map, name, (double)(value.gauge / scale.gauge),
+                            STATSD_COUNTER);
 } /* }}} int statsd_handle_counter */
 
-static int statsd_handle_gauge(char const *name, /* {{{ */
-                               char const *value_str) {
+static int statsd_handle_gauge(statsd_map_t *map, /* {{{ */
+                               char const *name, char const *value_str) {
   value_t value;
   int status;
 
@@ -263,14 +387,15 @@ static int statsd_handle_gauge(char const *name, /* {{{ */
     return status;
 
   if ((value_str[0] == '+') || (value_str[0] == '-'))
-    return statsd_metric_add(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_partial_add(map, name, (double)value.gauge, STATSD_GAUGE);
   else
-    return statsd_metric_set(name, (double)value.gauge, STATSD_GAUGE);
+    return statsd_partial_set(map, name, (double)value.gauge, STATSD_GAUGE);
 } /* }}} int statsd_handle_gauge */
 
-static int statsd_handle_timer(char const *name, /* {{{ */
-                               char const *value_str, char const *extra) {
-  statsd_metric_t *metric;
+static int statsd_handle_timer(statsd_map_t *map, /* {{{ */
+                               char const *name, char const *value_str,
+                               char const *extra) {
+  statsd_partial_t *p;
   value_t value_ms;
   value_t scale;
   cdtime_t value;
@@ -296,65 +421,50 @@ static int statsd_handle_timer(char const *name, /* {{{ */
 
   value = MS_TO_CDTIME_T(value_ms.gauge / scale.gauge);
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_TIMER);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  p = statsd_map_lookup(map, name, STATSD_TIMER);
+  if (p == NULL)
     return -1;
-  }
 
-  if (metric->latency == NULL)
-    metric->latency = latency_counter_create();
-  if (metric->latency == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  if (p->latency == NULL)
+    p->latency = latency_counter_create();
+  if (p->latency == NULL)
     return -1;
-  }
 
-  latency_counter_add(metric->latency, value);
-  metric->updates_num++;
+  latency_counter_add(p->latency, value);
+  p->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 } /* }}} int statsd_handle_timer */
 
-static int statsd_handle_set(char const *name, /* {{{ */
-                             char const *set_key_orig) {
-  statsd_metric_t *metric = NULL;
+static int statsd_handle_set(statsd_map_t *map, /* {{{ */
+                             char const *name, char const *set_key_orig) {
+  statsd_partial_t *p;
   char *set_key;
   int status;
 
-  pthread_mutex_lock(&metrics_lock);
-
-  metric = statsd_metric_lookup_unsafe(name, STATSD_SET);
-  if (metric == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  p = statsd_map_lookup(map, name, STATSD_SET);
+  if (p == NULL)
     return -1;
-  }
 
-  /* Make sure metric->set exists. */
-  if (metric->set == NULL)
-    metric->set = c_avl_create((int (*)(const void *, const void *))strcmp);
+  /* Make sure p->set exists. */
+  if (p->set == NULL)
+    p->set = c_avl_create((int (*)(const void *, const void *))strcmp);
 
-  if (metric->set == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
+  if (p->set == NULL) {
     ERROR("statsd plugin: c_avl_create failed.");
     return -1;
   }
 
   set_key = strdup(set_key_orig);
   if (set_key == NULL) {
-    pthread_mutex_unlock(&metrics_lock);
     ERROR("statsd plugin: strdup failed.");
     return -1;
   }
 
-  status = c_avl_insert(metric->set, set_key, /* value = */ NULL);
+  status = c_avl_insert(p->set, set_key, /* value = */ NULL);
   if (status < 0) {
-    pthread_mutex_unlock(&metrics_lock);
-    if (status < 0)
-      ERROR("statsd plugin: c_avl_insert (\"%s\") failed with status %i.",
-            set_key, status);
+    ERROR("statsd plugin: c_avl_insert (\"%s\") failed with status %i.",
+          set_key, status);
     sfree(set_key);
     return -1;
   } else if (status > 0) /* key already exists */
@@ -362,13 +472,12 @@ static int statsd_handle_set(char const *name, /* {{{ */
     sfree(set_key);
   }
 
-  metric->updates_num++;
+  p->updates_num++;
 
-  pthread_mutex_unlock(&metrics_lock);
   return 0;
 } /* }}} int statsd_handle_set */
 
-static int statsd_parse_line(char *buffer) /* {{{ */
+static int statsd_parse_line(statsd_map_t *map, char *buffer) /* {{{ */
 {
   char *name = buffer;
   char *value;
@@ -394,23 +503,23 @@ static int statsd_parse_line(char *buffer) /* {{{ */
   }
 
   if (strcmp("c", type) == 0)
-    return statsd_handle_counter(name, value, extra);
+    return statsd_handle_counter(map, name, value, extra);
   else if (strcmp("ms", type) == 0)
-    return statsd_handle_timer(name, value, extra);
+    return statsd_handle_timer(map, name, value, extra);
 
   /* extra is only valid for counters and timers */
   if (extra != NULL)
     return -1;
 
   if (strcmp("g", type) == 0)
-    return statsd_handle_gauge(name, value);
+    return statsd_handle_gauge(map, name, value);
   else if (strcmp("s", type) == 0)
-    return statsd_handle_set(name, value);
+    return statsd_handle_set(map, name, value);
   else
     return -1;
 } /* }}} void statsd_parse_line */
 
-static void statsd_parse_buffer(char *buffer) /* {{{ */
+static void statsd_parse_buffer(statsd_map_t *map, char *buffer) /* {{{ */
 {
   while (buffer != NULL) {
     char orig[64];
@@ -430,7 +539,7 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
 
     sstrncpy(orig, buffer, sizeof(orig));
 
-    status = statsd_parse_line(buffer);
+    status = statsd_parse_line(map, buffer);
     if (status != 0)
       ERROR("statsd plugin: Unable to parse line: \"%s\"", orig);
 
@@ -438,13 +547,15 @@ static void statsd_parse_buffer(char *buffer) /* {{{ */
   }
 } /* }}} void statsd_parse_buffer */
 
-static void statsd_network_read(int fd) /* {{{ */
-{
-  char buffer[4096];
-  size_t buffer_size;
-  ssize_t status;
-
-  status = recv(fd, buffer, sizeof(buffer), /* flags = */ MSG_DONTWAIT);
+static void statsd_network_read(statsd_worker_t *w, statsd_map_t *map, /* {{{ */
+                                int fd) {
+#if HAVE_RECVMMSG
+  int status = recvmmsg(fd, w->msgs, STATSD_RECEIVE_BATCH,
+                        /* flags = */ MSG_DONTWAIT, /* timeout = */ NULL);
+#else
+  ssize_t status = recv(fd, w->buffers[0], STATSD_BUFFER_SIZE,
+                        /* flags = */ MSG_DONTWAIT);
+#endif
   if (status < 0) {
     char errbuf[1024];
 
@@ -456,12 +567,21 @@ static void statsd_network_read(int fd) /* {{{ */
     return;
   }
 
-  buffer_size = (size_t)status;
-  if (buffer_size >= sizeof(buffer))
-    buffer_size = sizeof(buffer) - 1;
-  buffer[buffer_size] = 0;
+#if HAVE_RECVMMSG
+  for (int i = 0; i < status; i++) {
+    size_t buffer_size = (size_t)w->msgs[i].msg_len;
+#else
+  for (int i = 0; i < 1; i++) {
+    size_t buffer_size = (size_t)status;
+#endif
+    char *buffer = w->buffers[i];
 
-  statsd_parse_buffer(buffer);
+    if (buffer_size >= STATSD_BUFFER_SIZE)
+      buffer_size = STATSD_BUFFER_SIZE - 1;
+    buffer[buffer_size] = 0;
+
+    statsd_parse_buffer(map, buffer);
+  }
 } /* }}} void statsd_network_read */
 
 static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
@@ -509,6 +629,22 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
     DEBUG("statsd plugin: Trying to bind to [%s]:%s ...", dbg_node,
           dbg_service);
 
+#ifdef SO_REUSEPORT
+    /* Every worker binds its own socket to the address; the kernel distributes
+     * the incoming datagrams among them. */
+    if (workers_num > 1) {
+      int yes = 1;
+      status = setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &yes, sizeof(yes));
+      if (status != 0) {
+        char errbuf[1024];
+        ERROR("statsd plugin: setsockopt(SO_REUSEPORT) failed: %s",
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+        close(fd);
+        continue;
+      }
+    }
+#endif
+
     status = bind(fd, ai_ptr->ai_addr, ai_ptr->ai_addrlen);
     if (status != 0) {
       char errbuf[1024];
@@ -548,6 +684,7 @@ static int statsd_network_init(struct pollfd **ret_fds, /* {{{ */
 
 static void *statsd_network_thread(void *args) /* {{{ */
 {
+  statsd_worker_t *w = args;
   struct pollfd *fds = NULL;
   size_t fds_num = 0;
   int status;
@@ -571,13 +708,19 @@ static void *statsd_network_thread(void *args) /* {{{ */
       break;
     }
 
+    /* Begin a batch; see statsd_worker_take_map(). */
+    __atomic_add_fetch(&w->epoch, 1, __ATOMIC_SEQ_CST);
+    statsd_map_t *map = &w->maps[__atomic_load_n(&w->active, __ATOMIC_SEQ_CST)];
+
     for (size_t i = 0; i < fds_num; i++) {
       if ((fds[i].revents & (POLLIN | POLLPRI)) == 0)
         continue;
 
-      statsd_network_read(fds[i].fd);
+      statsd_network_read(w, map, fds[i].fd);
       fds[i].revents = 0;
     }
+
+    __atomic_add_fetch(&w->epoch, 1, __ATOMIC_RELEASE);
   } /* while (!network_thread_shutdown) */
 
   /* Clean up */
@@ -618,6 +761,30 @@ static int statsd_config_timer_percentile(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int statsd_config_timer_percentile */
 
+static int statsd_config_workers(oconfig_item_t *ci) /* {{{ */
+{
+  int tmp = 0;
+
+  int status = cf_util_get_int(ci, &tmp);
+  if (status != 0)
+    return status;
+
+  if (tmp < 1) {
+    ERROR("statsd plugin: The \"%s\" option must be positive.", ci->key);
+    return ERANGE;
+  }
+#ifndef SO_REUSEPORT
+  if (tmp > 1) {
+    WARNING("statsd plugin: Multiple workers require SO_REUSEPORT, which is "
+            "not supported on this system. Using one worker.");
+    tmp = 1;
+  }
+#endif
+
+  conf_workers = (size_t)tmp;
+  return 0;
+} /* }}} int statsd_config_workers */
+
 static int statsd_config(oconfig_item_t *ci) /* {{{ */
 {
   for (int i = 0; i < ci->children_num; i++) {
@@ -647,6 +814,8 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
       cf_util_get_boolean(child, &conf_timer_count);
     else if (strcasecmp("TimerPercentile", child->key) == 0)
       statsd_config_timer_percentile(child);
+    else if (strcasecmp("Workers", child->key) == 0)
+      statsd_config_workers(child);
     else
       ERROR("statsd plugin: The \"%s\" config option is not valid.",
             child->key);
@@ -655,18 +824,84 @@ static int statsd_config(oconfig_item_t *ci) /* {{{ */
   return 0;
 } /* }}} int statsd_config */
 
+static int statsd_worker_init(statsd_worker_t *w, size_t id) /* {{{ */
+{
+  w->id = id;
+
+  w->buffers = calloc(STATSD_RECEIVE_BATCH, sizeof(*w->buffers));
+  if (w->buffers == NULL)
+    return ENOMEM;
+
+#if HAVE_RECVMMSG
+  w->msgs = calloc(STATSD_RECEIVE_BATCH, sizeof(*w->msgs));
+  w->iovs = calloc(STATSD_RECEIVE_BATCH, sizeof(*w->iovs));
+  if ((w->msgs == NULL) || (w->iovs == NULL))
+    return ENOMEM;
+
+  for (size_t i = 0; i < STATSD_RECEIVE_BATCH; i++) {
+    w->iovs[i].iov_base = w->buffers[i];
+    w->iovs[i].iov_len = STATSD_BUFFER_SIZE;
+    w->msgs[i].msg_hdr.msg_iov = w->iovs + i;
+    w->msgs[i].msg_hdr.msg_iovlen = 1;
+  }
+#endif
+
+  return 0;
+} /* }}} int statsd_worker_init */
+
+static void statsd_worker_destroy(statsd_worker_t *w) /* {{{ */
+{
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(w->maps); i++) {
+    statsd_map_t *map = w->maps + i;
+
+    for (size_t j = 0; j < map->size; j++)
+      statsd_partial_free(map->slots + j);
+    sfree(map->slots);
+    map->size = 0;
+    map->used = 0;
+  }
+
+  sfree(w->buffers);
+#if HAVE_RECVMMSG
+  sfree(w->msgs);
+  sfree(w->iovs);
+#endif
+} /* }}} void statsd_worker_destroy */
+
 static int statsd_init(void) /* {{{ */
 {
   pthread_mutex_lock(&metrics_lock);
   if (metrics_tree == NULL)
     metrics_tree = c_avl_create((int (*)(const void *, const void *))strcmp);
 
-  if (!network_thread_running) {
+  if (workers == NULL) {
+    workers = calloc(conf_workers, sizeof(*workers));
+    if (workers == NULL) {
+      pthread_mutex_unlock(&metrics_lock);
+      ERROR("statsd plugin: calloc failed.");
+      return ENOMEM;
+    }
+    workers_num = conf_workers;
+
+    for (size_t i = 0; i < workers_num; i++) {
+      if (statsd_worker_init(workers + i, i) != 0) {
+        pthread_mutex_unlock(&metrics_lock);
+        ERROR("statsd plugin: Allocating receive buffers failed.");
+        return ENOMEM;
+      }
+    }
+  }
+
+  for (size_t i = 0; i < workers_num; i++) {
+    statsd_worker_t *w = workers + i;
     int status;
 
-    status = pthread_create(&network_thread,
+    if (w->running)
+      continue;
+
+    status = pthread_create(&w->thread,
                             /* attr = */ NULL, statsd_network_thread,
-                            /* args = */ NULL);
+                            /* args = */ w);
     if (status != 0) {
       char errbuf[1024];
       pthread_mutex_unlock(&metrics_lock);
@@ -674,8 +909,8 @@ static int statsd_init(void) /* {{{ */
             sstrerror(errno, errbuf, sizeof(errbuf)));
       return status;
     }
+    w->running = 1;
   }
-  network_thread_running = 1;
 
   pthread_mutex_unlock(&metrics_lock);
 
@@ -818,6 +1053,114 @@ static int statsd_metric_submit_unsafe(char const *name,
   return plugin_dispatch_values(&vl);
 } /* }}} int statsd_metric_submit_unsafe */
 
+/* Takes the map the worker has been writing to and hands it the other one.
+ * Returns once the worker no longer accesses the returned map. */
+static statsd_map_t *statsd_worker_take_map(statsd_worker_t *w) /* {{{ */
+{
+  int old = __atomic_load_n(&w->active, __ATOMIC_RELAXED);
+  __atomic_store_n(&w->active, !old, __ATOMIC_SEQ_CST);
+
+  /* If the worker is in the middle of a batch, it may have picked up the old
+   * map before the switch. The next batch is guaranteed to see the new one, so
+   * waiting for the current batch to end is sufficient. */
+  uint64_t epoch = __atomic_load_n(&w->epoch, __ATOMIC_SEQ_CST);
+  if ((epoch % 2) != 0) {
+    while (__atomic_load_n(&w->epoch, __ATOMIC_ACQUIRE) == epoch)
+      sched_yield();
+  }
+
+  return &w->maps[old];
+} /* }}} statsd_map_t *statsd_worker_take_map */
+
+/* Must hold metrics_lock when calling this function. */
+static int statsd_partial_merge_unsafe(statsd_partial_t *p) /* {{{ */
+{
+  statsd_metric_t *metric = statsd_metric_lookup_unsafe(p->name, p->type);
+  if (metric == NULL)
+    return -1;
+
+  switch (p->type) {
+  case STATSD_COUNTER:
+    metric->value += p->value;
+    break;
+
+  case STATSD_GAUGE:
+    if (p->gauge_set)
+      metric->value = p->value;
+    else
+      metric->value += p->value;
+    break;
+
+  case STATSD_TIMER:
+    if (metric->latency == NULL)
+      metric->latency = latency_counter_create();
+    if (metric->latency == NULL)
+      return -1;
+    latency_counter_merge(metric->latency, p->latency);
+    break;
+
+  case STATSD_SET: {
+    void *key;
+    void *value;
+
+    if (metric->set == NULL)
+      metric->set = c_avl_create((int (*)(const void *, const void *))strcmp);
+    if (metric->set == NULL) {
+      ERROR("statsd plugin: c_avl_create failed.");
+      return -1;
+    }
+
+    /* Move the keys over; the partial's set is left empty. */
+    while ((p->set != NULL) && (c_avl_pick(p->set, &key, &value) == 0)) {
+      if (c_avl_insert(metric->set, key, /* value = */ NULL) != 0)
+        sfree(key);
+    }
+    break;
+  }
+  }
+
+  metric->updates_num += p->updates_num;
+  return 0;
+} /* }}} int statsd_partial_merge_unsafe */
+
+/* Merges all partials of the map into "metrics_tree" and resets the map.
+ * Partials which didn't receive any updates during the last interval are
+ * removed, so that the map does not grow without bounds. Must hold
+ * metrics_lock when calling this function. */
+static void statsd_map_merge_unsafe(statsd_map_t *map) /* {{{ */
+{
+  size_t removed = 0;
+
+  for (size_t i = 0; i < map->size; i++) {
+    statsd_partial_t *p = map->slots + i;
+
+    if (p->name == NULL)
+      continue;
+
+    if (p->updates_num == 0) {
+      statsd_partial_free(p);
+      memset(p, 0, sizeof(*p));
+      removed++;
+      continue;
+    }
+
+    statsd_partial_merge_unsafe(p);
+
+    p->value = 0.0;
+    p->gauge_set = 0;
+    p->updates_num = 0;
+    if (p->latency != NULL)
+      latency_counter_reset(p->latency);
+  }
+
+  if (removed > 0) {
+    /* Re-insert the remaining partials so that all probe sequences are
+     * contiguous again. */
+    map->used -= removed;
+    statsd_map_resize(map, map->size);
+  }
+} /* }}} void statsd_map_merge_unsafe */
+
 static int statsd_read(void) /* {{{ */
 {
   c_avl_iterator_t *iter;
@@ -834,6 +1177,9 @@ static int statsd_read(void) /* {{{ */
     return 0;
   }
 
+  for (size_t i = 0; i < workers_num; i++)
+    statsd_map_merge_unsafe(statsd_worker_take_map(workers + i));
+
   iter = c_avl_get_iterator(metrics_tree);
   while (c_avl_iterator_next(iter, (void *)&name, (void *)&metric) == 0) {
     if ((metric->updates_num == 0) &&
@@ -884,15 +1230,25 @@ static int statsd_shutdown(void) /* {{{ */
   void *key;
   void *value;
 
-  if (network_thread_running) {
-    network_thread_shutdown = 1;
-    pthread_kill(network_thread, SIGTERM);
-    pthread_join(network_thread, /* retval = */ NULL);
+  network_thread_shutdown = 1;
+  for (size_t i = 0; i < workers_num; i++) {
+    statsd_worker_t *w = workers + i;
+
+    if (!w->running)
+      continue;
+
+    pthread_kill(w->thread, SIGTERM);
+    pthread_join(w->thread, /* retval = */ NULL);
+    w->running = 0;
   }
-  network_thread_running = 0;
 
   pthread_mutex_lock(&metrics_lock);
 
+  for (size_t i = 0; i < workers_num; i++)
+    statsd_worker_destroy(workers + i);
+  sfree(workers);
+  workers_num = 0;
+
   while (c_avl_pick(metrics_tree, &key, &value) == 0) {
     sfree(key);
     statsd_metric_free(value);
@@ -92,6 +92,7 @@ static int ut_threshold_add(const threshold_t *th) { /* {{{ */
     sfree(name_copy);
   }
 
+  threshold_invalidate();
   pthread_mutex_unlock(&threshold_lock);
 
   if (status != 0) {
@@ -690,7 +691,7 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
                               __attribute__((unused))
                               user_data_t *ud) { /* {{{ */
   threshold_t *th;
-  gauge_t *values;
+  gauge_t values[ds->ds_num];
   int status;
 
   int worst_state = -1;
@@ -700,27 +701,20 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
   if (threshold_tree == NULL)
     return 0;
 
-  /* Is this lock really necessary? So far, thresholds are only inserted at
-   * startup. -octo */
-  pthread_mutex_lock(&threshold_lock);
-  th = threshold_search(vl);
-  pthread_mutex_unlock(&threshold_lock);
-  if (th == NULL)
+  /* The thresholds found for a value list are memoized in the value cache,
+   * so this neither takes "threshold_lock" nor searches the tree unless the
+   * thresholds have changed. */
+  if (ut_lookup_threshold(ds, vl, values, &th) != 0)
     return 0;
 
   DEBUG("ut_check_threshold: Found matching threshold(s)");
 
-  values = uc_get_rate(ds, vl);
-  if (values == NULL)
-    return 0;
-
   while (th != NULL) {
     int ds_index = -1;
 
     status = ut_check_one_threshold(ds, vl, th, values, &ds_index);
     if (status < 0) {
       ERROR("ut_check_threshold: ut_check_one_threshold failed.");
-      sfree(values);
       return -1;
     }
 
@@ -737,12 +731,9 @@ static int ut_check_threshold(const data_set_t *ds, const value_list_t *vl,
       ut_report_state(ds, vl, worst_th, values, worst_ds_index, worst_state);
   if (status != 0) {
     ERROR("ut_check_threshold: ut_report_state failed.");
-    sfree(values);
     return -1;
   }
 
-  sfree(values);
-
   return 0;
 } /* }}} int ut_check_threshold */
 
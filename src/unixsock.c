@@ -41,18 +41,30 @@
 
 #include <grp.h>
 
+#if HAVE_SYS_EPOLL_H
+#include <sys/epoll.h>
+#else
+#include <poll.h>
+#endif
+
 #ifndef UNIX_PATH_MAX
 #define UNIX_PATH_MAX sizeof(((struct sockaddr_un *)0)->sun_path)
 #endif
 
 #define US_DEFAULT_PATH LOCALSTATEDIR "/run/" PACKAGE_NAME "-unixsock"
 
+#define US_DEFAULT_WORKERS 4
+/* Size of the per-connection input buffer. It is grown for longer lines, up to
+ * US_MAX_LINE_LENGTH. */
+#define US_BUFFER_SIZE 65536
+#define US_MAX_LINE_LENGTH (1024 * 1024)
+
 /*
  * Private variables
  */
 /* valid configuration file keys */
 static const char *config_keys[] = {"SocketFile", "SocketGroup", "SocketPerms",
-                                    "DeleteSocket"};
+                                    "DeleteSocket", "Workers"};
 static int config_keys_num = STATIC_ARRAY_SIZE(config_keys);
 
 static int loop = 0;
@@ -66,6 +78,65 @@ static _Bool delete_socket = 0;
 
 static pthread_t listen_thread = (pthread_t)0;
 
+/* A client connection. The socket is non-blocking. Input is read in large
+ * chunks and all complete lines are handled at once. The responses are
+ * collected in "out" and written as the socket accepts them; no more input is
+ * read until all of them have been written. */
+struct us_conn_s {
+  int fd;
+  struct us_worker_s *worker;
+
+  char *buffer;
+  size_t buffer_size;
+  size_t buffer_fill;
+  _Bool eof;
+
+  char *out;
+  size_t out_len;
+  size_t out_pos;
+  /* Whether the worker waits for the socket to become writable rather than
+   * readable. */
+  _Bool want_write;
+
+  /* Set while the connection's commands are handled by a thread of its own,
+   * see us_conn_handoff(). The worker ignores the connection in the meantime.
+   * Protected by the worker's lock. */
+  _Bool busy;
+
+  struct us_conn_s *next;
+};
+typedef struct us_conn_s us_conn_t;
+
+/* Connections are distributed among a fixed number of workers, each of which
+ * waits for input on its connections using epoll(7) (or poll(2) where epoll
+ * is not available). */
+struct us_worker_s {
+  pthread_t thread;
+  _Bool running;
+
+  /* List of connections, protected by "lock". Connections are added by the
+   * listen thread and removed by the worker. */
+  pthread_mutex_t lock;
+  us_conn_t *conns;
+
+  /* Number of threads running FLUSH commands for the worker's connections,
+   * protected by "lock". */
+  size_t helpers_num;
+  pthread_cond_t helpers_cond;
+
+#if HAVE_SYS_EPOLL_H
+  int epoll_fd;
+#else
+  /* Written to by the listen thread to wake up poll(2) when a connection has
+   * been added. */
+  int wakeup_fd[2];
+#endif
+};
+typedef struct us_worker_s us_worker_t;
+
+static us_worker_t *workers = NULL;
+static size_t workers_num = US_DEFAULT_WORKERS;
+
 /*
  * Functions
  */
@@ -163,137 +234,624 @@ static int us_open_socket(void) {
   return 0;
 } /* int us_open_socket */
 
-static void *us_handle_client(void *arg) {
-  int fdin;
-  int fdout;
-  FILE *fhin, *fhout;
+static void us_conn_destroy(us_conn_t *conn) /* {{{ */
+{
+  if (conn == NULL)
+    return;
+
+  if (conn->fd >= 0)
+    close(conn->fd);
+
+  sfree(conn->buffer);
+  sfree(conn->out);
+  sfree(conn);
+} /* }}} void us_conn_destroy */
+
+static us_conn_t *us_conn_create(int fd) /* {{{ */
+{
+  us_conn_t *conn = calloc(1, sizeof(*conn));
+  if (conn == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    close(fd);
+    return NULL;
+  }
+  conn->fd = fd;
+
+  conn->buffer_size = US_BUFFER_SIZE;
+  conn->buffer = malloc(conn->buffer_size);
+  if (conn->buffer == NULL) {
+    ERROR("unixsock plugin: malloc failed.");
+    us_conn_destroy(conn);
+    return NULL;
+  }
+  conn->buffer[0] = 0;
+
+  /* A client which doesn't read its responses must not block the worker. */
+  int flags = fcntl(fd, F_GETFL);
+  if ((flags == -1) || (fcntl(fd, F_SETFL, flags | O_NONBLOCK) != 0)) {
+    char errbuf[1024];
+    ERROR("unixsock plugin: fcntl failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    us_conn_destroy(conn);
+    return NULL;
+  }
+
+  return conn;
+} /* }}} us_conn_t *us_conn_create */
 
-  fdin = *((int *)arg);
-  free(arg);
-  arg = NULL;
+/* Handles a single command line, writing the response to "fhout". Returns
+ * non-zero if the connection should be closed. */
+static int us_handle_line(us_conn_t *conn, FILE *fhout, /* {{{ */
+                          char *buffer) {
+  char command[32];
+  size_t len;
 
-  DEBUG("unixsock plugin: us_handle_client: Reading from fd #%i", fdin);
+  len = strlen(buffer);
+  while ((len > 0) &&
+         ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
+    buffer[--len] = '\0';
 
-  fdout = dup(fdin);
-  if (fdout < 0) {
+  if (len == 0)
+    return 0;
+
+  /* Only the first field is needed to select the handler, so extract it
+   * rather than splitting (a copy of) the entire line. */
+  char const *ptr = buffer + strspn(buffer, " \t\r\n");
+  size_t command_len = strcspn(ptr, " \t\r\n");
+  if (command_len == 0) {
+    fprintf(fhout, "-1 Internal error\n");
+    return -1;
+  }
+  if (command_len >= sizeof(command))
+    command_len = sizeof(command) - 1;
+  memcpy(command, ptr, command_len);
+  command[command_len] = 0;
+
+  if (strcasecmp(command, "getval") == 0) {
+    cmd_handle_getval(fhout, buffer);
+  } else if (strcasecmp(command, "getthreshold") == 0) {
+    handle_getthreshold(fhout, buffer);
+  } else if (strcasecmp(command, "putval") == 0) {
+    cmd_handle_putval(fhout, buffer);
+  } else if (strcasecmp(command, "listval") == 0) {
+    cmd_handle_listval(fhout, buffer);
+  } else if (strcasecmp(command, "putnotif") == 0) {
+    handle_putnotif(fhout, buffer);
+  } else if (strcasecmp(command, "flush") == 0) {
+    cmd_handle_flush(fhout, buffer);
+  } else {
+    if (fprintf(fhout, "-1 Unknown command: %s\n", command) < 0) {
+      char errbuf[1024];
+      WARNING("unixsock plugin: failed to write response for socket #%i: %s",
+              conn->fd, sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+  }
+
+  return 0;
+} /* }}} int us_handle_line */
+
+/* FLUSH commands call the flush callbacks of the write plugins, which may take
+ * a long time. */
+static _Bool us_line_is_flush(char const *line) /* {{{ */
+{
+  line += strspn(line, " \t\r\n");
+  if (strncasecmp(line, "flush", strlen("flush")) != 0)
+    return 0;
+  return (line[5] == 0) || (strchr(" \t\r\n", line[5]) != NULL);
+} /* }}} _Bool us_line_is_flush */
+
+/* Selects whether the worker waits for the socket to become writable or
+ * readable. */
+static int us_conn_watch(us_conn_t *conn, _Bool want_write) /* {{{ */
+{
+  if (conn->want_write == want_write)
+    return 0;
+  conn->want_write = want_write;
+
+#if HAVE_SYS_EPOLL_H
+  struct epoll_event ev = {.events = want_write ? EPOLLOUT : EPOLLIN,
+                           .data.ptr = conn};
+  if (epoll_ctl(conn->worker->epoll_fd, EPOLL_CTL_MOD, conn->fd, &ev) != 0) {
     char errbuf[1024];
-    ERROR("unixsock plugin: dup failed: %s",
+    ERROR("unixsock plugin: epoll_ctl failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
-    close(fdin);
-    pthread_exit((void *)1);
+    return -1;
+  }
+#endif
+
+  return 0;
+} /* }}} int us_conn_watch */
+
+/* Writes as much of the pending output as the socket accepts. Returns non-zero
+ * if writing failed. */
+static int us_conn_write(us_conn_t *conn) /* {{{ */
+{
+  while (conn->out_pos < conn->out_len) {
+    ssize_t status = write(conn->fd, conn->out + conn->out_pos,
+                           conn->out_len - conn->out_pos);
+    if (status < 0) {
+      if (errno == EINTR)
+        continue;
+      if ((errno == EAGAIN) || (errno == EWOULDBLOCK))
+        return 0;
+
+      char errbuf[1024];
+      WARNING("unixsock plugin: failed to write to socket #%i: %s", conn->fd,
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    conn->out_pos += (size_t)status;
+  }
+
+  sfree(conn->out);
+  conn->out_len = 0;
+  conn->out_pos = 0;
+  return 0;
+} /* }}} int us_conn_write */
+
+/* Reads the available input into the buffer. Returns non-zero if reading
+ * failed or the line is too long. */
+static int us_conn_read(us_conn_t *conn) /* {{{ */
+{
+  /* Make room for at least one more byte and the terminating null byte. */
+  if ((conn->buffer_fill + 2) > conn->buffer_size) {
+    if (conn->buffer_size >= US_MAX_LINE_LENGTH) {
+      WARNING("unixsock plugin: Line on socket #%i exceeds %d bytes. Closing "
+              "the connection.",
+              conn->fd, US_MAX_LINE_LENGTH);
+      char const *msg = "-1 Line too long\n";
+      if (write(conn->fd, msg, strlen(msg)) < 0)
+        DEBUG("unixsock plugin: Sending the error to socket #%i failed.",
+              conn->fd);
+      return -1;
+    }
+
+    char *tmp = realloc(conn->buffer, 2 * conn->buffer_size);
+    if (tmp == NULL) {
+      ERROR("unixsock plugin: realloc failed.");
+      return -1;
+    }
+    conn->buffer = tmp;
+    conn->buffer_size *= 2;
   }
 
-  fhin = fdopen(fdin, "r");
-  if (fhin == NULL) {
+  ssize_t status = read(conn->fd, conn->buffer + conn->buffer_fill,
+                        conn->buffer_size - conn->buffer_fill - 1);
+  if (status < 0) {
+    if ((errno == EINTR) || (errno == EAGAIN) || (errno == EWOULDBLOCK))
+      return 0;
+
     char errbuf[1024];
-    ERROR("unixsock plugin: fdopen failed: %s",
+    WARNING("unixsock plugin: failed to read from socket #%i: %s", conn->fd,
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+
+  if (status == 0) {
+    DEBUG("unixsock plugin: Client on socket #%i disconnected.", conn->fd);
+    conn->eof = 1;
+  }
+
+  conn->buffer_fill += (size_t)status;
+  conn->buffer[conn->buffer_fill] = 0;
+  return 0;
+} /* }}} int us_conn_read */
+
+/* Handles all complete lines in the buffer and, once the client has closed its
+ * end, the final line. The responses are appended to the pending output. If
+ * "handoff" is true, stops at the first FLUSH command and returns 1. Returns a
+ * negative value if the connection should be closed. */
+static int us_conn_process(us_conn_t *conn, _Bool handoff) /* {{{ */
+{
+  char *data = NULL;
+  size_t data_len = 0;
+
+  FILE *fh = open_memstream(&data, &data_len);
+  if (fh == NULL) {
+    char errbuf[1024];
+    ERROR("unixsock plugin: open_memstream failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
-    close(fdin);
-    close(fdout);
-    pthread_exit((void *)1);
-    return (void *)1;
+    return -1;
+  }
+
+  int ret = 0;
+  char *line = conn->buffer;
+  while ((ret == 0) && (*line != 0)) {
+    char *end = strchr(line, '\n');
+    char *next;
+
+    /* Like fgets(3), treat a final line without newline as a command. */
+    if (end != NULL) {
+      *end = 0;
+      next = end + 1;
+    } else if (conn->eof) {
+      next = line + strlen(line);
+    } else {
+      break;
+    }
+
+    if (handoff && us_line_is_flush(line)) {
+      if (end != NULL)
+        *end = '\n';
+      ret = 1;
+      break;
+    }
+
+    if (us_handle_line(conn, fh, line) != 0)
+      ret = -1;
+    line = next;
   }
 
-  fhout = fdopen(fdout, "w");
-  if (fhout == NULL) {
+  conn->buffer_fill -= (size_t)(line - conn->buffer);
+  memmove(conn->buffer, line, conn->buffer_fill);
+  conn->buffer[conn->buffer_fill] = 0;
+
+  if (fclose(fh) != 0) {
     char errbuf[1024];
-    ERROR("unixsock plugin: fdopen failed: %s",
+    ERROR("unixsock plugin: fclose failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
-    fclose(fhin); /* this closes fdin as well */
-    close(fdout);
-    pthread_exit((void *)1);
-    return (void *)1;
+    sfree(data);
+    return -1;
+  }
+
+  if ((data_len > 0) && (conn->out_len == 0)) {
+    sfree(conn->out);
+    conn->out = data;
+    conn->out_len = data_len;
+    conn->out_pos = 0;
+    return ret;
+  } else if (data_len > 0) {
+    char *tmp = realloc(conn->out, conn->out_len + data_len);
+    if (tmp == NULL) {
+      ERROR("unixsock plugin: realloc failed.");
+      sfree(data);
+      return -1;
+    }
+    memcpy(tmp + conn->out_len, data, data_len);
+    conn->out = tmp;
+    conn->out_len += data_len;
+  }
+
+  sfree(data);
+  return ret;
+} /* }}} int us_conn_process */
+
+/* Handles the remaining commands of a connection which has been handed off by
+ * its worker and gives it back afterwards. */
+static void *us_helper_thread(void *arg) /* {{{ */
+{
+  us_conn_t *conn = arg;
+  us_worker_t *w = conn->worker;
+
+  /* Let the worker write the responses so far and close the connection. */
+  if (us_conn_process(conn, /* handoff = */ 0) != 0) {
+    conn->eof = 1;
+    conn->buffer_fill = 0;
+    conn->buffer[0] = 0;
   }
 
-  /* change output buffer to line buffered mode */
-  if (setvbuf(fhout, NULL, _IOLBF, 0) != 0) {
+  pthread_mutex_lock(&w->lock);
+  conn->busy = 0;
+  conn->want_write = 1;
+#if HAVE_SYS_EPOLL_H
+  struct epoll_event ev = {.events = EPOLLOUT, .data.ptr = conn};
+  if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) != 0) {
     char errbuf[1024];
-    ERROR("unixsock plugin: setvbuf failed: %s",
+    ERROR("unixsock plugin: epoll_ctl failed: %s",
           sstrerror(errno, errbuf, sizeof(errbuf)));
-    fclose(fhin);
-    fclose(fhout);
-    pthread_exit((void *)1);
-    return (void *)0;
   }
+#else
+  if (write(w->wakeup_fd[1], "", 1) < 0) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: Waking up worker failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+  }
+#endif
+  w->helpers_num--;
+  pthread_cond_signal(&w->helpers_cond);
+  pthread_mutex_unlock(&w->lock);
+
+  return (void *)0;
+} /* }}} void *us_helper_thread */
 
-  while (42) {
-    char buffer[1024];
-    char buffer_copy[1024];
-    char *fields[128];
-    int fields_num;
-    int len;
+/* Hands the connection to a thread of its own until its FLUSH command has been
+ * handled, so that the worker's other connections are not blocked. */
+static int us_conn_handoff(us_conn_t *conn) /* {{{ */
+{
+  us_worker_t *w = conn->worker;
 
-    errno = 0;
-    if (fgets(buffer, sizeof(buffer), fhin) == NULL) {
-      if ((errno == EINTR) || (errno == EAGAIN))
-        continue;
+#if HAVE_SYS_EPOLL_H
+  if (epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL) != 0) {
+    char errbuf[1024];
+    ERROR("unixsock plugin: epoll_ctl failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    return -1;
+  }
+#endif
+
+  pthread_mutex_lock(&w->lock);
+  conn->busy = 1;
+  w->helpers_num++;
+  pthread_mutex_unlock(&w->lock);
+
+  pthread_t thread;
+  int status = plugin_thread_create(&thread, NULL, us_helper_thread, conn,
+                                    "unixsock flush");
+  if (status != 0) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: pthread_create failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+    us_helper_thread(conn);
+    return 0;
+  }
+  pthread_detach(thread);
+
+  return 0;
+} /* }}} int us_conn_handoff */
+
+/* Called by the worker when the socket is readable or writable. Returns
+ * non-zero if the connection should be closed. */
+static int us_conn_handle(us_conn_t *conn) /* {{{ */
+{
+  /* Pending responses are written before reading more input, so that clients
+   * which don't read their responses are throttled. */
+  if (us_conn_write(conn) != 0)
+    return -1;
+  if (conn->out_len > 0)
+    return us_conn_watch(conn, /* want_write = */ 1);
 
-      if (errno != 0) {
-        char errbuf[1024];
-        WARNING("unixsock plugin: failed to read from socket #%i: %s",
-                fileno(fhin), sstrerror(errno, errbuf, sizeof(errbuf)));
-      }
+  if (!conn->eof && (us_conn_read(conn) != 0))
+    return -1;
+
+  int status = us_conn_process(conn, /* handoff = */ 1);
+  if (status > 0)
+    return us_conn_handoff(conn);
+
+  if ((us_conn_write(conn) != 0) || (status != 0))
+    return -1;
+  if (conn->out_len > 0)
+    return us_conn_watch(conn, /* want_write = */ 1);
+  if (conn->eof)
+    return -1;
+
+  return us_conn_watch(conn, /* want_write = */ 0);
+} /* }}} int us_conn_handle */
+
+static void us_worker_remove_conn(us_worker_t *w, us_conn_t *conn) /* {{{ */
+{
+  pthread_mutex_lock(&w->lock);
+  for (us_conn_t **ptr = &w->conns; *ptr != NULL; ptr = &(*ptr)->next) {
+    if (*ptr == conn) {
+      *ptr = conn->next;
       break;
     }
+  }
+  pthread_mutex_unlock(&w->lock);
 
-    len = strlen(buffer);
-    while ((len > 0) &&
-           ((buffer[len - 1] == '\n') || (buffer[len - 1] == '\r')))
-      buffer[--len] = '\0';
+#if HAVE_SYS_EPOLL_H
+  epoll_ctl(w->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+#endif
+  us_conn_destroy(conn);
+} /* }}} void us_worker_remove_conn */
 
-    if (len == 0)
-      continue;
+static int us_worker_add_conn(us_worker_t *w, us_conn_t *conn) /* {{{ */
+{
+  conn->worker = w;
 
-    sstrncpy(buffer_copy, buffer, sizeof(buffer_copy));
+  pthread_mutex_lock(&w->lock);
+  conn->next = w->conns;
+  w->conns = conn;
+  pthread_mutex_unlock(&w->lock);
 
-    fields_num =
-        strsplit(buffer_copy, fields, sizeof(fields) / sizeof(fields[0]));
-    if (fields_num < 1) {
-      fprintf(fhout, "-1 Internal error\n");
-      fclose(fhin);
-      fclose(fhout);
-      pthread_exit((void *)1);
-      return (void *)1;
+#if HAVE_SYS_EPOLL_H
+  struct epoll_event ev = {.events = EPOLLIN, .data.ptr = conn};
+  if (epoll_ctl(w->epoll_fd, EPOLL_CTL_ADD, conn->fd, &ev) != 0) {
+    char errbuf[1024];
+    ERROR("unixsock plugin: epoll_ctl failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    us_worker_remove_conn(w, conn);
+    return -1;
+  }
+#else
+  if (write(w->wakeup_fd[1], "", 1) < 0) {
+    char errbuf[1024];
+    WARNING("unixsock plugin: Waking up worker failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+  }
+#endif
+
+  return 0;
+} /* }}} int us_worker_add_conn */
+
+static void *us_worker_thread(void *arg) /* {{{ */
+{
+  us_worker_t *w = arg;
+
+  while (loop != 0) {
+#if HAVE_SYS_EPOLL_H
+    struct epoll_event events[16];
+
+    int num = epoll_wait(w->epoll_fd, events, STATIC_ARRAY_SIZE(events),
+                         /* timeout = */ -1);
+    if (num < 0) {
+      if (errno == EINTR)
+        continue;
+
+      char errbuf[1024];
+      ERROR("unixsock plugin: epoll_wait failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      break;
     }
 
-    if (strcasecmp(fields[0], "getval") == 0) {
-      cmd_handle_getval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "getthreshold") == 0) {
-      handle_getthreshold(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putval") == 0) {
-      cmd_handle_putval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "listval") == 0) {
-      cmd_handle_listval(fhout, buffer);
-    } else if (strcasecmp(fields[0], "putnotif") == 0) {
-      handle_putnotif(fhout, buffer);
-    } else if (strcasecmp(fields[0], "flush") == 0) {
-      cmd_handle_flush(fhout, buffer);
-    } else {
-      if (fprintf(fhout, "-1 Unknown command: %s\n", fields[0]) < 0) {
-        char errbuf[1024];
-        WARNING("unixsock plugin: failed to write to socket #%i: %s",
-                fileno(fhout), sstrerror(errno, errbuf, sizeof(errbuf)));
-        break;
-      }
+    for (int i = 0; i < num; i++) {
+      us_conn_t *conn = events[i].data.ptr;
+      if (us_conn_handle(conn) != 0)
+        us_worker_remove_conn(w, conn);
+    }
+#else
+    struct pollfd *fds;
+    us_conn_t **conns;
+    size_t conns_num = 0;
+
+    /* Only this thread removes connections, so the pointers remain valid
+     * after releasing the lock. Connections handed off to a helper thread are
+     * skipped. */
+    pthread_mutex_lock(&w->lock);
+    for (us_conn_t *conn = w->conns; conn != NULL; conn = conn->next)
+      if (!conn->busy)
+        conns_num++;
+    fds = calloc(conns_num + 1, sizeof(*fds));
+    conns = calloc(conns_num + 1, sizeof(*conns));
+    if ((fds == NULL) || (conns == NULL)) {
+      pthread_mutex_unlock(&w->lock);
+      ERROR("unixsock plugin: calloc failed.");
+      sfree(fds);
+      sfree(conns);
+      break;
+    }
+    fds[0].fd = w->wakeup_fd[0];
+    fds[0].events = POLLIN;
+    size_t i = 1;
+    for (us_conn_t *conn = w->conns; conn != NULL; conn = conn->next) {
+      if (conn->busy)
+        continue;
+      fds[i].fd = conn->fd;
+      fds[i].events = conn->want_write ? POLLOUT : POLLIN;
+      conns[i] = conn;
+      i++;
     }
-  } /* while (fgets) */
+    pthread_mutex_unlock(&w->lock);
 
-  DEBUG("unixsock plugin: us_handle_client: Exiting..");
-  fclose(fhin);
-  fclose(fhout);
+    int num = poll(fds, (nfds_t)(conns_num + 1), /* timeout = */ -1);
+    if ((num < 0) && (errno != EINTR)) {
+      char errbuf[1024];
+      ERROR("unixsock plugin: poll failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      sfree(fds);
+      sfree(conns);
+      break;
+    }
+
+    if ((num > 0) && (fds[0].revents != 0)) {
+      char buffer[64];
+      if (read(w->wakeup_fd[0], buffer, sizeof(buffer)) < 0)
+        DEBUG("unixsock plugin: Draining the wakeup pipe failed.");
+    }
+
+    for (i = 1; (num > 0) && (i <= conns_num); i++) {
+      if (fds[i].revents == 0)
+        continue;
+      if (us_conn_handle(conns[i]) != 0)
+        us_worker_remove_conn(w, conns[i]);
+    }
+
+    sfree(fds);
+    sfree(conns);
+#endif
+  } /* while (loop) */
 
-  pthread_exit((void *)0);
   return (void *)0;
-} /* void *us_handle_client */
+} /* }}} void *us_worker_thread */
+
+static int us_workers_start(void) /* {{{ */
+{
+  workers = calloc(workers_num, sizeof(*workers));
+  if (workers == NULL) {
+    ERROR("unixsock plugin: calloc failed.");
+    return -1;
+  }
+
+  for (size_t i = 0; i < workers_num; i++) {
+    us_worker_t *w = workers + i;
+
+    pthread_mutex_init(&w->lock, /* attr = */ NULL);
+    pthread_cond_init(&w->helpers_cond, /* attr = */ NULL);
+#if HAVE_SYS_EPOLL_H
+    w->epoll_fd = -1;
+#else
+    w->wakeup_fd[0] = w->wakeup_fd[1] = -1;
+#endif
+  }
+
+  for (size_t i = 0; i < workers_num; i++) {
+    us_worker_t *w = workers + i;
+    char errbuf[1024];
+
+#if HAVE_SYS_EPOLL_H
+    w->epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (w->epoll_fd < 0) {
+      ERROR("unixsock plugin: epoll_create1 failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+#else
+    if (pipe(w->wakeup_fd) != 0) {
+      ERROR("unixsock plugin: pipe failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+#endif
+
+    int status = plugin_thread_create(&w->thread, NULL, us_worker_thread, w,
+                                      "unixsock worker");
+    if (status != 0) {
+      ERROR("unixsock plugin: pthread_create failed: %s",
+            sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    w->running = 1;
+  }
+
+  return 0;
+} /* }}} int us_workers_start */
+
+static void us_workers_stop(void) /* {{{ */
+{
+  if (workers == NULL)
+    return;
+
+  for (size_t i = 0; i < workers_num; i++) {
+    us_worker_t *w = workers + i;
+
+    if (w->running) {
+      pthread_kill(w->thread, SIGTERM);
+      pthread_join(w->thread, NULL);
+      w->running = 0;
+    }
+
+    /* Helper threads give their connection back to the worker, so wait for
+     * them before destroying the connections. */
+    pthread_mutex_lock(&w->lock);
+    while (w->helpers_num > 0)
+      pthread_cond_wait(&w->helpers_cond, &w->lock);
+    pthread_mutex_unlock(&w->lock);
+
+    while (w->conns != NULL) {
+      us_conn_t *conn = w->conns;
+      w->conns = conn->next;
+      us_conn_destroy(conn);
+    }
+
+#if HAVE_SYS_EPOLL_H
+    if (w->epoll_fd >= 0)
+      close(w->epoll_fd);
+#else
+    if (w->wakeup_fd[0] >= 0)
+      close(w->wakeup_fd[0]);
+    if (w->wakeup_fd[1] >= 0)
+      close(w->wakeup_fd[1]);
+#endif
+    pthread_cond_destroy(&w->helpers_cond);
+    pthread_mutex_destroy(&w->lock);
+  }
+
+  sfree(workers);
+} /* }}} void us_workers_stop */
 
 static void *us_server_thread(void __attribute__((unused)) * arg) {
   int status;
-  int *remote_fd;
-  pthread_t th;
-  pthread_attr_t th_attr;
-
-  pthread_attr_init(&th_attr);
-  pthread_attr_setdetachstate(&th_attr, PTHREAD_CREATE_DETACHED);
+  size_t next_worker = 0;
 
   if (us_open_socket() != 0)
     pthread_exit((void *)1);
@@ -311,37 +869,21 @@ static void *us_server_thread(void __attribute__((unused)) * arg) {
             sstrerror(errno, errbuf, sizeof(errbuf)));
       close(sock_fd);
       sock_fd = -1;
-      pthread_attr_destroy(&th_attr);
       pthread_exit((void *)1);
     }
 
-    remote_fd = malloc(sizeof(*remote_fd));
-    if (remote_fd == NULL) {
-      char errbuf[1024];
-      WARNING("unixsock plugin: malloc failed: %s",
-              sstrerror(errno, errbuf, sizeof(errbuf)));
-      close(status);
+    us_conn_t *conn = us_conn_create(status);
+    if (conn == NULL)
       continue;
-    }
-    *remote_fd = status;
 
-    DEBUG("Spawning child to handle connection on fd #%i", *remote_fd);
-
-    status = plugin_thread_create(&th, &th_attr, us_handle_client,
-                                  (void *)remote_fd, "unixsock conn");
-    if (status != 0) {
-      char errbuf[1024];
-      WARNING("unixsock plugin: pthread_create failed: %s",
-              sstrerror(errno, errbuf, sizeof(errbuf)));
-      close(*remote_fd);
-      free(remote_fd);
-      continue;
-    }
+    DEBUG("unixsock plugin: Handing connection on fd #%i to worker %zu.",
+          conn->fd, next_worker);
+    us_worker_add_conn(workers + next_worker, conn);
+    next_worker = (next_worker + 1) % workers_num;
   } /* while (loop) */
 
   close(sock_fd);
   sock_fd = -1;
-  pthread_attr_destroy(&th_attr);
 
   status = unlink((sock_file != NULL) ? sock_file : US_DEFAULT_PATH);
   if (status != 0) {
@@ -376,6 +918,13 @@ static int us_config(const char *key, const char *val) {
       delete_socket = 1;
     else
       delete_socket = 0;
+  } else if (strcasecmp(key, "Workers") == 0) {
+    int tmp = atoi(val);
+    if (tmp < 1) {
+      ERROR("unixsock plugin: The \"Workers\" option must be positive.");
+      return 1;
+    }
+    workers_num = (size_t)tmp;
   } else {
     return -1;
   }
@@ -395,6 +944,11 @@ static int us_init(void) {
 
   loop = 1;
 
+  if (us_workers_start() != 0) {
+    us_workers_stop();
+    return -1;
+  }
+
   status = plugin_thread_create(&listen_thread, NULL, us_server_thread, NULL,
                                 "unixsock listen");
   if (status != 0) {
@@ -418,6 +972,8 @@ static int us_shutdown(void) {
     listen_thread = (pthread_t)0;
   }
 
+  us_workers_stop();
+
   plugin_unregister_init("unixsock");
   plugin_unregister_shutdown("unixsock");
 
@@ -0,0 +1,278 @@
+/**
+ * collectd - src/utils_format_bench.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+/* Micro benchmark for the output formatters. The first part compares the
+ * formatting kernels of utils_strbuf with the printf(3) based code they
+ * replace, the second part measures the bytes per second produced by
+ * format_graphite(), format_json_value_list() and format_values() for a mix of
+ * typical value lists.
+ *
+ * Usage: bench_utils_format [<iterations>] */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_format_graphite.h"
+#include "utils_format_json.h"
+#include "utils_strbuf.h"
+
+#define VALUES_NUM 1024
+
+static size_t iterations = 200;
+
+static double values[VALUES_NUM];
+static derive_t derives[VALUES_NUM];
+
+static data_source_t dsrc_gauge[] = {{"value", DS_TYPE_GAUGE, 0.0, NAN}};
+static data_source_t dsrc_derive[] = {{"rx", DS_TYPE_DERIVE, 0.0, NAN},
+                                      {"tx", DS_TYPE_DERIVE, 0.0, NAN}};
+static data_set_t ds_gauge = {"gauge", 1, dsrc_gauge};
+static data_set_t ds_derive = {"if_octets", 2, dsrc_derive};
+
+static double now_wall(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec) / 1e9;
+}
+
+/* The JSON escaping done before utils_strbuf. */
+static int old_json_escape(char *buffer, size_t buffer_size,
+                           const char *string) {
+  size_t dst_pos = 0;
+
+#define BUFFER_ADD(c)                                                          \
+  do {                                                                         \
+    if (dst_pos >= (buffer_size - 1)) {                                        \
+      buffer[buffer_size - 1] = 0;                                             \
+      return -ENOMEM;                                                          \
+    }                                                                          \
+    buffer[dst_pos] = (c);                                                     \
+    dst_pos++;                                                                 \
+  } while (0)
+
+  BUFFER_ADD('"');
+  for (size_t src_pos = 0; string[src_pos] != 0; src_pos++) {
+    if ((string[src_pos] == '"') || (string[src_pos] == '\\')) {
+      BUFFER_ADD('\\');
+      BUFFER_ADD(string[src_pos]);
+    } else if (string[src_pos] <= 0x001F)
+      BUFFER_ADD('?');
+    else
+      BUFFER_ADD(string[src_pos]);
+  }
+  BUFFER_ADD('"');
+  buffer[dst_pos] = 0;
+
+#undef BUFFER_ADD
+
+  return 0;
+}
+
+static char const *strings[] = {
+    "localhost",
+    "www01.dc1.example.com",
+    "interface",
+    "if_octets",
+    "eth0",
+    "/var/lib/postgresql/data \"main\"",
+};
+
+typedef enum {
+  KERNEL_DOUBLE,
+  KERNEL_INT,
+  KERNEL_TIME,
+  KERNEL_JSON,
+} kernel_t;
+
+/* Runs one kernel over all test values and returns the number of bytes
+ * produced. */
+static size_t run_kernel(kernel_t kernel, _Bool use_strbuf) {
+  char buffer[64];
+  size_t bytes = 0;
+
+  for (size_t i = 0; i < VALUES_NUM; i++) {
+    strbuf_t buf;
+    strbuf_init_fixed(&buf, buffer, sizeof(buffer));
+
+    switch (kernel) {
+    case KERNEL_DOUBLE:
+      if (use_strbuf)
+        strbuf_print_double(&buf, values[i]);
+      else
+        ssnprintf(buffer, sizeof(buffer), GAUGE_FORMAT, values[i]);
+      break;
+    case KERNEL_INT:
+      if (use_strbuf)
+        strbuf_print_int(&buf, derives[i]);
+      else
+        ssnprintf(buffer, sizeof(buffer), "%" PRIi64, derives[i]);
+      break;
+    case KERNEL_TIME: {
+      cdtime_t t = TIME_T_TO_CDTIME_T(1480063672) + (cdtime_t)derives[i];
+      if (use_strbuf)
+        strbuf_print_time(&buf, t);
+      else
+        ssnprintf(buffer, sizeof(buffer), "%.3f", CDTIME_T_TO_DOUBLE(t));
+      break;
+    }
+    case KERNEL_JSON: {
+      char const *s = strings[i % STATIC_ARRAY_SIZE(strings)];
+      if (use_strbuf)
+        strbuf_print_json_string(&buf, s);
+      else
+        old_json_escape(buffer, sizeof(buffer), s);
+      break;
+    }
+    }
+
+    bytes += strlen(buffer);
+  }
+
+  return bytes;
+}
+
+static void bench_kernel(char const *name, kernel_t kernel) {
+  double rate[2];
+
+  for (int use_strbuf = 0; use_strbuf < 2; use_strbuf++) {
+    size_t bytes = 0;
+    double start = now_wall();
+
+    for (size_t i = 0; i < 10 * iterations; i++)
+      bytes += run_kernel(kernel, (_Bool)use_strbuf);
+
+    rate[use_strbuf] = (double)bytes / (now_wall() - start);
+  }
+
+  printf("%-14s %10.1f MB/s %10.1f MB/s %6.2fx\n", name, rate[0] / 1e6,
+         rate[1] / 1e6, rate[1] / rate[0]);
+}
+
+typedef enum {
+  FORMAT_GRAPHITE,
+  FORMAT_JSON,
+  FORMAT_VALUES,
+} format_t;
+
+static size_t run_format(format_t format, value_list_t *vl,
+                         data_set_t const *ds) {
+  char buffer[4096];
+  size_t bytes = 0;
+
+  switch (format) {
+  case FORMAT_GRAPHITE:
+    if (format_graphite(buffer, sizeof(buffer), ds, vl, "collectd.", NULL, '_',
+                        0) == 0)
+      bytes = strlen(buffer);
+    break;
+  case FORMAT_JSON: {
+    size_t fill = 0;
+    size_t bfree = sizeof(buffer);
+    format_json_initialize(buffer, &fill, &bfree);
+    if (format_json_value_list(buffer, &fill, &bfree, ds, vl, 0) == 0)
+      bytes = fill;
+    break;
+  }
+  case FORMAT_VALUES:
+    if (format_values(buffer, sizeof(buffer), ds, vl, 0) == 0)
+      bytes = strlen(buffer);
+    break;
+  }
+
+  return bytes;
+}
+
+static void bench_format(char const *name, format_t format) {
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t v[2];
+  size_t bytes = 0;
+  double start;
+
+  sstrncpy(vl.host, "www01.dc1.example.com", sizeof(vl.host));
+  sstrncpy(vl.plugin, "interface", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, "eth0", sizeof(vl.plugin_instance));
+  vl.values = v;
+  vl.interval = TIME_T_TO_CDTIME_T(10);
+
+  start = now_wall();
+  for (size_t r = 0; r < iterations; r++) {
+    for (size_t i = 0; i < VALUES_NUM; i++) {
+      vl.time = TIME_T_TO_CDTIME_T(1480063672) + (cdtime_t)derives[i];
+
+      /* alternating gauges and two-valued derives */
+      if (i % 2) {
+        sstrncpy(vl.type, ds_gauge.type, sizeof(vl.type));
+        v[0].gauge = values[i];
+        vl.values_len = 1;
+        bytes += run_format(format, &vl, &ds_gauge);
+      } else {
+        sstrncpy(vl.type, ds_derive.type, sizeof(vl.type));
+        v[0].derive = derives[i];
+        v[1].derive = derives[(i + 1) % VALUES_NUM];
+        vl.values_len = 2;
+        bytes += run_format(format, &vl, &ds_derive);
+      }
+    }
+  }
+
+  double elapsed = now_wall() - start;
+  printf("%-14s %10.1f MB/s %10.0f value lists/s\n", name,
+         (double)bytes / elapsed / 1e6,
+         (double)(iterations * VALUES_NUM) / elapsed);
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1)
+    iterations = (size_t)atol(argv[1]);
+  if (iterations < 1) {
+    fprintf(stderr, "Usage: %s [<iterations>]\n", argv[0]);
+    return 1;
+  }
+
+  /* Mostly values with few digits, as reported by the read plugins, and some
+   * results of divisions. */
+  srand(42);
+  for (size_t i = 0; i < VALUES_NUM; i++) {
+    derives[i] = (derive_t)rand() * 1000 + rand() % 1000;
+    if (i % 4 == 3)
+      values[i] = (double)rand() / (double)(rand() + 1);
+    else
+      values[i] = (double)(rand() % 100000) / 100.0;
+  }
+
+  printf("kernel          printf/loop      strbuf\n");
+  bench_kernel("double", KERNEL_DOUBLE);
+  bench_kernel("integer", KERNEL_INT);
+  bench_kernel("time", KERNEL_TIME);
+  bench_kernel("json string", KERNEL_JSON);
+
+  printf("\nformatter\n");
+  bench_format("graphite", FORMAT_GRAPHITE);
+  bench_format("json", FORMAT_JSON);
+  bench_format("values", FORMAT_VALUES);
+
+  return 0;
+}
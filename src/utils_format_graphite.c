@@ -34,73 +34,35 @@
 /* Utils functions to format data sets in graphite format.
  * Largely taken from write_graphite.c as it remains the same formatting */
 
-static int gr_format_values(char *ret, size_t ret_len, int ds_num,
-                            const data_set_t *ds, const value_list_t *vl,
-                            gauge_t const *rates) {
-  size_t offset = 0;
-  int status;
-
+static int gr_format_values(strbuf_t *buf, int ds_num, const data_set_t *ds,
+                            const value_list_t *vl, gauge_t const *rates) {
   assert(0 == strcmp(ds->type, vl->type));
 
-  memset(ret, 0, ret_len);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = ssnprintf(ret + offset, ret_len - offset, __VA_ARGS__);           \
-    if (status < 1) {                                                          \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (ret_len - offset)) {                       \
-      return -1;                                                               \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  if (ds->ds[ds_num].type == DS_TYPE_GAUGE)
-    BUFFER_ADD(GAUGE_FORMAT, vl->values[ds_num].gauge);
-  else if (rates != NULL)
-    BUFFER_ADD("%f", rates[ds_num]);
-  else if (ds->ds[ds_num].type == DS_TYPE_COUNTER)
-    BUFFER_ADD("%llu", vl->values[ds_num].counter);
-  else if (ds->ds[ds_num].type == DS_TYPE_DERIVE)
-    BUFFER_ADD("%" PRIi64, vl->values[ds_num].derive);
-  else if (ds->ds[ds_num].type == DS_TYPE_ABSOLUTE)
-    BUFFER_ADD("%" PRIu64, vl->values[ds_num].absolute);
-  else {
-    ERROR("gr_format_values plugin: Unknown data source type: %i",
-          ds->ds[ds_num].type);
-    return -1;
-  }
-
-#undef BUFFER_ADD
+  if ((ds->ds[ds_num].type != DS_TYPE_GAUGE) && (rates != NULL))
+    return strbuf_print_double(buf, rates[ds_num]);
 
-  return 0;
+  return format_value(buf, ds->ds[ds_num].type, vl->values[ds_num]);
 }
 
 static void gr_copy_escape_part(char *dst, const char *src, size_t dst_len,
-                                char escape_char, _Bool preserve_separator) {
-  memset(dst, 0, dst_len);
+                                char escape_char,
+                                strbuf_charset_t const *reject) {
+  strbuf_t buf;
 
+  strbuf_init_fixed(&buf, dst, dst_len);
   if (src == NULL)
     return;
 
-  for (size_t i = 0; i < dst_len; i++) {
-    if (src[i] == 0) {
-      dst[i] = 0;
-      break;
-    }
-
-    if ((!preserve_separator && (src[i] == '.')) || isspace((int)src[i]) ||
-        iscntrl((int)src[i]))
-      dst[i] = escape_char;
-    else
-      dst[i] = src[i];
-  }
+  /* The parts are shorter than DATA_MAX_NAME_LEN, so this cannot fail. */
+  strbuf_print_replaced(&buf, src, reject, escape_char);
 }
 
-static int gr_format_name(char *ret, int ret_len, value_list_t const *vl,
+static int gr_format_name(strbuf_t *buf, value_list_t const *vl,
                           char const *ds_name, char const *prefix,
                           char const *postfix, char const escape_char,
                           unsigned int flags) {
+  strbuf_charset_t part_reject;
+  strbuf_charset_t reject;
   char n_host[DATA_MAX_NAME_LEN];
   char n_plugin[DATA_MAX_NAME_LEN];
   char n_plugin_instance[DATA_MAX_NAME_LEN];
@@ -116,60 +78,68 @@ static int gr_format_name(char *ret, int ret_len, value_list_t const *vl,
   if (postfix == NULL)
     postfix = "";
 
-  _Bool preserve_separator = (flags & GRAPHITE_PRESERVE_SEPARATOR) ? 1 : 0;
+  char separator = (flags & GRAPHITE_SEPARATE_INSTANCES) ? '.' : '-';
+
+  /* White space and control characters are replaced in the identifier parts,
+   * and so is the separator unless it is to be preserved. */
+  strbuf_charset_init(&part_reject, " ");
+  for (unsigned char c = 0x01; c < 0x20; c++)
+    strbuf_charset_add(&part_reject, c);
+  strbuf_charset_add(&part_reject, 0x7f);
+  if (!(flags & GRAPHITE_PRESERVE_SEPARATOR))
+    strbuf_charset_add(&part_reject, '.');
 
   gr_copy_escape_part(n_host, vl->host, sizeof(n_host), escape_char,
-                      preserve_separator);
+                      &part_reject);
   gr_copy_escape_part(n_plugin, vl->plugin, sizeof(n_plugin), escape_char,
-                      preserve_separator);
+                      &part_reject);
   gr_copy_escape_part(n_plugin_instance, vl->plugin_instance,
-                      sizeof(n_plugin_instance), escape_char,
-                      preserve_separator);
+                      sizeof(n_plugin_instance), escape_char, &part_reject);
   gr_copy_escape_part(n_type, vl->type, sizeof(n_type), escape_char,
-                      preserve_separator);
+                      &part_reject);
   gr_copy_escape_part(n_type_instance, vl->type_instance,
-                      sizeof(n_type_instance), escape_char, preserve_separator);
-
-  if (n_plugin_instance[0] != '\0')
-    ssnprintf(tmp_plugin, sizeof(tmp_plugin), "%s%c%s", n_plugin,
-              (flags & GRAPHITE_SEPARATE_INSTANCES) ? '.' : '-',
-              n_plugin_instance);
-  else
-    sstrncpy(tmp_plugin, n_plugin, sizeof(tmp_plugin));
+                      sizeof(n_type_instance), escape_char, &part_reject);
+
+  strbuf_t tmp;
+  strbuf_init_fixed(&tmp, tmp_plugin, sizeof(tmp_plugin));
+  strbuf_print(&tmp, n_plugin);
+  if (n_plugin_instance[0] != '\0') {
+    strbuf_printn(&tmp, &separator, 1);
+    strbuf_print(&tmp, n_plugin_instance);
+  }
 
+  strbuf_init_fixed(&tmp, tmp_type, sizeof(tmp_type));
   if (n_type_instance[0] != '\0') {
-    if ((flags & GRAPHITE_DROP_DUPE_FIELDS) && strcmp(n_plugin, n_type) == 0)
-      sstrncpy(tmp_type, n_type_instance, sizeof(tmp_type));
-    else
-      ssnprintf(tmp_type, sizeof(tmp_type), "%s%c%s", n_type,
-                (flags & GRAPHITE_SEPARATE_INSTANCES) ? '.' : '-',
-                n_type_instance);
+    if (!(flags & GRAPHITE_DROP_DUPE_FIELDS) || strcmp(n_plugin, n_type) != 0) {
+      strbuf_print(&tmp, n_type);
+      strbuf_printn(&tmp, &separator, 1);
+    }
+    strbuf_print(&tmp, n_type_instance);
   } else
-    sstrncpy(tmp_type, n_type, sizeof(tmp_type));
+    strbuf_print(&tmp, n_type);
 
   /* Assert always_append_ds -> ds_name */
   assert(!(flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds_name != NULL));
-  if (ds_name != NULL) {
-    if ((flags & GRAPHITE_DROP_DUPE_FIELDS) &&
-        strcmp(tmp_plugin, tmp_type) == 0)
-      ssnprintf(ret, ret_len, "%s%s%s.%s.%s", prefix, n_host, postfix,
-                tmp_plugin, ds_name);
-    else
-      ssnprintf(ret, ret_len, "%s%s%s.%s.%s.%s", prefix, n_host, postfix,
-                tmp_plugin, tmp_type, ds_name);
-  } else
-    ssnprintf(ret, ret_len, "%s%s%s.%s.%s", prefix, n_host, postfix, tmp_plugin,
-              tmp_type);
-
-  return 0;
-}
 
-static void escape_graphite_string(char *buffer, char escape_char) {
-  assert(strchr(GRAPHITE_FORBIDDEN, escape_char) == NULL);
+  /* Escape the characters graphite does not accept in the whole name. */
+  strbuf_charset_init(&reject, GRAPHITE_FORBIDDEN);
+  int status = 0;
+  status |= strbuf_print_replaced(buf, prefix, &reject, escape_char);
+  status |= strbuf_print_replaced(buf, n_host, &reject, escape_char);
+  status |= strbuf_print_replaced(buf, postfix, &reject, escape_char);
+  status |= strbuf_print(buf, ".");
+  status |= strbuf_print_replaced(buf, tmp_plugin, &reject, escape_char);
+  if ((ds_name == NULL) || !(flags & GRAPHITE_DROP_DUPE_FIELDS) ||
+      (strcmp(tmp_plugin, tmp_type) != 0)) {
+    status |= strbuf_print(buf, ".");
+    status |= strbuf_print_replaced(buf, tmp_type, &reject, escape_char);
+  }
+  if (ds_name != NULL) {
+    status |= strbuf_print(buf, ".");
+    status |= strbuf_print_replaced(buf, ds_name, &reject, escape_char);
+  }
 
-  for (char *head = buffer + strcspn(buffer, GRAPHITE_FORBIDDEN); *head != '\0';
-       head += strcspn(head, GRAPHITE_FORBIDDEN))
-    *head = escape_char;
+  return status;
 }
 
 int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
@@ -177,68 +147,48 @@ int format_graphite(char *buffer, size_t buffer_size, data_set_t const *ds,
                     char const *postfix, char const escape_char,
                     unsigned int flags) {
   int status = 0;
-  int buffer_pos = 0;
+  strbuf_t buf;
+
+  assert(strchr(GRAPHITE_FORBIDDEN, escape_char) == NULL);
+
+  /* Rates are only looked up if there is a data source to use them for. */
+  _Bool have_rates = 0;
+  for (size_t i = 0; (flags & GRAPHITE_STORE_RATES) && (i < ds->ds_num); i++)
+    if (ds->ds[i].type != DS_TYPE_GAUGE)
+      have_rates = 1;
 
-  gauge_t *rates = NULL;
-  if (flags & GRAPHITE_STORE_RATES) {
-    rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      ERROR("format_graphite: error with uc_get_rate");
+  gauge_t rates[ds->ds_num];
+  if (have_rates) {
+    if (uc_get_rates(ds, vl, rates) != 0) {
+      ERROR("format_graphite: error with uc_get_rates");
       return -1;
     }
   }
 
+  strbuf_init_fixed(&buf, buffer, buffer_size);
+
   for (size_t i = 0; i < ds->ds_num; i++) {
     char const *ds_name = NULL;
-    char key[10 * DATA_MAX_NAME_LEN];
-    char values[512];
-    size_t message_len;
-    char message[1024];
+    size_t line_start = buf.pos;
 
     if ((flags & GRAPHITE_ALWAYS_APPEND_DS) || (ds->ds_num > 1))
       ds_name = ds->ds[i].name;
 
-    /* Copy the identifier to `key' and escape it. */
-    status = gr_format_name(key, sizeof(key), vl, ds_name, prefix, postfix,
-                            escape_char, flags);
-    if (status != 0) {
-      ERROR("format_graphite: error with gr_format_name");
-      sfree(rates);
-      return status;
-    }
-
-    escape_graphite_string(key, escape_char);
-    /* Convert the values to an ASCII representation and put that into
-     * `values'. */
-    status = gr_format_values(values, sizeof(values), i, ds, vl, rates);
-    if (status != 0) {
-      ERROR("format_graphite: error with gr_format_values");
-      sfree(rates);
-      return status;
-    }
-
     /* Compute the graphite command */
-    message_len =
-        (size_t)ssnprintf(message, sizeof(message), "%s %s %u\r\n", key, values,
-                          (unsigned int)CDTIME_T_TO_TIME_T(vl->time));
-    if (message_len >= sizeof(message)) {
-      ERROR("format_graphite: message buffer too small: "
-            "Need %zu bytes.",
-            message_len + 1);
-      sfree(rates);
-      return -ENOMEM;
-    }
-
-    /* Append it in case we got multiple data set */
-    if ((buffer_pos + message_len) >= buffer_size) {
+    status = gr_format_name(&buf, vl, ds_name, prefix, postfix, escape_char,
+                            flags);
+    status |= strbuf_print(&buf, " ");
+    status |= gr_format_values(&buf, i, ds, vl, have_rates ? rates : NULL);
+    status |= strbuf_print(&buf, " ");
+    status |= strbuf_print_uint(&buf, (uint64_t)CDTIME_T_TO_TIME_T(vl->time));
+    status |= strbuf_print(&buf, "\r\n");
+    if (status != 0) {
       ERROR("format_graphite: target buffer too small");
-      sfree(rates);
+      if (buffer_size > 0)
+        buffer[line_start] = '\0';
       return -ENOMEM;
     }
-    memcpy((void *)(buffer + buffer_pos), message, message_len);
-    buffer_pos += message_len;
-    buffer[buffer_pos] = '\0';
   }
-  sfree(rates);
+
   return status;
 } /* int format_graphite */
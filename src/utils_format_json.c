@@ -43,262 +43,164 @@
 #endif
 #endif
 
-static int json_escape_string(char *buffer, size_t buffer_size, /* {{{ */
-                              const char *string) {
-  size_t dst_pos;
-
-  if ((buffer == NULL) || (string == NULL))
-    return -EINVAL;
-
-  if (buffer_size < 3)
-    return -ENOMEM;
-
-  dst_pos = 0;
-
-#define BUFFER_ADD(c)                                                          \
-  do {                                                                         \
-    if (dst_pos >= (buffer_size - 1)) {                                        \
-      buffer[buffer_size - 1] = 0;                                             \
-      return -ENOMEM;                                                          \
-    }                                                                          \
-    buffer[dst_pos] = (c);                                                     \
-    dst_pos++;                                                                 \
-  } while (0)
-
-  /* Escape special characters */
-  BUFFER_ADD('"');
-  for (size_t src_pos = 0; string[src_pos] != 0; src_pos++) {
-    if ((string[src_pos] == '"') || (string[src_pos] == '\\')) {
-      BUFFER_ADD('\\');
-      BUFFER_ADD(string[src_pos]);
-    } else if (string[src_pos] <= 0x001F)
-      BUFFER_ADD('?');
-    else
-      BUFFER_ADD(string[src_pos]);
-  } /* for */
-  BUFFER_ADD('"');
-  buffer[dst_pos] = 0;
-
-#undef BUFFER_ADD
-
-  return 0;
-} /* }}} int json_escape_string */
-
-static int values_to_json(char *buffer, size_t buffer_size, /* {{{ */
+static int values_to_json(strbuf_t *buf, /* {{{ */
                           const data_set_t *ds, const value_list_t *vl,
                           int store_rates) {
-  size_t offset = 0;
-  gauge_t *rates = NULL;
-
-  memset(buffer, 0, buffer_size);
+  gauge_t rates[ds->ds_num];
+  _Bool have_rates = 0;
+  int status = 0;
 
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = ssnprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);    \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (buffer_size - offset)) {                   \
-      sfree(rates);                                                            \
-      return -ENOMEM;                                                          \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  BUFFER_ADD("[");
+  status |= strbuf_print(buf, "[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
+      status |= strbuf_print(buf, ",");
 
     if (ds->ds[i].type == DS_TYPE_GAUGE) {
       if (isfinite(vl->values[i].gauge))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, vl->values[i].gauge);
+        status |= strbuf_print_double(buf, vl->values[i].gauge);
       else
-        BUFFER_ADD("null");
+        status |= strbuf_print(buf, "null");
     } else if (store_rates) {
-      if (rates == NULL)
-        rates = uc_get_rate(ds, vl);
-      if (rates == NULL) {
-        WARNING("utils_format_json: uc_get_rate failed.");
-        sfree(rates);
+      if (!have_rates && (uc_get_rates(ds, vl, rates) != 0)) {
+        WARNING("utils_format_json: uc_get_rates failed.");
         return -1;
       }
+      have_rates = 1;
 
       if (isfinite(rates[i]))
-        BUFFER_ADD(JSON_GAUGE_FORMAT, rates[i]);
+        status |= strbuf_print_double(buf, rates[i]);
       else
-        BUFFER_ADD("null");
-    } else if (ds->ds[i].type == DS_TYPE_COUNTER)
-      BUFFER_ADD("%llu", vl->values[i].counter);
-    else if (ds->ds[i].type == DS_TYPE_DERIVE)
-      BUFFER_ADD("%" PRIi64, vl->values[i].derive);
-    else if (ds->ds[i].type == DS_TYPE_ABSOLUTE)
-      BUFFER_ADD("%" PRIu64, vl->values[i].absolute);
-    else {
-      ERROR("format_json: Unknown data source type: %i", ds->ds[i].type);
-      sfree(rates);
-      return -1;
+        status |= strbuf_print(buf, "null");
+    } else {
+      int ret = format_value(buf, ds->ds[i].type, vl->values[i]);
+      if (ret != 0)
+        return -ret;
     }
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
+  status |= strbuf_print(buf, "]");
 
-#undef BUFFER_ADD
-
-  DEBUG("format_json: values_to_json: buffer = %s;", buffer);
-  sfree(rates);
-  return 0;
+  return (status == 0) ? 0 : -ENOMEM;
 } /* }}} int values_to_json */
 
-static int dstypes_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = ssnprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);    \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+static int dstypes_to_json(strbuf_t *buf, const data_set_t *ds) /* {{{ */
+{
+  int status = 0;
 
-  BUFFER_ADD("[");
+  status |= strbuf_print(buf, "[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
+      status |= strbuf_print(buf, ",");
 
-    BUFFER_ADD("\"%s\"", DS_TYPE_TO_STRING(ds->ds[i].type));
+    status |= strbuf_print(buf, "\"");
+    status |= strbuf_print(buf, DS_TYPE_TO_STRING(ds->ds[i].type));
+    status |= strbuf_print(buf, "\"");
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
+  status |= strbuf_print(buf, "]");
 
-#undef BUFFER_ADD
-
-  DEBUG("format_json: dstypes_to_json: buffer = %s;", buffer);
-
-  return 0;
+  return (status == 0) ? 0 : -ENOMEM;
 } /* }}} int dstypes_to_json */
 
-static int dsnames_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                           const data_set_t *ds) {
-  size_t offset = 0;
-
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    int status;                                                                \
-    status = ssnprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);    \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+static int dsnames_to_json(strbuf_t *buf, const data_set_t *ds) /* {{{ */
+{
+  int status = 0;
 
-  BUFFER_ADD("[");
+  status |= strbuf_print(buf, "[");
   for (size_t i = 0; i < ds->ds_num; i++) {
     if (i > 0)
-      BUFFER_ADD(",");
+      status |= strbuf_print(buf, ",");
 
-    BUFFER_ADD("\"%s\"", ds->ds[i].name);
+    status |= strbuf_print(buf, "\"");
+    status |= strbuf_print(buf, ds->ds[i].name);
+    status |= strbuf_print(buf, "\"");
   } /* for ds->ds_num */
-  BUFFER_ADD("]");
-
-#undef BUFFER_ADD
+  status |= strbuf_print(buf, "]");
 
-  DEBUG("format_json: dsnames_to_json: buffer = %s;", buffer);
-
-  return 0;
+  return (status == 0) ? 0 : -ENOMEM;
 } /* }}} int dsnames_to_json */
 
-static int meta_data_keys_to_json(char *buffer, size_t buffer_size, /* {{{ */
+static int meta_data_keys_to_json(strbuf_t *buf, /* {{{ */
                                   meta_data_t *meta, char **keys,
                                   size_t keys_num) {
-  size_t offset = 0;
-  int status;
-
-  buffer[0] = 0;
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = ssnprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);    \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
+  size_t start = buf->pos;
+  int status = 0;
 
   for (size_t i = 0; i < keys_num; ++i) {
     int type;
     char *key = keys[i];
 
+#define BUFFER_ADD_KEY()                                                       \
+  do {                                                                         \
+    status |= strbuf_print(buf, ",\"");                                        \
+    status |= strbuf_print(buf, key);                                          \
+    status |= strbuf_print(buf, "\":");                                        \
+  } while (0)
+
     type = meta_data_type(meta, key);
     if (type == MD_TYPE_STRING) {
       char *value = NULL;
       if (meta_data_get_string(meta, key, &value) == 0) {
-        char temp[512] = "";
-
-        status = json_escape_string(temp, sizeof(temp), value);
+        BUFFER_ADD_KEY();
+        status |= strbuf_print_json_string(buf, value);
         sfree(value);
-        if (status != 0)
-          return status;
-
-        BUFFER_ADD(",\"%s\":%s", key, temp);
       }
     } else if (type == MD_TYPE_SIGNED_INT) {
       int64_t value = 0;
-      if (meta_data_get_signed_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIi64, key, value);
+      if (meta_data_get_signed_int(meta, key, &value) == 0) {
+        BUFFER_ADD_KEY();
+        status |= strbuf_print_int(buf, value);
+      }
     } else if (type == MD_TYPE_UNSIGNED_INT) {
       uint64_t value = 0;
-      if (meta_data_get_unsigned_int(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%" PRIu64, key, value);
+      if (meta_data_get_unsigned_int(meta, key, &value) == 0) {
+        BUFFER_ADD_KEY();
+        status |= strbuf_print_uint(buf, value);
+      }
     } else if (type == MD_TYPE_DOUBLE) {
       double value = 0.0;
-      if (meta_data_get_double(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%f", key, value);
+      if (meta_data_get_double(meta, key, &value) == 0) {
+        BUFFER_ADD_KEY();
+        status |= strbuf_printf(buf, "%f", value);
+      }
     } else if (type == MD_TYPE_BOOLEAN) {
       _Bool value = 0;
-      if (meta_data_get_boolean(meta, key, &value) == 0)
-        BUFFER_ADD(",\"%s\":%s", key, value ? "true" : "false");
+      if (meta_data_get_boolean(meta, key, &value) == 0) {
+        BUFFER_ADD_KEY();
+        status |= strbuf_print(buf, value ? "true" : "false");
+      }
     }
+
+#undef BUFFER_ADD_KEY
   } /* for (keys) */
 
-  if (offset == 0)
+  if (status != 0)
+    return -ENOMEM;
+  if (buf->pos == start)
     return ENOENT;
 
-  buffer[0] = '{'; /* replace leading ',' */
-  BUFFER_ADD("}");
-
-#undef BUFFER_ADD
+  buf->ptr[start] = '{'; /* replace leading ',' */
+  if (strbuf_print(buf, "}") != 0)
+    return -ENOMEM;
 
   return 0;
 } /* }}} int meta_data_keys_to_json */
 
-static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
-                             meta_data_t *meta) {
+static int meta_data_to_json(strbuf_t *buf, meta_data_t *meta) /* {{{ */
+{
   char **keys = NULL;
   size_t keys_num;
   int status;
 
-  if ((buffer == NULL) || (buffer_size == 0) || (meta == NULL))
+  if ((buf == NULL) || (meta == NULL))
     return EINVAL;
 
   status = meta_data_toc(meta, &keys);
-  if (status <= 0)
+  if (status < 0)
     return status;
+  if (status == 0)
+    return ENOENT;
   keys_num = (size_t)status;
 
-  status = meta_data_keys_to_json(buffer, buffer_size, meta, keys, keys_num);
+  status = meta_data_keys_to_json(buf, meta, keys, keys_num);
 
   for (size_t i = 0; i < keys_num; ++i)
     sfree(keys[i]);
@@ -307,54 +209,42 @@ static int meta_data_to_json(char *buffer, size_t buffer_size, /* {{{ */
   return status;
 } /* }}} int meta_data_to_json */
 
-static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
+static int value_list_to_json(strbuf_t *buf, /* {{{ */
                               const data_set_t *ds, const value_list_t *vl,
                               int store_rates) {
-  char temp[512];
-  size_t offset = 0;
   int status;
 
-  memset(buffer, 0, buffer_size);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = ssnprintf(buffer + offset, buffer_size - offset, __VA_ARGS__);    \
-    if (status < 1)                                                            \
-      return -1;                                                               \
-    else if (((size_t)status) >= (buffer_size - offset))                       \
-      return -ENOMEM;                                                          \
-    else                                                                       \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
   /* All value lists have a leading comma. The first one will be replaced with
    * a square bracket in `format_json_finalize'. */
-  BUFFER_ADD(",{");
+  if (strbuf_print(buf, ",{\"values\":") != 0)
+    return -ENOMEM;
 
-  status = values_to_json(temp, sizeof(temp), ds, vl, store_rates);
+  status = values_to_json(buf, ds, vl, store_rates);
   if (status != 0)
     return status;
-  BUFFER_ADD("\"values\":%s", temp);
 
-  status = dstypes_to_json(temp, sizeof(temp), ds);
+  if (strbuf_print(buf, ",\"dstypes\":") != 0)
+    return -ENOMEM;
+  status = dstypes_to_json(buf, ds);
   if (status != 0)
     return status;
-  BUFFER_ADD(",\"dstypes\":%s", temp);
 
-  status = dsnames_to_json(temp, sizeof(temp), ds);
+  if (strbuf_print(buf, ",\"dsnames\":") != 0)
+    return -ENOMEM;
+  status = dsnames_to_json(buf, ds);
   if (status != 0)
     return status;
-  BUFFER_ADD(",\"dsnames\":%s", temp);
 
-  BUFFER_ADD(",\"time\":%.3f", CDTIME_T_TO_DOUBLE(vl->time));
-  BUFFER_ADD(",\"interval\":%.3f", CDTIME_T_TO_DOUBLE(vl->interval));
+  status = 0;
+  status |= strbuf_print(buf, ",\"time\":");
+  status |= strbuf_print_time(buf, vl->time);
+  status |= strbuf_print(buf, ",\"interval\":");
+  status |= strbuf_print_time(buf, vl->interval);
 
 #define BUFFER_ADD_KEYVAL(key, value)                                          \
   do {                                                                         \
-    status = json_escape_string(temp, sizeof(temp), (value));                  \
-    if (status != 0)                                                           \
-      return status;                                                           \
-    BUFFER_ADD(",\"%s\":%s", (key), temp);                                     \
+    status |= strbuf_print(buf, ",\"" key "\":");                              \
+    status |= strbuf_print_json_string(buf, (value));                          \
   } while (0)
 
   BUFFER_ADD_KEYVAL("host", vl->host);
@@ -363,22 +253,30 @@ static int value_list_to_json(char *buffer, size_t buffer_size, /* {{{ */
   BUFFER_ADD_KEYVAL("type", vl->type);
   BUFFER_ADD_KEYVAL("type_instance", vl->type_instance);
 
+#undef BUFFER_ADD_KEYVAL
+
+  if (status != 0)
+    return -ENOMEM;
+
   if (vl->meta != NULL) {
-    char meta_buffer[buffer_size];
-    memset(meta_buffer, 0, sizeof(meta_buffer));
-    status = meta_data_to_json(meta_buffer, sizeof(meta_buffer), vl->meta);
-    if (status != 0)
-      return status;
+    size_t pos = buf->pos;
 
-    BUFFER_ADD(",\"meta\":%s", meta_buffer);
-  } /* if (vl->meta != NULL) */
+    if (strbuf_print(buf, ",\"meta\":") != 0)
+      return -ENOMEM;
 
-  BUFFER_ADD("}");
+    status = meta_data_to_json(buf, vl->meta);
+    if (status == ENOENT) {
+      /* no meta data which can be represented */
+      buf->pos = pos;
+      buf->ptr[pos] = 0;
+    } else if (status != 0)
+      return status;
+  } /* if (vl->meta != NULL) */
 
-#undef BUFFER_ADD_KEYVAL
-#undef BUFFER_ADD
+  if (strbuf_print(buf, "}") != 0)
+    return -ENOMEM;
 
-  DEBUG("format_json: value_list_to_json: buffer = %s;", buffer);
+  DEBUG("format_json: value_list_to_json: buffer = %s;", buf->ptr);
 
   return 0;
 } /* }}} int value_list_to_json */
@@ -389,17 +287,20 @@ static int format_json_value_list_nocheck(char *buffer, /* {{{ */
                                           const data_set_t *ds,
                                           const value_list_t *vl,
                                           int store_rates, size_t temp_size) {
-  char temp[temp_size];
+  strbuf_t buf;
   int status;
 
-  status = value_list_to_json(temp, sizeof(temp), ds, vl, store_rates);
-  if (status != 0)
+  /* Format directly into the free part of the buffer. On failure, the
+   * partially written value list is cut off again. */
+  strbuf_init_fixed(&buf, buffer + (*ret_buffer_fill), temp_size);
+  status = value_list_to_json(&buf, ds, vl, store_rates);
+  if (status != 0) {
+    buffer[*ret_buffer_fill] = 0;
     return status;
-  temp_size = strlen(temp);
+  }
 
-  memcpy(buffer + (*ret_buffer_fill), temp, temp_size + 1);
-  (*ret_buffer_fill) += temp_size;
-  (*ret_buffer_free) -= temp_size;
+  (*ret_buffer_fill) += buf.pos;
+  (*ret_buffer_free) -= buf.pos;
 
   return 0;
 } /* }}} int format_json_value_list_nocheck */
@@ -422,7 +323,7 @@ int format_json_initialize(char *buffer, /* {{{ */
   if (buffer_free < 3)
     return -ENOMEM;
 
-  memset(buffer, 0, buffer_free);
+  buffer[0] = 0;
   *ret_buffer_fill = buffer_fill;
   *ret_buffer_free = buffer_free;
 
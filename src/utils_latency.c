@@ -37,10 +37,31 @@
 #define LLONG_MAX 9223372036854775807LL
 #endif
 
-#ifndef HISTOGRAM_DEFAULT_BIN_WIDTH
-/* 1048576 = 2^20 ^= 1/1024 s */
-#define HISTOGRAM_DEFAULT_BIN_WIDTH 1048576
-#endif
+/*
+ * The histogram is log-linear, similar to HdrHistogram: the range of possible
+ * latencies is split into "octaves", i.e. powers of two, and each octave is
+ * split into SUB_BUCKETS_NUM buckets of equal width. The width of a bucket is
+ * therefore proportional to the latencies it holds, so the relative error is
+ * at most 1/SUB_BUCKETS_NUM (< 1%) regardless of the magnitude of the values.
+ *
+ * Latencies below 2^UNIT_BITS (~1 us) are not distinguished; the first octave
+ * is linear with a bucket width of 2^UNIT_BITS.
+ *
+ * Like before, buckets have an exclusive lower bound and an inclusive upper
+ * bound, i.e. a latency of exactly 1.0 ms is in the bucket "(x, 1.0 ms]". This
+ * is achieved by sorting (latency - 1) into the buckets.
+ *
+ * The counts of one octave are allocated when the first latency in that
+ * octave is added. Typical distributions span only a few octaves, so this
+ * keeps the memory footprint small, while adding a value remains O(1) and
+ * merging is proportional to the number of allocated octaves.
+ */
+#define UNIT_BITS 10
+#define SUB_BUCKET_BITS 7
+#define SUB_BUCKETS_NUM (1 << SUB_BUCKET_BITS)
+/* (LLONG_MAX - 1) >> UNIT_BITS has 53 significant bits, i.e. it is sorted into
+ * octave 53 - SUB_BUCKET_BITS. */
+#define OCTAVES_NUM (64 - UNIT_BITS - SUB_BUCKET_BITS)
 
 struct latency_counter_s {
   cdtime_t start_time;
@@ -51,67 +72,48 @@ struct latency_counter_s {
   cdtime_t min;
   cdtime_t max;
 
-  cdtime_t bin_width;
-  int histogram[HISTOGRAM_NUM_BINS];
+  uint32_t *octaves[OCTAVES_NUM];
 };
 
-/*
-* Histogram represents the distribution of data, it has a list of "bins".
-* Each bin represents an interval and has a count (frequency) of
-* number of values fall within its interval.
-*
-* Histogram's range is determined by the number of bins and the bin width,
-* There are 1000 bins and all bins have the same width of default 1 millisecond.
-* When a value above this range is added, Histogram's range is increased by
-* increasing the bin width (note that number of bins remains always at 1000).
-* This operation of increasing bin width is little expensive as each bin need
-* to be visited to update it's count. To reduce frequent change of bin width,
-* new bin width will be the next nearest power of 2. Example: 2, 4, 8, 16, 32,
-* 64, 128, 256, 512, 1024, 2048, 5086, ...
-*
-* So, if the required bin width is 300, then new bin width will be 512 as it is
-* the next nearest power of 2.
-*/
-static void change_bin_width(latency_counter_t *lc, cdtime_t latency) /* {{{ */
+static int msb64(uint64_t x) /* {{{ */
 {
-  /* This function is called because the new value is above histogram's range.
-   * First find the required bin width:
-   *           requiredBinWidth = (value + 1) / numBins
-   * then get the next nearest power of 2
-   *           newBinWidth = 2^(ceil(log2(requiredBinWidth)))
-   */
-  double required_bin_width =
-      ((double)(latency + 1)) / ((double)HISTOGRAM_NUM_BINS);
-  double required_bin_width_logbase2 = log(required_bin_width) / log(2.0);
-  cdtime_t new_bin_width =
-      (cdtime_t)(pow(2.0, ceil(required_bin_width_logbase2)) + .5);
-  cdtime_t old_bin_width = lc->bin_width;
-
-  lc->bin_width = new_bin_width;
-
-  /* bin_width has been increased, now iterate through all bins and move the
-   * old bin's count to new bin. */
-  if (lc->num > 0) // if the histogram has data then iterate else skip
-  {
-    double width_change_ratio =
-        ((double)old_bin_width) / ((double)new_bin_width);
-
-    for (size_t i = 0; i < HISTOGRAM_NUM_BINS; i++) {
-      size_t new_bin = (size_t)(((double)i) * width_change_ratio);
-      if (i == new_bin)
-        continue;
-      assert(new_bin < i);
+#if defined(__GNUC__)
+  return 63 - __builtin_clzll((unsigned long long)x);
+#else
+  int n = 0;
+  while (x >>= 1)
+    n++;
+  return n;
+#endif
+} /* }}} int msb64 */
 
-      lc->histogram[new_bin] += lc->histogram[i];
-      lc->histogram[i] = 0;
-    }
+static void latency_to_bucket(cdtime_t latency, /* {{{ */
+                              size_t *ret_octave, size_t *ret_sub) {
+  uint64_t y = ((uint64_t)latency - 1) >> UNIT_BITS;
+
+  if (y < SUB_BUCKETS_NUM) {
+    *ret_octave = 0;
+    *ret_sub = (size_t)y;
+    return;
+  }
+
+  int shift = msb64(y) - SUB_BUCKET_BITS;
+  *ret_octave = (size_t)(shift + 1);
+  *ret_sub = (size_t)((y >> shift) - SUB_BUCKETS_NUM);
+} /* }}} void latency_to_bucket */
+
+/* Returns the exclusive lower bound of a bucket and stores its width in
+ * "ret_width". */
+static cdtime_t bucket_lower_bound(size_t octave, size_t sub, /* {{{ */
+                                   cdtime_t *ret_width) {
+  if (octave == 0) {
+    *ret_width = ((cdtime_t)1) << UNIT_BITS;
+    return ((cdtime_t)sub) << UNIT_BITS;
   }
 
-  DEBUG("utils_latency: change_bin_width: latency = %.3f; "
-        "old_bin_width = %.3f; new_bin_width = %.3f;",
-        CDTIME_T_TO_DOUBLE(latency), CDTIME_T_TO_DOUBLE(old_bin_width),
-        CDTIME_T_TO_DOUBLE(new_bin_width));
-} /* }}} void change_bin_width */
+  *ret_width = ((cdtime_t)1) << (octave - 1 + UNIT_BITS);
+  return ((cdtime_t)(SUB_BUCKETS_NUM + sub)) << (octave - 1 + UNIT_BITS);
+} /* }}} cdtime_t bucket_lower_bound */
 
 latency_counter_t *latency_counter_create(void) /* {{{ */
 {
@@ -121,19 +123,24 @@ latency_counter_t *latency_counter_create(void) /* {{{ */
   if (lc == NULL)
     return NULL;
 
-  lc->bin_width = HISTOGRAM_DEFAULT_BIN_WIDTH;
   latency_counter_reset(lc);
   return lc;
 } /* }}} latency_counter_t *latency_counter_create */
 
 void latency_counter_destroy(latency_counter_t *lc) /* {{{ */
 {
+  if (lc == NULL)
+    return;
+
+  for (size_t i = 0; i < OCTAVES_NUM; i++)
+    sfree(lc->octaves[i]);
   sfree(lc);
 } /* }}} void latency_counter_destroy */
 
 void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
 {
-  cdtime_t bin;
+  size_t octave;
+  size_t sub;
 
   if ((lc == NULL) || (latency == 0) || (latency > ((cdtime_t)LLONG_MAX)))
     return;
@@ -148,50 +155,62 @@ void latency_counter_add(latency_counter_t *lc, cdtime_t latency) /* {{{ */
   if (lc->max < latency)
     lc->max = latency;
 
-  /* A latency of _exactly_ 1.0 ms is stored in the buffer 0, so
-   * subtract one from the cdtime_t value so that exactly 1.0 ms get sorted
-   * accordingly. */
-  bin = (latency - 1) / lc->bin_width;
-  if (bin >= HISTOGRAM_NUM_BINS) {
-    change_bin_width(lc, latency);
-    bin = (latency - 1) / lc->bin_width;
-    if (bin >= HISTOGRAM_NUM_BINS) {
-      ERROR("utils_latency: latency_counter_add: Invalid bin: %" PRIu64, bin);
+  latency_to_bucket(latency, &octave, &sub);
+  if (lc->octaves[octave] == NULL) {
+    lc->octaves[octave] = calloc(SUB_BUCKETS_NUM, sizeof(uint32_t));
+    if (lc->octaves[octave] == NULL) {
+      ERROR("utils_latency: latency_counter_add: calloc failed.");
       return;
     }
   }
-  lc->histogram[bin]++;
+  lc->octaves[octave][sub]++;
 } /* }}} void latency_counter_add */
 
-void latency_counter_reset(latency_counter_t *lc) /* {{{ */
-{
-  if (lc == NULL)
+void latency_counter_merge(latency_counter_t *dst, /* {{{ */
+                           latency_counter_t const *src) {
+  if ((dst == NULL) || (src == NULL) || (src->num == 0))
     return;
 
-  cdtime_t bin_width = lc->bin_width;
-  cdtime_t max_bin = (lc->max - 1) / lc->bin_width;
+  for (size_t i = 0; i < OCTAVES_NUM; i++) {
+    if (src->octaves[i] == NULL)
+      continue;
 
-/*
-  If max latency is REDUCE_THRESHOLD times less than histogram's range,
-  then cut it in half. REDUCE_THRESHOLD must be >= 2.
-  Value of 4 is selected to reduce frequent changes of bin width.
-*/
-#define REDUCE_THRESHOLD 4
-  if ((lc->num > 0) && (lc->bin_width >= HISTOGRAM_DEFAULT_BIN_WIDTH * 2) &&
-      (max_bin < HISTOGRAM_NUM_BINS / REDUCE_THRESHOLD)) {
-    /* new bin width will be the previous power of 2 */
-    bin_width = bin_width / 2;
-
-    DEBUG("utils_latency: latency_counter_reset: max_latency = %.3f; "
-          "max_bin = %" PRIu64 "; old_bin_width = %.3f; new_bin_width = %.3f;",
-          CDTIME_T_TO_DOUBLE(lc->max), max_bin,
-          CDTIME_T_TO_DOUBLE(lc->bin_width), CDTIME_T_TO_DOUBLE(bin_width));
+    if (dst->octaves[i] == NULL) {
+      dst->octaves[i] = calloc(SUB_BUCKETS_NUM, sizeof(uint32_t));
+      if (dst->octaves[i] == NULL) {
+        ERROR("utils_latency: latency_counter_merge: calloc failed.");
+        continue;
+      }
+    }
+
+    for (size_t j = 0; j < SUB_BUCKETS_NUM; j++)
+      dst->octaves[i][j] += src->octaves[i][j];
   }
 
-  memset(lc, 0, sizeof(*lc));
+  if ((dst->num == 0) || (dst->min > src->min))
+    dst->min = src->min;
+  if ((dst->num == 0) || (dst->max < src->max))
+    dst->max = src->max;
+
+  dst->sum += src->sum;
+  dst->num += src->num;
+} /* }}} void latency_counter_merge */
 
-  /* preserve bin width */
-  lc->bin_width = bin_width;
+void latency_counter_reset(latency_counter_t *lc) /* {{{ */
+{
+  if (lc == NULL)
+    return;
+
+  /* Keep the octaves allocated: the next interval is likely to hit the same
+   * ones. */
+  for (size_t i = 0; i < OCTAVES_NUM; i++)
+    if (lc->octaves[i] != NULL)
+      memset(lc->octaves[i], 0, SUB_BUCKETS_NUM * sizeof(uint32_t));
+
+  lc->sum = 0;
+  lc->num = 0;
+  lc->min = 0;
+  lc->max = 0;
   lc->start_time = cdtime();
 } /* }}} void latency_counter_reset */
 
@@ -236,51 +255,51 @@ cdtime_t latency_counter_get_average(latency_counter_t *lc) /* {{{ */
 
 cdtime_t latency_counter_get_percentile(latency_counter_t *lc, /* {{{ */
                                         double percent) {
-  double percent_upper;
-  double percent_lower;
-  double p;
-  cdtime_t latency_lower;
-  cdtime_t latency_interpolated;
-  int sum;
-  size_t i;
+  double percent_upper = 0.0;
+  double percent_lower = 0.0;
+  uint64_t sum = 0;
 
   if ((lc == NULL) || (lc->num == 0) || !((percent > 0.0) && (percent < 100.0)))
     return 0;
 
-  /* Find index i so that at least "percent" events are within i+1 ms. */
-  percent_upper = 0.0;
-  percent_lower = 0.0;
-  sum = 0;
-  for (i = 0; i < HISTOGRAM_NUM_BINS; i++) {
-    percent_lower = percent_upper;
-    sum += lc->histogram[i];
-    if (sum == 0)
-      percent_upper = 0.0;
-    else
-      percent_upper = 100.0 * ((double)sum) / ((double)lc->num);
-
-    if (percent_upper >= percent)
-      break;
-  }
-
-  if (i >= HISTOGRAM_NUM_BINS)
-    return 0;
+  /* Find the bucket so that at least "percent" events are within its upper
+   * bound, then interpolate linearly within the bucket. */
+  for (size_t i = 0; i < OCTAVES_NUM; i++) {
+    if (lc->octaves[i] == NULL)
+      continue;
 
-  assert(percent_upper >= percent);
-  assert(percent_lower < percent);
+    for (size_t j = 0; j < SUB_BUCKETS_NUM; j++) {
+      if (lc->octaves[i][j] == 0)
+        continue;
 
-  if (i == 0)
-    return lc->bin_width;
+      percent_lower = percent_upper;
+      sum += lc->octaves[i][j];
+      percent_upper = 100.0 * ((double)sum) / ((double)lc->num);
 
-  latency_lower = ((cdtime_t)i) * lc->bin_width;
-  p = (percent - percent_lower) / (percent_upper - percent_lower);
+      if (percent_upper < percent)
+        continue;
 
-  latency_interpolated =
-      latency_lower + DOUBLE_TO_CDTIME_T(p * CDTIME_T_TO_DOUBLE(lc->bin_width));
+      cdtime_t width;
+      cdtime_t latency_lower = bucket_lower_bound(i, j, &width);
+      double p = (percent - percent_lower) / (percent_upper - percent_lower);
+      cdtime_t latency_interpolated =
+          latency_lower + DOUBLE_TO_CDTIME_T(p * CDTIME_T_TO_DOUBLE(width));
+
+      /* The extremes are known exactly. */
+      if (latency_interpolated < lc->min)
+        latency_interpolated = lc->min;
+      if (latency_interpolated > lc->max)
+        latency_interpolated = lc->max;
+
+      DEBUG("latency_counter_get_percentile: latency_interpolated = %.3f",
+            CDTIME_T_TO_DOUBLE(latency_interpolated));
+      return latency_interpolated;
+    }
+  }
 
-  DEBUG("latency_counter_get_percentile: latency_interpolated = %.3f",
-        CDTIME_T_TO_DOUBLE(latency_interpolated));
-  return latency_interpolated;
+  /* Only reached if the counts are inconsistent with "num", e.g. because an
+   * allocation failed in latency_counter_add(). */
+  return lc->max;
 } /* }}} cdtime_t latency_counter_get_percentile */
 
 double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
@@ -294,50 +313,32 @@ double latency_counter_get_rate(const latency_counter_t *lc, /* {{{ */
   if (lower == upper)
     return 0;
 
-  /* Buckets have an exclusive lower bound and an inclusive upper bound. That
-   * means that the first bucket, index 0, represents (0-bin_width]. That means
-   * that latency==bin_width needs to result in bin=0, that's why we need to
-   * subtract one before dividing by bin_width. */
-  cdtime_t lower_bin = 0;
-  if (lower)
-    /* lower is *exclusive* => determine bucket for lower+1 */
-    lower_bin = ((lower + 1) - 1) / lc->bin_width;
-
-  /* lower is greater than the longest latency observed => rate is zero. */
-  if (lower_bin >= HISTOGRAM_NUM_BINS)
-    return 0;
+  /* Buckets have an exclusive lower bound and an inclusive upper bound, just
+   * like the requested interval. Buckets which are only partially covered by
+   * the interval are counted proportionally. */
+  double sum = 0;
+  for (size_t i = 0; i < OCTAVES_NUM; i++) {
+    if (lc->octaves[i] == NULL)
+      continue;
 
-  cdtime_t upper_bin = HISTOGRAM_NUM_BINS - 1;
-  if (upper)
-    upper_bin = (upper - 1) / lc->bin_width;
+    for (size_t j = 0; j < SUB_BUCKETS_NUM; j++) {
+      if (lc->octaves[i][j] == 0)
+        continue;
 
-  if (upper_bin >= HISTOGRAM_NUM_BINS) {
-    upper_bin = HISTOGRAM_NUM_BINS - 1;
-    upper = 0;
-  }
+      cdtime_t width;
+      cdtime_t bucket_lower = bucket_lower_bound(i, j, &width);
+      cdtime_t bucket_upper = bucket_lower + width;
 
-  double sum = 0;
-  for (size_t i = lower_bin; i <= upper_bin; i++)
-    sum += lc->histogram[i];
-
-  if (lower) {
-    /* Approximate ratio of requests in lower_bin, that fall between
-     * lower_bin_boundary and lower. This ratio is then subtracted from sum to
-     * increase accuracy. */
-    cdtime_t lower_bin_boundary = lower_bin * lc->bin_width;
-    assert(lower >= lower_bin_boundary);
-    double lower_ratio =
-        (double)(lower - lower_bin_boundary) / ((double)lc->bin_width);
-    sum -= lower_ratio * lc->histogram[lower_bin];
-  }
+      cdtime_t from = (bucket_lower > lower) ? bucket_lower : lower;
+      cdtime_t to = bucket_upper;
+      if (upper && (upper < to))
+        to = upper;
+      if (to <= from)
+        continue;
 
-  if (upper) {
-    /* As above: approximate ratio of requests in upper_bin, that fall between
-     * upper and upper_bin_boundary. */
-    cdtime_t upper_bin_boundary = (upper_bin + 1) * lc->bin_width;
-    assert(upper <= upper_bin_boundary);
-    double ratio = (double)(upper_bin_boundary - upper) / (double)lc->bin_width;
-    sum -= ratio * lc->histogram[upper_bin];
+      sum += ((double)lc->octaves[i][j]) * ((double)(to - from)) /
+             ((double)width);
+    }
   }
 
   return sum / (CDTIME_T_TO_DOUBLE(now - lc->start_time));
@@ -28,10 +28,6 @@
 
 #include "utils_time.h"
 
-#ifndef HISTOGRAM_NUM_BINS
-#define HISTOGRAM_NUM_BINS 1000
-#endif
-
 struct latency_counter_s;
 typedef struct latency_counter_s latency_counter_t;
 
@@ -41,6 +37,17 @@ void latency_counter_destroy(latency_counter_t *lc);
 void latency_counter_add(latency_counter_t *lc, cdtime_t latency);
 void latency_counter_reset(latency_counter_t *lc);
 
+/*
+ * NAME
+ *  latency_counter_merge(dst,src)
+ *
+ * DESCRIPTION
+ *   Adds all latencies recorded by "src" to "dst", as if they had been added
+ *   to "dst" with latency_counter_add(). Both counters use the same buckets,
+ *   so no precision is lost.
+ */
+void latency_counter_merge(latency_counter_t *dst, latency_counter_t const *src);
+
 cdtime_t latency_counter_get_min(latency_counter_t *lc);
 cdtime_t latency_counter_get_max(latency_counter_t *lc);
 cdtime_t latency_counter_get_sum(latency_counter_t *lc);
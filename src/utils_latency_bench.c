@@ -0,0 +1,142 @@
+/**
+ * collectd - src/utils_latency_bench.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+/* Micro benchmark for the latency counter: compares the percentiles reported
+ * by latency_counter_get_percentile() to the exact percentiles of the added
+ * values, for a couple of distributions, and measures the CPU time of
+ * latency_counter_add() and latency_counter_merge().
+ *
+ * Usage: bench_utils_latency [<values>] */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_latency.h"
+#include "utils_time.h"
+
+static uint64_t rng_state = 0x2545F4914F6CDD1DULL;
+
+/* xorshift64*, so that all runs use the same values. */
+static double rng_uniform(void) {
+  rng_state ^= rng_state >> 12;
+  rng_state ^= rng_state << 25;
+  rng_state ^= rng_state >> 27;
+  uint64_t r = rng_state * 0x2545F4914F6CDD1DULL;
+  return ((double)(r >> 11) + 0.5) / 9007199254740992.0; /* (0, 1) */
+}
+
+static double rng_normal(void) {
+  return sqrt(-2.0 * log(rng_uniform())) * cos(2.0 * M_PI * rng_uniform());
+}
+
+/* 1 ms to 100 ms, uniformly distributed. */
+static double dist_uniform(void) { return 0.001 + 0.099 * rng_uniform(); }
+
+/* Median of 2 ms with a long tail. */
+static double dist_lognormal(void) { return 0.002 * exp(rng_normal()); }
+
+/* Mostly 50 us to 200 us, with one percent of 1 s to 5 s outliers. */
+static double dist_outliers(void) {
+  if (rng_uniform() < 0.01)
+    return 1.0 + 4.0 * rng_uniform();
+  return 0.00005 + 0.00015 * rng_uniform();
+}
+
+static double now_cpu(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec) / 1e9;
+}
+
+static int compare_cdtime(void const *a, void const *b) {
+  cdtime_t x = *(cdtime_t const *)a;
+  cdtime_t y = *(cdtime_t const *)b;
+  return (x > y) - (x < y);
+}
+
+static void run(char const *name, double (*dist)(void), size_t values_num) {
+  double const percents[] = {50.0, 90.0, 99.0, 99.9};
+  cdtime_t *values = calloc(values_num, sizeof(*values));
+  latency_counter_t *lc = latency_counter_create();
+  latency_counter_t *half = latency_counter_create();
+  latency_counter_t *merged = latency_counter_create();
+  assert((values != NULL) && (lc != NULL) && (half != NULL) &&
+         (merged != NULL));
+
+  for (size_t i = 0; i < values_num; i++)
+    values[i] = DOUBLE_TO_CDTIME_T(dist());
+
+  double start = now_cpu();
+  for (size_t i = 0; i < values_num; i++)
+    latency_counter_add(lc, values[i]);
+  double per_add = (now_cpu() - start) / (double)values_num;
+
+  for (size_t i = 0; i < values_num / 2; i++)
+    latency_counter_add(half, values[i]);
+
+  size_t merges_num = 10000;
+  start = now_cpu();
+  for (size_t i = 0; i < merges_num; i++)
+    latency_counter_merge(merged, half);
+  double per_merge = (now_cpu() - start) / (double)merges_num;
+
+  qsort(values, values_num, sizeof(*values), compare_cdtime);
+
+  printf("%-9s add: %6.1f ns/value, merge: %8.1f ns\n", name, 1e9 * per_add,
+         1e9 * per_merge);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(percents); i++) {
+    /* nearest rank */
+    size_t rank = (size_t)ceil(percents[i] / 100.0 * (double)values_num);
+    double want = CDTIME_T_TO_DOUBLE(values[(rank > 0) ? rank - 1 : 0]);
+    double got =
+        CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(lc, percents[i]));
+
+    printf("  p%-5g exact %12.6f s, counter %12.6f s, error %7.3f %%\n",
+           percents[i], want, got, 100.0 * fabs(got - want) / want);
+  }
+
+  latency_counter_destroy(merged);
+  latency_counter_destroy(half);
+  latency_counter_destroy(lc);
+  sfree(values);
+}
+
+int main(int argc, char **argv) {
+  size_t values_num = 1000000;
+
+  if (argc > 1)
+    values_num = (size_t)atol(argv[1]);
+  if (values_num < 2) {
+    fprintf(stderr, "Usage: %s [<values>]\n", argv[0]);
+    return 1;
+  }
+
+  run("uniform", dist_uniform, values_num);
+  run("lognormal", dist_lognormal, values_num);
+  run("outliers", dist_outliers, values_num);
+
+  return 0;
+}
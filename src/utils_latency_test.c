@@ -102,15 +102,9 @@ DEF_TEST(percentile) {
 }
 
 DEF_TEST(get_rate) {
-  /* We re-declare the struct here so we can inspect its content. */
+  /* We re-declare the beginning of the struct so we can read the start time. */
   struct {
     cdtime_t start_time;
-    cdtime_t sum;
-    size_t num;
-    cdtime_t min;
-    cdtime_t max;
-    cdtime_t bin_width;
-    int histogram[HISTOGRAM_NUM_BINS];
   } * peek;
   latency_counter_t *l;
 
@@ -121,71 +115,40 @@ DEF_TEST(get_rate) {
     latency_counter_add(l, TIME_T_TO_CDTIME_T(i));
   }
 
-  /* We expect a bucket width of 125ms. */
-  EXPECT_EQ_UINT64(DOUBLE_TO_CDTIME_T(0.125), peek->bin_width);
-
-  struct {
-    size_t index;
-    int want;
-  } bucket_cases[] = {
-      {0, 0},  /* (0.000-0.125] */
-      {1, 0},  /* (0.125-0.250] */
-      {2, 0},  /* (0.250-0.375] */
-      {3, 0},  /* (0.375-0.500] */
-      {4, 0},  /* (0.500-0.625] */
-      {5, 0},  /* (0.625-0.750] */
-      {6, 0},  /* (0.750-0.875] */
-      {7, 1},  /* (0.875-1.000] */
-      {8, 0},  /* (1.000-1.125] */
-      {9, 0},  /* (1.125-1.250] */
-      {10, 0}, /* (1.250-1.375] */
-      {11, 0}, /* (1.375-1.500] */
-      {12, 0}, /* (1.500-1.625] */
-      {13, 0}, /* (1.625-1.750] */
-      {14, 0}, /* (1.750-1.875] */
-      {15, 1}, /* (1.875-2.000] */
-      {16, 0}, /* (2.000-2.125] */
-  };
-
-  for (size_t i = 0; i < STATIC_ARRAY_SIZE(bucket_cases); i++) {
-    size_t index = bucket_cases[i].index;
-    EXPECT_EQ_INT(bucket_cases[i].want, peek->histogram[index]);
-  }
-
   struct {
     cdtime_t lower_bound;
     cdtime_t upper_bound;
     double want;
   } cases[] = {
       {
-          // bucket 6 is zero
+          // no updates in this range
           DOUBLE_TO_CDTIME_T_STATIC(0.750), DOUBLE_TO_CDTIME_T_STATIC(0.875),
           0.00,
       },
       {
-          // bucket 7 contains the t=1 update
+          // contains the t=1 update
           DOUBLE_TO_CDTIME_T_STATIC(0.875), DOUBLE_TO_CDTIME_T_STATIC(1.000),
           1.00,
       },
       {
-          // range: bucket 7 - bucket 15; contains the t=1 and t=2 updates
+          // contains the t=1 and t=2 updates
           DOUBLE_TO_CDTIME_T_STATIC(0.875), DOUBLE_TO_CDTIME_T_STATIC(2.000),
           2.00,
       },
       {
-          // lower bucket is only partially applied
-          DOUBLE_TO_CDTIME_T_STATIC(0.875 + (0.125 / 4)),
-          DOUBLE_TO_CDTIME_T_STATIC(2.000), 1.75,
+          // the lower bound is exclusive, the upper bound inclusive
+          DOUBLE_TO_CDTIME_T_STATIC(1.000), DOUBLE_TO_CDTIME_T_STATIC(2.000),
+          1.00,
       },
       {
-          // upper bucket is only partially applied
-          DOUBLE_TO_CDTIME_T_STATIC(0.875),
-          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (0.125 / 4)), 1.75,
+          // bounds close to the updates
+          DOUBLE_TO_CDTIME_T_STATIC(0.990), DOUBLE_TO_CDTIME_T_STATIC(1.990),
+          1.00,
       },
       {
-          // both buckets are only partially applied
-          DOUBLE_TO_CDTIME_T_STATIC(0.875 + (0.125 / 4)),
-          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (0.125 / 4)), 1.50,
+          // bucket of the t=2 update (width 1/128 s) is only partially applied
+          DOUBLE_TO_CDTIME_T_STATIC(0.875),
+          DOUBLE_TO_CDTIME_T_STATIC(2.000 - (1.0 / 512.0)), 1.75,
       },
       {
           // lower bound is unspecified
@@ -193,7 +156,7 @@ DEF_TEST(get_rate) {
       },
       {
           // upper bound is unspecified
-          DOUBLE_TO_CDTIME_T_STATIC(125.000 - 0.125), 0, 1.00,
+          DOUBLE_TO_CDTIME_T_STATIC(124.500), 0, 1.00,
       },
       {
           // overflow test: upper >> longest latency
@@ -225,10 +188,81 @@ DEF_TEST(get_rate) {
   return 0;
 }
 
+DEF_TEST(relative_error) {
+  latency_counter_t *l;
+
+  CHECK_NOT_NULL(l = latency_counter_create());
+
+  /* Large latencies must not affect the precision for small ones. */
+  for (size_t i = 0; i < 1000; i++)
+    latency_counter_add(l, US_TO_CDTIME_T(100 + i));
+  latency_counter_add(l, TIME_T_TO_CDTIME_T(3600));
+
+  for (double p = 10.0; p < 100.0; p += 10.0) {
+    double want = 100e-6 + (p / 100.0) * 1001.0 * 1e-6;
+    double got = CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(l, p));
+    printf("# p%.0f = %g, want approximately %g\n", p, got, want);
+    OK(fabs(got - want) / want < 0.01);
+  }
+
+  double got = CDTIME_T_TO_DOUBLE(latency_counter_get_percentile(l, 99.99));
+  OK(fabs(got - 3600.0) / 3600.0 < 0.01);
+  EXPECT_EQ_UINT64(TIME_T_TO_CDTIME_T(3600), latency_counter_get_max(l));
+
+  latency_counter_destroy(l);
+  return 0;
+}
+
+DEF_TEST(merge) {
+  latency_counter_t *all;
+  latency_counter_t *small;
+  latency_counter_t *large;
+
+  CHECK_NOT_NULL(all = latency_counter_create());
+  CHECK_NOT_NULL(small = latency_counter_create());
+  CHECK_NOT_NULL(large = latency_counter_create());
+
+  /* "small" keeps the default bin width, "large" has to widen its bins. */
+  for (size_t i = 0; i < 100; i++) {
+    cdtime_t latency = (i < 50) ? MS_TO_CDTIME_T(i + 1)
+                                : TIME_T_TO_CDTIME_T(((time_t)i) + 1);
+    latency_counter_add(all, latency);
+    latency_counter_add((i < 50) ? small : large, latency);
+  }
+
+  /* Merge in both directions. */
+  latency_counter_t *merged;
+  CHECK_NOT_NULL(merged = latency_counter_create());
+  latency_counter_merge(merged, small);
+  latency_counter_merge(merged, large);
+  latency_counter_merge(small, large);
+
+  latency_counter_t *counters[] = {merged, small};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(counters); i++) {
+    latency_counter_t *l = counters[i];
+
+    EXPECT_EQ_INT(100, latency_counter_get_num(l));
+    EXPECT_EQ_UINT64(latency_counter_get_min(all), latency_counter_get_min(l));
+    EXPECT_EQ_UINT64(latency_counter_get_max(all), latency_counter_get_max(l));
+    EXPECT_EQ_UINT64(latency_counter_get_sum(all), latency_counter_get_sum(l));
+    for (double p = 10.0; p < 100.0; p += 10.0)
+      EXPECT_EQ_UINT64(latency_counter_get_percentile(all, p),
+                       latency_counter_get_percentile(l, p));
+  }
+
+  latency_counter_destroy(all);
+  latency_counter_destroy(small);
+  latency_counter_destroy(large);
+  latency_counter_destroy(merged);
+  return 0;
+}
+
 int main(void) {
   RUN_TEST(simple);
   RUN_TEST(percentile);
   RUN_TEST(get_rate);
+  RUN_TEST(relative_error);
+  RUN_TEST(merge);
 
   END_TEST;
 }
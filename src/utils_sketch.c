@@ -0,0 +1,345 @@
+/**
+ * collectd - src/utils_sketch.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_sketch.h"
+
+#include <math.h>
+
+/*
+ * The quantile sketch maps a positive value v to the bucket
+ * ceil(log(v) / log(GAMMA)), i.e. bucket i holds the values in
+ * (GAMMA^(i-1), GAMMA^i]. A bucket is reported as the value with the same
+ * relative distance to both bounds, which is at most ALPHA off. Negative
+ * values use the mirrored buckets, zero has a bucket of its own.
+ *
+ * Buckets are identified by keys which sort like the values they hold:
+ * KEY_OFFSET + i for positive values, -(KEY_OFFSET + i) for negative values
+ * and zero for zero. The index of the smallest subnormal double is about
+ * -37500, of the largest double about 35900, so keys never cross zero. The
+ * used buckets are kept in an array sorted by key.
+ */
+#define ALPHA 0.01
+#define GAMMA ((1.0 + ALPHA) / (1.0 - ALPHA))
+#define KEY_OFFSET 40000
+
+struct quantile_bucket_s {
+  int32_t key;
+  uint64_t count;
+};
+typedef struct quantile_bucket_s quantile_bucket_t;
+
+struct quantile_sketch_s {
+  double log_gamma;
+
+  quantile_bucket_t *buckets;
+  size_t buckets_num;
+  size_t buckets_size;
+
+  uint64_t num;
+  double min;
+  double max;
+};
+
+static int32_t qs_value_to_key(quantile_sketch_t const *qs, /* {{{ */
+                               double value) {
+  if (value == 0.0)
+    return 0;
+
+  int32_t index = (int32_t)ceil(log(fabs(value)) / qs->log_gamma);
+  return (value > 0.0) ? (KEY_OFFSET + index) : -(KEY_OFFSET + index);
+} /* }}} int32_t qs_value_to_key */
+
+static double qs_key_to_value(quantile_sketch_t const *qs, /* {{{ */
+                              int32_t key) {
+  if (key == 0)
+    return 0.0;
+
+  int32_t index = (key > 0) ? (key - KEY_OFFSET) : (-key - KEY_OFFSET);
+  double value = 2.0 * exp((double)index * qs->log_gamma) / (GAMMA + 1.0);
+  return (key > 0) ? value : -value;
+} /* }}} double qs_key_to_value */
+
+static int qs_reserve(quantile_sketch_t *qs, size_t num) /* {{{ */
+{
+  if (num <= qs->buckets_size)
+    return 0;
+
+  size_t new_size = (qs->buckets_size > 0) ? 2 * qs->buckets_size : 16;
+  while (new_size < num)
+    new_size *= 2;
+
+  quantile_bucket_t *tmp =
+      realloc(qs->buckets, new_size * sizeof(*qs->buckets));
+  if (tmp == NULL)
+    return ENOMEM;
+
+  qs->buckets = tmp;
+  qs->buckets_size = new_size;
+  return 0;
+} /* }}} int qs_reserve */
+
+quantile_sketch_t *quantile_sketch_create(void) /* {{{ */
+{
+  quantile_sketch_t *qs;
+
+  qs = calloc(1, sizeof(*qs));
+  if (qs == NULL)
+    return NULL;
+
+  qs->log_gamma = log(GAMMA);
+
+  quantile_sketch_reset(qs);
+  return qs;
+} /* }}} quantile_sketch_t *quantile_sketch_create */
+
+void quantile_sketch_destroy(quantile_sketch_t *qs) /* {{{ */
+{
+  if (qs == NULL)
+    return;
+
+  sfree(qs->buckets);
+  sfree(qs);
+} /* }}} void quantile_sketch_destroy */
+
+int quantile_sketch_add(quantile_sketch_t *qs, double value) /* {{{ */
+{
+  if ((qs == NULL) || !isfinite(value))
+    return EINVAL;
+
+  int32_t key = qs_value_to_key(qs, value);
+
+  /* Binary search for the first bucket with a key >= "key". */
+  size_t lo = 0;
+  size_t hi = qs->buckets_num;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (qs->buckets[mid].key < key)
+      lo = mid + 1;
+    else
+      hi = mid;
+  }
+
+  if ((lo == qs->buckets_num) || (qs->buckets[lo].key != key)) {
+    if (qs_reserve(qs, qs->buckets_num + 1) != 0)
+      return ENOMEM;
+    memmove(qs->buckets + lo + 1, qs->buckets + lo,
+            (qs->buckets_num - lo) * sizeof(*qs->buckets));
+    qs->buckets[lo] = (quantile_bucket_t){.key = key};
+    qs->buckets_num++;
+  }
+  qs->buckets[lo].count++;
+
+  if ((qs->num == 0) || (qs->min > value))
+    qs->min = value;
+  if ((qs->num == 0) || (qs->max < value))
+    qs->max = value;
+  qs->num++;
+
+  return 0;
+} /* }}} int quantile_sketch_add */
+
+void quantile_sketch_reset(quantile_sketch_t *qs) /* {{{ */
+{
+  if (qs == NULL)
+    return;
+
+  /* Keep the allocated buckets around; the next interval most likely uses a
+   * similar number of them. */
+  qs->buckets_num = 0;
+  qs->num = 0;
+  qs->min = NAN;
+  qs->max = NAN;
+} /* }}} void quantile_sketch_reset */
+
+int quantile_sketch_merge(quantile_sketch_t *dst, /* {{{ */
+                          quantile_sketch_t const *src) {
+  if ((dst == NULL) || (src == NULL))
+    return EINVAL;
+  if (src->num == 0)
+    return 0;
+
+  if (qs_reserve(dst, dst->buckets_num + src->buckets_num) != 0)
+    return ENOMEM;
+
+  /* Merge both sorted arrays from the back, so "dst" can be merged in
+   * place. */
+  size_t d = dst->buckets_num;
+  size_t s = src->buckets_num;
+  size_t out = d + s;
+  while (s > 0) {
+    if ((d > 0) && (dst->buckets[d - 1].key > src->buckets[s - 1].key)) {
+      dst->buckets[--out] = dst->buckets[--d];
+    } else if ((d > 0) &&
+               (dst->buckets[d - 1].key == src->buckets[s - 1].key)) {
+      dst->buckets[--out] = dst->buckets[--d];
+      dst->buckets[out].count += src->buckets[--s].count;
+    } else {
+      dst->buckets[--out] = src->buckets[--s];
+    }
+  }
+
+  /* Close the gap left by buckets present in both sketches. */
+  size_t tail = dst->buckets_num + src->buckets_num - out;
+  if (out > d)
+    memmove(dst->buckets + d, dst->buckets + out, tail * sizeof(*dst->buckets));
+  dst->buckets_num = d + tail;
+
+  if ((dst->num == 0) || (dst->min > src->min))
+    dst->min = src->min;
+  if ((dst->num == 0) || (dst->max < src->max))
+    dst->max = src->max;
+  dst->num += src->num;
+
+  return 0;
+} /* }}} int quantile_sketch_merge */
+
+uint64_t quantile_sketch_get_num(quantile_sketch_t const *qs) /* {{{ */
+{
+  return (qs != NULL) ? qs->num : 0;
+} /* }}} uint64_t quantile_sketch_get_num */
+
+double quantile_sketch_get_percentile(quantile_sketch_t const *qs, /* {{{ */
+                                      double percent) {
+  if ((qs == NULL) || (qs->num == 0) || !(percent >= 0.0) ||
+      !(percent <= 100.0))
+    return NAN;
+
+  if (percent == 0.0)
+    return qs->min;
+  if (percent == 100.0)
+    return qs->max;
+
+  /* The value of the given rank, counting from zero. */
+  double rank = (percent / 100.0) * (double)(qs->num - 1);
+  uint64_t sum = 0;
+  for (size_t i = 0; i < qs->buckets_num; i++) {
+    sum += qs->buckets[i].count;
+    if ((double)sum > rank) {
+      double value = qs_key_to_value(qs, qs->buckets[i].key);
+      /* The bucket's value may lie outside of the observed range. */
+      if (value < qs->min)
+        return qs->min;
+      if (value > qs->max)
+        return qs->max;
+      return value;
+    }
+  }
+
+  return qs->max;
+} /* }}} double quantile_sketch_get_percentile */
+
+/*
+ * The distinct counter is a HyperLogLog sketch: the first REGISTER_BITS bits
+ * of a hash select a register, which keeps the maximum number of leading
+ * zeros (plus one) seen in the remaining bits.
+ */
+#define REGISTER_BITS 10
+#define REGISTERS_NUM (1 << REGISTER_BITS)
+
+struct distinct_counter_s {
+  uint8_t registers[REGISTERS_NUM];
+};
+
+/* The finalizer of SplitMix64, spreading the bits of hashes which are only
+ * 32 bits wide over all 64 bits. */
+static uint64_t dc_mix(uint64_t x) /* {{{ */
+{
+  x += 0x9e3779b97f4a7c15ULL;
+  x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+  return x ^ (x >> 31);
+} /* }}} uint64_t dc_mix */
+
+distinct_counter_t *distinct_counter_create(void) /* {{{ */
+{
+  return calloc(1, sizeof(distinct_counter_t));
+} /* }}} distinct_counter_t *distinct_counter_create */
+
+void distinct_counter_destroy(distinct_counter_t *dc) /* {{{ */
+{
+  sfree(dc);
+} /* }}} void distinct_counter_destroy */
+
+void distinct_counter_add(distinct_counter_t *dc, uint64_t hash) /* {{{ */
+{
+  if (dc == NULL)
+    return;
+
+  uint64_t x = dc_mix(hash);
+  size_t index = (size_t)(x >> (64 - REGISTER_BITS));
+  /* The lowest bit set makes sure the count of leading zeros is defined. */
+  uint64_t rest = (x << REGISTER_BITS) | (1ULL << (REGISTER_BITS - 1));
+  uint8_t rank = (uint8_t)(__builtin_clzll(rest) + 1);
+
+  if (dc->registers[index] < rank)
+    dc->registers[index] = rank;
+} /* }}} void distinct_counter_add */
+
+void distinct_counter_reset(distinct_counter_t *dc) /* {{{ */
+{
+  if (dc == NULL)
+    return;
+
+  memset(dc->registers, 0, sizeof(dc->registers));
+} /* }}} void distinct_counter_reset */
+
+void distinct_counter_merge(distinct_counter_t *dst, /* {{{ */
+                            distinct_counter_t const *src) {
+  if ((dst == NULL) || (src == NULL))
+    return;
+
+  for (size_t i = 0; i < REGISTERS_NUM; i++)
+    if (dst->registers[i] < src->registers[i])
+      dst->registers[i] = src->registers[i];
+} /* }}} void distinct_counter_merge */
+
+double distinct_counter_get(distinct_counter_t const *dc) /* {{{ */
+{
+  double m = (double)REGISTERS_NUM;
+  double sum = 0.0;
+  size_t zeros = 0;
+
+  if (dc == NULL)
+    return NAN;
+
+  for (size_t i = 0; i < REGISTERS_NUM; i++) {
+    sum += ldexp(1.0, -(int)dc->registers[i]);
+    if (dc->registers[i] == 0)
+      zeros++;
+  }
+
+  double estimate = (0.7213 / (1.0 + 1.079 / m)) * m * m / sum;
+
+  /* Use linear counting for small cardinalities, for which HyperLogLog is
+   * biased. */
+  if ((estimate <= 2.5 * m) && (zeros > 0))
+    return m * log(m / (double)zeros);
+
+  return estimate;
+} /* }}} double distinct_counter_get */
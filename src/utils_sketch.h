@@ -0,0 +1,89 @@
+/**
+ * collectd - src/utils_sketch.h
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#ifndef UTILS_SKETCH_H
+#define UTILS_SKETCH_H 1
+
+#include "collectd.h"
+
+/*
+ * Quantile sketch
+ *
+ * Counts values in buckets whose bounds grow exponentially, so that any
+ * percentile is reported with a relative error of at most one percent. Only
+ * the buckets which have been used are allocated. Sketches can be merged
+ * without losing precision.
+ */
+struct quantile_sketch_s;
+typedef struct quantile_sketch_s quantile_sketch_t;
+
+quantile_sketch_t *quantile_sketch_create(void);
+void quantile_sketch_destroy(quantile_sketch_t *qs);
+
+/* Returns EINVAL for values which are not finite, and ENOMEM. */
+int quantile_sketch_add(quantile_sketch_t *qs, double value);
+void quantile_sketch_reset(quantile_sketch_t *qs);
+
+/*
+ * NAME
+ *  quantile_sketch_merge(dst,src)
+ *
+ * DESCRIPTION
+ *   Adds all values recorded by "src" to "dst", as if they had been added to
+ *   "dst" with quantile_sketch_add().
+ */
+int quantile_sketch_merge(quantile_sketch_t *dst, quantile_sketch_t const *src);
+
+uint64_t quantile_sketch_get_num(quantile_sketch_t const *qs);
+
+/* Returns NAN if no values have been added. The 0th and 100th percentile are
+ * the exact minimum and maximum. */
+double quantile_sketch_get_percentile(quantile_sketch_t const *qs,
+                                      double percent);
+
+/*
+ * Distinct counter
+ *
+ * Estimates the number of distinct items added, using the HyperLogLog
+ * algorithm with 1024 registers. Small counts are exact in practice, the
+ * standard error of large counts is about three percent.
+ */
+struct distinct_counter_s;
+typedef struct distinct_counter_s distinct_counter_t;
+
+distinct_counter_t *distinct_counter_create(void);
+void distinct_counter_destroy(distinct_counter_t *dc);
+
+/* Adds the item with the hash "hash". The hash is mixed before use, so e.g.
+ * strhash() can be used directly. */
+void distinct_counter_add(distinct_counter_t *dc, uint64_t hash);
+void distinct_counter_reset(distinct_counter_t *dc);
+void distinct_counter_merge(distinct_counter_t *dst,
+                            distinct_counter_t const *src);
+
+double distinct_counter_get(distinct_counter_t const *dc);
+
+#endif /* UTILS_SKETCH_H */
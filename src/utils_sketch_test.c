@@ -0,0 +1,161 @@
+/**
+ * collectd - src/utils_sketch_test.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+#include "collectd.h"
+
+#include "common.h" /* for STATIC_ARRAY_SIZE */
+#include "testing.h"
+#include "utils_sketch.h"
+
+DEF_TEST(percentile) {
+  quantile_sketch_t *qs;
+
+  CHECK_NOT_NULL(qs = quantile_sketch_create());
+  EXPECT_EQ_INT(1, isnan(quantile_sketch_get_percentile(qs, 50.0)));
+
+  /* 1 .. 100, shuffled */
+  for (int i = 0; i < 100; i++)
+    CHECK_ZERO(quantile_sketch_add(qs, (double)((i * 37) % 100 + 1)));
+  OK(quantile_sketch_add(qs, NAN) != 0);
+  OK(quantile_sketch_add(qs, INFINITY) != 0);
+
+  EXPECT_EQ_INT(100, (int)quantile_sketch_get_num(qs));
+  EXPECT_EQ_DOUBLE(1.0, quantile_sketch_get_percentile(qs, 0.0));
+  EXPECT_EQ_DOUBLE(100.0, quantile_sketch_get_percentile(qs, 100.0));
+
+  double percents[] = {1.0, 10.0, 50.0, 90.0, 95.0, 99.0};
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(percents); i++) {
+    /* The exact value with the rank used by the sketch. */
+    double want = floor(percents[i] / 100.0 * 99.0) + 1.0;
+    double got = quantile_sketch_get_percentile(qs, percents[i]);
+    printf("# percentile %g: want %g, got %g\n", percents[i], want, got);
+    OK(fabs(got - want) <= 0.01 * want);
+  }
+
+  quantile_sketch_reset(qs);
+  EXPECT_EQ_INT(0, (int)quantile_sketch_get_num(qs));
+  EXPECT_EQ_INT(1, isnan(quantile_sketch_get_percentile(qs, 50.0)));
+
+  quantile_sketch_destroy(qs);
+  return 0;
+}
+
+DEF_TEST(relative_error) {
+  quantile_sketch_t *qs;
+  double values[] = {-1e300, -42.5, -1e-9, 0.0, 3e-300, 0.001, 1.0, 7.5e12};
+
+  CHECK_NOT_NULL(qs = quantile_sketch_create());
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(values); i++) {
+    quantile_sketch_reset(qs);
+    /* Two values, so the median is not clamped to the exact minimum. */
+    CHECK_ZERO(quantile_sketch_add(qs, values[i]));
+    CHECK_ZERO(quantile_sketch_add(qs, 2e300));
+
+    double got = quantile_sketch_get_percentile(qs, 50.0);
+    printf("# value %g: got %g\n", values[i], got);
+    OK(fabs(got - values[i]) <= 0.01 * fabs(values[i]));
+  }
+
+  quantile_sketch_destroy(qs);
+  return 0;
+}
+
+DEF_TEST(merge) {
+  quantile_sketch_t *all;
+  quantile_sketch_t *parts[3];
+
+  CHECK_NOT_NULL(all = quantile_sketch_create());
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(parts); i++)
+    CHECK_NOT_NULL(parts[i] = quantile_sketch_create());
+
+  /* Overlapping and disjoint buckets in the parts. */
+  for (int i = 0; i < 3000; i++) {
+    double value = (double)((i * 7919) % 3000) - 500.0;
+    CHECK_ZERO(quantile_sketch_add(all, value));
+    CHECK_ZERO(quantile_sketch_add(parts[(i % 7) % 3], value));
+  }
+
+  quantile_sketch_t *merged;
+  CHECK_NOT_NULL(merged = quantile_sketch_create());
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(parts); i++)
+    CHECK_ZERO(quantile_sketch_merge(merged, parts[i]));
+
+  EXPECT_EQ_INT(3000, (int)quantile_sketch_get_num(merged));
+  for (double p = 0.0; p <= 100.0; p += 2.5)
+    EXPECT_EQ_DOUBLE(quantile_sketch_get_percentile(all, p),
+                     quantile_sketch_get_percentile(merged, p));
+
+  quantile_sketch_destroy(merged);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(parts); i++)
+    quantile_sketch_destroy(parts[i]);
+  quantile_sketch_destroy(all);
+  return 0;
+}
+
+DEF_TEST(distinct) {
+  distinct_counter_t *dc;
+  distinct_counter_t *parts[2];
+
+  CHECK_NOT_NULL(dc = distinct_counter_create());
+  EXPECT_EQ_DOUBLE(0.0, distinct_counter_get(dc));
+
+  /* Small counts are exact, duplicates are not counted. */
+  for (int round = 0; round < 3; round++)
+    for (uint64_t i = 0; i < 10; i++)
+      distinct_counter_add(dc, i);
+  EXPECT_EQ_INT(10, (int)round(distinct_counter_get(dc)));
+
+  /* Large counts are estimated, also after merging. */
+  distinct_counter_reset(dc);
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(parts); i++)
+    CHECK_NOT_NULL(parts[i] = distinct_counter_create());
+  for (uint64_t i = 0; i < 100000; i++) {
+    distinct_counter_add(dc, i);
+    distinct_counter_add(parts[i % 2], i);
+    distinct_counter_add(parts[(i + 1) % 2], i / 2);
+  }
+
+  double got = distinct_counter_get(dc);
+  printf("# distinct: want 100000, got %g\n", got);
+  OK(fabs(got - 100000.0) < 10000.0);
+
+  distinct_counter_merge(parts[0], parts[1]);
+  EXPECT_EQ_DOUBLE(got, distinct_counter_get(parts[0]));
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(parts); i++)
+    distinct_counter_destroy(parts[i]);
+  distinct_counter_destroy(dc);
+  return 0;
+}
+
+int main(void) {
+  RUN_TEST(percentile);
+  RUN_TEST(relative_error);
+  RUN_TEST(merge);
+  RUN_TEST(distinct);
+
+  END_TEST;
+}
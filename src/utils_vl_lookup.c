@@ -68,6 +68,39 @@ struct identifier_match_s {
 };
 typedef struct identifier_match_s identifier_match_t;
 
+/* Initial number of buckets of the memo of lookup_search() results and the
+ * number of locks protecting it. Both must be powers of two. The memo never has
+ * fewer buckets than locks, so the lock of an identifier is the same whatever
+ * the memo's size. */
+#define LU_MEMO_SIZE 4096
+#define LU_MEMO_LOCKS 64
+
+struct user_class_s;
+typedef struct user_class_s user_class_t;
+struct user_obj_s;
+typedef struct user_obj_s user_obj_t;
+
+/* A user object a value list belongs to, and its class. */
+struct lu_match_s {
+  user_class_t *user_class;
+  user_obj_t *user_obj;
+};
+typedef struct lu_match_s lu_match_t;
+
+/* The user objects found for one identifier. The memo is a hash table with
+ * chaining which grows with the number of identifiers, so every identifier
+ * searched since the last lookup_add() is memoized. The matches and the name
+ * are allocated along with the entry. */
+struct lu_memo_entry_s;
+typedef struct lu_memo_entry_s lu_memo_entry_t;
+struct lu_memo_entry_s {
+  char *name;
+  uint32_t hash;
+  lu_match_t *matches;
+  size_t matches_num;
+  lu_memo_entry_t *next;
+};
+
 struct lookup_s {
   c_avl_tree_t *by_type_tree;
 
@@ -75,10 +108,16 @@ struct lookup_s {
   lookup_obj_callback_t cb_user_obj;
   lookup_free_class_callback_t cb_free_class;
   lookup_free_obj_callback_t cb_free_obj;
+
+  /* "memo_size" only changes while all locks are held. Lock i protects the
+   * buckets whose index is i modulo LU_MEMO_LOCKS, and "memo_num[i]" counts
+   * the entries in them. */
+  lu_memo_entry_t **memo;
+  size_t memo_size;
+  size_t memo_num[LU_MEMO_LOCKS];
+  pthread_mutex_t memo_lock[LU_MEMO_LOCKS];
 };
 
-struct user_obj_s;
-typedef struct user_obj_s user_obj_t;
 struct user_obj_s {
   void *user_obj;
   lookup_identifier_t ident;
@@ -92,7 +131,6 @@ struct user_class_s {
   identifier_match_t match;
   user_obj_t *user_obj_list; /* list of user_obj */
 };
-typedef struct user_class_s user_class_t;
 
 struct user_class_list_s;
 typedef struct user_class_list_s user_class_list_t;
@@ -104,6 +142,7 @@ struct user_class_list_s {
 struct by_type_entry_s {
   c_avl_tree_t *by_plugin_tree; /* plugin -> user_class_list_t */
   user_class_list_t *wildcard_plugin_list;
+  size_t user_class_num;
 };
 typedef struct by_type_entry_s by_type_entry_t;
 
@@ -265,22 +304,25 @@ static user_obj_t *lu_find_user_obj(user_class_t *user_class, /* {{{ */
   return NULL;
 } /* }}} user_obj_t *lu_find_user_obj */
 
-static int lu_handle_user_class(lookup_t *obj, /* {{{ */
-                                data_set_t const *ds, value_list_t const *vl,
-                                user_class_t *user_class) {
+/* Finds or creates the user object of "vl" in "user_class". Returns zero and
+ * sets "ret_user_obj" to NULL if "vl" doesn't match the user class. */
+static int lu_find_match(lookup_t *obj, /* {{{ */
+                         data_set_t const *ds, value_list_t const *vl,
+                         user_class_t *user_class, user_obj_t **ret_user_obj) {
   user_obj_t *user_obj;
-  int status;
 
   assert(strcmp(vl->type, user_class->match.type.str) == 0);
   assert(user_class->match.plugin.is_regex ||
          (strcmp(vl->plugin, user_class->match.plugin.str)) == 0);
 
+  *ret_user_obj = NULL;
+
   if (!lu_part_matches(&user_class->match.type_instance, vl->type_instance) ||
       !lu_part_matches(&user_class->match.plugin_instance,
                        vl->plugin_instance) ||
       !lu_part_matches(&user_class->match.plugin, vl->plugin) ||
       !lu_part_matches(&user_class->match.host, vl->host))
-    return 1;
+    return 0;
 
   pthread_mutex_lock(&user_class->lock);
   user_obj = lu_find_user_obj(user_class, vl);
@@ -295,39 +337,173 @@ static int lu_handle_user_class(lookup_t *obj, /* {{{ */
   }
   pthread_mutex_unlock(&user_class->lock);
 
-  status = obj->cb_user_obj(ds, vl, user_class->user_class, user_obj->user_obj);
-  if (status != 0) {
-    ERROR("utils_vl_lookup: The user object callback failed with status %i.",
-          status);
-    /* Returning a negative value means: abort! */
-    if (status < 0)
-      return status;
-    else
-      return 1;
+  *ret_user_obj = user_obj;
+  return 0;
+} /* }}} int lu_find_match */
+
+/* Appends the matches of "vl" in "user_class_list" to "matches", which must
+ * be large enough for all user classes of the type. Returns the new number of
+ * matches or less than zero on error. */
+static int lu_find_matches(lookup_t *obj, /* {{{ */
+                           data_set_t const *ds, value_list_t const *vl,
+                           user_class_list_t *user_class_list,
+                           lu_match_t *matches, int matches_num) {
+  for (user_class_list_t *ptr = user_class_list; ptr != NULL;
+       ptr = ptr->next) {
+    user_obj_t *user_obj = NULL;
+
+    int status = lu_find_match(obj, ds, vl, &ptr->entry, &user_obj);
+    if (status != 0)
+      return -1;
+    if (user_obj == NULL)
+      continue;
+
+    matches[matches_num].user_class = &ptr->entry;
+    matches[matches_num].user_obj = user_obj;
+    matches_num++;
   }
 
-  return 0;
-} /* }}} int lu_handle_user_class */
+  return matches_num;
+} /* }}} int lu_find_matches */
 
-static int lu_handle_user_class_list(lookup_t *obj, /* {{{ */
-                                     data_set_t const *ds,
-                                     value_list_t const *vl,
-                                     user_class_list_t *user_class_list) {
-  user_class_list_t *ptr;
-  int retval = 0;
+static void lu_memo_lock_all(lookup_t *obj) /* {{{ */
+{
+  for (size_t i = 0; i < LU_MEMO_LOCKS; i++)
+    pthread_mutex_lock(&obj->memo_lock[i]);
+} /* }}} void lu_memo_lock_all */
 
-  for (ptr = user_class_list; ptr != NULL; ptr = ptr->next) {
-    int status;
+static void lu_memo_unlock_all(lookup_t *obj) /* {{{ */
+{
+  for (size_t i = 0; i < LU_MEMO_LOCKS; i++)
+    pthread_mutex_unlock(&obj->memo_lock[i]);
+} /* }}} void lu_memo_unlock_all */
 
-    status = lu_handle_user_class(obj, ds, vl, &ptr->entry);
-    if (status < 0)
-      return status;
-    else if (status == 0)
-      retval++;
+/* Frees all entries. The caller must hold all locks. */
+static void lu_memo_free_entries(lookup_t *obj) /* {{{ */
+{
+  for (size_t i = 0; i < obj->memo_size; i++) {
+    while (obj->memo[i] != NULL) {
+      lu_memo_entry_t *next = obj->memo[i]->next;
+      sfree(obj->memo[i]);
+      obj->memo[i] = next;
+    }
   }
+  memset(obj->memo_num, 0, sizeof(obj->memo_num));
+} /* }}} void lu_memo_free_entries */
 
-  return retval;
-} /* }}} int lu_handle_user_class_list */
+static void lu_memo_clear(lookup_t *obj) /* {{{ */
+{
+  lu_memo_lock_all(obj);
+  lu_memo_free_entries(obj);
+  lu_memo_unlock_all(obj);
+} /* }}} void lu_memo_clear */
+
+/* Doubles the number of buckets if the ones protected by "lock_index" hold
+ * more than one entry per bucket on average. If allocating fails, the memo
+ * simply keeps its size. */
+static void lu_memo_grow(lookup_t *obj, size_t lock_index) /* {{{ */
+{
+  lu_memo_lock_all(obj);
+
+  /* Another thread may have grown the memo in the meantime. */
+  size_t old_size = obj->memo_size;
+  if (obj->memo_num[lock_index] <= old_size / LU_MEMO_LOCKS) {
+    lu_memo_unlock_all(obj);
+    return;
+  }
+
+  size_t new_size = 2 * old_size;
+  lu_memo_entry_t **new_memo = calloc(new_size, sizeof(*new_memo));
+  if (new_memo == NULL) {
+    lu_memo_unlock_all(obj);
+    return;
+  }
+
+  for (size_t i = 0; i < old_size; i++) {
+    while (obj->memo[i] != NULL) {
+      lu_memo_entry_t *entry = obj->memo[i];
+      obj->memo[i] = entry->next;
+
+      size_t bucket = entry->hash & (new_size - 1);
+      entry->next = new_memo[bucket];
+      new_memo[bucket] = entry;
+    }
+  }
+
+  sfree(obj->memo);
+  obj->memo = new_memo;
+  obj->memo_size = new_size;
+
+  lu_memo_unlock_all(obj);
+} /* }}} void lu_memo_grow */
+
+/* Copies the memoized matches of "name" to "matches". Returns the number of
+ * matches or less than zero if "name" is not memoized. */
+static int lu_memo_get(lookup_t *obj, char const *name, /* {{{ */
+                       uint32_t hash, lu_match_t *matches) {
+  pthread_mutex_t *lock = &obj->memo_lock[hash & (LU_MEMO_LOCKS - 1)];
+  int status = -1;
+
+  pthread_mutex_lock(lock);
+  for (lu_memo_entry_t *entry = obj->memo[hash & (obj->memo_size - 1)];
+       entry != NULL; entry = entry->next) {
+    if ((entry->hash != hash) || (strcmp(entry->name, name) != 0))
+      continue;
+
+    if (entry->matches_num > 0)
+      memcpy(matches, entry->matches,
+             entry->matches_num * sizeof(*entry->matches));
+    status = (int)entry->matches_num;
+    break;
+  }
+  pthread_mutex_unlock(lock);
+
+  return status;
+} /* }}} int lu_memo_get */
+
+static void lu_memo_put(lookup_t *obj, char const *name, /* {{{ */
+                        uint32_t hash, lu_match_t const *matches,
+                        int matches_num) {
+  size_t lock_index = hash & (LU_MEMO_LOCKS - 1);
+  pthread_mutex_t *lock = &obj->memo_lock[lock_index];
+  size_t name_len = strlen(name);
+
+  /* Allocate outside of the lock. If this fails, the result is simply not
+   * memoized. */
+  lu_memo_entry_t *entry =
+      malloc(sizeof(*entry) + (size_t)matches_num * sizeof(*matches) +
+             name_len + 1);
+  if (entry == NULL)
+    return;
+  entry->hash = hash;
+  entry->matches = (lu_match_t *)(entry + 1);
+  entry->matches_num = (size_t)matches_num;
+  if (matches_num > 0)
+    memcpy(entry->matches, matches, (size_t)matches_num * sizeof(*matches));
+  entry->name = (char *)(entry->matches + matches_num);
+  memcpy(entry->name, name, name_len + 1);
+
+  pthread_mutex_lock(lock);
+  lu_memo_entry_t **head = &obj->memo[hash & (obj->memo_size - 1)];
+
+  /* Another thread may have memoized the same identifier in the meantime. */
+  for (lu_memo_entry_t *e = *head; e != NULL; e = e->next) {
+    if ((e->hash == hash) && (strcmp(e->name, name) == 0)) {
+      pthread_mutex_unlock(lock);
+      sfree(entry);
+      return;
+    }
+  }
+
+  entry->next = *head;
+  *head = entry;
+  obj->memo_num[lock_index]++;
+  _Bool grow = (obj->memo_num[lock_index] > obj->memo_size / LU_MEMO_LOCKS);
+  pthread_mutex_unlock(lock);
+
+  if (grow)
+    lu_memo_grow(obj, lock_index);
+} /* }}} void lu_memo_put */
 
 static by_type_entry_t *lu_search_by_type(lookup_t *obj, /* {{{ */
                                           char const *type,
@@ -356,6 +532,7 @@ static by_type_entry_t *lu_search_by_type(lookup_t *obj, /* {{{ */
     return NULL;
   }
   by_type->wildcard_plugin_list = NULL;
+  by_type->user_class_num = 0;
 
   by_type->by_plugin_tree =
       c_avl_create((int (*)(const void *, const void *))strcmp);
@@ -385,6 +562,8 @@ static int lu_add_by_plugin(by_type_entry_t *by_type, /* {{{ */
   user_class_list_t *ptr = NULL;
   identifier_match_t const *match = &user_class_list->entry.match;
 
+  by_type->user_class_num++;
+
   /* Lookup user_class_list from the per-plugin structure. If this is the first
    * user_class to be added, the block returns immediately. Otherwise they will
    * set "ptr" to non-NULL. */
@@ -532,6 +711,17 @@ lookup_t *lookup_create(lookup_class_callback_t cb_user_class, /* {{{ */
     return NULL;
   }
 
+  obj->memo_size = LU_MEMO_SIZE;
+  obj->memo = calloc(obj->memo_size, sizeof(*obj->memo));
+  if (obj->memo == NULL) {
+    ERROR("utils_vl_lookup: calloc failed.");
+    c_avl_destroy(obj->by_type_tree);
+    sfree(obj);
+    return NULL;
+  }
+  for (size_t i = 0; i < LU_MEMO_LOCKS; i++)
+    pthread_mutex_init(&obj->memo_lock[i], /* attr = */ NULL);
+
   obj->cb_user_class = cb_user_class;
   obj->cb_user_obj = cb_user_obj;
   obj->cb_free_class = cb_free_class;
@@ -563,6 +753,11 @@ void lookup_destroy(lookup_t *obj) /* {{{ */
   c_avl_destroy(obj->by_type_tree);
   obj->by_type_tree = NULL;
 
+  lu_memo_free_entries(obj);
+  sfree(obj->memo);
+  for (size_t i = 0; i < LU_MEMO_LOCKS; i++)
+    pthread_mutex_destroy(&obj->memo_lock[i]);
+
   sfree(obj);
 } /* }}} void lookup_destroy */
 
@@ -571,6 +766,7 @@ int lookup_add(lookup_t *obj, /* {{{ */
                void *user_class) {
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_obj;
+  int status;
 
   by_type = lu_search_by_type(obj, ident->type, /* allocate = */ 1);
   if (by_type == NULL)
@@ -587,7 +783,12 @@ int lookup_add(lookup_t *obj, /* {{{ */
   user_class_obj->entry.user_obj_list = NULL;
   user_class_obj->next = NULL;
 
-  return lu_add_by_plugin(by_type, user_class_obj);
+  status = lu_add_by_plugin(by_type, user_class_obj);
+
+  /* Memoized identifiers may match the new user class. */
+  lu_memo_clear(obj);
+
+  return status;
 } /* }}} int lookup_add */
 
 /* returns the number of successful calls to the callback function */
@@ -595,8 +796,11 @@ int lookup_search(lookup_t *obj, /* {{{ */
                   data_set_t const *ds, value_list_t const *vl) {
   by_type_entry_t *by_type = NULL;
   user_class_list_t *user_class_list = NULL;
+  char buffer[6 * DATA_MAX_NAME_LEN];
+  char const *name;
+  uint32_t hash;
+  int matches_num;
   int retval = 0;
-  int status;
 
   if ((obj == NULL) || (ds == NULL) || (vl == NULL))
     return -EINVAL;
@@ -605,21 +809,52 @@ int lookup_search(lookup_t *obj, /* {{{ */
   if (by_type == NULL)
     return 0;
 
-  status =
-      c_avl_get(by_type->by_plugin_tree, vl->plugin, (void *)&user_class_list);
-  if (status == 0) {
-    status = lu_handle_user_class_list(obj, ds, vl, user_class_list);
-    if (status < 0)
-      return status;
-    retval += status;
+  /* Use the identity computed by the dispatch thread if available. */
+  vl_ident_t const *ident = plugin_get_vl_ident(vl);
+  if (ident != NULL) {
+    name = ident->name;
+    hash = ident->hash;
+  } else {
+    if (FORMAT_VL(buffer, sizeof(buffer), vl) != 0)
+      return -EINVAL;
+    name = buffer;
+    hash = strhash(buffer);
   }
 
-  if (by_type->wildcard_plugin_list != NULL) {
-    status =
-        lu_handle_user_class_list(obj, ds, vl, by_type->wildcard_plugin_list);
-    if (status < 0)
-      return status;
-    retval += status;
+  lu_match_t matches[by_type->user_class_num];
+  matches_num = lu_memo_get(obj, name, hash, matches);
+  if (matches_num < 0) {
+    /* Not memoized: evaluate the user classes of this plugin first, then the
+     * ones with a wildcard plugin. */
+    matches_num = 0;
+    if (c_avl_get(by_type->by_plugin_tree, vl->plugin,
+                  (void *)&user_class_list) == 0) {
+      matches_num = lu_find_matches(obj, ds, vl, user_class_list, matches,
+                                    matches_num);
+      if (matches_num < 0)
+        return matches_num;
+    }
+
+    matches_num = lu_find_matches(obj, ds, vl, by_type->wildcard_plugin_list,
+                                  matches, matches_num);
+    if (matches_num < 0)
+      return matches_num;
+
+    lu_memo_put(obj, name, hash, matches, matches_num);
+  }
+
+  for (int i = 0; i < matches_num; i++) {
+    int status = obj->cb_user_obj(ds, vl, matches[i].user_class->user_class,
+                                  matches[i].user_obj->user_obj);
+    if (status != 0) {
+      ERROR("utils_vl_lookup: The user object callback failed with status %i.",
+            status);
+      /* Returning a negative value means: abort! */
+      if (status < 0)
+        return status;
+      continue;
+    }
+    retval++;
   }
 
   return retval;
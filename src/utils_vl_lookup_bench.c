@@ -0,0 +1,162 @@
+/**
+ * collectd - src/utils_vl_lookup_bench.c
+ * Copyright (C) 2017       collectd developers
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and associated documentation files (the "Software"),
+ * to deal in the Software without restriction, including without limitation
+ * the rights to use, copy, modify, merge, publish, distribute, sublicense,
+ * and/or sell copies of the Software, and to permit persons to whom the
+ * Software is furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+ * DEALINGS IN THE SOFTWARE.
+ *
+ * Authors:
+ *   collectd developers
+ **/
+
+
+/* Micro benchmark for lookup_search(). Searches the CPU states of a number of
+ * hosts with many cores each, which together have more identifiers than the
+ * memo has buckets initially, and compares the first round, in which every
+ * identifier is evaluated against the user classes, with the later rounds,
+ * which are answered from the memo.
+ *
+ * Usage: bench_utils_vl_lookup [<hosts> [<cores> [<rounds>]]] */
+
+#include "collectd.h"
+
+#include "common.h"
+#include "utils_vl_lookup.h"
+
+static vl_ident_t *current_ident = NULL;
+
+/* Stub for the function provided by the daemon. */
+vl_ident_t const *plugin_get_vl_ident(value_list_t const *vl) {
+  if ((current_ident == NULL) || (current_ident->vl != vl))
+    return NULL;
+  return current_ident;
+}
+
+static void *bench_class_callback(data_set_t const *ds, value_list_t const *vl,
+                                  void *user_class) {
+  return strdup(vl->host);
+}
+
+static int bench_obj_callback(data_set_t const *ds, value_list_t const *vl,
+                              void *user_class, void *user_obj) {
+  return 0;
+}
+
+static void bench_free(void *ptr) { free(ptr); }
+
+static double now_cpu(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+  return (double)ts.tv_sec + ((double)ts.tv_nsec) / 1e9;
+}
+
+static char const *cpu_states[] = {"user",  "system",    "wait",
+                                   "nice",  "softirq",   "steal",
+                                   "interrupt", "idle"};
+
+/* Returns the CPU time per search. */
+static double run(lookup_t *obj, data_set_t const *ds, size_t hosts_num,
+                  size_t cores_num, size_t rounds) {
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t value = {.derive = 0};
+  vl_ident_t ident = {.vl = &vl};
+  size_t searches = 0;
+
+  vl.values = &value;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "cpu", sizeof(vl.plugin));
+  sstrncpy(vl.type, "cpu", sizeof(vl.type));
+
+  double start = now_cpu();
+  for (size_t r = 0; r < rounds; r++) {
+    for (size_t h = 0; h < hosts_num; h++) {
+      ssnprintf(vl.host, sizeof(vl.host), "host%zu.example.com", h);
+      for (size_t c = 0; c < cores_num; c++) {
+        ssnprintf(vl.plugin_instance, sizeof(vl.plugin_instance), "%zu", c);
+        for (size_t s = 0; s < STATIC_ARRAY_SIZE(cpu_states); s++) {
+          sstrncpy(vl.type_instance, cpu_states[s], sizeof(vl.type_instance));
+
+          /* Done once per value list by plugin_dispatch_values_internal(). */
+          FORMAT_VL(ident.name, sizeof(ident.name), &vl);
+          ident.name_len = strlen(ident.name);
+          ident.hash = strhash(ident.name);
+          ident.valid = 1;
+          current_ident = &ident;
+
+          lookup_search(obj, ds, &vl);
+          current_ident = NULL;
+          searches++;
+        }
+      }
+    }
+  }
+
+  return (now_cpu() - start) / (double)searches;
+}
+
+int main(int argc, char **argv) {
+  size_t hosts_num = 4;
+  size_t cores_num = 256;
+  size_t rounds = 10;
+  data_source_t dsrc = {"value", DS_TYPE_DERIVE, 0.0, NAN};
+  data_set_t ds = {"cpu", 1, &dsrc};
+
+  if (argc > 1)
+    hosts_num = (size_t)atol(argv[1]);
+  if (argc > 2)
+    cores_num = (size_t)atol(argv[2]);
+  if (argc > 3)
+    rounds = (size_t)atol(argv[3]);
+  if ((hosts_num < 1) || (cores_num < 1) || (rounds < 1)) {
+    fprintf(stderr, "Usage: %s [<hosts> [<cores> [<rounds>]]]\n", argv[0]);
+    return 1;
+  }
+
+  lookup_t *obj = lookup_create(bench_class_callback, bench_obj_callback,
+                                bench_free, bench_free);
+  if (obj == NULL) {
+    fprintf(stderr, "lookup_create failed.\n");
+    return 1;
+  }
+
+  /* Like the example in the documentation of the aggregation plugin: the
+   * CPU states of each host, aggregated over all cores. */
+  lookup_identifier_t ident = {
+      .host = "/.*/",
+      .plugin = "cpu",
+      .plugin_instance = "/.*/",
+      .type = "cpu",
+      .type_instance = "/.*/",
+  };
+  if (lookup_add(obj, &ident, LU_GROUP_BY_HOST | LU_GROUP_BY_TYPE_INSTANCE,
+                 strdup("class")) != 0) {
+    fprintf(stderr, "lookup_add failed.\n");
+    return 1;
+  }
+
+  double per_search_first = run(obj, &ds, hosts_num, cores_num, 1);
+  double per_search_memo = run(obj, &ds, hosts_num, cores_num, rounds);
+
+  printf("identifiers: %zu, rounds: %zu\n",
+         hosts_num * cores_num * STATIC_ARRAY_SIZE(cpu_states), rounds);
+  printf("first round:  %8.1f ns/search\n", 1e9 * per_search_first);
+  printf("later rounds: %8.1f ns/search\n", 1e9 * per_search_memo);
+
+  lookup_destroy(obj);
+  return 0;
+}
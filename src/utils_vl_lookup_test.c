@@ -41,6 +41,10 @@ static data_set_t const ds_test = {"test", 1, &dsrc_test};
 static data_source_t dsrc_unknown = {"value", DS_TYPE_DERIVE, 0.0, NAN};
 static data_set_t const ds_unknown = {"unknown", 1, &dsrc_unknown};
 
+/* Value lists are not dispatched in this test, so lookup_search() has to
+ * format the identifier itself. */
+vl_ident_t const *plugin_get_vl_ident(value_list_t const *vl) { return NULL; }
+
 static int lookup_obj_callback(data_set_t const *ds, value_list_t const *vl,
                                void *user_class, void *user_obj) {
   lookup_identifier_t *class = user_class;
@@ -231,12 +235,81 @@ DEF_TEST(regex) {
   return 0;
 }
 
+DEF_TEST(memoization) {
+  lookup_t *obj;
+  CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/.*/", "plugin0", "", "test", "/.*/",
+                     LU_GROUP_BY_HOST);
+
+  /* The second search of an identifier is answered from the memo. */
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "plugin0", "", "test",
+                                         "0", /* expect new = */ 1));
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "plugin0", "", "test",
+                                         "0", /* expect new = */ 0));
+  EXPECT_EQ_STR("host0", last_obj_ident.host);
+  EXPECT_EQ_INT(0, checked_lookup_search(obj, "host0", "plugin1", "", "test",
+                                         "0", /* expect new = */ 0));
+  EXPECT_EQ_INT(0, checked_lookup_search(obj, "host0", "plugin1", "", "test",
+                                         "0", /* expect new = */ 0));
+
+  /* Adding a user class invalidates the memo. */
+  checked_lookup_add(obj, "/.*/", "/.*/", "", "test", "0", LU_GROUP_BY_HOST);
+  EXPECT_EQ_INT(1, checked_lookup_search(obj, "host0", "plugin1", "", "test",
+                                         "0", /* expect new = */ 1));
+  EXPECT_EQ_INT(2, checked_lookup_search(obj, "host1", "plugin0", "", "test",
+                                         "0", /* expect new = */ 1));
+  EXPECT_EQ_INT(2, checked_lookup_search(obj, "host0", "plugin0", "", "test",
+                                         "0", /* expect new = */ 0));
+
+  lookup_destroy(obj);
+  return 0;
+}
+
+/* More identifiers than the memo has buckets initially, e.g. the CPU states of
+ * several hosts with many cores. */
+DEF_TEST(memoization_many) {
+  lookup_t *obj;
+  CHECK_NOT_NULL(obj = lookup_create(lookup_class_callback, lookup_obj_callback,
+                                     (void *)free, (void *)free));
+
+  checked_lookup_add(obj, "/.*/", "cpu", "/.*/", "test", "/.*/",
+                     LU_GROUP_BY_HOST);
+
+  /* Only the first value list of each host creates a new object, also when
+   * the identifiers are searched again. */
+  for (int round = 0; round < 2; round++) {
+    for (int host = 0; host < 3; host++) {
+      char host_name[DATA_MAX_NAME_LEN];
+      snprintf(host_name, sizeof(host_name), "host%d", host);
+
+      int found = 0;
+      for (int cpu = 0; cpu < 2048; cpu++) {
+        char cpu_name[DATA_MAX_NAME_LEN];
+        snprintf(cpu_name, sizeof(cpu_name), "%d", cpu);
+
+        _Bool expect_new = (round == 0) && (cpu == 0);
+        found += checked_lookup_search(obj, host_name, "cpu", cpu_name, "test",
+                                       "user", expect_new);
+      }
+      EXPECT_EQ_INT(2048, found);
+      EXPECT_EQ_STR(host_name, last_obj_ident.host);
+    }
+  }
+
+  lookup_destroy(obj);
+  return 0;
+}
+
 int main(int argc, char **argv) /* {{{ */
 {
   RUN_TEST(group_by_specific_host);
   RUN_TEST(group_by_any_host);
   RUN_TEST(multiple_lookups);
   RUN_TEST(regex);
+  RUN_TEST(memoization);
+  RUN_TEST(memoization_many);
 
   END_TEST;
 } /* }}} int main */
@@ -38,6 +38,9 @@
  *     Protocol "udp"
  *     LogSendErrors true
  *     Prefix "collectd"
+ *     QueueSize 4194304
+ *     SpoolPath "/var/lib/collectd/write_graphite"
+ *     ReplayRate 10000
  *   </Carbon>
  * </Plugin>
  */
@@ -81,6 +84,29 @@
 #define WG_MIN_RECONNECT_INTERVAL TIME_T_TO_CDTIME_T(1)
 #endif
 
+#ifndef WG_REPLAY_INTERVAL
+#define WG_REPLAY_INTERVAL MS_TO_CDTIME_T(100)
+#endif
+
+#ifndef WG_DEFAULT_QUEUE_SIZE
+#define WG_DEFAULT_QUEUE_SIZE (4 * 1024 * 1024)
+#endif
+
+/* in megabytes */
+#ifndef WG_DEFAULT_SPOOL_MAX_SIZE
+#define WG_DEFAULT_SPOOL_MAX_SIZE 1024
+#endif
+
+/* in megabytes */
+#ifndef WG_DEFAULT_SPOOL_SEGMENT_SIZE
+#define WG_DEFAULT_SPOOL_SEGMENT_SIZE 16
+#endif
+
+/* in lines per second */
+#ifndef WG_DEFAULT_REPLAY_RATE
+#define WG_DEFAULT_REPLAY_RATE 10000.0
+#endif
+
 /*
  * Private variables
  */
@@ -99,27 +125,71 @@ struct wg_callback {
 
   unsigned int format_flags;
 
+  /* The send buffer, the socket and the spool are only accessed by the sender
+   * thread. */
   char send_buf[WG_SEND_BUF_SIZE];
-  size_t send_buf_free;
   size_t send_buf_fill;
   cdtime_t send_buf_init_time;
 
-  pthread_mutex_t send_lock;
   c_complain_t init_complaint;
   cdtime_t last_connect_time;
 
   /* Force reconnect useful for load balanced environments */
   cdtime_t last_reconnect_time;
   cdtime_t reconnect_interval;
-  _Bool reconnect_interval_reached;
+
+  /* Queue between the write threads and the sender thread. This is a ring of
+   * bytes holding records, each of which is a uint32_t length followed by the
+   * lines formatted for one value list. */
+  pthread_mutex_t queue_lock;
+  pthread_cond_t queue_cond;
+  char *queue;
+  size_t queue_size;
+  size_t queue_head;
+  size_t queue_fill;
+  _Bool flush_requested;
+  cdtime_t flush_timeout;
+  _Bool shutdown;
+  uint64_t queue_dropped;
+  c_complain_t queue_complaint;
+
+  pthread_t sender_thread;
+  _Bool sender_running;
+  uint64_t send_dropped;
+
+  /* Optional on-disk spool: append-only segment files named
+   * "<seq>.spool". Segments [spool_first, spool_next) may exist; the writer,
+   * if open, appends to segment spool_next - 1. spool_size is the number of
+   * bytes which have not been replayed yet. */
+  char *spool_path;
+  uint64_t spool_max_size;
+  uint64_t spool_segment_size;
+  uint64_t spool_size;
+  uint64_t spool_first;
+  uint64_t spool_next;
+  int spool_writer_fd;
+  uint64_t spool_writer_size;
+  int spool_reader_fd;
+  off_t spool_reader_offset;
+  off_t spool_reader_size;
+  c_complain_t spool_complaint;
+
+  /* Replay rate limit in lines per second, zero disables the limit. */
+  double replay_rate;
+  double replay_tokens;
+  cdtime_t replay_last;
 };
 
+/* Callbacks whose sender thread is started by wg_init(). */
+static struct wg_callback **wg_callbacks = NULL;
+static size_t wg_callbacks_num = 0;
+
 /* wg_force_reconnect_check closes cb->sock_fd when it was open for longer
- * than cb->reconnect_interval. Must hold cb->send_lock when calling. */
+ * than cb->reconnect_interval. Must only be called by the sender thread. */
 static void wg_force_reconnect_check(struct wg_callback *cb) {
   cdtime_t now;
 
-  if (cb->reconnect_interval == 0)
+  if ((cb->reconnect_interval == 0) || (cb->sock_fd < 0))
     return;
 
   /* check if address changes if addr_timeout */
@@ -131,7 +201,6 @@ static void wg_force_reconnect_check(struct wg_callback *cb) {
   close(cb->sock_fd);
   cb->sock_fd = -1;
   cb->last_reconnect_time = now;
-  cb->reconnect_interval_reached = 1;
 
   INFO("write_graphite plugin: Connection closed after %.3f seconds.",
        CDTIME_T_TO_DOUBLE(now - cb->last_reconnect_time));
@@ -140,20 +209,13 @@ static void wg_force_reconnect_check(struct wg_callback *cb) {
 /*
  * Functions
  */
-static void wg_reset_buffer(struct wg_callback *cb) {
-  memset(cb->send_buf, 0, sizeof(cb->send_buf));
-  cb->send_buf_free = sizeof(cb->send_buf);
-  cb->send_buf_fill = 0;
-  cb->send_buf_init_time = cdtime();
-}
-
-static int wg_send_buffer(struct wg_callback *cb) {
+static int wg_send_data(struct wg_callback *cb, char const *data, size_t len) {
   ssize_t status;
 
   if (cb->sock_fd < 0)
     return -1;
 
-  status = swrite(cb->sock_fd, cb->send_buf, strlen(cb->send_buf));
+  status = swrite(cb->sock_fd, data, len);
   if (status != 0) {
     if (cb->log_send_errors) {
       char errbuf[1024];
@@ -172,34 +234,6 @@ static int wg_send_buffer(struct wg_callback *cb) {
   return 0;
 }
 
-/* NOTE: You must hold cb->send_lock when calling this function! */
-static int wg_flush_nolock(cdtime_t timeout, struct wg_callback *cb) {
-  int status;
-
-  DEBUG("write_graphite plugin: wg_flush_nolock: timeout = %.3f; "
-        "send_buf_fill = %zu;",
-        (double)timeout, cb->send_buf_fill);
-
-  /* timeout == 0  => flush unconditionally */
-  if (timeout > 0) {
-    cdtime_t now;
-
-    now = cdtime();
-    if ((cb->send_buf_init_time + timeout) > now)
-      return 0;
-  }
-
-  if (cb->send_buf_fill == 0) {
-    cb->send_buf_init_time = cdtime();
-    return 0;
-  }
-
-  status = wg_send_buffer(cb);
-  wg_reset_buffer(cb);
-
-  return status;
-}
-
 static int wg_callback_init(struct wg_callback *cb) {
   struct addrinfo *ai_list;
   cdtime_t now;
@@ -227,8 +261,9 @@ static int wg_callback_init(struct wg_callback *cb) {
 
   status = getaddrinfo(cb->node, cb->service, &ai_hints, &ai_list);
   if (status != 0) {
-    ERROR("write_graphite plugin: getaddrinfo (%s, %s, %s) failed: %s",
-          cb->node, cb->service, cb->protocol, gai_strerror(status));
+    c_complain(LOG_ERR, &cb->init_complaint,
+               "write_graphite plugin: getaddrinfo (%s, %s, %s) failed: %s",
+               cb->node, cb->service, cb->protocol, gai_strerror(status));
     return -1;
   }
 
@@ -277,13 +312,522 @@ static int wg_callback_init(struct wg_callback *cb) {
               cb->node, cb->service, cb->protocol);
   }
 
-  /* wg_force_reconnect_check does not flush the buffer before closing a
-   * sending socket, so only call wg_reset_buffer() if the socket was closed
-   * for a different reason (tracked in cb->reconnect_interval_reached). */
-  if (!cb->reconnect_interval_reached || (cb->send_buf_free == 0))
-    wg_reset_buffer(cb);
-  else
-    cb->reconnect_interval_reached = 0;
+  cb->last_reconnect_time = now;
+  /* Start with a full bucket, so a burst is replayed right away. */
+  cb->replay_tokens = cb->replay_rate;
+  cb->replay_last = now;
+
+  return 0;
+}
+
+/*
+ * Spool
+ */
+static void wg_spool_segment_name(struct wg_callback *cb, uint64_t seq,
+                                  char *buffer, size_t buffer_size) {
+  ssnprintf(buffer, buffer_size, "%s/%020" PRIu64 ".spool", cb->spool_path,
+            seq);
+}
+
+static void wg_spool_close_writer(struct wg_callback *cb) {
+  if (cb->spool_writer_fd < 0)
+    return;
+
+  close(cb->spool_writer_fd);
+  cb->spool_writer_fd = -1;
+  cb->spool_writer_size = 0;
+}
+
+static void wg_spool_close_reader(struct wg_callback *cb) {
+  if (cb->spool_reader_fd < 0)
+    return;
+
+  close(cb->spool_reader_fd);
+  cb->spool_reader_fd = -1;
+  cb->spool_reader_offset = 0;
+  cb->spool_reader_size = 0;
+}
+
+/* Removes the oldest segment, including any data not yet replayed from it. */
+static void wg_spool_remove_first(struct wg_callback *cb) {
+  char path[PATH_MAX];
+  uint64_t remaining = 0;
+
+  wg_spool_segment_name(cb, cb->spool_first, path, sizeof(path));
+
+  if (cb->spool_reader_fd >= 0) {
+    remaining = (uint64_t)(cb->spool_reader_size - cb->spool_reader_offset);
+    wg_spool_close_reader(cb);
+  } else {
+    struct stat statbuf;
+    if (stat(path, &statbuf) == 0)
+      remaining = (uint64_t)statbuf.st_size;
+  }
+
+  if ((unlink(path) != 0) && (errno != ENOENT)) {
+    char errbuf[1024];
+    ERROR("write_graphite plugin: unlink (%s) failed: %s", path,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+  }
+
+  cb->spool_size -= (remaining < cb->spool_size) ? remaining : cb->spool_size;
+  cb->spool_first++;
+}
+
+/* Appends data to the spool. Returns zero on success; when the spool is not
+ * configured or the data does not fit, the data is dropped and non-zero is
+ * returned. */
+static int wg_spool_write(struct wg_callback *cb, char const *data,
+                          size_t len) {
+  if (cb->spool_path == NULL)
+    return -1;
+
+  /* Make room by dropping the oldest closed segments. */
+  while ((cb->spool_size + len > cb->spool_max_size) &&
+         (cb->spool_first + ((cb->spool_writer_fd >= 0) ? 1 : 0) <
+          cb->spool_next)) {
+    c_complain(LOG_WARNING, &cb->spool_complaint,
+               "write_graphite plugin: %s: The spool in \"%s\" is full. "
+               "Dropping the oldest segment.",
+               cb->name, cb->spool_path);
+    wg_spool_remove_first(cb);
+  }
+
+  if (cb->spool_size + len > cb->spool_max_size) {
+    c_complain(LOG_WARNING, &cb->spool_complaint,
+               "write_graphite plugin: %s: The spool in \"%s\" is full. "
+               "Dropping data.",
+               cb->name, cb->spool_path);
+    return -1;
+  }
+
+  if ((cb->spool_writer_fd >= 0) &&
+      (cb->spool_writer_size >= cb->spool_segment_size))
+    wg_spool_close_writer(cb);
+
+  if (cb->spool_writer_fd < 0) {
+    char path[PATH_MAX];
+
+    wg_spool_segment_name(cb, cb->spool_next, path, sizeof(path));
+    cb->spool_writer_fd =
+        open(path, O_WRONLY | O_CREAT | O_APPEND, 0640);
+    if (cb->spool_writer_fd < 0) {
+      char errbuf[1024];
+      c_complain(LOG_ERR, &cb->spool_complaint,
+                 "write_graphite plugin: open (%s) failed: %s", path,
+                 sstrerror(errno, errbuf, sizeof(errbuf)));
+      return -1;
+    }
+    cb->spool_next++;
+    cb->spool_writer_size = 0;
+  }
+
+  if (swrite(cb->spool_writer_fd, data, len) != 0) {
+    char errbuf[1024];
+    c_complain(LOG_ERR, &cb->spool_complaint,
+               "write_graphite plugin: Writing to the spool in \"%s\" "
+               "failed: %s",
+               cb->spool_path, sstrerror(errno, errbuf, sizeof(errbuf)));
+    /* Start a new segment with the next write: the partially written line
+     * will be dropped when this segment is replayed. */
+    wg_spool_close_writer(cb);
+    return -1;
+  }
+
+  cb->spool_writer_size += len;
+  cb->spool_size += len;
+
+  c_release(LOG_INFO, &cb->spool_complaint,
+            "write_graphite plugin: %s: Writing to the spool in \"%s\" "
+            "succeeded.",
+            cb->name, cb->spool_path);
+  return 0;
+}
+
+/* Sends up to one packet from the oldest segment. Returns the number of
+ * lines sent, zero when no data could be sent and -1 on error. */
+static int wg_spool_replay_one(struct wg_callback *cb) {
+  char buffer[WG_SEND_BUF_SIZE];
+  char path[PATH_MAX];
+
+  if (cb->spool_first == cb->spool_next)
+    return 0;
+
+  wg_spool_segment_name(cb, cb->spool_first, path, sizeof(path));
+
+  if (cb->spool_reader_fd < 0) {
+    struct stat statbuf;
+
+    /* Never read a segment which is still being appended to. */
+    if ((cb->spool_writer_fd >= 0) && (cb->spool_first + 1 == cb->spool_next))
+      wg_spool_close_writer(cb);
+
+    cb->spool_reader_fd = open(path, O_RDONLY);
+    if ((cb->spool_reader_fd < 0) ||
+        (fstat(cb->spool_reader_fd, &statbuf) != 0)) {
+      char errbuf[1024];
+      if (errno != ENOENT)
+        ERROR("write_graphite plugin: Opening \"%s\" failed: %s", path,
+              sstrerror(errno, errbuf, sizeof(errbuf)));
+      wg_spool_close_reader(cb);
+      wg_spool_remove_first(cb);
+      return 0;
+    }
+    cb->spool_reader_offset = 0;
+    cb->spool_reader_size = statbuf.st_size;
+  }
+
+  ssize_t status = pread(cb->spool_reader_fd, buffer, sizeof(buffer),
+                         cb->spool_reader_offset);
+  if (status < 0) {
+    char errbuf[1024];
+    ERROR("write_graphite plugin: Reading \"%s\" failed: %s", path,
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    wg_spool_remove_first(cb);
+    return -1;
+  }
+
+  /* Only send complete lines, and not more than the rate limit allows. */
+  size_t max_lines = (size_t)cb->replay_tokens;
+  if (cb->replay_rate <= 0.0)
+    max_lines = SIZE_MAX;
+
+  size_t len = 0;
+  size_t lines_num = 0;
+  for (size_t i = 0; (i < (size_t)status) && (lines_num < max_lines); i++) {
+    if (buffer[i] != '\n')
+      continue;
+    len = i + 1;
+    lines_num++;
+  }
+
+  if (len == 0) {
+    if (max_lines == 0)
+      return 0;
+
+    /* End of the segment, possibly with an incomplete line left over by a
+     * failed write. A line longer than the buffer can not have been written
+     * by this plugin either, so the rest of the segment is dropped in both
+     * cases. */
+    if ((size_t)status > 0)
+      WARNING("write_graphite plugin: Dropping %zd bytes of incomplete data "
+              "from \"%s\".",
+              (ssize_t)(cb->spool_reader_size - cb->spool_reader_offset),
+              path);
+    wg_spool_remove_first(cb);
+    return 0;
+  }
+
+  if (wg_send_data(cb, buffer, len) != 0)
+    return -1;
+
+  cb->spool_reader_offset += (off_t)len;
+  cb->spool_size -= (len < cb->spool_size) ? len : cb->spool_size;
+  if (cb->replay_rate > 0.0)
+    cb->replay_tokens -= (double)lines_num;
+
+  if (cb->spool_reader_offset >= cb->spool_reader_size)
+    wg_spool_remove_first(cb);
+
+  return (int)lines_num;
+}
+
+/* Replays spooled data while the rate limit allows. */
+static void wg_spool_replay(struct wg_callback *cb) {
+  if ((cb->spool_size == 0) || (cb->sock_fd < 0))
+    return;
+
+  if (cb->replay_rate > 0.0) {
+    cdtime_t now = cdtime();
+
+    cb->replay_tokens +=
+        cb->replay_rate * CDTIME_T_TO_DOUBLE(now - cb->replay_last);
+    /* Allow bursts of up to one second. */
+    if (cb->replay_tokens > cb->replay_rate)
+      cb->replay_tokens = cb->replay_rate;
+    cb->replay_last = now;
+  }
+
+  /* Return to the queue regularly, live data takes precedence. */
+  for (int i = 0; (i < 256) && (cb->spool_first != cb->spool_next); i++) {
+    int status = wg_spool_replay_one(cb);
+    if (status < 0)
+      break;
+    /* Zero means nothing was sent: either the rate limit has been reached or
+     * an empty or broken segment has been removed. */
+    if ((status == 0) && (cb->replay_rate > 0.0) && (cb->replay_tokens < 1.0))
+      break;
+  }
+
+  if (cb->spool_size == 0)
+    INFO("write_graphite plugin: %s: Finished replaying the spool in \"%s\".",
+         cb->name, cb->spool_path);
+}
+
+static int wg_spool_scan_cb(const char *dirname, const char *filename,
+                            void *user_data) {
+  struct wg_callback *cb = user_data;
+  char path[PATH_MAX];
+  struct stat statbuf;
+  char *endptr = NULL;
+
+  errno = 0;
+  uint64_t seq = (uint64_t)strtoull(filename, &endptr, 10);
+  if ((errno != 0) || (endptr == filename) || (strcmp(".spool", endptr) != 0))
+    return 0;
+
+  ssnprintf(path, sizeof(path), "%s/%s", dirname, filename);
+  if (stat(path, &statbuf) != 0)
+    return 0;
+
+  if ((cb->spool_first == cb->spool_next) || (seq < cb->spool_first))
+    cb->spool_first = seq;
+  if (seq >= cb->spool_next)
+    cb->spool_next = seq + 1;
+  cb->spool_size += (uint64_t)statbuf.st_size;
+
+  return 0;
+}
+
+/* Creates the spool directory and picks up segments left over by a previous
+ * run, so they are replayed as well. */
+static int wg_spool_init(struct wg_callback *cb) {
+  char dir[PATH_MAX];
+
+  if (cb->spool_path == NULL)
+    return 0;
+
+  ssnprintf(dir, sizeof(dir), "%s/", cb->spool_path);
+  if (check_create_dir(dir) != 0) {
+    ERROR("write_graphite plugin: Creating the spool directory \"%s\" failed.",
+          cb->spool_path);
+    return -1;
+  }
+
+  cb->spool_first = cb->spool_next = 0;
+  cb->spool_size = 0;
+  walk_directory(cb->spool_path, wg_spool_scan_cb, cb, /* hidden = */ 0);
+
+  if (cb->spool_size > 0)
+    INFO("write_graphite plugin: %s: Found %" PRIu64 " bytes of spooled data "
+         "in \"%s\".",
+         cb->name, cb->spool_size, cb->spool_path);
+
+  return 0;
+}
+
+/*
+ * Queue
+ */
+static void wg_queue_peek(struct wg_callback *cb, size_t offset, void *data,
+                          size_t len) {
+  size_t pos = (cb->queue_head + offset) % cb->queue_size;
+  size_t n = cb->queue_size - pos;
+
+  if (n > len)
+    n = len;
+  memcpy(data, cb->queue + pos, n);
+  memcpy((char *)data + n, cb->queue, len - n);
+}
+
+static void wg_queue_put(struct wg_callback *cb, void const *data, size_t len) {
+  size_t pos = (cb->queue_head + cb->queue_fill) % cb->queue_size;
+  size_t n = cb->queue_size - pos;
+
+  if (n > len)
+    n = len;
+  memcpy(cb->queue + pos, data, n);
+  memcpy(cb->queue, (char const *)data + n, len - n);
+  cb->queue_fill += len;
+}
+
+/* Enqueues one record. Called by the write threads; never blocks on I/O. */
+static int wg_enqueue(struct wg_callback *cb, char const *message,
+                      size_t message_len) {
+  uint32_t len = (uint32_t)message_len;
+  size_t record_len = sizeof(len) + message_len;
+
+  pthread_mutex_lock(&cb->queue_lock);
+
+  if (cb->queue_size - cb->queue_fill < record_len) {
+    cb->queue_dropped++;
+    c_complain(LOG_WARNING, &cb->queue_complaint,
+               "write_graphite plugin: %s: The send queue is full, dropping "
+               "values. Is %s:%s reachable?",
+               cb->name, cb->node, cb->service);
+    pthread_mutex_unlock(&cb->queue_lock);
+    return -1;
+  }
+
+  size_t old_fill = cb->queue_fill;
+  wg_queue_put(cb, &len, sizeof(len));
+  wg_queue_put(cb, message, message_len);
+
+  /* Only wake up the sender when there is enough data for a full packet, or
+   * when data may have to be moved to the spool. */
+  if (((old_fill < WG_SEND_BUF_SIZE) && (cb->queue_fill >= WG_SEND_BUF_SIZE)) ||
+      ((old_fill <= cb->queue_size / 2) &&
+       (cb->queue_fill > cb->queue_size / 2)))
+    pthread_cond_signal(&cb->queue_cond);
+
+  c_release(LOG_INFO, &cb->queue_complaint,
+            "write_graphite plugin: %s: The send queue accepts values again.",
+            cb->name);
+
+  pthread_mutex_unlock(&cb->queue_lock);
+  return 0;
+}
+
+/*
+ * Sender thread
+ */
+static void wg_reset_buffer(struct wg_callback *cb) {
+  cb->send_buf_fill = 0;
+  cb->send_buf_init_time = cdtime();
+}
+
+/* Sends the send buffer. If the connection is down, the data is written to
+ * the spool or, if there is none, dropped. */
+static void wg_send_buffer(struct wg_callback *cb) {
+  if (cb->send_buf_fill == 0)
+    return;
+
+  wg_force_reconnect_check(cb);
+  if (cb->sock_fd < 0)
+    wg_callback_init(cb);
+
+  if ((cb->sock_fd < 0) ||
+      (wg_send_data(cb, cb->send_buf, cb->send_buf_fill) != 0)) {
+    if (wg_spool_write(cb, cb->send_buf, cb->send_buf_fill) != 0)
+      cb->send_dropped++;
+  }
+
+  wg_reset_buffer(cb);
+}
+
+/* Moves queued records into the send buffer and sends every full buffer. When
+ * "flush" is true, a partially filled buffer is sent, too, if it is older than
+ * "timeout". */
+static void wg_drain_queue(struct wg_callback *cb, _Bool flush,
+                           cdtime_t timeout) {
+  _Bool more;
+
+  do {
+    pthread_mutex_lock(&cb->queue_lock);
+    while (cb->queue_fill > 0) {
+      uint32_t len;
+
+      wg_queue_peek(cb, 0, &len, sizeof(len));
+      if (cb->send_buf_fill + len > sizeof(cb->send_buf))
+        break;
+
+      if (cb->send_buf_fill == 0)
+        cb->send_buf_init_time = cdtime();
+      wg_queue_peek(cb, sizeof(len), cb->send_buf + cb->send_buf_fill, len);
+      cb->send_buf_fill += len;
+
+      cb->queue_head = (cb->queue_head + sizeof(len) + len) % cb->queue_size;
+      cb->queue_fill -= sizeof(len) + len;
+    }
+    more = (cb->queue_fill > 0);
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    if (more)
+      wg_send_buffer(cb);
+  } while (more);
+
+  if (!flush || (cb->send_buf_fill == 0))
+    return;
+
+  /* timeout == 0  => flush unconditionally */
+  if ((timeout > 0) && ((cb->send_buf_init_time + timeout) > cdtime()))
+    return;
+
+  wg_send_buffer(cb);
+}
+
+/* Returns true if the sender has something to do right away. Must hold
+ * cb->queue_lock when calling. */
+static _Bool wg_sender_has_work(struct wg_callback *cb) {
+  if (cb->shutdown || cb->flush_requested)
+    return 1;
+
+  if (cb->sock_fd >= 0)
+    return cb->queue_fill >= WG_SEND_BUF_SIZE;
+
+  /* While the connection is down, the queue absorbs short outages. Only move
+   * data to the spool when the queue fills up. */
+  return (cb->spool_path != NULL) && (cb->queue_fill > cb->queue_size / 2);
+}
+
+static void *wg_sender_thread(void *arg) {
+  struct wg_callback *cb = arg;
+  _Bool shutdown = 0;
+
+  while (!shutdown) {
+    _Bool flush;
+    cdtime_t flush_timeout;
+
+    /* Wake up regularly to reconnect and to replay the spool. */
+    cdtime_t wait = WG_MIN_RECONNECT_INTERVAL;
+    if ((cb->sock_fd >= 0) && (cb->spool_size > 0))
+      wait = WG_REPLAY_INTERVAL;
+
+    pthread_mutex_lock(&cb->queue_lock);
+    if (!wg_sender_has_work(cb)) {
+      struct timespec ts = CDTIME_T_TO_TIMESPEC(cdtime() + wait);
+      pthread_cond_timedwait(&cb->queue_cond, &cb->queue_lock, &ts);
+    }
+    shutdown = cb->shutdown;
+    flush = cb->flush_requested;
+    flush_timeout = cb->flush_timeout;
+    cb->flush_requested = 0;
+    _Bool spill = (cb->queue_fill > cb->queue_size / 2);
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    if (shutdown && (cb->sock_fd < 0))
+      cb->last_connect_time = 0; /* one last attempt */
+
+    wg_force_reconnect_check(cb);
+    if (cb->sock_fd < 0)
+      wg_callback_init(cb);
+
+    if ((cb->sock_fd >= 0) || shutdown ||
+        (spill && (cb->spool_path != NULL))) {
+      wg_drain_queue(cb, flush || shutdown, shutdown ? 0 : flush_timeout);
+    }
+
+    if (!shutdown)
+      wg_spool_replay(cb);
+  }
+
+  wg_spool_close_writer(cb);
+  wg_spool_close_reader(cb);
+
+  if (cb->queue_dropped + cb->send_dropped > 0)
+    INFO("write_graphite plugin: %s: Dropped %" PRIu64 " value lists and %" PRIu64
+         " send buffers.",
+         cb->name, cb->queue_dropped, cb->send_dropped);
+
+  return NULL;
+} /* void *wg_sender_thread */
+
+static int wg_sender_start(struct wg_callback *cb) {
+  if (cb->sender_running)
+    return 0;
+
+  if (wg_spool_init(cb) != 0) {
+    /* Keep going without the spool. */
+    sfree(cb->spool_path);
+  }
+
+  int status = plugin_thread_create(&cb->sender_thread, /* attr = */ NULL,
+                                    wg_sender_thread, cb, "write_graphite");
+  if (status != 0) {
+    ERROR("write_graphite plugin: Starting the sender thread failed.");
+    return -1;
+  }
+  cb->sender_running = 1;
 
   return 0;
 }
@@ -296,9 +840,16 @@ static void wg_callback_free(void *data) {
 
   cb = data;
 
-  pthread_mutex_lock(&cb->send_lock);
+  /* The sender thread sends, or spools, everything which is still queued. */
+  if (cb->sender_running) {
+    pthread_mutex_lock(&cb->queue_lock);
+    cb->shutdown = 1;
+    pthread_cond_signal(&cb->queue_cond);
+    pthread_mutex_unlock(&cb->queue_lock);
 
-  wg_flush_nolock(/* timeout = */ 0, cb);
+    pthread_join(cb->sender_thread, /* retval = */ NULL);
+    cb->sender_running = 0;
+  }
 
   if (cb->sock_fd >= 0) {
     close(cb->sock_fd);
@@ -311,8 +862,11 @@ static void wg_callback_free(void *data) {
   sfree(cb->service);
   sfree(cb->prefix);
   sfree(cb->postfix);
+  sfree(cb->spool_path);
+  sfree(cb->queue);
 
-  pthread_mutex_destroy(&cb->send_lock);
+  pthread_cond_destroy(&cb->queue_cond);
+  pthread_mutex_destroy(&cb->queue_lock);
 
   sfree(cb);
 }
@@ -321,73 +875,18 @@ static int wg_flush(cdtime_t timeout,
                     const char *identifier __attribute__((unused)),
                     user_data_t *user_data) {
   struct wg_callback *cb;
-  int status;
 
   if (user_data == NULL)
     return -EINVAL;
 
   cb = user_data->data;
 
-  pthread_mutex_lock(&cb->send_lock);
-
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  status = wg_flush_nolock(timeout, cb);
-  pthread_mutex_unlock(&cb->send_lock);
-
-  return status;
-}
-
-static int wg_send_message(char const *message, struct wg_callback *cb) {
-  int status;
-  size_t message_len;
-
-  message_len = strlen(message);
-
-  pthread_mutex_lock(&cb->send_lock);
-
-  wg_force_reconnect_check(cb);
-
-  if (cb->sock_fd < 0) {
-    status = wg_callback_init(cb);
-    if (status != 0) {
-      /* An error message has already been printed. */
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
-  if (message_len >= cb->send_buf_free) {
-    status = wg_flush_nolock(/* timeout = */ 0, cb);
-    if (status != 0) {
-      pthread_mutex_unlock(&cb->send_lock);
-      return status;
-    }
-  }
-
-  /* Assert that we have enough space for this message. */
-  assert(message_len < cb->send_buf_free);
-
-  /* `message_len + 1' because `message_len' does not include the
-   * trailing null byte. Neither does `send_buffer_fill'. */
-  memcpy(cb->send_buf + cb->send_buf_fill, message, message_len + 1);
-  cb->send_buf_fill += message_len;
-  cb->send_buf_free -= message_len;
-
-  DEBUG("write_graphite plugin: [%s]:%s (%s) buf %zu/%zu (%.1f %%) \"%s\"",
-        cb->node, cb->service, cb->protocol, cb->send_buf_fill,
-        sizeof(cb->send_buf),
-        100.0 * ((double)cb->send_buf_fill) / ((double)sizeof(cb->send_buf)),
-        message);
-
-  pthread_mutex_unlock(&cb->send_lock);
+  pthread_mutex_lock(&cb->queue_lock);
+  if (!cb->flush_requested || (timeout < cb->flush_timeout))
+    cb->flush_timeout = timeout;
+  cb->flush_requested = 1;
+  pthread_cond_signal(&cb->queue_cond);
+  pthread_mutex_unlock(&cb->queue_lock);
 
   return 0;
 }
@@ -408,8 +907,8 @@ static int wg_write_messages(const data_set_t *ds, const value_list_t *vl,
   if (status != 0) /* error message has been printed already. */
     return status;
 
-  /* Send the message to graphite */
-  status = wg_send_message(buffer, cb);
+  /* Hand the message over to the sender thread */
+  status = wg_enqueue(cb, buffer, strlen(buffer));
   if (status != 0) /* error message has been printed already. */
     return status;
 
@@ -467,18 +966,30 @@ static int wg_config_node(oconfig_item_t *ci) {
     return -1;
   }
   cb->sock_fd = -1;
+  cb->spool_writer_fd = -1;
+  cb->spool_reader_fd = -1;
   cb->name = NULL;
   cb->node = strdup(WG_DEFAULT_NODE);
   cb->service = strdup(WG_DEFAULT_SERVICE);
   cb->protocol = strdup(WG_DEFAULT_PROTOCOL);
-  cb->last_reconnect_time = cdtime();
   cb->reconnect_interval = 0;
-  cb->reconnect_interval_reached = 0;
   cb->log_send_errors = WG_DEFAULT_LOG_SEND_ERRORS;
   cb->prefix = NULL;
   cb->postfix = NULL;
   cb->escape_char = WG_DEFAULT_ESCAPE;
   cb->format_flags = GRAPHITE_STORE_RATES;
+  cb->queue_size = WG_DEFAULT_QUEUE_SIZE;
+  cb->replay_rate = WG_DEFAULT_REPLAY_RATE;
+
+  int spool_max_size = WG_DEFAULT_SPOOL_MAX_SIZE;
+  int spool_segment_size = WG_DEFAULT_SPOOL_SEGMENT_SIZE;
+  int queue_size = WG_DEFAULT_QUEUE_SIZE;
+
+  pthread_mutex_init(&cb->queue_lock, /* attr = */ NULL);
+  pthread_cond_init(&cb->queue_cond, /* attr = */ NULL);
+  C_COMPLAIN_INIT(&cb->init_complaint);
+  C_COMPLAIN_INIT(&cb->queue_complaint);
+  C_COMPLAIN_INIT(&cb->spool_complaint);
 
   /* FIXME: Legacy configuration syntax. */
   if (strcasecmp("Carbon", ci->key) != 0) {
@@ -489,9 +1000,6 @@ static int wg_config_node(oconfig_item_t *ci) {
     }
   }
 
-  pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
-  C_COMPLAIN_INIT(&cb->init_complaint);
-
   for (int i = 0; i < ci->children_num; i++) {
     oconfig_item_t *child = ci->children + i;
 
@@ -527,6 +1035,16 @@ static int wg_config_node(oconfig_item_t *ci) {
       cf_util_get_flag(child, &cb->format_flags, GRAPHITE_DROP_DUPE_FIELDS);
     else if (strcasecmp("EscapeCharacter", child->key) == 0)
       config_set_char(&cb->escape_char, child);
+    else if (strcasecmp("QueueSize", child->key) == 0)
+      status = cf_util_get_int(child, &queue_size);
+    else if (strcasecmp("SpoolPath", child->key) == 0)
+      status = cf_util_get_string(child, &cb->spool_path);
+    else if (strcasecmp("SpoolMaxSize", child->key) == 0)
+      status = cf_util_get_int(child, &spool_max_size);
+    else if (strcasecmp("SpoolSegmentSize", child->key) == 0)
+      status = cf_util_get_int(child, &spool_segment_size);
+    else if (strcasecmp("ReplayRate", child->key) == 0)
+      status = cf_util_get_double(child, &cb->replay_rate);
     else {
       ERROR("write_graphite plugin: Invalid configuration "
             "option: %s.",
@@ -538,19 +1056,60 @@ static int wg_config_node(oconfig_item_t *ci) {
       break;
   }
 
+  if ((status == 0) && (queue_size < 2 * WG_SEND_BUF_SIZE)) {
+    ERROR("write_graphite plugin: QueueSize must be at least %d.",
+          2 * WG_SEND_BUF_SIZE);
+    status = -1;
+  }
+  if ((status == 0) && ((spool_max_size < 1) || (spool_segment_size < 1) ||
+                        (spool_segment_size > spool_max_size))) {
+    ERROR("write_graphite plugin: SpoolMaxSize and SpoolSegmentSize must be "
+          "positive and SpoolSegmentSize must not exceed SpoolMaxSize.");
+    status = -1;
+  }
+  if ((status == 0) && (cb->replay_rate < 0.0)) {
+    ERROR("write_graphite plugin: ReplayRate must not be negative.");
+    status = -1;
+  }
+
+  if (status == 0) {
+    cb->queue_size = (size_t)queue_size;
+    cb->queue = malloc(cb->queue_size);
+    if (cb->queue == NULL) {
+      ERROR("write_graphite plugin: malloc failed.");
+      status = -1;
+    }
+  }
+
   if (status != 0) {
     wg_callback_free(cb);
     return status;
   }
 
+  cb->spool_max_size = ((uint64_t)spool_max_size) * 1024 * 1024;
+  cb->spool_segment_size = ((uint64_t)spool_segment_size) * 1024 * 1024;
+
   /* FIXME: Legacy configuration syntax. */
-  if (cb->name == NULL)
+  if (cb->name == NULL) {
     ssnprintf(callback_name, sizeof(callback_name), "write_graphite/%s/%s/%s",
               cb->node, cb->service, cb->protocol);
-  else
+    /* Used in log messages. */
+    cb->name = strdup(callback_name + strlen("write_graphite/"));
+  } else
     ssnprintf(callback_name, sizeof(callback_name), "write_graphite/%s",
               cb->name);
 
+  struct wg_callback **tmp =
+      realloc(wg_callbacks, (wg_callbacks_num + 1) * sizeof(*wg_callbacks));
+  if (tmp == NULL) {
+    ERROR("write_graphite plugin: realloc failed.");
+    wg_callback_free(cb);
+    return -1;
+  }
+  wg_callbacks = tmp;
+  wg_callbacks[wg_callbacks_num] = cb;
+  wg_callbacks_num++;
+
   plugin_register_write(callback_name, wg_write,
                         &(user_data_t){
                             .data = cb, .free_func = wg_callback_free,
@@ -580,6 +1139,22 @@ static int wg_config(oconfig_item_t *ci) {
   return 0;
 }
 
+/* Starts a sender thread for each <Node> read by wg_config(). */
+static int wg_init(void) {
+  int status = 0;
+
+  for (size_t i = 0; i < wg_callbacks_num; i++) {
+    if (wg_sender_start(wg_callbacks[i]) != 0)
+      status = -1;
+  }
+
+  sfree(wg_callbacks);
+  wg_callbacks_num = 0;
+
+  return status;
+}
+
 void module_register(void) {
   plugin_register_complex_config("write_graphite", wg_config);
+  plugin_register_init("write_graphite", wg_init);
 }
@@ -29,16 +29,68 @@
 #include "plugin.h"
 #include "utils_format_json.h"
 #include "utils_format_kairosdb.h"
+#include "utils_latency.h"
 
 #include <curl/curl.h>
 
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #ifndef WRITE_HTTP_DEFAULT_BUFFER_SIZE
 #define WRITE_HTTP_DEFAULT_BUFFER_SIZE 4096
 #endif
 
+#ifndef WRITE_HTTP_DEFAULT_CONCURRENCY
+#define WRITE_HTTP_DEFAULT_CONCURRENCY 1
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_QUEUE_LENGTH
+#define WRITE_HTTP_DEFAULT_QUEUE_LENGTH 128
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_MAX_RETRIES
+#define WRITE_HTTP_DEFAULT_MAX_RETRIES 3
+#endif
+
+#ifndef WRITE_HTTP_DEFAULT_RETRY_INTERVAL
+#define WRITE_HTTP_DEFAULT_RETRY_INTERVAL TIME_T_TO_CDTIME_T(1)
+#endif
+
+/* Upper bound for the exponential backoff, unless RetryInterval is larger. */
+#ifndef WRITE_HTTP_MAX_RETRY_INTERVAL
+#define WRITE_HTTP_MAX_RETRY_INTERVAL TIME_T_TO_CDTIME_T(60)
+#endif
+
+/* How long to keep sending queued data on shutdown. */
+#ifndef WRITE_HTTP_SHUTDOWN_TIMEOUT
+#define WRITE_HTTP_SHUTDOWN_TIMEOUT TIME_T_TO_CDTIME_T(10)
+#endif
+
 /*
  * Private variables
  */
+/* A request body, i.e. a full send buffer or a notification, waiting to be
+ * sent or retried. */
+struct wh_request_s {
+  char *data;
+  size_t size;
+  _Bool compressed;
+  int attempts;
+  cdtime_t not_before;
+  cdtime_t start_time;
+  struct wh_request_s *next;
+};
+typedef struct wh_request_s wh_request_t;
+
+/* One easy handle per concurrent request. */
+struct wh_handle_s {
+  CURL *curl;
+  wh_request_t *request;
+  char curl_errbuf[CURL_ERROR_SIZE];
+};
+typedef struct wh_handle_s wh_handle_t;
+
 struct wh_callback_s {
   char *name;
 
@@ -67,9 +119,9 @@ struct wh_callback_s {
   _Bool send_metrics;
   _Bool send_notifications;
 
-  CURL *curl;
   struct curl_slist *headers;
-  char curl_errbuf[CURL_ERROR_SIZE];
+  /* "headers" plus "Content-Encoding: gzip", for compressed requests. */
+  struct curl_slist *headers_gzip;
 
   char *send_buffer;
   size_t send_buffer_size;
@@ -80,23 +132,46 @@ struct wh_callback_s {
   pthread_mutex_t send_lock;
 
   int data_ttl;
+
+  /* Requests are handed over to the sender thread, which runs up to
+   * "concurrency" of them in parallel on a curl multi handle. */
+  int concurrency;
+  int queue_length;
+  int max_retries;
+  cdtime_t retry_interval;
+  _Bool compress;
+  _Bool report_stats;
+
+  CURLM *multi;
+  wh_handle_t *handles;
+  pthread_t sender_thread;
+  _Bool sender_running;
+  int wakeup_fd[2];
+
+  /* Protects the queue and the statistics. */
+  pthread_mutex_t queue_lock;
+  wh_request_t *queue_head;
+  wh_request_t *queue_tail;
+  int queue_num;
+  int in_flight;
+  _Bool shutdown;
+
+  uint64_t stats_success;
+  uint64_t stats_failed;
+  uint64_t stats_retried;
+  uint64_t stats_dropped;
+  uint64_t stats_bytes_uncompressed;
+  uint64_t stats_bytes_compressed;
+  latency_counter_t *stats_latency;
 };
 typedef struct wh_callback_s wh_callback_t;
 
 static char **http_attrs;
 static size_t http_attrs_num;
 
-static void wh_log_http_error(wh_callback_t *cb) {
-  if (!cb->log_http_error)
-    return;
-
-  long http_code = 0;
-
-  curl_easy_getinfo(cb->curl, CURLINFO_RESPONSE_CODE, &http_code);
-
-  if (http_code != 200)
-    INFO("write_http plugin: HTTP Error code: %lu", http_code);
-}
+/* Callbacks whose sender thread is started by wh_init(). */
+static wh_callback_t **wh_callbacks = NULL;
+static size_t wh_callbacks_num = 0;
 
 static void wh_reset_buffer(wh_callback_t *cb) /* {{{ */
 {
@@ -114,50 +189,222 @@ static void wh_reset_buffer(wh_callback_t *cb) /* {{{ */
   }
 } /* }}} wh_reset_buffer */
 
-/* must hold cb->send_lock when calling */
-static int wh_post_nolock(wh_callback_t *cb, char const *data) /* {{{ */
+static void wh_request_free(wh_request_t *req) /* {{{ */
 {
-  int status = 0;
+  if (req == NULL)
+    return;
 
-  curl_easy_setopt(cb->curl, CURLOPT_URL, cb->location);
-  curl_easy_setopt(cb->curl, CURLOPT_POSTFIELDS, data);
-  status = curl_easy_perform(cb->curl);
+  sfree(req->data);
+  sfree(req);
+} /* }}} void wh_request_free */
+
+/* Appends a request to the queue. When the queue is full, the oldest queued
+ * request is dropped so that a slow endpoint never blocks the write threads.
+ * Takes ownership of "req". */
+static void wh_queue_push(wh_callback_t *cb, wh_request_t *req) /* {{{ */
+{
+  wh_request_t *dropped = NULL;
 
-  wh_log_http_error(cb);
+  pthread_mutex_lock(&cb->queue_lock);
 
-  if (status != CURLE_OK) {
-    ERROR("write_http plugin: curl_easy_perform failed with "
-          "status %i: %s",
-          status, cb->curl_errbuf);
+  if ((cb->queue_num >= cb->queue_length) && (cb->queue_head != NULL)) {
+    dropped = cb->queue_head;
+    cb->queue_head = dropped->next;
+    if (cb->queue_head == NULL)
+      cb->queue_tail = NULL;
+    cb->queue_num--;
+    cb->stats_dropped++;
   }
-  return status;
-} /* }}} wh_post_nolock */
 
-static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+  req->next = NULL;
+  if (cb->queue_tail == NULL)
+    cb->queue_head = req;
+  else
+    cb->queue_tail->next = req;
+  cb->queue_tail = req;
+  cb->queue_num++;
+
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  if (dropped != NULL) {
+    WARNING("write_http plugin: %s: The send queue is full, dropping the "
+            "oldest request.",
+            cb->name);
+    wh_request_free(dropped);
+  }
+
+  /* Wake up the sender thread. If the pipe is full, it will wake up anyway. */
+  if (cb->wakeup_fd[1] >= 0) {
+    char c = 0;
+    if (write(cb->wakeup_fd[1], &c, sizeof(c)) < 0) {
+      /* ignore */
+    }
+  }
+} /* }}} void wh_queue_push */
+
+/* Removes and returns the first request which may be sent at "now". Must hold
+ * cb->queue_lock when calling. */
+static wh_request_t *wh_queue_take_ready(wh_callback_t *cb, /* {{{ */
+                                         cdtime_t now) {
+  wh_request_t *prev = NULL;
+
+  for (wh_request_t *req = cb->queue_head; req != NULL; req = req->next) {
+    if (req->not_before > now) {
+      prev = req;
+      continue;
+    }
+
+    if (prev == NULL)
+      cb->queue_head = req->next;
+    else
+      prev->next = req->next;
+    if (cb->queue_tail == req)
+      cb->queue_tail = prev;
+    cb->queue_num--;
+
+    req->next = NULL;
+    return req;
+  }
+
+  return NULL;
+} /* }}} wh_request_t *wh_queue_take_ready */
+
+/* Creates a request from a copy of "data" and queues it. */
+static int wh_post(wh_callback_t *cb, char const *data, size_t size) /* {{{ */
 {
-  if (cb->curl != NULL)
-    return 0;
+  wh_request_t *req = calloc(1, sizeof(*req));
+  if (req == NULL) {
+    ERROR("write_http plugin: calloc failed.");
+    return ENOMEM;
+  }
+
+  req->data = malloc(size + 1);
+  if (req->data == NULL) {
+    ERROR("write_http plugin: malloc failed.");
+    sfree(req);
+    return ENOMEM;
+  }
+  memcpy(req->data, data, size);
+  req->data[size] = 0;
+  req->size = size;
+
+  wh_queue_push(cb, req);
+  return 0;
+} /* }}} int wh_post */
+
+#if HAVE_LIBZ
+/* Replaces the request body with its gzip compressed form. */
+static int wh_request_compress(wh_callback_t *cb, /* {{{ */
+                               wh_request_t *req) {
+  z_stream zs = {0};
+
+  /* 15 window bits, +16 to write a gzip header and trailer. */
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16,
+                   /* memLevel = */ 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    ERROR("write_http plugin: deflateInit2 failed.");
+    return -1;
+  }
+
+  uLong size = deflateBound(&zs, (uLong)req->size);
+  char *out = malloc(size);
+  if (out == NULL) {
+    deflateEnd(&zs);
+    ERROR("write_http plugin: malloc failed.");
+    return -1;
+  }
+
+  zs.next_in = (Bytef *)req->data;
+  zs.avail_in = (uInt)req->size;
+  zs.next_out = (Bytef *)out;
+  zs.avail_out = (uInt)size;
+
+  int status = deflate(&zs, Z_FINISH);
+  if (status != Z_STREAM_END) {
+    deflateEnd(&zs);
+    sfree(out);
+    ERROR("write_http plugin: deflate failed with status %d.", status);
+    return -1;
+  }
 
-  cb->curl = curl_easy_init();
-  if (cb->curl == NULL) {
+  pthread_mutex_lock(&cb->queue_lock);
+  cb->stats_bytes_uncompressed += req->size;
+  cb->stats_bytes_compressed += zs.total_out;
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  sfree(req->data);
+  req->data = out;
+  req->size = (size_t)zs.total_out;
+  req->compressed = 1;
+
+  deflateEnd(&zs);
+  return 0;
+} /* }}} int wh_request_compress */
+#endif
+
+static int wh_curl_setup(wh_callback_t *cb, wh_handle_t *h) /* {{{ */
+{
+  h->curl = curl_easy_init();
+  if (h->curl == NULL) {
     ERROR("curl plugin: curl_easy_init failed.");
     return -1;
   }
 
   if (cb->low_speed_limit > 0 && cb->low_speed_time > 0) {
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_LIMIT,
+    curl_easy_setopt(h->curl, CURLOPT_LOW_SPEED_LIMIT,
                      (long)(cb->low_speed_limit * cb->low_speed_time));
-    curl_easy_setopt(cb->curl, CURLOPT_LOW_SPEED_TIME,
+    curl_easy_setopt(h->curl, CURLOPT_LOW_SPEED_TIME,
                      (long)cb->low_speed_time);
   }
 
 #ifdef HAVE_CURLOPT_TIMEOUT_MS
   if (cb->timeout > 0)
-    curl_easy_setopt(cb->curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
+    curl_easy_setopt(h->curl, CURLOPT_TIMEOUT_MS, (long)cb->timeout);
 #endif
 
-  curl_easy_setopt(cb->curl, CURLOPT_NOSIGNAL, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(h->curl, CURLOPT_NOSIGNAL, 1L);
+  curl_easy_setopt(h->curl, CURLOPT_USERAGENT, COLLECTD_USERAGENT);
+  curl_easy_setopt(h->curl, CURLOPT_HTTPHEADER, cb->headers);
+  curl_easy_setopt(h->curl, CURLOPT_PRIVATE, h);
+  curl_easy_setopt(h->curl, CURLOPT_URL, cb->location);
+
+  curl_easy_setopt(h->curl, CURLOPT_ERRORBUFFER, h->curl_errbuf);
+  curl_easy_setopt(h->curl, CURLOPT_FOLLOWLOCATION, 1L);
+  curl_easy_setopt(h->curl, CURLOPT_MAXREDIRS, 50L);
+
+  if (cb->user != NULL) {
+#ifdef HAVE_CURLOPT_USERNAME
+    curl_easy_setopt(h->curl, CURLOPT_USERNAME, cb->user);
+    curl_easy_setopt(h->curl, CURLOPT_PASSWORD,
+                     (cb->pass == NULL) ? "" : cb->pass);
+#else
+    curl_easy_setopt(h->curl, CURLOPT_USERPWD, cb->credentials);
+#endif
+    curl_easy_setopt(h->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
+  }
+
+  curl_easy_setopt(h->curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
+  curl_easy_setopt(h->curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
+  curl_easy_setopt(h->curl, CURLOPT_SSLVERSION, cb->sslversion);
+  if (cb->cacert != NULL)
+    curl_easy_setopt(h->curl, CURLOPT_CAINFO, cb->cacert);
+  if (cb->capath != NULL)
+    curl_easy_setopt(h->curl, CURLOPT_CAPATH, cb->capath);
+
+  if (cb->clientkey != NULL && cb->clientcert != NULL) {
+    curl_easy_setopt(h->curl, CURLOPT_SSLKEY, cb->clientkey);
+    curl_easy_setopt(h->curl, CURLOPT_SSLCERT, cb->clientcert);
+
+    if (cb->clientkeypass != NULL)
+      curl_easy_setopt(h->curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+  }
+
+  return 0;
+} /* }}} int wh_curl_setup */
+
+static int wh_callback_init(wh_callback_t *cb) /* {{{ */
+{
+  if (cb->multi != NULL)
+    return 0;
 
   cb->headers = curl_slist_append(cb->headers, "Accept:  */*");
   if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB)
@@ -166,18 +413,18 @@ static int wh_callback_init(wh_callback_t *cb) /* {{{ */
   else
     cb->headers = curl_slist_append(cb->headers, "Content-Type: text/plain");
   cb->headers = curl_slist_append(cb->headers, "Expect:");
-  curl_easy_setopt(cb->curl, CURLOPT_HTTPHEADER, cb->headers);
 
-  curl_easy_setopt(cb->curl, CURLOPT_ERRORBUFFER, cb->curl_errbuf);
-  curl_easy_setopt(cb->curl, CURLOPT_FOLLOWLOCATION, 1L);
-  curl_easy_setopt(cb->curl, CURLOPT_MAXREDIRS, 50L);
+  /* Requests whose compression failed are sent as they are, so the header is
+   * set per request. */
+  if (cb->compress) {
+    for (struct curl_slist *h = cb->headers; h != NULL; h = h->next)
+      cb->headers_gzip = curl_slist_append(cb->headers_gzip, h->data);
+    cb->headers_gzip =
+        curl_slist_append(cb->headers_gzip, "Content-Encoding: gzip");
+  }
 
+#ifndef HAVE_CURLOPT_USERNAME
   if (cb->user != NULL) {
-#ifdef HAVE_CURLOPT_USERNAME
-    curl_easy_setopt(cb->curl, CURLOPT_USERNAME, cb->user);
-    curl_easy_setopt(cb->curl, CURLOPT_PASSWORD,
-                     (cb->pass == NULL) ? "" : cb->pass);
-#else
     size_t credentials_size;
 
     credentials_size = strlen(cb->user) + 2;
@@ -192,32 +439,281 @@ static int wh_callback_init(wh_callback_t *cb) /* {{{ */
 
     ssnprintf(cb->credentials, credentials_size, "%s:%s", cb->user,
               (cb->pass == NULL) ? "" : cb->pass);
-    curl_easy_setopt(cb->curl, CURLOPT_USERPWD, cb->credentials);
-#endif
-    curl_easy_setopt(cb->curl, CURLOPT_HTTPAUTH, CURLAUTH_ANY);
   }
+#endif
 
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYPEER, (long)cb->verify_peer);
-  curl_easy_setopt(cb->curl, CURLOPT_SSL_VERIFYHOST, cb->verify_host ? 2L : 0L);
-  curl_easy_setopt(cb->curl, CURLOPT_SSLVERSION, cb->sslversion);
-  if (cb->cacert != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAINFO, cb->cacert);
-  if (cb->capath != NULL)
-    curl_easy_setopt(cb->curl, CURLOPT_CAPATH, cb->capath);
+  cb->handles = calloc((size_t)cb->concurrency, sizeof(*cb->handles));
+  if (cb->handles == NULL) {
+    ERROR("write_http plugin: calloc failed.");
+    return -1;
+  }
 
-  if (cb->clientkey != NULL && cb->clientcert != NULL) {
-    curl_easy_setopt(cb->curl, CURLOPT_SSLKEY, cb->clientkey);
-    curl_easy_setopt(cb->curl, CURLOPT_SSLCERT, cb->clientcert);
+  for (int i = 0; i < cb->concurrency; i++) {
+    if (wh_curl_setup(cb, cb->handles + i) != 0)
+      return -1;
+  }
 
-    if (cb->clientkeypass != NULL)
-      curl_easy_setopt(cb->curl, CURLOPT_SSLKEYPASSWD, cb->clientkeypass);
+  if (pipe(cb->wakeup_fd) != 0) {
+    char errbuf[1024];
+    ERROR("write_http plugin: pipe failed: %s",
+          sstrerror(errno, errbuf, sizeof(errbuf)));
+    cb->wakeup_fd[0] = cb->wakeup_fd[1] = -1;
+    return -1;
   }
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cb->wakeup_fd); i++)
+    fcntl(cb->wakeup_fd[i], F_SETFL,
+          fcntl(cb->wakeup_fd[i], F_GETFL) | O_NONBLOCK);
 
-  wh_reset_buffer(cb);
+  cb->multi = curl_multi_init();
+  if (cb->multi == NULL) {
+    ERROR("write_http plugin: curl_multi_init failed.");
+    return -1;
+  }
 
   return 0;
 } /* }}} int wh_callback_init */
 
+/* Handles a finished transfer: the request is either done, scheduled for a
+ * retry, or dropped. */
+static void wh_request_done(wh_callback_t *cb, wh_handle_t *h, /* {{{ */
+                            CURLcode result) {
+  wh_request_t *req = h->request;
+  long http_code = 0;
+  _Bool success = 0;
+  _Bool retry = 0;
+
+  h->request = NULL;
+  curl_easy_getinfo(h->curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+  if (result != CURLE_OK) {
+    retry = 1;
+  } else if ((http_code >= 200) && (http_code < 300)) {
+    success = 1;
+  } else {
+    if (cb->log_http_error)
+      INFO("write_http plugin: HTTP Error code: %lu", http_code);
+    /* Retry server errors and rate limiting, but not requests the server
+     * rejected. */
+    retry = (http_code >= 500) || (http_code == 408) || (http_code == 429);
+  }
+
+  cdtime_t now = cdtime();
+
+  pthread_mutex_lock(&cb->queue_lock);
+  cb->in_flight--;
+  latency_counter_add(cb->stats_latency, now - req->start_time);
+  if (retry && ((req->attempts > cb->max_retries) || cb->shutdown))
+    retry = 0;
+  if (success)
+    cb->stats_success++;
+  else if (retry)
+    cb->stats_retried++;
+  else
+    cb->stats_failed++;
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  if (success) {
+    wh_request_free(req);
+    return;
+  }
+
+  if (!retry) {
+    if (result != CURLE_OK)
+      ERROR("write_http plugin: %s: Giving up on a request after %d "
+            "attempt(s). The last error was: %s",
+            cb->name, req->attempts,
+            (h->curl_errbuf[0] != 0) ? h->curl_errbuf
+                                     : curl_easy_strerror(result));
+    else if (cb->log_http_error)
+      ERROR("write_http plugin: %s: Giving up on a request after %d "
+            "attempt(s). The last HTTP status was %ld.",
+            cb->name, req->attempts, http_code);
+    wh_request_free(req);
+    return;
+  }
+
+  /* Exponential backoff. */
+  cdtime_t delay = cb->retry_interval;
+  cdtime_t max_delay = (cb->retry_interval > WRITE_HTTP_MAX_RETRY_INTERVAL)
+                           ? cb->retry_interval
+                           : WRITE_HTTP_MAX_RETRY_INTERVAL;
+  for (int i = 1; (i < req->attempts) && (delay < max_delay); i++)
+    delay *= 2;
+  if (delay > max_delay)
+    delay = max_delay;
+
+  DEBUG("write_http plugin: %s: Retrying a request in %.3f seconds.", cb->name,
+        CDTIME_T_TO_DOUBLE(delay));
+  req->not_before = now + delay;
+  wh_queue_push(cb, req);
+} /* }}} void wh_request_done */
+
+static void wh_request_start(wh_callback_t *cb, wh_handle_t *h, /* {{{ */
+                             wh_request_t *req) {
+#if HAVE_LIBZ
+  if (cb->compress && !req->compressed)
+    wh_request_compress(cb, req); /* sent uncompressed on failure */
+#endif
+
+  h->request = req;
+  h->curl_errbuf[0] = 0;
+  req->attempts++;
+  req->start_time = cdtime();
+
+  curl_easy_setopt(h->curl, CURLOPT_HTTPHEADER,
+                   req->compressed ? cb->headers_gzip : cb->headers);
+  curl_easy_setopt(h->curl, CURLOPT_POSTFIELDSIZE, (long)req->size);
+  curl_easy_setopt(h->curl, CURLOPT_POSTFIELDS, req->data);
+
+  CURLMcode status = curl_multi_add_handle(cb->multi, h->curl);
+  if (status != CURLM_OK) {
+    ERROR("write_http plugin: curl_multi_add_handle failed: %s",
+          curl_multi_strerror(status));
+    h->request = NULL;
+    pthread_mutex_lock(&cb->queue_lock);
+    cb->in_flight--;
+    cb->stats_failed++;
+    pthread_mutex_unlock(&cb->queue_lock);
+    wh_request_free(req);
+  }
+} /* }}} void wh_request_start */
+
+static void *wh_sender_thread(void *arg) /* {{{ */
+{
+  wh_callback_t *cb = arg;
+  cdtime_t deadline = 0;
+
+  while (42) {
+    wh_handle_t *start[cb->concurrency];
+    wh_request_t *start_req[cb->concurrency];
+    int start_num = 0;
+    cdtime_t now = cdtime();
+    cdtime_t wait = TIME_T_TO_CDTIME_T(1);
+
+    pthread_mutex_lock(&cb->queue_lock);
+    if (cb->shutdown && (deadline == 0))
+      deadline = now + WRITE_HTTP_SHUTDOWN_TIMEOUT;
+
+    /* Retries are not delayed on shutdown. */
+    for (int i = 0; i < cb->concurrency; i++) {
+      if (cb->handles[i].request != NULL)
+        continue;
+
+      wh_request_t *req =
+          wh_queue_take_ready(cb, cb->shutdown ? (cdtime_t)-1 : now);
+      if (req == NULL)
+        break;
+
+      start[start_num] = cb->handles + i;
+      start_req[start_num] = req;
+      cb->handles[i].request = req; /* reserve the handle */
+      start_num++;
+      cb->in_flight++;
+    }
+
+    for (wh_request_t *req = cb->queue_head; req != NULL; req = req->next) {
+      if ((req->not_before > now) && (req->not_before - now < wait))
+        wait = req->not_before - now;
+    }
+
+    _Bool idle = (cb->queue_head == NULL) && (cb->in_flight == 0);
+    _Bool shutdown = cb->shutdown;
+    pthread_mutex_unlock(&cb->queue_lock);
+
+    if (shutdown && (idle || (now >= deadline)))
+      break;
+
+    for (int i = 0; i < start_num; i++)
+      wh_request_start(cb, start[i], start_req[i]);
+
+    int running = 0;
+    curl_multi_perform(cb->multi, &running);
+
+    CURLMsg *msg;
+    int msgs_left = 0;
+    int done_num = 0;
+    while ((msg = curl_multi_info_read(cb->multi, &msgs_left)) != NULL) {
+      if (msg->msg != CURLMSG_DONE)
+        continue;
+
+      CURL *curl = msg->easy_handle;
+      CURLcode result = msg->data.result;
+      wh_handle_t *h = NULL;
+
+      curl_easy_getinfo(curl, CURLINFO_PRIVATE, (char **)&h);
+      curl_multi_remove_handle(cb->multi, curl);
+      if (h != NULL)
+        wh_request_done(cb, h, result);
+      done_num++;
+    }
+
+    /* Handles have become available: start the next requests right away. */
+    if (done_num > 0)
+      continue;
+
+    struct curl_waitfd wfd = {.fd = cb->wakeup_fd[0],
+                              .events = CURL_WAIT_POLLIN};
+    int timeout_ms = (int)CDTIME_T_TO_MS(wait);
+    curl_multi_wait(cb->multi, &wfd, 1, (timeout_ms > 0) ? timeout_ms : 1,
+                    /* numfds = */ NULL);
+
+    char buffer[64];
+    while (read(cb->wakeup_fd[0], buffer, sizeof(buffer)) > 0)
+      /* drain */;
+  }
+
+  /* Drop what could not be sent before the deadline. */
+  int dropped = 0;
+  for (int i = 0; i < cb->concurrency; i++) {
+    wh_handle_t *h = cb->handles + i;
+    if (h->request == NULL)
+      continue;
+    curl_multi_remove_handle(cb->multi, h->curl);
+    wh_request_free(h->request);
+    h->request = NULL;
+    dropped++;
+  }
+
+  pthread_mutex_lock(&cb->queue_lock);
+  while (cb->queue_head != NULL) {
+    wh_request_t *req = cb->queue_head;
+    cb->queue_head = req->next;
+    wh_request_free(req);
+    dropped++;
+  }
+  cb->queue_tail = NULL;
+  cb->queue_num = 0;
+  cb->in_flight = 0;
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  if (dropped > 0)
+    WARNING("write_http plugin: %s: Dropped %d request(s) which could not be "
+            "sent before shutdown.",
+            cb->name, dropped);
+
+  return NULL;
+} /* }}} void *wh_sender_thread */
+
+static int wh_sender_start(wh_callback_t *cb) /* {{{ */
+{
+  if (wh_callback_init(cb) != 0) {
+    ERROR("write_http plugin: wh_callback_init failed.");
+    return -1;
+  }
+
+  int status = plugin_thread_create(&cb->sender_thread, /* attr = */ NULL,
+                                    wh_sender_thread, cb, "write_http");
+  if (status != 0) {
+    ERROR("write_http plugin: Starting the sender thread failed.");
+    return -1;
+  }
+  cb->sender_running = 1;
+
+  return 0;
+} /* }}} int wh_sender_start */
+
+/* Hands the send buffer over to the sender thread. Must hold cb->send_lock
+ * when calling. */
 static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
 {
   int status;
@@ -240,9 +736,6 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       cb->send_buffer_init_time = cdtime();
       return 0;
     }
-
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
   } else if (cb->format == WH_FORMAT_JSON || cb->format == WH_FORMAT_KAIROSDB) {
     if (cb->send_buffer_fill <= 2) {
       cb->send_buffer_init_time = cdtime();
@@ -257,9 +750,6 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
       wh_reset_buffer(cb);
       return status;
     }
-
-    status = wh_post_nolock(cb, cb->send_buffer);
-    wh_reset_buffer(cb);
   } else {
     ERROR("write_http: wh_flush_nolock: "
           "Unknown format: %i",
@@ -267,6 +757,9 @@ static int wh_flush_nolock(cdtime_t timeout, wh_callback_t *cb) /* {{{ */
     return -1;
   }
 
+  status = wh_post(cb, cb->send_buffer, cb->send_buffer_fill);
+  wh_reset_buffer(cb);
+
   return status;
 } /* }}} wh_flush_nolock */
 
@@ -282,13 +775,6 @@ static int wh_flush(cdtime_t timeout, /* {{{ */
   cb = user_data->data;
 
   pthread_mutex_lock(&cb->send_lock);
-
-  if (wh_callback_init(cb) != 0) {
-    ERROR("write_http plugin: wh_callback_init failed.");
-    pthread_mutex_unlock(&cb->send_lock);
-    return -1;
-  }
-
   status = wh_flush_nolock(timeout, cb);
   pthread_mutex_unlock(&cb->send_lock);
 
@@ -307,15 +793,57 @@ static void wh_callback_free(void *data) /* {{{ */
   if (cb->send_buffer != NULL)
     wh_flush_nolock(/* timeout = */ 0, cb);
 
-  if (cb->curl != NULL) {
-    curl_easy_cleanup(cb->curl);
-    cb->curl = NULL;
+  /* The sender thread sends what is left in the queue, for a while. */
+  if (cb->sender_running) {
+    pthread_mutex_lock(&cb->queue_lock);
+    cb->shutdown = 1;
+    pthread_mutex_unlock(&cb->queue_lock);
+    if (write(cb->wakeup_fd[1], "", 1) < 0) {
+      /* ignore */
+    }
+
+    pthread_join(cb->sender_thread, /* retval = */ NULL);
+    cb->sender_running = 0;
+  }
+
+  while (cb->queue_head != NULL) {
+    wh_request_t *req = cb->queue_head;
+    cb->queue_head = req->next;
+    wh_request_free(req);
+  }
+
+  if (cb->handles != NULL) {
+    for (int i = 0; i < cb->concurrency; i++) {
+      if (cb->handles[i].curl != NULL)
+        curl_easy_cleanup(cb->handles[i].curl);
+    }
+    sfree(cb->handles);
+  }
+
+  if (cb->multi != NULL) {
+    curl_multi_cleanup(cb->multi);
+    cb->multi = NULL;
   }
 
   if (cb->headers != NULL) {
     curl_slist_free_all(cb->headers);
     cb->headers = NULL;
   }
+  if (cb->headers_gzip != NULL) {
+    curl_slist_free_all(cb->headers_gzip);
+    cb->headers_gzip = NULL;
+  }
+
+  for (size_t i = 0; i < STATIC_ARRAY_SIZE(cb->wakeup_fd); i++) {
+    if (cb->wakeup_fd[i] >= 0)
+      close(cb->wakeup_fd[i]);
+  }
+
+  if (cb->stats_latency != NULL)
+    latency_counter_destroy(cb->stats_latency);
+
+  pthread_mutex_destroy(&cb->queue_lock);
+  pthread_mutex_destroy(&cb->send_lock);
 
   sfree(cb->name);
   sfree(cb->location);
@@ -332,6 +860,84 @@ static void wh_callback_free(void *data) /* {{{ */
   sfree(cb);
 } /* }}} void wh_callback_free */
 
+static int wh_stats_read(user_data_t *ud) /* {{{ */
+{
+  wh_callback_t *cb = ud->data;
+  value_list_t vl = VALUE_LIST_INIT;
+  value_t values[2];
+
+  pthread_mutex_lock(&cb->queue_lock);
+  gauge_t queued = (gauge_t)cb->queue_num;
+  gauge_t in_flight = (gauge_t)cb->in_flight;
+  derive_t success = (derive_t)cb->stats_success;
+  derive_t failed = (derive_t)cb->stats_failed;
+  derive_t retried = (derive_t)cb->stats_retried;
+  derive_t dropped = (derive_t)cb->stats_dropped;
+  derive_t uncompressed = (derive_t)cb->stats_bytes_uncompressed;
+  derive_t compressed = (derive_t)cb->stats_bytes_compressed;
+  gauge_t latency_avg =
+      CDTIME_T_TO_DOUBLE(latency_counter_get_average(cb->stats_latency));
+  gauge_t latency_p99 = CDTIME_T_TO_DOUBLE(
+      latency_counter_get_percentile(cb->stats_latency, 99.0));
+  _Bool have_latency = (latency_counter_get_num(cb->stats_latency) > 0);
+  latency_counter_reset(cb->stats_latency);
+  pthread_mutex_unlock(&cb->queue_lock);
+
+  vl.values = values;
+  vl.values_len = 1;
+  sstrncpy(vl.plugin, "write_http", sizeof(vl.plugin));
+  sstrncpy(vl.plugin_instance, cb->name, sizeof(vl.plugin_instance));
+
+  /* Requests waiting to be sent and requests being sent */
+  sstrncpy(vl.type, "queue_length", sizeof(vl.type));
+  vl.values[0].gauge = queued;
+  sstrncpy(vl.type_instance, "queued", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].gauge = in_flight;
+  sstrncpy(vl.type_instance, "in_flight", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Request outcomes */
+  sstrncpy(vl.type, "http_requests", sizeof(vl.type));
+  vl.values[0].derive = success;
+  sstrncpy(vl.type_instance, "success", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].derive = failed;
+  sstrncpy(vl.type_instance, "failed", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].derive = retried;
+  sstrncpy(vl.type_instance, "retried", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].derive = dropped;
+  sstrncpy(vl.type_instance, "dropped", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  /* Latency of the requests completed since the last read */
+  sstrncpy(vl.type, "response_time", sizeof(vl.type));
+  vl.values[0].gauge = have_latency ? latency_avg : NAN;
+  sstrncpy(vl.type_instance, "average", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  vl.values[0].gauge = have_latency ? latency_p99 : NAN;
+  sstrncpy(vl.type_instance, "percentile-99", sizeof(vl.type_instance));
+  plugin_dispatch_values(&vl);
+
+  if (cb->compress) {
+    vl.values_len = 2;
+    vl.values[0].derive = uncompressed;
+    vl.values[1].derive = compressed;
+    sstrncpy(vl.type, "compression", sizeof(vl.type));
+    vl.type_instance[0] = 0;
+    plugin_dispatch_values(&vl);
+  }
+
+  return 0;
+} /* }}} int wh_stats_read */
+
 static int wh_write_command(const data_set_t *ds,
                             const value_list_t *vl, /* {{{ */
                             wh_callback_t *cb) {
@@ -380,11 +986,6 @@ static int wh_write_command(const data_set_t *ds,
   }
 
   pthread_mutex_lock(&cb->send_lock);
-  if (wh_callback_init(cb) != 0) {
-    ERROR("write_http plugin: wh_callback_init failed.");
-    pthread_mutex_unlock(&cb->send_lock);
-    return -1;
-  }
 
   if (command_len >= cb->send_buffer_free) {
     status = wh_flush_nolock(/* timeout = */ 0, cb);
@@ -420,11 +1021,6 @@ static int wh_write_json(const data_set_t *ds, const value_list_t *vl, /* {{{ */
   int status;
 
   pthread_mutex_lock(&cb->send_lock);
-  if (wh_callback_init(cb) != 0) {
-    ERROR("write_http plugin: wh_callback_init failed.");
-    pthread_mutex_unlock(&cb->send_lock);
-    return -1;
-  }
 
   status =
       format_json_value_list(cb->send_buffer, &cb->send_buffer_fill,
@@ -464,15 +1060,6 @@ static int wh_write_kairosdb(const data_set_t *ds,
 
   pthread_mutex_lock(&cb->send_lock);
 
-  if (cb->curl == NULL) {
-    status = wh_callback_init(cb);
-    if (status != 0) {
-      ERROR("write_http plugin: wh_callback_init failed.");
-      pthread_mutex_unlock(&cb->send_lock);
-      return -1;
-    }
-  }
-
   status = format_kairosdb_value_list(
       cb->send_buffer, &cb->send_buffer_fill, &cb->send_buffer_free, ds, vl,
       cb->store_rates, (char const *const *)http_attrs, http_attrs_num,
@@ -549,17 +1136,7 @@ static int wh_notify(notification_t const *n, user_data_t *ud) /* {{{ */
     return status;
   }
 
-  pthread_mutex_lock(&cb->send_lock);
-  if (wh_callback_init(cb) != 0) {
-    ERROR("write_http plugin: wh_callback_init failed.");
-    pthread_mutex_unlock(&cb->send_lock);
-    return -1;
-  }
-
-  status = wh_post_nolock(cb, alert);
-  pthread_mutex_unlock(&cb->send_lock);
-
-  return status;
+  return wh_post(cb, alert, strlen(alert));
 } /* }}} int wh_notify */
 
 static int config_set_format(wh_callback_t *cb, /* {{{ */
@@ -629,8 +1206,16 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   cb->send_metrics = 1;
   cb->send_notifications = 0;
   cb->data_ttl = 0;
+  cb->concurrency = WRITE_HTTP_DEFAULT_CONCURRENCY;
+  cb->queue_length = WRITE_HTTP_DEFAULT_QUEUE_LENGTH;
+  cb->max_retries = WRITE_HTTP_DEFAULT_MAX_RETRIES;
+  cb->retry_interval = WRITE_HTTP_DEFAULT_RETRY_INTERVAL;
+  cb->compress = 0;
+  cb->report_stats = 0;
+  cb->wakeup_fd[0] = cb->wakeup_fd[1] = -1;
 
   pthread_mutex_init(&cb->send_lock, /* attr = */ NULL);
+  pthread_mutex_init(&cb->queue_lock, /* attr = */ NULL);
 
   cf_util_get_string(ci, &cb->name);
 
@@ -740,7 +1325,19 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
       sfree(val);
     } else if (strcasecmp("TTL", child->key) == 0) {
       status = cf_util_get_int(child, &cb->data_ttl);
-    } else {
+    } else if (strcasecmp("Concurrency", child->key) == 0)
+      status = cf_util_get_int(child, &cb->concurrency);
+    else if (strcasecmp("QueueLength", child->key) == 0)
+      status = cf_util_get_int(child, &cb->queue_length);
+    else if (strcasecmp("MaxRetries", child->key) == 0)
+      status = cf_util_get_int(child, &cb->max_retries);
+    else if (strcasecmp("RetryInterval", child->key) == 0)
+      status = cf_util_get_cdtime(child, &cb->retry_interval);
+    else if (strcasecmp("Compress", child->key) == 0)
+      status = cf_util_get_boolean(child, &cb->compress);
+    else if (strcasecmp("ReportStats", child->key) == 0)
+      status = cf_util_get_boolean(child, &cb->report_stats);
+    else {
       ERROR("write_http plugin: Invalid configuration "
             "option: %s.",
             child->key);
@@ -770,6 +1367,31 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     return -1;
   }
 
+  if ((cb->concurrency < 1) || (cb->queue_length < 1) ||
+      (cb->max_retries < 0)) {
+    ERROR("write_http plugin: %s: Concurrency and QueueLength must be "
+          "positive, MaxRetries must not be negative.",
+          cb->name);
+    wh_callback_free(cb);
+    return -1;
+  }
+
+#if !HAVE_LIBZ
+  if (cb->compress) {
+    WARNING("write_http plugin: %s: Compress requires zlib support, which "
+            "has not been compiled in. Sending uncompressed data.",
+            cb->name);
+    cb->compress = 0;
+  }
+#endif
+
+  cb->stats_latency = latency_counter_create();
+  if (cb->stats_latency == NULL) {
+    ERROR("write_http plugin: latency_counter_create failed.");
+    wh_callback_free(cb);
+    return -1;
+  }
+
   if (cb->low_speed_limit > 0)
     cb->low_speed_time = CDTIME_T_TO_TIME_T(plugin_get_interval());
 
@@ -791,6 +1413,17 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
   /* Nulls the buffer and sets ..._free and ..._fill. */
   wh_reset_buffer(cb);
 
+  wh_callback_t **tmp =
+      realloc(wh_callbacks, (wh_callbacks_num + 1) * sizeof(*wh_callbacks));
+  if (tmp == NULL) {
+    ERROR("write_http plugin: realloc failed.");
+    wh_callback_free(cb);
+    return -1;
+  }
+  wh_callbacks = tmp;
+  wh_callbacks[wh_callbacks_num] = cb;
+  wh_callbacks_num++;
+
   ssnprintf(callback_name, sizeof(callback_name), "write_http/%s", cb->name);
   DEBUG("write_http: Registering write callback '%s' with URL '%s'",
         callback_name, cb->location);
@@ -811,6 +1444,13 @@ static int wh_config_node(oconfig_item_t *ci) /* {{{ */
     user_data.free_func = NULL;
   }
 
+  if (cb->report_stats) {
+    user_data.free_func = NULL;
+    plugin_register_complex_read(/* group = */ NULL, callback_name,
+                                 wh_stats_read, /* interval = */ 0,
+                                 &user_data);
+  }
+
   return 0;
 } /* }}} int wh_config_node */
 
@@ -841,7 +1481,18 @@ static int wh_init(void) /* {{{ */
   /* Call this while collectd is still single-threaded to avoid
    * initialization issues in libgcrypt. */
   curl_global_init(CURL_GLOBAL_SSL);
-  return 0;
+
+  /* The senders use curl, so they are only started once it is initialized. */
+  int status = 0;
+  for (size_t i = 0; i < wh_callbacks_num; i++) {
+    if (wh_sender_start(wh_callbacks[i]) != 0)
+      status = -1;
+  }
+
+  sfree(wh_callbacks);
+  wh_callbacks_num = 0;
+
+  return status;
 } /* }}} int wh_init */
 
 void module_register(void) /* {{{ */
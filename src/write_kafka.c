@@ -29,6 +29,7 @@
 #include "common.h"
 #include "plugin.h"
 #include "utils_cmd_putval.h"
+#include "utils_complain.h"
 #include "utils_format_graphite.h"
 #include "utils_format_json.h"
 #include "utils_random.h"
@@ -37,6 +38,33 @@
 #include <librdkafka/rdkafka.h>
 #include <stdint.h>
 
+#ifndef KAFKA_DEFAULT_BATCH_MAX_SIZE
+#define KAFKA_DEFAULT_BATCH_MAX_SIZE 131072
+#endif
+
+/* How often the partition count of a topic is refreshed in batch mode. */
+#ifndef KAFKA_METADATA_INTERVAL
+#define KAFKA_METADATA_INTERVAL TIME_T_TO_CDTIME_T(300)
+#endif
+
+/* How long to wait for outstanding messages on shutdown, in milliseconds. */
+#ifndef KAFKA_SHUTDOWN_TIMEOUT
+#define KAFKA_SHUTDOWN_TIMEOUT 10000
+#endif
+
+/* A batch of records, produced as one message. While a message is in flight
+ * librdkafka references "data" directly; the buffer is returned to the pool
+ * by the delivery report callback. */
+struct kafka_buffer_s {
+  char *data;
+  size_t len;
+  size_t records_num;
+  int32_t partition;
+  struct kafka_buffer_s *next;     /* pool */
+  struct kafka_buffer_s *all_next; /* all buffers of a topic */
+};
+typedef struct kafka_buffer_s kafka_buffer_t;
+
 struct kafka_topic_context {
 #define KAFKA_FORMAT_JSON 0
 #define KAFKA_FORMAT_COMMAND 1
@@ -53,7 +81,21 @@ struct kafka_topic_context {
   char *postfix;
   char escape_char;
   char *topic_name;
+  _Bool key_identifier;
   pthread_mutex_t lock;
+
+  /* Batch mode: records are packed into one buffer per partition, which is
+   * produced when it is full and once per flush interval. */
+  _Bool batch;
+  size_t batch_max_size;
+  cdtime_t batch_flush_interval;
+  int32_t partition_cnt; /* zero while unknown */
+  cdtime_t metadata_time;
+  kafka_buffer_t **batches;
+  size_t batches_num;
+  kafka_buffer_t *pool;
+  kafka_buffer_t *buffers;
+  c_complain_t delivery_complaint;
 };
 
 static int kafka_handle(struct kafka_topic_context *);
@@ -93,6 +135,20 @@ static char *kafka_random_key(char buffer[static KAFKA_RANDOM_KEY_SIZE]) {
   return buffer;
 }
 
+/* Returns the hash of the value list's identifier. The identifier has usually
+ * been computed by the daemon already. */
+static uint32_t kafka_vl_hash(value_list_t const *vl) {
+  vl_ident_t const *ident = plugin_get_vl_ident(vl);
+  char name[6 * DATA_MAX_NAME_LEN];
+
+  if (ident != NULL)
+    return ident->hash;
+
+  if (FORMAT_VL(name, sizeof(name), vl) != 0)
+    return 0;
+  return strhash(name);
+}
+
 static int32_t kafka_partition(const rd_kafka_topic_t *rkt, const void *keydata,
                                size_t keylen, int32_t partition_cnt, void *p,
                                void *m) {
@@ -158,10 +214,287 @@ static int kafka_handle(struct kafka_topic_context *ctx) /* {{{ */
          rd_kafka_topic_name(ctx->topic));
   }
 
+  if (ctx->batch && (ctx->batches == NULL)) {
+    ctx->batches = calloc(1, sizeof(*ctx->batches));
+    if (ctx->batches == NULL) {
+      ERROR("write_kafka plugin: calloc failed.");
+      return ENOMEM;
+    }
+    ctx->batches_num = 1;
+  }
+
   return 0;
 
 } /* }}} int kafka_handle */
 
+/* Returns an empty buffer from the pool. Must hold ctx->lock when calling. */
+static kafka_buffer_t *kafka_buffer_get(struct kafka_topic_context *ctx) /* {{{ */
+{
+  kafka_buffer_t *b = ctx->pool;
+
+  if (b != NULL) {
+    ctx->pool = b->next;
+  } else {
+    b = calloc(1, sizeof(*b));
+    if (b == NULL)
+      return NULL;
+    b->data = malloc(ctx->batch_max_size);
+    if (b->data == NULL) {
+      sfree(b);
+      return NULL;
+    }
+    b->all_next = ctx->buffers;
+    ctx->buffers = b;
+  }
+
+  b->len = 0;
+  b->records_num = 0;
+  b->partition = RD_KAFKA_PARTITION_UA;
+  b->next = NULL;
+  return b;
+} /* }}} kafka_buffer_t *kafka_buffer_get */
+
+static void kafka_buffer_put(struct kafka_topic_context *ctx, /* {{{ */
+                             kafka_buffer_t *b) {
+  pthread_mutex_lock(&ctx->lock);
+  b->next = ctx->pool;
+  ctx->pool = b;
+  pthread_mutex_unlock(&ctx->lock);
+} /* }}} void kafka_buffer_put */
+
+/* Called by rd_kafka_poll() for every message in batch mode. */
+static void kafka_delivery_report(rd_kafka_t *rk, /* {{{ */
+                                  const rd_kafka_message_t *msg,
+                                  void *opaque) {
+  struct kafka_topic_context *ctx = opaque;
+  kafka_buffer_t *b = msg->_private;
+
+  if (msg->err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    c_complain(LOG_ERR, &ctx->delivery_complaint,
+               "write_kafka plugin: Delivering a message to topic \"%s\" "
+               "failed: %s",
+               ctx->topic_name, rd_kafka_err2str(msg->err));
+  } else {
+    c_release(LOG_INFO, &ctx->delivery_complaint,
+              "write_kafka plugin: Delivering messages to topic \"%s\" "
+              "succeeded.",
+              ctx->topic_name);
+  }
+
+  if (b != NULL)
+    kafka_buffer_put(ctx, b);
+} /* }}} void kafka_delivery_report */
+
+/* Produces full batches. The buffers are handed over to librdkafka without
+ * copying them. */
+static void kafka_batch_produce(struct kafka_topic_context *ctx, /* {{{ */
+                                kafka_buffer_t **buffers, size_t buffers_num) {
+  if (buffers_num == 0)
+    return;
+
+  for (size_t i = 0; i < buffers_num; i++) {
+    /* Space for the closing bracket has been reserved when appending. */
+    if (ctx->format == KAFKA_FORMAT_JSON)
+      buffers[i]->data[buffers[i]->len++] = ']';
+  }
+
+#ifdef RD_KAFKA_MSG_F_PARTITION
+  rd_kafka_message_t msgs[buffers_num];
+  memset(msgs, 0, sizeof(msgs));
+
+  for (size_t i = 0; i < buffers_num; i++) {
+    msgs[i].partition = buffers[i]->partition;
+    msgs[i].payload = buffers[i]->data;
+    msgs[i].len = buffers[i]->len;
+    msgs[i]._private = buffers[i];
+  }
+
+  int accepted = rd_kafka_produce_batch(ctx->topic, RD_KAFKA_PARTITION_UA,
+                                        RD_KAFKA_MSG_F_PARTITION, msgs,
+                                        (int)buffers_num);
+  if (accepted < (int)buffers_num) {
+    for (size_t i = 0; i < buffers_num; i++) {
+      if (msgs[i].err == RD_KAFKA_RESP_ERR_NO_ERROR)
+        continue;
+      ERROR("write_kafka plugin: Producing a batch of %zu records to topic "
+            "\"%s\" failed: %s",
+            buffers[i]->records_num, ctx->topic_name,
+            rd_kafka_err2str(msgs[i].err));
+      kafka_buffer_put(ctx, buffers[i]);
+    }
+  }
+#else
+  for (size_t i = 0; i < buffers_num; i++) {
+    if (rd_kafka_produce(ctx->topic, buffers[i]->partition, /* flags = */ 0,
+                         buffers[i]->data, buffers[i]->len, /* key = */ NULL,
+                         /* keylen = */ 0, buffers[i]) != 0) {
+      ERROR("write_kafka plugin: Producing a batch of %zu records to topic "
+            "\"%s\" failed: %s",
+            buffers[i]->records_num, ctx->topic_name,
+            rd_kafka_err2str(rd_kafka_errno2err(errno)));
+      kafka_buffer_put(ctx, buffers[i]);
+    }
+  }
+#endif
+
+  /* Serve delivery reports, which return buffers to the pool. */
+  rd_kafka_poll(ctx->kafka, /* timeout = */ 0);
+} /* }}} void kafka_batch_produce */
+
+/* Produces all non-empty batches. */
+static void kafka_batch_flush(struct kafka_topic_context *ctx) /* {{{ */
+{
+  pthread_mutex_lock(&ctx->lock);
+  kafka_buffer_t *flush[ctx->batches_num];
+  size_t flush_num = 0;
+
+  for (size_t i = 0; i < ctx->batches_num; i++) {
+    if (ctx->batches[i] == NULL)
+      continue;
+    flush[flush_num] = ctx->batches[i];
+    flush_num++;
+    ctx->batches[i] = NULL;
+  }
+  pthread_mutex_unlock(&ctx->lock);
+
+  kafka_batch_produce(ctx, flush, flush_num);
+} /* }}} void kafka_batch_flush */
+
+/* Fetches the number of partitions of the topic, so that each batch can be
+ * assigned to a partition. */
+static void kafka_update_partitions(struct kafka_topic_context *ctx) /* {{{ */
+{
+  const struct rd_kafka_metadata *md = NULL;
+  cdtime_t now = cdtime();
+
+  if ((ctx->partition_cnt > 0) &&
+      ((now - ctx->metadata_time) < KAFKA_METADATA_INTERVAL))
+    return;
+  ctx->metadata_time = now;
+
+  rd_kafka_resp_err_t err = rd_kafka_metadata(
+      ctx->kafka, /* all_topics = */ 0, ctx->topic, &md, /* timeout = */ 1000);
+  if (err != RD_KAFKA_RESP_ERR_NO_ERROR) {
+    DEBUG("write_kafka plugin: rd_kafka_metadata failed: %s",
+          rd_kafka_err2str(err));
+    return;
+  }
+
+  int32_t partition_cnt = 0;
+  if ((md->topic_cnt == 1) && (md->topics[0].err == 0))
+    partition_cnt = md->topics[0].partition_cnt;
+  rd_kafka_metadata_destroy(md);
+
+  if ((partition_cnt < 1) || (partition_cnt == ctx->partition_cnt))
+    return;
+
+  kafka_buffer_t **batches = calloc((size_t)partition_cnt, sizeof(*batches));
+  if (batches == NULL) {
+    ERROR("write_kafka plugin: calloc failed.");
+    return;
+  }
+
+  /* Swap the arrays in one go, so that no record appended in between is lost.
+   * Batches built for the old partition count are produced as they are. */
+  pthread_mutex_lock(&ctx->lock);
+  kafka_buffer_t **old = ctx->batches;
+  size_t old_num = 0;
+  for (size_t i = 0; i < ctx->batches_num; i++)
+    if (old[i] != NULL)
+      old[old_num++] = old[i];
+
+  ctx->batches = batches;
+  ctx->batches_num = (size_t)partition_cnt;
+  ctx->partition_cnt = partition_cnt;
+  pthread_mutex_unlock(&ctx->lock);
+
+  kafka_batch_produce(ctx, old, old_num);
+  sfree(old);
+
+  INFO("write_kafka plugin: Topic \"%s\" has %" PRIi32 " partitions.",
+       ctx->topic_name, partition_cnt);
+} /* }}} void kafka_update_partitions */
+
+/* Appends one formatted record to the batch of the partition selected by the
+ * identifier hash. */
+static int kafka_batch_append(struct kafka_topic_context *ctx, /* {{{ */
+                              uint32_t hash, char const *record,
+                              size_t record_len) {
+  kafka_buffer_t *full = NULL;
+  /* Separator (or opening bracket) plus closing bracket or newline. */
+  size_t need = record_len + 2;
+
+  pthread_mutex_lock(&ctx->lock);
+
+  size_t idx = hash % ctx->batches_num;
+  kafka_buffer_t *b = ctx->batches[idx];
+
+  if ((b != NULL) && (b->len + need > ctx->batch_max_size)) {
+    full = b;
+    b = ctx->batches[idx] = NULL;
+  }
+
+  if (b == NULL) {
+    b = kafka_buffer_get(ctx);
+    if (b == NULL) {
+      pthread_mutex_unlock(&ctx->lock);
+      ERROR("write_kafka plugin: Allocating a batch buffer failed.");
+      if (full != NULL)
+        kafka_batch_produce(ctx, &full, 1);
+      return ENOMEM;
+    }
+    if (ctx->partition_cnt > 0)
+      b->partition = (int32_t)idx;
+    ctx->batches[idx] = b;
+  }
+
+  if (ctx->format == KAFKA_FORMAT_JSON)
+    b->data[b->len++] = (b->records_num == 0) ? '[' : ',';
+  memcpy(b->data + b->len, record, record_len);
+  b->len += record_len;
+  if (ctx->format == KAFKA_FORMAT_COMMAND)
+    b->data[b->len++] = '\n';
+  b->records_num++;
+
+  pthread_mutex_unlock(&ctx->lock);
+
+  if (full != NULL)
+    kafka_batch_produce(ctx, &full, 1);
+
+  return 0;
+} /* }}} int kafka_batch_append */
+
+static int kafka_flush(cdtime_t timeout __attribute__((unused)), /* {{{ */
+                       const char *identifier __attribute__((unused)),
+                       user_data_t *ud) {
+  struct kafka_topic_context *ctx = ud->data;
+
+  pthread_mutex_lock(&ctx->lock);
+  int status = kafka_handle(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+  if (status != 0)
+    return status;
+
+  kafka_batch_flush(ctx);
+  return 0;
+} /* }}} int kafka_flush */
+
+/* Registered as a read callback with the BatchFlushInterval as interval. */
+static int kafka_batch_timer(user_data_t *ud) /* {{{ */
+{
+  struct kafka_topic_context *ctx = ud->data;
+
+  pthread_mutex_lock(&ctx->lock);
+  int status = kafka_handle(ctx);
+  pthread_mutex_unlock(&ctx->lock);
+  if (status != 0)
+    return status;
+
+  kafka_update_partitions(ctx);
+  kafka_batch_flush(ctx);
+  return 0;
+} /* }}} int kafka_batch_timer */
+
 static int kafka_write(const data_set_t *ds, /* {{{ */
                        const value_list_t *vl, user_data_t *ud) {
   int status = 0;
@@ -171,6 +504,8 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
   size_t bfree = sizeof(buffer);
   size_t bfill = 0;
   size_t blen = 0;
+  char const *record = NULL;
+  size_t record_len = 0;
   struct kafka_topic_context *ctx = ud->data;
 
   if ((ds == NULL) || (vl == NULL) || (ctx == NULL))
@@ -199,6 +534,11 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
     format_json_value_list(buffer, &bfill, &bfree, ds, vl, ctx->store_rates);
     format_json_finalize(buffer, &bfill, &bfree);
     blen = strlen(buffer);
+    /* Batches are one JSON array: strip the brackets of this record. */
+    if (ctx->batch && (blen >= 2)) {
+      record = buffer + 1;
+      record_len = blen - 2;
+    }
     break;
   case KAFKA_FORMAT_GRAPHITE:
     status =
@@ -216,8 +556,24 @@ static int kafka_write(const data_set_t *ds, /* {{{ */
     return -1;
   }
 
-  key =
-      (ctx->key != NULL) ? ctx->key : kafka_random_key(KAFKA_RANDOM_KEY_BUFFER);
+  if (ctx->batch) {
+    if (record == NULL) {
+      record = buffer;
+      record_len = blen;
+    }
+    if (record_len + 2 <= ctx->batch_max_size)
+      return kafka_batch_append(ctx, kafka_vl_hash(vl), record, record_len);
+    /* Too large for a batch: produce it on its own. */
+  }
+
+  char key_buffer[KAFKA_RANDOM_KEY_SIZE];
+  if (ctx->key_identifier) {
+    ssnprintf(key_buffer, sizeof(key_buffer), "%08" PRIX32, kafka_vl_hash(vl));
+    key = key_buffer;
+  } else if (ctx->key != NULL)
+    key = ctx->key;
+  else
+    key = kafka_random_key(key_buffer);
   keylen = strlen(key);
 
   rd_kafka_produce(ctx->topic, RD_KAFKA_PARTITION_UA, RD_KAFKA_MSG_F_COPY,
@@ -233,6 +589,19 @@ static void kafka_topic_context_free(void *p) /* {{{ */
   if (ctx == NULL)
     return;
 
+  if (ctx->batch && (ctx->kafka != NULL) && (ctx->topic != NULL)) {
+    kafka_batch_flush(ctx);
+
+    /* Wait for the outstanding messages, which reference our buffers. */
+    cdtime_t deadline = cdtime() + MS_TO_CDTIME_T(KAFKA_SHUTDOWN_TIMEOUT);
+    while ((rd_kafka_outq_len(ctx->kafka) > 0) && (cdtime() < deadline))
+      rd_kafka_poll(ctx->kafka, /* timeout = */ 100);
+    if (rd_kafka_outq_len(ctx->kafka) > 0)
+      WARNING("write_kafka plugin: %d message(s) for topic \"%s\" have not "
+              "been delivered before shutdown.",
+              rd_kafka_outq_len(ctx->kafka), ctx->topic_name);
+  }
+
   if (ctx->topic_name != NULL)
     sfree(ctx->topic_name);
   if (ctx->topic != NULL)
@@ -244,6 +613,19 @@ static void kafka_topic_context_free(void *p) /* {{{ */
   if (ctx->kafka != NULL)
     rd_kafka_destroy(ctx->kafka);
 
+  /* librdkafka no longer references any buffer. */
+  while (ctx->buffers != NULL) {
+    kafka_buffer_t *b = ctx->buffers;
+    ctx->buffers = b->all_next;
+    sfree(b->data);
+    sfree(b);
+  }
+  sfree(ctx->batches);
+  sfree(ctx->key);
+  sfree(ctx->prefix);
+  sfree(ctx->postfix);
+  pthread_mutex_destroy(&ctx->lock);
+
   sfree(ctx);
 } /* }}} void kafka_topic_context_free */
 
@@ -268,6 +650,10 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   tctx->store_rates = 1;
   tctx->format = KAFKA_FORMAT_JSON;
   tctx->key = NULL;
+  tctx->batch = 0;
+  tctx->batch_max_size = KAFKA_DEFAULT_BATCH_MAX_SIZE;
+  tctx->batch_flush_interval = 0;
+  C_COMPLAIN_INIT(&tctx->delivery_complaint);
 
   if ((tctx->kafka_conf = rd_kafka_conf_dup(conf)) == NULL) {
     sfree(tctx);
@@ -335,6 +721,9 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
       if (strcasecmp("Random", tctx->key) == 0) {
         sfree(tctx->key);
         tctx->key = strdup(kafka_random_key(KAFKA_RANDOM_KEY_BUFFER));
+      } else if (strcasecmp("Identifier", tctx->key) == 0) {
+        sfree(tctx->key);
+        tctx->key_identifier = 1;
       }
     } else if (strcasecmp("Format", child->key) == 0) {
       status = cf_util_get_string(child, &key);
@@ -387,6 +776,33 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
                 "only one character. Others will be ignored.");
       tctx->escape_char = tmp_buff[0];
       sfree(tmp_buff);
+    } else if (strcasecmp("Batch", child->key) == 0) {
+      status = cf_util_get_boolean(child, &tctx->batch);
+    } else if (strcasecmp("BatchMaxSize", child->key) == 0) {
+      int tmp = 0;
+      status = cf_util_get_int(child, &tmp);
+      if ((status == 0) && (tmp < 1024)) {
+        WARNING("write_kafka plugin: BatchMaxSize must be at least 1024.");
+        status = -1;
+      }
+      if (status == 0)
+        tctx->batch_max_size = (size_t)tmp;
+    } else if (strcasecmp("BatchFlushInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &tctx->batch_flush_interval);
+    } else if (strcasecmp("Compression", child->key) == 0) {
+      char *codec = NULL;
+      status = cf_util_get_string(child, &codec);
+      if (status != 0)
+        goto errout;
+      ret = rd_kafka_conf_set(tctx->kafka_conf, "compression.codec", codec,
+                              errbuf, sizeof(errbuf));
+      if (ret != RD_KAFKA_CONF_OK) {
+        WARNING("write_kafka plugin: Invalid compression codec \"%s\": %s",
+                codec, errbuf);
+        sfree(codec);
+        goto errout;
+      }
+      sfree(codec);
     } else {
       WARNING("write_kafka plugin: Invalid directive: %s.", child->key);
     }
@@ -398,6 +814,13 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
   rd_kafka_topic_conf_set_partitioner_cb(tctx->conf, kafka_partition);
   rd_kafka_topic_conf_set_opaque(tctx->conf, tctx);
 
+  if (tctx->batch) {
+    rd_kafka_conf_set_dr_msg_cb(tctx->kafka_conf, kafka_delivery_report);
+    rd_kafka_conf_set_opaque(tctx->kafka_conf, tctx);
+  }
+
+  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+
   ssnprintf(callback_name, sizeof(callback_name), "write_kafka/%s",
             tctx->topic_name);
 
@@ -413,7 +836,14 @@ static void kafka_config_topic(rd_kafka_conf_t *conf,
     goto errout;
   }
 
-  pthread_mutex_init(&tctx->lock, /* attr = */ NULL);
+  if (tctx->batch) {
+    user_data_t ud = {.data = tctx};
+
+    plugin_register_flush(callback_name, kafka_flush, &ud);
+    plugin_register_complex_read(/* group = */ NULL, callback_name,
+                                 kafka_batch_timer, tctx->batch_flush_interval,
+                                 &ud);
+  }
 
   return;
 errout:
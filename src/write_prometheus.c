@@ -36,6 +36,10 @@
 
 #include <microhttpd.h>
 
+#if HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #ifndef PROMETHEUS_DEFAULT_STALENESS_DELTA
 #define PROMETHEUS_DEFAULT_STALENESS_DELTA TIME_T_TO_CDTIME_T_STATIC(300)
 #endif
@@ -47,8 +51,78 @@
   "encoding=delimited"
 #define CONTENT_TYPE_TEXT "text/plain; version=0.0.4"
 
+/* Size of the blocks handed to microhttpd when streaming a response. */
+#define RESPONSE_BLOCK_SIZE 32768
+
+/* prom_family_t is a metric family together with its serialized forms. The
+ * text and protobuf representations are rendered when a scrape needs them and
+ * cached until the family changes. The caches are protected by metrics_lock. */
+typedef struct {
+  /* Must be the first member: pointers to "fam" are cast to prom_family_t. */
+  Io__Prometheus__Client__MetricFamily fam;
+
+  _Bool text_dirty;
+  uint8_t *text;
+  size_t text_len;
+
+  _Bool proto_dirty;
+  uint8_t *proto;
+  size_t proto_len;
+
+  /* Incremented whenever the family changes. */
+  uint64_t version;
+} prom_family_t;
+
+/* prom_part_t is a copy of one metric family, taken while building a
+ * snapshot. */
+typedef struct {
+  char *name;
+  uint64_t version;
+  /* If set, the family was not rendered before and "data" has to be put into
+   * its cache. For the text format, "data" is the packed protobuf of the
+   * family until part_render() has been called. */
+  _Bool dirty;
+  uint8_t *data;
+  size_t len;
+} prom_part_t;
+
+/* prom_snapshot_t is a complete, rendered response. Snapshots are immutable
+ * and reference counted, so that they can be served without holding any lock.
+ */
+typedef struct {
+  size_t refcount; /* protected by snapshot_lock */
+  uint64_t generation;
+  uint8_t *data;
+  size_t len;
+
+#if HAVE_LIBZ
+  /* The gzip-compressed form of "data" is created on demand, by the first
+   * scrape asking for it, and shared by all later scrapes of this snapshot.
+   * It is compressed in one go and kept in memory in addition to "data" for
+   * as long as the snapshot is referenced. */
+  pthread_mutex_t gzip_lock;
+  _Bool gzip_done;
+  uint8_t *gzip_data;
+  size_t gzip_len;
+#endif
+} prom_snapshot_t;
+
+/* prom_stream_t is the state of one response being streamed to a client. */
+typedef struct {
+  prom_snapshot_t *snap;
+  uint8_t const *data;
+  size_t len;
+} prom_stream_t;
+
 static c_avl_tree_t *metrics;
 static pthread_mutex_t metrics_lock = PTHREAD_MUTEX_INITIALIZER;
+/* Incremented whenever anything in "metrics" changes. Protected by
+ * metrics_lock. */
+static uint64_t metrics_generation;
+
+static prom_snapshot_t *snapshot_text;
+static prom_snapshot_t *snapshot_proto;
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
 
 static unsigned short httpd_port = 9103;
 static struct MHD_Daemon *httpd;
@@ -72,30 +146,21 @@ static size_t varint(uint8_t buffer[static VARINT_UINT32_BYTES],
   return 0;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in ProtoBuf format. It prefixes each protobuf with its encoded
- * size, the so called "delimited" format. */
-static void format_protobuf(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
-
-  char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
-  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    /* Prometheus uses a message length prefix to determine where one
-     * MetricFamily ends and the next begins. This delimiter is encoded as a
-     * "varint", which is common in Protobufs. */
-    uint8_t delim[VARINT_UINT32_BYTES] = {0};
-    size_t delim_len = varint(
-        delim,
-        (uint32_t)io__prometheus__client__metric_family__get_packed_size(fam));
-    buffer->append(buffer, delim_len, delim);
-
-    io__prometheus__client__metric_family__pack_to_buffer(fam, buffer);
-  }
-  c_avl_iterator_destroy(iter);
-
-  pthread_mutex_unlock(&metrics_lock);
+/* format_protobuf adds a metric family to a buffer in ProtoBuf format. It
+ * prefixes the protobuf with its encoded size, the so called "delimited"
+ * format. */
+static void format_protobuf(ProtobufCBuffer *buffer,
+                            Io__Prometheus__Client__MetricFamily *fam) {
+  /* Prometheus uses a message length prefix to determine where one
+   * MetricFamily ends and the next begins. This delimiter is encoded as a
+   * "varint", which is common in Protobufs. */
+  uint8_t delim[VARINT_UINT32_BYTES] = {0};
+  size_t delim_len = varint(
+      delim,
+      (uint32_t)io__prometheus__client__metric_family__get_packed_size(fam));
+  buffer->append(buffer, delim_len, delim);
+
+  io__prometheus__client__metric_family__pack_to_buffer(fam, buffer);
 }
 
 static char const *escape_label_value(char *buffer, size_t buffer_size,
@@ -167,56 +232,423 @@ static char *format_labels(char *buffer, size_t buffer_size,
   return buffer;
 }
 
-/* format_protobuf iterates over all metric families in "metrics" and adds them
- * to a buffer in plain text format. */
-static void format_text(ProtobufCBuffer *buffer) {
-  pthread_mutex_lock(&metrics_lock);
+/* format_text adds a metric family to a buffer in plain text format. */
+static void format_text(ProtobufCBuffer *buffer,
+                        Io__Prometheus__Client__MetricFamily const *fam) {
+  char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
 
-  char *unused_name;
-  Io__Prometheus__Client__MetricFamily *fam;
-  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
-  while (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&fam) == 0) {
-    char line[1024]; /* 4x DATA_MAX_NAME_LEN? */
+  ssnprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
 
-    ssnprintf(line, sizeof(line), "# HELP %s %s\n", fam->name, fam->help);
-    buffer->append(buffer, strlen(line), (uint8_t *)line);
+  ssnprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name,
+            (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
+                ? "gauge"
+                : "counter");
+  buffer->append(buffer, strlen(line), (uint8_t *)line);
+
+  for (size_t i = 0; i < fam->n_metric; i++) {
+    Io__Prometheus__Client__Metric *m = fam->metric[i];
+
+    char labels[1024];
+
+    char timestamp_ms[24] = "";
+    if (m->has_timestamp_ms)
+      ssnprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
+                m->timestamp_ms);
+
+    if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
+      ssnprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
+                format_labels(labels, sizeof(labels), m), m->gauge->value,
+                timestamp_ms);
+    else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
+      ssnprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
+                format_labels(labels, sizeof(labels), m), m->counter->value,
+                timestamp_ms);
 
-    ssnprintf(line, sizeof(line), "# TYPE %s %s\n", fam->name,
-              (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-                  ? "gauge"
-                  : "counter");
     buffer->append(buffer, strlen(line), (uint8_t *)line);
+  }
+}
+
+/* family_mark_dirty invalidates the cached representations of a family. Must
+ * be called with metrics_lock held. */
+static void family_mark_dirty(Io__Prometheus__Client__MetricFamily *fam) {
+  prom_family_t *pf = (prom_family_t *)fam;
+
+  pf->text_dirty = 1;
+  pf->proto_dirty = 1;
+  pf->version++;
+  metrics_generation++;
+}
+
+static void snapshot_release(prom_snapshot_t *snap) {
+  if (snap == NULL)
+    return;
+
+  pthread_mutex_lock(&snapshot_lock);
+  assert(snap->refcount > 0);
+  snap->refcount--;
+  _Bool unused = (snap->refcount == 0);
+  pthread_mutex_unlock(&snapshot_lock);
+
+  if (unused) {
+#if HAVE_LIBZ
+    pthread_mutex_destroy(&snap->gzip_lock);
+    sfree(snap->gzip_data);
+#endif
+    sfree(snap->data);
+    sfree(snap);
+  }
+}
+
+/* part_copy copies a metric family into "part". Clean families are copied
+ * from their cache. Dirty families are serialized into a protobuf, which is
+ * much cheaper than rendering them as text. For the protobuf format this
+ * already is the final form; the text format is rendered by part_render()
+ * later, without holding metrics_lock. Must be called with metrics_lock held.
+ */
+static int part_copy(prom_part_t *part, prom_family_t *pf, _Bool want_proto) {
+  uint8_t const *cached = want_proto ? pf->proto : pf->text;
+  size_t cached_len = want_proto ? pf->proto_len : pf->text_len;
+
+  part->name = strdup(pf->fam.name);
+  if (part->name == NULL)
+    return ENOMEM;
+  part->version = pf->version;
+  part->dirty = (want_proto ? pf->proto_dirty : pf->text_dirty) ||
+                (cached == NULL);
+
+  if (!part->dirty) {
+    part->data = malloc(cached_len > 0 ? cached_len : 1);
+    if (part->data == NULL)
+      return ENOMEM;
+    memcpy(part->data, cached, cached_len);
+    part->len = cached_len;
+    return 0;
+  }
+
+  if (want_proto) {
+    uint8_t scratch[4096];
+    ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
+    format_protobuf((ProtobufCBuffer *)&simple, &pf->fam);
+
+    part->data = malloc(simple.len > 0 ? simple.len : 1);
+    if (part->data != NULL) {
+      memcpy(part->data, simple.data, simple.len);
+      part->len = simple.len;
+    }
+    PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+    return (part->data != NULL) ? 0 : ENOMEM;
+  }
+
+  part->len = io__prometheus__client__metric_family__get_packed_size(&pf->fam);
+  part->data = malloc(part->len > 0 ? part->len : 1);
+  if (part->data == NULL)
+    return ENOMEM;
+  io__prometheus__client__metric_family__pack(&pf->fam, part->data);
+  return 0;
+}
 
-    for (size_t i = 0; i < fam->n_metric; i++) {
-      Io__Prometheus__Client__Metric *m = fam->metric[i];
+/* part_render replaces the packed protobuf of a dirty part with its text
+ * representation. */
+static int part_render(prom_part_t *part) {
+  Io__Prometheus__Client__MetricFamily *fam =
+      io__prometheus__client__metric_family__unpack(
+          /* allocator = */ NULL, part->len, part->data);
+  if (fam == NULL)
+    return EINVAL;
 
-      char labels[1024];
+  uint8_t scratch[4096];
+  ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
+  format_text((ProtobufCBuffer *)&simple, fam);
+  io__prometheus__client__metric_family__free_unpacked(fam,
+                                                       /* allocator = */ NULL);
 
-      char timestamp_ms[24] = "";
-      if (m->has_timestamp_ms)
-        ssnprintf(timestamp_ms, sizeof(timestamp_ms), " %" PRIi64,
-                  m->timestamp_ms);
+  uint8_t *data = malloc(simple.len > 0 ? simple.len : 1);
+  if (data == NULL) {
+    PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+    return ENOMEM;
+  }
+  memcpy(data, simple.data, simple.len);
+
+  sfree(part->data);
+  part->data = data;
+  part->len = simple.len;
+  PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
+  return 0;
+}
 
-      if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__GAUGE)
-        ssnprintf(line, sizeof(line), "%s{%s} " GAUGE_FORMAT "%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->gauge->value,
-                  timestamp_ms);
-      else /* if (fam->type == IO__PROMETHEUS__CLIENT__METRIC_TYPE__COUNTER) */
-        ssnprintf(line, sizeof(line), "%s{%s} %.0f%s\n", fam->name,
-                  format_labels(labels, sizeof(labels), m), m->counter->value,
-                  timestamp_ms);
+/* part_store puts a part rendered by part_render() into the cache of its
+ * family, unless the family changed or went away in the meantime. Must be
+ * called with metrics_lock held. */
+static void part_store(prom_part_t *part, _Bool want_proto) {
+  prom_family_t *pf = NULL;
+  if (c_avl_get(metrics, part->name, (void *)&pf) != 0)
+    return;
+  if (pf->version != part->version)
+    return;
 
-      buffer->append(buffer, strlen(line), (uint8_t *)line);
+  uint8_t **data = want_proto ? &pf->proto : &pf->text;
+  sfree(*data);
+  *data = part->data;
+  part->data = NULL;
+  if (want_proto) {
+    pf->proto_len = part->len;
+    pf->proto_dirty = 0;
+  } else {
+    pf->text_len = part->len;
+    pf->text_dirty = 0;
+  }
+}
+
+static void parts_destroy(prom_part_t *parts, size_t parts_num) {
+  if (parts == NULL)
+    return;
+
+  for (size_t i = 0; i < parts_num; i++) {
+    sfree(parts[i].name);
+    sfree(parts[i].data);
+  }
+  sfree(parts);
+}
+
+/* snapshot_build concatenates the representations of all metric families into
+ * a new snapshot. metrics_lock is only held while copying the families and
+ * while putting the newly rendered families into the cache; all rendering is
+ * done without it, so that writers are not blocked by a scrape. Only families
+ * that changed since the last scrape are rendered; the others are copied from
+ * their cache. */
+static prom_snapshot_t *snapshot_build(_Bool want_proto) {
+  char footer[1024] = "";
+  if (!want_proto)
+    ssnprintf(footer, sizeof(footer),
+              "\n# collectd/write_prometheus %s at %s\n", PACKAGE_VERSION,
+              hostname_g);
+
+  pthread_mutex_lock(&metrics_lock);
+  uint64_t generation = metrics_generation;
+  size_t parts_num = (size_t)c_avl_size(metrics);
+  prom_part_t *parts = calloc(parts_num > 0 ? parts_num : 1, sizeof(*parts));
+  if (parts == NULL) {
+    pthread_mutex_unlock(&metrics_lock);
+    return NULL;
+  }
+
+  size_t i = 0;
+  char *unused_name;
+  prom_family_t *pf;
+  c_avl_iterator_t *iter = c_avl_get_iterator(metrics);
+  while ((i < parts_num) &&
+         (c_avl_iterator_next(iter, (void *)&unused_name, (void *)&pf) == 0)) {
+    if (part_copy(parts + i, pf, want_proto) != 0) {
+      c_avl_iterator_destroy(iter);
+      pthread_mutex_unlock(&metrics_lock);
+      parts_destroy(parts, parts_num);
+      return NULL;
     }
+    i++;
   }
   c_avl_iterator_destroy(iter);
+  pthread_mutex_unlock(&metrics_lock);
 
-  char server[1024];
-  ssnprintf(server, sizeof(server), "\n# collectd/write_prometheus %s at %s\n",
-            PACKAGE_VERSION, hostname_g);
-  buffer->append(buffer, strlen(server), (uint8_t *)server);
+  size_t size = strlen(footer);
+  for (i = 0; i < parts_num; i++) {
+    if (!want_proto && parts[i].dirty && (part_render(parts + i) != 0)) {
+      ERROR("write_prometheus plugin: Rendering metric family \"%s\" failed.",
+            parts[i].name);
+      sfree(parts[i].data);
+      parts[i].len = 0;
+      parts[i].dirty = 0;
+      continue;
+    }
+    size += parts[i].len;
+  }
+
+  prom_snapshot_t *snap = calloc(1, sizeof(*snap));
+  if (snap == NULL) {
+    parts_destroy(parts, parts_num);
+    return NULL;
+  }
+  snap->data = malloc(size > 0 ? size : 1);
+  if (snap->data == NULL) {
+    sfree(snap);
+    parts_destroy(parts, parts_num);
+    return NULL;
+  }
+#if HAVE_LIBZ
+  pthread_mutex_init(&snap->gzip_lock, /* attr = */ NULL);
+#endif
+
+  for (i = 0; i < parts_num; i++) {
+    if (parts[i].data == NULL)
+      continue;
+
+    assert((snap->len + parts[i].len) <= size);
+    memcpy(snap->data + snap->len, parts[i].data, parts[i].len);
+    snap->len += parts[i].len;
+  }
+  memcpy(snap->data + snap->len, footer, strlen(footer));
+  snap->len += strlen(footer);
+  snap->generation = generation;
 
+  /* Cache the newly rendered families for the next scrape. */
+  pthread_mutex_lock(&metrics_lock);
+  for (i = 0; i < parts_num; i++)
+    if (parts[i].dirty && (parts[i].data != NULL))
+      part_store(parts + i, want_proto);
   pthread_mutex_unlock(&metrics_lock);
+
+  parts_destroy(parts, parts_num);
+  return snap;
+}
+
+/* snapshot_get returns a snapshot reflecting the current state of "metrics".
+ * If nothing changed since the last scrape, the previous snapshot is returned
+ * without walking the metrics. The caller must release the snapshot with
+ * snapshot_release(). */
+static prom_snapshot_t *snapshot_get(_Bool want_proto) {
+  prom_snapshot_t **current = want_proto ? &snapshot_proto : &snapshot_text;
+
+  pthread_mutex_lock(&metrics_lock);
+  uint64_t generation = metrics_generation;
+  pthread_mutex_unlock(&metrics_lock);
+
+  pthread_mutex_lock(&snapshot_lock);
+  if ((*current != NULL) && ((*current)->generation == generation)) {
+    prom_snapshot_t *snap = *current;
+    snap->refcount++;
+    pthread_mutex_unlock(&snapshot_lock);
+    return snap;
+  }
+  pthread_mutex_unlock(&snapshot_lock);
+
+  prom_snapshot_t *snap = snapshot_build(want_proto);
+  if (snap == NULL) {
+    ERROR("write_prometheus plugin: Building a snapshot failed.");
+    return NULL;
+  }
+
+  /* Publish the new snapshot: one reference is held by "current", one by the
+   * caller. Concurrent scrapes may build snapshots at the same time; the most
+   * recent one is kept. */
+  pthread_mutex_lock(&snapshot_lock);
+  prom_snapshot_t *old = NULL;
+  if ((*current == NULL) || ((*current)->generation < snap->generation)) {
+    old = *current;
+    *current = snap;
+    snap->refcount = 2;
+  } else {
+    snap->refcount = 1;
+  }
+  pthread_mutex_unlock(&snapshot_lock);
+
+  snapshot_release(old);
+  return snap;
+}
+
+#if HAVE_LIBZ
+/* snapshot_gzip compresses the snapshot, unless that has been done before.
+ * Returns zero if "gzip_data" is available. */
+static int snapshot_gzip(prom_snapshot_t *snap) {
+  pthread_mutex_lock(&snap->gzip_lock);
+  if (snap->gzip_done) {
+    int status = (snap->gzip_data != NULL) ? 0 : -1;
+    pthread_mutex_unlock(&snap->gzip_lock);
+    return status;
+  }
+  snap->gzip_done = 1;
+
+  z_stream zs = {0};
+  /* 15 window bits, +16 to write a gzip header and trailer. */
+  if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 15 + 16,
+                   /* memLevel = */ 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+    pthread_mutex_unlock(&snap->gzip_lock);
+    ERROR("write_prometheus plugin: deflateInit2 failed.");
+    return -1;
+  }
+
+  uLong size = deflateBound(&zs, (uLong)snap->len);
+  uint8_t *out = malloc(size);
+  if (out == NULL) {
+    deflateEnd(&zs);
+    pthread_mutex_unlock(&snap->gzip_lock);
+    ERROR("write_prometheus plugin: malloc failed.");
+    return -1;
+  }
+
+  zs.next_in = snap->data;
+  zs.avail_in = (uInt)snap->len;
+  zs.next_out = out;
+  zs.avail_out = (uInt)size;
+
+  int status = deflate(&zs, Z_FINISH);
+  if (status != Z_STREAM_END) {
+    deflateEnd(&zs);
+    sfree(out);
+    pthread_mutex_unlock(&snap->gzip_lock);
+    ERROR("write_prometheus plugin: deflate failed with status %d.", status);
+    return -1;
+  }
+
+  /* deflateBound() is a worst case estimate; give back what is not needed,
+   * since the buffer lives as long as the snapshot. */
+  snap->gzip_len = (size_t)zs.total_out;
+  snap->gzip_data = realloc(out, snap->gzip_len > 0 ? snap->gzip_len : 1);
+  if (snap->gzip_data == NULL)
+    snap->gzip_data = out;
+  deflateEnd(&zs);
+
+  pthread_mutex_unlock(&snap->gzip_lock);
+  return 0;
+}
+
+/* accepts_gzip returns true if the "Accept-Encoding" header lists gzip with a
+ * non-zero quality. */
+static _Bool accepts_gzip(char const *accept_encoding) {
+  if (accept_encoding == NULL)
+    return 0;
+
+  char const *ptr = accept_encoding;
+  while (*ptr != 0) {
+    ptr += strspn(ptr, " \t,");
+    size_t len = strcspn(ptr, ",");
+    size_t name_len = strcspn(ptr, " \t;,");
+
+    if (((name_len == 4) && (strncasecmp("gzip", ptr, 4) == 0)) ||
+        ((name_len == 1) && (ptr[0] == '*'))) {
+      char const *q = strstr(ptr, "q=");
+      if ((q == NULL) || ((size_t)(q - ptr) >= len))
+        return 1;
+      return atof(q + strlen("q=")) > 0.0;
+    }
+
+    ptr += len;
+  }
+
+  return 0;
+}
+#endif
+
+/* http_stream is the content reader callback, copying the next block of the
+ * response into microhttpd's buffer. */
+static ssize_t http_stream(void *cls, uint64_t pos, char *buf, size_t max) {
+  prom_stream_t *stream = cls;
+
+  if (pos >= stream->len)
+    return MHD_CONTENT_READER_END_OF_STREAM;
+
+  size_t len = stream->len - (size_t)pos;
+  if (len > max)
+    len = max;
+
+  memcpy(buf, stream->data + pos, len);
+  return (ssize_t)len;
+}
+
+static void http_stream_free(void *cls) {
+  prom_stream_t *stream = cls;
+
+  snapshot_release(stream->snap);
+  sfree(stream);
 }
 
 /* http_handler is the callback called by the microhttpd library. It essentially
@@ -244,29 +676,53 @@ static int http_handler(void *cls, struct MHD_Connection *connection,
       (accept != NULL) &&
       (strstr(accept, "application/vnd.google.protobuf") != NULL);
 
-  uint8_t scratch[4096] = {0};
-  ProtobufCBufferSimple simple = PROTOBUF_C_BUFFER_SIMPLE_INIT(scratch);
-  ProtobufCBuffer *buffer = (ProtobufCBuffer *)&simple;
-
-  if (want_proto)
-    format_protobuf(buffer);
-  else
-    format_text(buffer);
-
-#if defined(MHD_VERSION) && MHD_VERSION >= 0x00090500
-  struct MHD_Response *res = MHD_create_response_from_buffer(
-      simple.len, simple.data, MHD_RESPMEM_MUST_COPY);
-#else
-  struct MHD_Response *res = MHD_create_response_from_data(
-      simple.len, simple.data, /* must_free = */ 0, /* must_copy = */ 1);
+  prom_stream_t *stream = calloc(1, sizeof(*stream));
+  if (stream == NULL)
+    return MHD_NO;
+
+  stream->snap = snapshot_get(want_proto);
+  if (stream->snap == NULL) {
+    sfree(stream);
+    return MHD_NO;
+  }
+  stream->data = stream->snap->data;
+  stream->len = stream->snap->len;
+
+#if HAVE_LIBZ
+  _Bool gzip = 0;
+  char const *accept_encoding = MHD_lookup_connection_value(
+      connection, MHD_HEADER_KIND, MHD_HTTP_HEADER_ACCEPT_ENCODING);
+  if (accepts_gzip(accept_encoding) && (snapshot_gzip(stream->snap) == 0)) {
+    stream->data = stream->snap->gzip_data;
+    stream->len = stream->snap->gzip_len;
+    gzip = 1;
+  }
 #endif
+
+  /* The response is streamed straight out of the (shared) snapshot; the
+   * snapshot is released by http_stream_free() once the response has been
+   * sent or the connection was closed. */
+  struct MHD_Response *res =
+      MHD_create_response_from_callback(stream->len, RESPONSE_BLOCK_SIZE,
+                                        http_stream, stream, http_stream_free);
+  if (res == NULL) {
+    http_stream_free(stream);
+    return MHD_NO;
+  }
+
   MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_TYPE,
                           want_proto ? CONTENT_TYPE_PROTO : CONTENT_TYPE_TEXT);
+  /* Sent even without zlib: caches must not assume that this server's
+   * responses never depend on Accept-Encoding, e.g. after an upgrade. */
+  MHD_add_response_header(res, MHD_HTTP_HEADER_VARY, "Accept-Encoding");
+#if HAVE_LIBZ
+  if (gzip)
+    MHD_add_response_header(res, MHD_HTTP_HEADER_CONTENT_ENCODING, "gzip");
+#endif
 
   int status = MHD_queue_response(connection, MHD_HTTP_OK, res);
 
   MHD_destroy_response(res);
-  PROTOBUF_C_BUFFER_SIMPLE_CLEAR(&simple);
   return status;
 }
 
@@ -616,16 +1072,24 @@ static void metric_family_destroy(Io__Prometheus__Client__MetricFamily *msg) {
   }
   sfree(msg->metric);
 
-  sfree(msg);
+  prom_family_t *pf = (prom_family_t *)msg;
+  sfree(pf->text);
+  sfree(pf->proto);
+
+  sfree(pf);
 }
 
 /* metric_family_create allocates and initializes a new metric family. */
 static Io__Prometheus__Client__MetricFamily *
 metric_family_create(char *name, data_set_t const *ds, value_list_t const *vl,
                      size_t ds_index) {
-  Io__Prometheus__Client__MetricFamily *msg = calloc(1, sizeof(*msg));
-  if (msg == NULL)
+  prom_family_t *pf = calloc(1, sizeof(*pf));
+  if (pf == NULL)
     return NULL;
+  pf->text_dirty = 1;
+  pf->proto_dirty = 1;
+
+  Io__Prometheus__Client__MetricFamily *msg = &pf->fam;
   io__prometheus__client__metric_family__init(msg);
 
   msg->name = name;
@@ -718,10 +1182,11 @@ metric_family_get(data_set_t const *ds, value_list_t const *vl, size_t ds_index,
 
   int status = c_avl_insert(metrics, fam->name, fam);
   if (status != 0) {
-    ERROR("write_prometheus plugin: Adding \"%s\" failed.", name);
+    ERROR("write_prometheus plugin: Adding \"%s\" failed.", fam->name);
     metric_family_destroy(fam);
     return NULL;
   }
+  metrics_generation++;
 
   return fam;
 }
@@ -791,6 +1256,7 @@ static int prom_write(data_set_t const *ds, value_list_t const *vl,
       continue;
 
     int status = metric_family_update(fam, ds, vl, i);
+    family_mark_dirty(fam);
     if (status != 0) {
       ERROR("write_prometheus plugin: Updating metric \"%s\" failed with "
             "status %d",
@@ -818,6 +1284,7 @@ static int prom_missing(value_list_t const *vl,
       continue;
 
     int status = metric_family_delete_metric(fam, vl);
+    family_mark_dirty(fam);
     if (status != 0) {
       ERROR("write_prometheus plugin: Deleting a metric in family \"%s\" "
             "failed with status %d",
@@ -863,6 +1330,16 @@ static int prom_shutdown() {
   }
   pthread_mutex_unlock(&metrics_lock);
 
+  pthread_mutex_lock(&snapshot_lock);
+  prom_snapshot_t *text = snapshot_text;
+  prom_snapshot_t *proto = snapshot_proto;
+  snapshot_text = NULL;
+  snapshot_proto = NULL;
+  pthread_mutex_unlock(&snapshot_lock);
+
+  snapshot_release(text);
+  snapshot_release(proto);
+
   return 0;
 }
 
@@ -28,6 +28,7 @@
 
 #include "common.h"
 #include "plugin.h"
+#include "utils_cache.h"
 
 #include <hiredis/hiredis.h>
 #include <sys/time.h>
@@ -46,15 +47,140 @@ struct wr_node_s {
   int database;
   int max_set_size;
   _Bool store_rates;
+  int batch_size;
+  cdtime_t flush_interval;
 
   redisContext *conn;
   pthread_mutex_t lock;
+
+  /* Commands are pipelined: they are appended to the connection's output
+   * buffer and the replies are read once "batch_size" value lists have been
+   * appended. */
+  size_t replies_pending;
+  int values_pending;
+
+  /* Incremented whenever a SADD may have been lost. The generation in which
+   * an identifier has been added to the "values" set is stored in the value
+   * cache's meta data (key "meta_key"), so that SADD is only sent once. */
+  uint64_t generation;
+  char meta_key[DATA_MAX_NAME_LEN + 32];
 };
 typedef struct wr_node_s wr_node_t;
 
 /*
  * Functions
  */
+static void wr_disconnect(wr_node_t *node) /* {{{ */
+{
+  if (node->conn != NULL) {
+    redisFree(node->conn);
+    node->conn = NULL;
+  }
+
+  node->replies_pending = 0;
+  node->values_pending = 0;
+  node->generation++;
+} /* }}} void wr_disconnect */
+
+/* Must hold node->lock when calling. */
+static int wr_connect(wr_node_t *node) /* {{{ */
+{
+  redisReply *rr;
+
+  if (node->conn != NULL)
+    return 0;
+
+  node->conn =
+      redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
+  if (node->conn == NULL) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
+          "Unknown reason",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379);
+    return -1;
+  } else if (node->conn->err) {
+    ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
+          (node->host != NULL) ? node->host : "localhost",
+          (node->port != 0) ? node->port : 6379, node->conn->errstr);
+    wr_disconnect(node);
+    return -1;
+  }
+
+  rr = redisCommand(node->conn, "SELECT %d", node->database);
+  if (rr == NULL)
+    WARNING("SELECT command error. database:%d message:%s", node->database,
+            node->conn->errstr);
+  else
+    freeReplyObject(rr);
+
+  /* Identifiers have to be added to the "values" set again in case the
+   * database has been lost. */
+  node->generation++;
+
+  return 0;
+} /* }}} int wr_connect */
+
+/* Reads the replies to all pipelined commands. Must hold node->lock when
+ * calling. */
+static int wr_drain(wr_node_t *node) /* {{{ */
+{
+  int errors_num = 0;
+
+  if (node->conn == NULL)
+    return 0;
+
+  while (node->replies_pending > 0) {
+    redisReply *rr = NULL;
+
+    if (redisGetReply(node->conn, (void **)&rr) != REDIS_OK) {
+      ERROR("write_redis plugin: Node \"%s\": Sending %i value list(s) "
+            "failed: %s",
+            node->name, node->values_pending, node->conn->errstr);
+      wr_disconnect(node);
+      return -1;
+    }
+    node->replies_pending--;
+
+    if (rr->type == REDIS_REPLY_ERROR) {
+      if (errors_num == 0)
+        WARNING("write_redis plugin: Node \"%s\": Command error: %s",
+                node->name, rr->str);
+      errors_num++;
+    }
+    freeReplyObject(rr);
+  }
+
+  /* The failed command may have been a SADD. */
+  if (errors_num > 0) {
+    node->generation++;
+    if (errors_num > 1)
+      WARNING("write_redis plugin: Node \"%s\": %i more command(s) failed.",
+              node->name, errors_num - 1);
+  }
+
+  node->values_pending = 0;
+  return 0;
+} /* }}} int wr_drain */
+
+static int wr_append(wr_node_t *node, const char *format, ...) /* {{{ */
+{
+  va_list ap;
+  int status;
+
+  va_start(ap, format);
+  status = redisvAppendCommand(node->conn, format, ap);
+  va_end(ap);
+
+  if (status != REDIS_OK) {
+    ERROR("write_redis plugin: Node \"%s\": Appending command failed: %s",
+          node->name, node->conn->errstr);
+    return -1;
+  }
+
+  node->replies_pending++;
+  return 0;
+} /* }}} int wr_append */
+
 static int wr_write(const data_set_t *ds, /* {{{ */
                     const value_list_t *vl, user_data_t *ud) {
   wr_node_t *node = ud->data;
@@ -65,7 +191,6 @@ static int wr_write(const data_set_t *ds, /* {{{ */
   size_t value_size;
   char *value_ptr;
   int status;
-  redisReply *rr;
 
   status = FORMAT_VL(ident, sizeof(ident), vl);
   if (status != 0)
@@ -83,66 +208,65 @@ static int wr_write(const data_set_t *ds, /* {{{ */
 
   pthread_mutex_lock(&node->lock);
 
-  if (node->conn == NULL) {
-    node->conn =
-        redisConnectWithTimeout((char *)node->host, node->port, node->timeout);
-    if (node->conn == NULL) {
-      ERROR("write_redis plugin: Connecting to host \"%s\" (port %i) failed: "
-            "Unknown reason",
-            (node->host != NULL) ? node->host : "localhost",
-            (node->port != 0) ? node->port : 6379);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    } else if (node->conn->err) {
-      ERROR(
-          "write_redis plugin: Connecting to host \"%s\" (port %i) failed: %s",
-          (node->host != NULL) ? node->host : "localhost",
-          (node->port != 0) ? node->port : 6379, node->conn->errstr);
-      pthread_mutex_unlock(&node->lock);
-      return -1;
-    }
-
-    rr = redisCommand(node->conn, "SELECT %d", node->database);
-    if (rr == NULL)
-      WARNING("SELECT command error. database:%d message:%s", node->database,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if (wr_connect(node) != 0) {
+    pthread_mutex_unlock(&node->lock);
+    return -1;
   }
 
-  rr = redisCommand(node->conn, "ZADD %s %s %s", key, time, value);
-  if (rr == NULL)
-    WARNING("ZADD command error. key:%s message:%s", key, node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  status = wr_append(node, "ZADD %s %s %s", key, time, value);
 
-  if (node->max_set_size >= 0) {
-    rr = redisCommand(node->conn, "ZREMRANGEBYRANK %s %d %d", key, 0,
-                      (-1 * node->max_set_size) - 1);
-    if (rr == NULL)
-      WARNING("ZREMRANGEBYRANK command error. key:%s message:%s", key,
-              node->conn->errstr);
-    else
-      freeReplyObject(rr);
+  if ((status == 0) && (node->max_set_size >= 0))
+    status = wr_append(node, "ZREMRANGEBYRANK %s %d %d", key, 0,
+                       (-1 * node->max_set_size) - 1);
+
+  if (status == 0) {
+    uint64_t generation = 0;
+
+    if ((uc_meta_data_get_unsigned_int(vl, node->meta_key, &generation) != 0) ||
+        (generation != node->generation)) {
+      status = wr_append(
+          node, "SADD %svalues %s",
+          (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
+      if (status == 0)
+        uc_meta_data_add_unsigned_int(vl, node->meta_key, node->generation);
+    }
   }
 
-  /* TODO(octo): This is more overhead than necessary. Use the cache and
-   * metadata to determine if it is a new metric and call SADD only once for
-   * each metric. */
-  rr = redisCommand(
-      node->conn, "SADD %svalues %s",
-      (node->prefix != NULL) ? node->prefix : REDIS_DEFAULT_PREFIX, ident);
-  if (rr == NULL)
-    WARNING("SADD command error. ident:%s message:%s", ident,
-            node->conn->errstr);
-  else
-    freeReplyObject(rr);
+  if (status != 0) {
+    wr_disconnect(node);
+    pthread_mutex_unlock(&node->lock);
+    return status;
+  }
+
+  node->values_pending++;
+  if (node->values_pending >= node->batch_size)
+    status = wr_drain(node);
 
   pthread_mutex_unlock(&node->lock);
 
-  return 0;
+  return status;
 } /* }}} int wr_write */
 
+static int wr_flush(cdtime_t timeout __attribute__((unused)), /* {{{ */
+                    const char *identifier __attribute__((unused)),
+                    user_data_t *ud) {
+  wr_node_t *node = ud->data;
+  int status;
+
+  pthread_mutex_lock(&node->lock);
+  status = wr_drain(node);
+  pthread_mutex_unlock(&node->lock);
+
+  return status;
+} /* }}} int wr_flush */
+
+/* Registered as a read callback so that pipelined commands are sent at least
+ * once per "FlushInterval". */
+static int wr_flush_timer(user_data_t *ud) /* {{{ */
+{
+  return wr_flush(0, NULL, ud);
+} /* }}} int wr_flush_timer */
+
 static void wr_config_free(void *ptr) /* {{{ */
 {
   wr_node_t *node = ptr;
@@ -151,11 +275,14 @@ static void wr_config_free(void *ptr) /* {{{ */
     return;
 
   if (node->conn != NULL) {
+    wr_drain(node);
     redisFree(node->conn);
     node->conn = NULL;
   }
 
   sfree(node->host);
+  sfree(node->prefix);
+  pthread_mutex_destroy(&node->lock);
   sfree(node);
 } /* }}} void wr_config_free */
 
@@ -177,6 +304,8 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
   node->database = 0;
   node->max_set_size = -1;
   node->store_rates = 1;
+  node->batch_size = 1;
+  node->flush_interval = 0;
   pthread_mutex_init(&node->lock, /* attr = */ NULL);
 
   status = cf_util_get_string_buffer(ci, node->name, sizeof(node->name));
@@ -208,6 +337,14 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
       status = cf_util_get_int(child, &node->max_set_size);
     } else if (strcasecmp("StoreRates", child->key) == 0) {
       status = cf_util_get_boolean(child, &node->store_rates);
+    } else if (strcasecmp("BatchSize", child->key) == 0) {
+      status = cf_util_get_int(child, &node->batch_size);
+      if ((status == 0) && (node->batch_size < 1)) {
+        WARNING("write_redis plugin: BatchSize must be at least 1.");
+        status = -1;
+      }
+    } else if (strcasecmp("FlushInterval", child->key) == 0) {
+      status = cf_util_get_cdtime(child, &node->flush_interval);
     } else
       WARNING("write_redis plugin: Ignoring unknown config option \"%s\".",
               child->key);
@@ -220,11 +357,21 @@ static int wr_config_node(oconfig_item_t *ci) /* {{{ */
     char cb_name[DATA_MAX_NAME_LEN];
 
     ssnprintf(cb_name, sizeof(cb_name), "write_redis/%s", node->name);
+    ssnprintf(node->meta_key, sizeof(node->meta_key), "write_redis:%s:sadd",
+              node->name);
 
     status = plugin_register_write(
         cb_name, wr_write, &(user_data_t){
                                .data = node, .free_func = wr_config_free,
                            });
+
+    if ((status == 0) && (node->batch_size > 1)) {
+      user_data_t ud = {.data = node};
+
+      plugin_register_flush(cb_name, wr_flush, &ud);
+      plugin_register_complex_read(/* group = */ NULL, cb_name, wr_flush_timer,
+                                   node->flush_interval, &ud);
+    }
   }
 
   if (status != 0)
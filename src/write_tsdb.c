@@ -314,55 +314,22 @@ static int wt_flush(cdtime_t timeout,
 
 static int wt_format_values(char *ret, size_t ret_len, int ds_num,
                             const data_set_t *ds, const value_list_t *vl,
-                            _Bool store_rates) {
-  size_t offset = 0;
-  int status;
-  gauge_t *rates = NULL;
+                            gauge_t const *rates) {
+  strbuf_t buf;
+  int ds_type = ds->ds[ds_num].type;
+  value_t value = vl->values[ds_num];
 
   assert(0 == strcmp(ds->type, vl->type));
 
-  memset(ret, 0, ret_len);
-
-#define BUFFER_ADD(...)                                                        \
-  do {                                                                         \
-    status = ssnprintf(ret + offset, ret_len - offset, __VA_ARGS__);           \
-    if (status < 1) {                                                          \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else if (((size_t)status) >= (ret_len - offset)) {                       \
-      sfree(rates);                                                            \
-      return -1;                                                               \
-    } else                                                                     \
-      offset += ((size_t)status);                                              \
-  } while (0)
-
-  if (ds->ds[ds_num].type == DS_TYPE_GAUGE)
-    BUFFER_ADD(GAUGE_FORMAT, vl->values[ds_num].gauge);
-  else if (store_rates) {
-    if (rates == NULL)
-      rates = uc_get_rate(ds, vl);
-    if (rates == NULL) {
-      WARNING("format_values: "
-              "uc_get_rate failed.");
-      return -1;
-    }
-    BUFFER_ADD(GAUGE_FORMAT, rates[ds_num]);
-  } else if (ds->ds[ds_num].type == DS_TYPE_COUNTER)
-    BUFFER_ADD("%llu", vl->values[ds_num].counter);
-  else if (ds->ds[ds_num].type == DS_TYPE_DERIVE)
-    BUFFER_ADD("%" PRIi64, vl->values[ds_num].derive);
-  else if (ds->ds[ds_num].type == DS_TYPE_ABSOLUTE)
-    BUFFER_ADD("%" PRIu64, vl->values[ds_num].absolute);
-  else {
-    ERROR("format_values plugin: Unknown data source type: %i",
-          ds->ds[ds_num].type);
-    sfree(rates);
-    return -1;
+  if ((ds_type != DS_TYPE_GAUGE) && (rates != NULL)) {
+    ds_type = DS_TYPE_GAUGE;
+    value.gauge = rates[ds_num];
   }
 
-#undef BUFFER_ADD
+  strbuf_init_fixed(&buf, ret, ret_len);
+  if (format_value(&buf, ds_type, value) != 0)
+    return -1;
 
-  sfree(rates);
   return 0;
 }
 
@@ -512,6 +479,7 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
                              struct wt_callback *cb) {
   char key[10 * DATA_MAX_NAME_LEN];
   char values[512];
+  gauge_t rates[ds->ds_num];
 
   int status;
 
@@ -521,6 +489,17 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
     return -1;
   }
 
+  /* Rates are only looked up if there is a data source to use them for. */
+  _Bool have_rates = 0;
+  for (size_t i = 0; cb->store_rates && (i < ds->ds_num); i++)
+    if (ds->ds[i].type != DS_TYPE_GAUGE)
+      have_rates = 1;
+
+  if (have_rates && (uc_get_rates(ds, vl, rates) != 0)) {
+    WARNING("write_tsdb plugin: uc_get_rates failed.");
+    return -1;
+  }
+
   for (size_t i = 0; i < ds->ds_num; i++) {
     const char *ds_name = NULL;
 
@@ -537,8 +516,8 @@ static int wt_write_messages(const data_set_t *ds, const value_list_t *vl,
     escape_string(key, sizeof(key));
     /* Convert the values to an ASCII representation and put that into
      * 'values'. */
-    status =
-        wt_format_values(values, sizeof(values), i, ds, vl, cb->store_rates);
+    status = wt_format_values(values, sizeof(values), i, ds, vl,
+                              have_rates ? rates : NULL);
     if (status != 0) {
       ERROR("write_tsdb plugin: error with "
             "wt_format_values");